@@ -2,6 +2,7 @@
 #define mujs_h
 
 #include <setjmp.h> /* required for setjmp in fz_try macro */
+#include <stddef.h> /* size_t */
 
 #ifdef __cplusplus
 extern "C" {
@@ -43,6 +44,7 @@ typedef int (*js_HasProperty)(js_State *J, void *p, const char *name);
 typedef int (*js_Put)(js_State *J, void *p, const char *name);
 typedef int (*js_Delete)(js_State *J, void *p, const char *name);
 typedef void (*js_Report)(js_State *J, const char *message);
+typedef const char *(*js_Reader)(js_State *J, void *data, int *size);
 
 /* Basic functions */
 js_State *js_newstate(js_Alloc alloc, void *actx, int flags);
@@ -57,6 +59,7 @@ int js_dostring(js_State *J, const char *source);
 int js_dofile(js_State *J, const char *filename);
 int js_ploadstring(js_State *J, const char *filename, const char *source);
 int js_ploadfile(js_State *J, const char *filename);
+int js_pload(js_State *J, const char *filename, js_Reader reader, void *data);
 int js_pcall(js_State *J, int n);
 int js_pconstruct(js_State *J, int n);
 
@@ -72,6 +75,7 @@ void js_endtry(js_State *J);
 /* State constructor flags */
 enum {
 	JS_STRICT = 1,
+	JS_LAZY = 2, /* compile function bodies on their first call */
 };
 
 /* RegExp flags */
@@ -109,6 +113,7 @@ JS_NORETURN void js_throw(js_State *J);
 
 void js_loadstring(js_State *J, const char *filename, const char *source);
 void js_loadfile(js_State *J, const char *filename);
+void js_load(js_State *J, const char *filename, js_Reader reader, void *data); /* source read in chunks until reader returns NULL or size 0 */
 
 void js_eval(js_State *J);
 void js_call(js_State *J, int n);
@@ -270,12 +275,104 @@ const char* js_resolvetypename(js_State *J, int idx);
 enum {
 	JS_BINSTRIPDEBUG = 1
 };
+enum {
+	JS_BINOK,
+	JS_BINSTALE, /* made by a different engine version */
+	JS_BINCORRUPT, /* not a binary, truncated or damaged */
+};
 int js_dumpscript(js_State *J, int idx, char **buf, int flags);
+int js_checkbin(const char *source, int length); /* header and checksum only */
 void js_loadbin(js_State *J, const char *source, int length);
 void js_loadbinE(js_State *J, const char *source, int length);
 int js_ploadbin(js_State *J, const char *source, int length);
 void js_loadbinfile(js_State *J, const char *filename);
 int js_ploadbinfile(js_State *J, const char *filename);
+/* compile context: makes binaries for js_loadbin, and may run on another thread than the state that loads them */
+typedef struct js_Compiler js_Compiler;
+js_Compiler *js_newcompiler(js_Alloc alloc, void *actx, int flags);
+void js_freecompiler(js_Compiler *C);
+int js_compilebin(js_Compiler *C, const char *filename, const char *source, char **buf); /* returns length, or -1 on error */
+const char *js_compileerror(js_Compiler *C);
+void js_freebin(js_Compiler *C, char *buf);
+/* resumable execution */
+enum {
+	JS_CODONE, /* returned, result on the stack */
+	JS_COYIELD, /* suspended, yielded value on the stack */
+	JS_COERROR /* threw, error object on the stack */
+};
+enum {
+	JS_COSUSPENDED,
+	JS_CORUNNING,
+	JS_CODEAD
+};
+void js_newcoroutine(js_State *J);
+int js_iscoroutine(js_State *J, int idx);
+int js_costatus(js_State *J, int idx);
+int js_resume(js_State *J, int idx, int n);
+int js_isyieldable(js_State *J);
+JS_NORETURN void js_yield(js_State *J);
+/* instruction budget, the hook runs every count backward jumps and calls */
+typedef void (*js_Hook)(js_State *J);
+void js_sethook(js_State *J, js_Hook hook, int count);
+/* sampling profiler, records the call stack every interval ticks */
+void js_startprofile(js_State *J, int interval);
+void js_stopprofile(js_State *J);
+void js_sampleprofile(js_State *J); /* sample at the next tick, for timer driven profiling */
+int js_profilesamples(js_State *J);
+void js_dumpprofile(js_State *J); /* push collapsed stacks, one "a;b;c count" line per stack */
+/* heap statistics */
+enum { JS_HEAPCLASSES = 17 };
+typedef struct js_HeapCount { unsigned int count; size_t bytes; } js_HeapCount;
+typedef struct js_HeapStats {
+	js_HeapCount objects[JS_HEAPCLASSES]; /* by class, see js_heapclassname */
+	js_HeapCount properties; /* property slots and their hash tables */
+	js_HeapCount environments;
+	js_HeapCount functions; /* including bytecode and constant tables */
+	js_HeapCount memstrings;
+	js_HeapCount internedstrings;
+	size_t total;
+	size_t peak; /* highest total seen by a collection or a call to js_heapstats */
+	unsigned int gccount;
+	double gctime, gclast; /* seconds spent in all collections, and in the last one */
+} js_HeapStats;
+void js_heapstats(js_State *J, js_HeapStats *stats);
+const char *js_heapclassname(int cls);
+/* shared scripts, compiled once and loaded into states on any thread */
+typedef struct js_Shared js_Shared;
+js_Shared *js_compileshared(js_State *J, const char *filename, const char *source);
+js_Shared *js_retainshared(js_Shared *S);
+void js_releaseshared(js_Shared *S);
+void js_loadshared(js_State *J, js_Shared *S); /* push a script function, like js_loadstring */
+int js_dumpimage(js_State *J, int idx, char **buffer); /* memory image of a script, for js_mapshared */
+js_Shared *js_mapshared(js_State *J, const char *filename); /* map an image file and run it in place */
+/* state snapshots, new states are copied from the image instead of being built */
+typedef struct js_Snapshot js_Snapshot;
+js_Snapshot *js_snapshot(js_State *J); /* collects garbage first, the state must not be running */
+js_State *js_newstatefrom(js_Snapshot *S, js_Alloc alloc, void *actx);
+void js_freesnapshot(js_Snapshot *S);
+size_t js_snapshotsize(js_Snapshot *S);
+/* compile cache for js_loadstring and js_loadfile, keyed by source hash and engine version */
+typedef const char *(*js_CacheLoad)(void *cctx, const char *key, int *length);
+typedef void (*js_CacheRelease)(void *cctx, const char *data);
+typedef void (*js_CacheStore)(void *cctx, const char *key, const char *data, int length);
+void js_setcompilecache(js_State *J, js_CacheLoad load, js_CacheRelease release, js_CacheStore store, void *cctx);
+void js_setcachedir(js_State *J, const char *dir); /* keep bytecode in files in dir, NULL to turn off */
+/* execution statistics, only counted when built with JS_OPSTATS */
+void js_setstats(js_State *J, int enable); /* enabling resets the counters */
+void js_getstats(js_State *J); /* push { opcodes: { name: count }, functions: [ { name, file, line, calls, instructions, time } ] } */
+/* JSON text for the host, written or read in pieces instead of made into one string */
+typedef void (*js_Writer)(js_State *J, void *data, const char *s, int n);
+int js_stringify(js_State *J, int idx, const char *gap, js_Writer write, void *data); /* returns 0 if the value has no JSON form */
+typedef struct js_Stringifier js_Stringifier;
+js_Stringifier *js_newstringifier(js_State *J, int idx, const char *gap);
+int js_readstringifier(js_State *J, js_Stringifier *S, char *buf, int size); /* returns the bytes read, 0 at the end */
+void js_freestringifier(js_State *J, js_Stringifier *S);
+/* structured clone: values in a binary form any state can load, keeping shared objects and cycles */
+typedef void (*js_CloneSave)(js_State *J, void *data, js_Writer write, void *wdata); /* write the bytes of a userdata */
+typedef void (*js_CloneLoad)(js_State *J, const char *s, int n); /* push a new userdata made from the bytes */
+void js_setclonehooks(js_State *J, const char *tag, js_CloneSave save, js_CloneLoad load);
+int js_dumpclone(js_State *J, int idx, char **buffer); /* returns the size, free the buffer with js_free */
+void js_loadclone(js_State *J, const char *buffer, int length); /* push the value */
 
 #ifdef __cplusplus
 }
@@ -1,6 +1,7 @@
 "list",
 "fundec",
 "identifier",
+"lazy",
 "exp_identifier",
 "exp_number",
 "exp_string",
@@ -712,37 +712,45 @@ static void A_isArray(js_State *J)
 	}
 }
 
+static const js_Method Array_prototype_methods[] = {
+	{ "Array.prototype.toString", Ap_toString, 0 },
+	{ "Array.prototype.concat", Ap_concat, 0 }, /* 1 */
+	{ "Array.prototype.join", Ap_join, 1 },
+	{ "Array.prototype.pop", Ap_pop, 0 },
+	{ "Array.prototype.push", Ap_push, 0 }, /* 1 */
+	{ "Array.prototype.reverse", Ap_reverse, 0 },
+	{ "Array.prototype.shift", Ap_shift, 0 },
+	{ "Array.prototype.slice", Ap_slice, 2 },
+	{ "Array.prototype.sort", Ap_sort, 1 },
+	{ "Array.prototype.splice", Ap_splice, 0 }, /* 2 */
+	{ "Array.prototype.unshift", Ap_unshift, 0 }, /* 1 */
+
+	/* ES5 */
+	{ "Array.prototype.indexOf", Ap_indexOf, 1 },
+	{ "Array.prototype.lastIndexOf", Ap_lastIndexOf, 1 },
+	{ "Array.prototype.every", Ap_every, 1 },
+	{ "Array.prototype.some", Ap_some, 1 },
+	{ "Array.prototype.forEach", Ap_forEach, 1 },
+	{ "Array.prototype.map", Ap_map, 1 },
+	{ "Array.prototype.filter", Ap_filter, 1 },
+	{ "Array.prototype.reduce", Ap_reduce, 1 },
+	{ "Array.prototype.reduceRight", Ap_reduceRight, 1 },
+};
+
+static const js_Method Array_methods[] = {
+	{ "Array.isArray", A_isArray, 1 },
+};
+
 void jsB_initarray(js_State *J)
 {
 	js_pushobject(J, J->Array_prototype);
 	{
-		jsB_propf(J, "Array.prototype.toString", Ap_toString, 0);
-		jsB_propf(J, "Array.prototype.concat", Ap_concat, 0); /* 1 */
-		jsB_propf(J, "Array.prototype.join", Ap_join, 1);
-		jsB_propf(J, "Array.prototype.pop", Ap_pop, 0);
-		jsB_propf(J, "Array.prototype.push", Ap_push, 0); /* 1 */
-		jsB_propf(J, "Array.prototype.reverse", Ap_reverse, 0);
-		jsB_propf(J, "Array.prototype.shift", Ap_shift, 0);
-		jsB_propf(J, "Array.prototype.slice", Ap_slice, 2);
-		jsB_propf(J, "Array.prototype.sort", Ap_sort, 1);
-		jsB_propf(J, "Array.prototype.splice", Ap_splice, 0); /* 2 */
-		jsB_propf(J, "Array.prototype.unshift", Ap_unshift, 0); /* 1 */
-
-		/* ES5 */
-		jsB_propf(J, "Array.prototype.indexOf", Ap_indexOf, 1);
-		jsB_propf(J, "Array.prototype.lastIndexOf", Ap_lastIndexOf, 1);
-		jsB_propf(J, "Array.prototype.every", Ap_every, 1);
-		jsB_propf(J, "Array.prototype.some", Ap_some, 1);
-		jsB_propf(J, "Array.prototype.forEach", Ap_forEach, 1);
-		jsB_propf(J, "Array.prototype.map", Ap_map, 1);
-		jsB_propf(J, "Array.prototype.filter", Ap_filter, 1);
-		jsB_propf(J, "Array.prototype.reduce", Ap_reduce, 1);
-		jsB_propf(J, "Array.prototype.reduceRight", Ap_reduceRight, 1);
+		jsB_methods(J, Array_prototype_methods, nelem(Array_prototype_methods));
 	}
 	js_newcconstructor(J, jsB_new_Array, jsB_new_Array, "Array", 0); /* 1 */
 	{
 		/* ES5 */
-		jsB_propf(J, "Array.isArray", A_isArray, 1);
+		jsB_methods(J, Array_methods, nelem(Array_methods));
 	}
 	js_defglobal(J, "Array", JS_DONTENUM);
 }
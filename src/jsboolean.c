@@ -26,14 +26,18 @@ static void Bp_valueOf(js_State *J)
 	js_pushboolean(J, self->u.boolean);
 }
 
+static const js_Method Boolean_prototype_methods[] = {
+	{ "Boolean.prototype.toString", Bp_toString, 0 },
+	{ "Boolean.prototype.valueOf", Bp_valueOf, 0 },
+};
+
 void jsB_initboolean(js_State *J)
 {
 	J->Boolean_prototype->u.boolean = 0;
 
 	js_pushobject(J, J->Boolean_prototype);
 	{
-		jsB_propf(J, "Boolean.prototype.toString", Bp_toString, 0);
-		jsB_propf(J, "Boolean.prototype.valueOf", Bp_valueOf, 0);
+		jsB_methods(J, Boolean_prototype_methods, nelem(Boolean_prototype_methods));
 	}
 	js_newcconstructor(J, jsB_Boolean, jsB_new_Boolean, "Boolean", 1);
 	js_defglobal(J, "Boolean", JS_DONTENUM);
@@ -4,12 +4,6 @@
 #include "jsvalue.h"
 #include "jsbuiltin.h"
 
-static void jsB_globalf(js_State *J, const char *name, js_CFunction cfun, int n)
-{
-	js_newcfunction(J, cfun, name, n);
-	js_defglobal(J, name, JS_DONTENUM);
-}
-
 void jsB_propf(js_State *J, const char *name, js_CFunction cfun, int n)
 {
 	const char *pname = strrchr(name, '.');
@@ -18,6 +12,40 @@ void jsB_propf(js_State *J, const char *name, js_CFunction cfun, int n)
 	js_defproperty(J, -2, pname, JS_DONTENUM);
 }
 
+/* Attach a static table of methods to the object on top of the stack, see js_LazyTable */
+void jsB_methods(js_State *J, const js_Method *methods, int n)
+{
+	js_Object *obj = js_toobject(J, -1);
+	js_LazyTable *lazy;
+	int i;
+
+	if (obj->lazy || n > 64 || J->lazylen == 0xffff) {
+		for (i = 0; i < n; ++i)
+			jsB_propf(J, methods[i].name, methods[i].function, methods[i].length);
+		return;
+	}
+
+	if (J->lazylen == J->lazycap) {
+		J->lazycap = J->lazycap ? J->lazycap * 2 : 16;
+		J->lazy = js_realloc(J, J->lazy, J->lazycap * sizeof *J->lazy);
+	}
+	while (J->lazyhashlen + n > J->lazyhashcap) {
+		J->lazyhashcap = J->lazyhashcap ? J->lazyhashcap * 2 : 256;
+		J->lazyhash = js_realloc(J, J->lazyhash, J->lazyhashcap * sizeof *J->lazyhash);
+	}
+
+	lazy = &J->lazy[J->lazylen++];
+	lazy->methods = methods;
+	lazy->n = n;
+	lazy->hash = J->lazyhashlen;
+	lazy->done = 0;
+	for (i = 0; i < n; ++i) {
+		const char *pname = strrchr(methods[i].name, '.');
+		J->lazyhash[J->lazyhashlen++] = jsU_tostrhash(pname ? pname + 1 : methods[i].name);
+	}
+	obj->lazy = J->lazylen;
+}
+
 void jsB_propn(js_State *J, const char *name, double number)
 {
 	js_pushnumber(J, number);
@@ -189,6 +217,18 @@ static void jsB_encodeURIComponent(js_State *J)
 	Encode(J, js_tostring(J, 1), URIUNESCAPED);
 }
 
+static const js_Method global_methods[] = {
+	{ "parseInt", jsB_parseInt, 1 },
+	{ "parseFloat", jsB_parseFloat, 1 },
+	{ "isNaN", jsB_isNaN, 1 },
+	{ "isFinite", jsB_isFinite, 1 },
+
+	{ "decodeURI", jsB_decodeURI, 1 },
+	{ "decodeURIComponent", jsB_decodeURIComponent, 1 },
+	{ "encodeURI", jsB_encodeURI, 1 },
+	{ "encodeURIComponent", jsB_encodeURIComponent, 1 },
+};
+
 void jsB_init(js_State *J)
 {
 	/* Create the prototype objects here, before the constructors */
@@ -233,13 +273,7 @@ void jsB_init(js_State *J)
 	js_pushundefined(J);
 	js_defglobal(J, "undefined", JS_READONLY | JS_DONTENUM | JS_DONTCONF);
 
-	jsB_globalf(J, "parseInt", jsB_parseInt, 1);
-	jsB_globalf(J, "parseFloat", jsB_parseFloat, 1);
-	jsB_globalf(J, "isNaN", jsB_isNaN, 1);
-	jsB_globalf(J, "isFinite", jsB_isFinite, 1);
-
-	jsB_globalf(J, "decodeURI", jsB_decodeURI, 1);
-	jsB_globalf(J, "decodeURIComponent", jsB_decodeURIComponent, 1);
-	jsB_globalf(J, "encodeURI", jsB_encodeURI, 1);
-	jsB_globalf(J, "encodeURIComponent", jsB_encodeURIComponent, 1);
+	js_pushobject(J, J->G);
+	jsB_methods(J, global_methods, nelem(global_methods));
+	js_pop(J, 1);
 }
@@ -15,6 +15,7 @@ void jsB_initjson(js_State *J);
 void jsB_initdate(js_State *J);
 
 void jsB_propf(js_State *J, const char *name, js_CFunction cfun, int n);
+void jsB_methods(js_State *J, const js_Method *methods, int n);
 void jsB_propn(js_State *J, const char *name, double number);
 void jsB_props(js_State *J, const char *name, const char *string);
 
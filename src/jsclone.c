@@ -0,0 +1,614 @@
+#include "jsi.h"
+#include "jsvalue.h"
+
+/*
+	Structured clone. js_dumpclone writes a value and everything it reaches
+	as tagged records, numbering objects in the order they are first met so
+	that meeting one again, as in a cycle, writes a reference instead.
+	Property names are interned, so each distinct name is written once and
+	referred to by number after that.
+
+	js_loadclone makes the objects in the same order. Each new object is on
+	the value stack or already a member of its parent before its own
+	members are read, so none can be collected if a userdata hook runs a
+	script. The input is checked as it is read; it may come from anywhere.
+*/
+
+#define CLONEMAGIC "MJSV"
+#define CLONEVERSION 1
+
+enum {
+	CL_UNDEFINED, CL_NULL, CL_FALSE, CL_TRUE,
+	CL_INTEGER, CL_NUMBER, CL_STRING, CL_USTRING,
+	CL_REF, /* an object written before, by number */
+	CL_OBJECT, /* member count, then name and value of each */
+	CL_ARRAY, /* length, then each element or CL_HOLE */
+	CL_SPARSE, /* length, then members as for CL_OBJECT */
+	CL_HOLE,
+	CL_DATE, CL_REGEXP,
+	CL_BOOLEAN, CL_NUMBEROBJ, CL_STRINGOBJ,
+	CL_USERDATA, /* tag, then the bytes written by its save hook */
+};
+
+static js_CloneHook *findclonehook(js_State *J, const char *tag, int n)
+{
+	int i;
+	for (i = 0; i < J->clonehookslen; ++i)
+		if (!strncmp(J->clonehooks[i].tag, tag, n) && J->clonehooks[i].tag[n] == 0)
+			return &J->clonehooks[i];
+	return NULL;
+}
+
+void js_setclonehooks(js_State *J, const char *tag, js_CloneSave save, js_CloneLoad load)
+{
+	js_CloneHook *hook = findclonehook(J, tag, strlen(tag));
+	if (!hook) {
+		if (J->clonehookslen == J->clonehookscap) {
+			int cap = J->clonehookscap ? J->clonehookscap * 2 : 8;
+			J->clonehooks = js_realloc(J, J->clonehooks, cap * sizeof *J->clonehooks);
+			J->clonehookscap = cap;
+		}
+		hook = &J->clonehooks[J->clonehookslen++];
+		hook->tag = js_intern(J, tag);
+	}
+	hook->save = save;
+	hook->load = load;
+}
+
+/* Writing */
+
+#define CLONENAMECACHE 64
+
+struct dumpstate
+{
+	js_Buffer buf;
+	hashtable_t objects; /* object -> number */
+	hashtable_t names; /* interned name -> number */
+	uint32_t nobjects, nnames;
+	struct { const char *name; uint32_t id; } namecache[CLONENAMECACHE]; /* recent names, by address */
+};
+
+static void dumpvalue(js_State *J, struct dumpstate *D, const js_Value *v);
+
+/* Write a u32 at an earlier position, to fill in a count once it is known */
+static void dumppatch(js_State *J, struct dumpstate *D, uint32_t at, uint32_t n)
+{
+	uint32_t end = D->buf.n;
+	D->buf.n = at;
+	jsbuf_putu32(J, &D->buf, n);
+	D->buf.n = end;
+}
+
+static void dumpstring(js_State *J, struct dumpstate *D, const char *s, uint32_t n)
+{
+	jsbuf_putu32(J, &D->buf, n);
+	jsbuf_putb(J, &D->buf, (uint8_t *)s, n);
+}
+
+/* Names are a length shifted left, then the text, or a number shifted left with the low bit set */
+static void dumpname(js_State *J, struct dumpstate *D, const char *name)
+{
+	int slot = ((uintptr_t)name >> 3) % CLONENAMECACHE;
+	uint32_t *id, n;
+
+	if (D->namecache[slot].name == name) {
+		jsbuf_putu32(J, &D->buf, D->namecache[slot].id << 1 | 1);
+		return;
+	}
+
+	id = hashtable_find(&D->names, (uintptr_t)name);
+	if (id) {
+		jsbuf_putu32(J, &D->buf, *id << 1 | 1);
+	} else {
+		n = strlen(name);
+		hashtable_insert(&D->names, (uintptr_t)name, &D->nnames);
+		id = &D->nnames;
+		jsbuf_putu32(J, &D->buf, n << 1);
+		jsbuf_putb(J, &D->buf, (uint8_t *)name, n);
+	}
+	D->namecache[slot].name = name;
+	D->namecache[slot].id = *id;
+	if (id == &D->nnames)
+		D->nnames++;
+}
+
+static void dumpwrite(js_State *J, void *data, const char *s, int n)
+{
+	struct dumpstate *D = data;
+	jsbuf_putb(J, &D->buf, (uint8_t *)s, n);
+}
+
+/* Write a property of the object on top of the stack, calling its getter if it has one */
+static void dumpproperty(js_State *J, struct dumpstate *D, js_Property *ref, const char *name)
+{
+	js_Value v;
+	if (ref->atts & JS_ACCESSOR) {
+		js_getproperty(J, -1, name);
+		v = *js_tovalue(J, -1);
+		dumpvalue(J, D, &v);
+		js_pop(J, 1);
+	} else {
+		v = ref->value;
+		dumpvalue(J, D, &v);
+	}
+}
+
+/* Write the own enumerable properties in the order a for-in loop gives them */
+static void dumpmembers(js_State *J, struct dumpstate *D, js_Object *obj)
+{
+	js_Property *ref;
+	uint32_t at = D->buf.n, count = 0;
+	int i;
+
+	js_pushobject(J, obj); /* keep it while getters run */
+	jsbuf_putu32(J, &D->buf, 0);
+	/* by position, as a getter may add properties and move the table */
+	for (i = 0; i < hashtable_count(obj->properties); ++i) {
+		ref = (js_Property *)hashtable_items(obj->properties) + i;
+		if (ref->atts & JS_DONTENUM)
+			continue;
+		dumpname(J, D, ref->name);
+		dumpproperty(J, D, ref, ref->name);
+		++count;
+	}
+	dumppatch(J, D, at, count);
+	js_pop(J, 1);
+}
+
+static void dumparray(js_State *J, struct dumpstate *D, js_Object *obj)
+{
+	const HASHTABLE_U64 *keys = hashtable_keys(obj->properties);
+	js_Property *ref;
+	char buf[32];
+	int i, n = obj->u.a.length;
+
+	/*
+		Arrays filled in order hold only their elements, in order, in the
+		table; write those without names. Anything else is written by name.
+	*/
+	if (hashtable_count(obj->properties) == n) {
+		for (i = 0; i < n; ++i)
+			if (keys[i] != jsV_indexhash(i))
+				break;
+		if (i == n) {
+			js_pushobject(J, obj);
+			jsbuf_putu8(J, &D->buf, CL_ARRAY);
+			jsbuf_putu32(J, &D->buf, n);
+			/* by position, as a getter may change the array and move the table */
+			for (i = 0; i < n && i < hashtable_count(obj->properties); ++i) {
+				ref = (js_Property *)hashtable_items(obj->properties) + i;
+				dumpproperty(J, D, ref, js_itoa(buf, i));
+			}
+			for (; i < n; ++i)
+				jsbuf_putu8(J, &D->buf, CL_HOLE);
+			js_pop(J, 1);
+			return;
+		}
+	}
+
+	jsbuf_putu8(J, &D->buf, CL_SPARSE);
+	jsbuf_putu32(J, &D->buf, n);
+	dumpmembers(J, D, obj);
+}
+
+static void dumpuserdata(js_State *J, struct dumpstate *D, js_Object *obj)
+{
+	const char *tag = obj->u.user.tag;
+	js_CloneHook *hook = findclonehook(J, tag, strlen(tag));
+	uint32_t at;
+
+	if (!hook || !hook->save)
+		js_typeerror(J, "cannot clone userdata '%s'", tag);
+	jsbuf_putu8(J, &D->buf, CL_USERDATA);
+	dumpstring(J, D, tag, strlen(tag));
+	at = D->buf.n;
+	jsbuf_putu32(J, &D->buf, 0);
+	js_pushobject(J, obj);
+	hook->save(J, obj->u.user.data, dumpwrite, D);
+	js_pop(J, 1);
+	dumppatch(J, D, at, D->buf.n - at - 4);
+}
+
+static void dumpobject(js_State *J, struct dumpstate *D, js_Object *obj)
+{
+	uint32_t *id = hashtable_find(&D->objects, (uintptr_t)obj);
+	const char *s;
+
+	if (id) {
+		jsbuf_putu8(J, &D->buf, CL_REF);
+		jsbuf_putu32(J, &D->buf, *id);
+		return;
+	}
+	hashtable_insert(&D->objects, (uintptr_t)obj, &D->nobjects);
+	D->nobjects++;
+
+	switch (obj->type) {
+	case JS_COBJECT:
+	case JS_CERROR:
+	case JS_CMATH:
+	case JS_CJSON:
+	case JS_CARGUMENTS:
+		jsbuf_putu8(J, &D->buf, CL_OBJECT);
+		dumpmembers(J, D, obj);
+		break;
+	case JS_CARRAY:
+		dumparray(J, D, obj);
+		break;
+	case JS_CDATE:
+		jsbuf_putu8(J, &D->buf, CL_DATE);
+		jsbuf_putf64(J, &D->buf, obj->u.number);
+		break;
+	case JS_CREGEXP:
+		jsbuf_putu8(J, &D->buf, CL_REGEXP);
+		jsbuf_putu8(J, &D->buf, obj->u.r.flags);
+		dumpstring(J, D, obj->u.r.source, strlen(obj->u.r.source));
+		break;
+	case JS_CBOOLEAN:
+		jsbuf_putu8(J, &D->buf, CL_BOOLEAN);
+		jsbuf_putu8(J, &D->buf, obj->u.boolean != 0);
+		break;
+	case JS_CNUMBER:
+		jsbuf_putu8(J, &D->buf, CL_NUMBEROBJ);
+		jsbuf_putf64(J, &D->buf, obj->u.number);
+		break;
+	case JS_CSTRING:
+		s = obj->u.string.u.ptr8;
+		jsbuf_putu8(J, &D->buf, CL_STRINGOBJ);
+		jsbuf_putu8(J, &D->buf, obj->u.string.isunicode != 0);
+		dumpstring(J, D, s, strlen(s));
+		break;
+	case JS_CUSERDATA:
+		dumpuserdata(J, D, obj);
+		break;
+	default:
+		js_typeerror(J, "cannot clone %s object", js_heapclassname(obj->type));
+	}
+}
+
+static void dumpvalue(js_State *J, struct dumpstate *D, const js_Value *v)
+{
+	const char *s;
+	double n;
+
+	switch (v->type) {
+	case JS_TUNDEFINED: jsbuf_putu8(J, &D->buf, CL_UNDEFINED); break;
+	case JS_TNULL: jsbuf_putu8(J, &D->buf, CL_NULL); break;
+	case JS_TBOOLEAN: jsbuf_putu8(J, &D->buf, v->u.boolean ? CL_TRUE : CL_FALSE); break;
+	case JS_TINTEGER:
+		jsbuf_putu8(J, &D->buf, CL_INTEGER);
+		jsbuf_puti32(J, &D->buf, v->u.integer);
+		break;
+	case JS_TNUMBER:
+		n = v->u.number;
+		if (n >= INT_MIN && n <= INT_MAX && n == (int)n && (n != 0 || !signbit(n))) {
+			jsbuf_putu8(J, &D->buf, CL_INTEGER);
+			jsbuf_puti32(J, &D->buf, (int)n);
+		} else {
+			jsbuf_putu8(J, &D->buf, CL_NUMBER);
+			jsbuf_putf64(J, &D->buf, n);
+		}
+		break;
+	case JS_TOBJECT:
+		dumpobject(J, D, v->u.object);
+		break;
+	default:
+		s = jsU_valtocstr(v);
+		jsbuf_putu8(J, &D->buf, jsU_valisstru(v) ? CL_USTRING : CL_STRING);
+		dumpstring(J, D, s, strlen(s));
+		break;
+	}
+}
+
+int js_dumpclone(js_State *J, int idx, char **buffer)
+{
+	struct dumpstate D;
+	js_Value v = *js_tovalue(J, idx);
+
+	jsbuf_init(J, &D.buf, 256);
+	hashtable_init(&D.objects, sizeof(uint32_t), 64, NULL);
+	hashtable_init(&D.names, sizeof(uint32_t), 64, NULL);
+	D.nobjects = D.nnames = 0;
+	memset(D.namecache, 0, sizeof D.namecache);
+
+	if (js_try(J)) {
+		jsbuf_free(J, &D.buf);
+		hashtable_term(&D.objects);
+		hashtable_term(&D.names);
+		js_throw(J);
+	}
+
+	jsbuf_putb(J, &D.buf, (uint8_t *)CLONEMAGIC, 4);
+	jsbuf_putu8(J, &D.buf, CLONEVERSION);
+	dumpvalue(J, &D, &v);
+
+	js_endtry(J);
+	hashtable_term(&D.objects);
+	hashtable_term(&D.names);
+	*buffer = (char *)D.buf.data;
+	return D.buf.n;
+}
+
+/* Reading */
+
+struct loadname { const char *name; uint64_t hash; };
+
+struct loadstate
+{
+	js_Buffer buf; /* n is the read position and m the length */
+	js_Object **objects;
+	int nobjects, objectscap;
+	struct loadname *names;
+	int nnames, namescap;
+};
+
+static void loadvalue(js_State *J, struct loadstate *L);
+
+JS_NORETURN static void loaderror(js_State *J)
+{
+	js_error(J, "invalid clone data");
+}
+
+static void loadneed(js_State *J, struct loadstate *L, uint32_t n)
+{
+	if (n > L->buf.m - L->buf.n)
+		loaderror(J);
+}
+
+static uint8_t loadu8(js_State *J, struct loadstate *L)
+{
+	loadneed(J, L, 1);
+	return jsbuf_getu8(J, &L->buf);
+}
+
+static uint32_t loadu32(js_State *J, struct loadstate *L)
+{
+	loadneed(J, L, 4);
+	return jsbuf_getu32(J, &L->buf);
+}
+
+static double loadf64(js_State *J, struct loadstate *L)
+{
+	loadneed(J, L, 8);
+	return jsbuf_getf64(J, &L->buf);
+}
+
+/* Return the bytes of a string, which are not zero terminated */
+static const char *loadstring(js_State *J, struct loadstate *L, uint32_t *n)
+{
+	const char *s;
+	*n = loadu32(J, L);
+	loadneed(J, L, *n);
+	s = (const char *)L->buf.data + L->buf.n;
+	L->buf.n += *n;
+	return s;
+}
+
+/* Number the object on top of the stack for later references */
+static js_Object *loadkeep(js_State *J, struct loadstate *L)
+{
+	js_Object *obj = js_toobject(J, -1);
+	if (L->nobjects == L->objectscap) {
+		L->objectscap = L->objectscap ? L->objectscap * 2 : 64;
+		L->objects = js_realloc(J, L->objects, L->objectscap * sizeof *L->objects);
+	}
+	L->objects[L->nobjects++] = obj;
+	return obj;
+}
+
+static const char *loadname(js_State *J, struct loadstate *L, uint64_t *hash)
+{
+	uint32_t x = loadu32(J, L);
+	uint64_t h = 5381;
+	const char *s;
+	uint32_t i, n;
+
+	if (x & 1) {
+		if (x >> 1 >= (uint32_t)L->nnames)
+			loaderror(J);
+		*hash = L->names[x >> 1].hash;
+		return L->names[x >> 1].name;
+	}
+
+	n = x >> 1;
+	loadneed(J, L, n);
+	s = (const char *)L->buf.data + L->buf.n;
+	if (memchr(s, 0, n))
+		loaderror(J);
+	L->buf.n += n;
+	for (i = 0; i < n; ++i)
+		h = ((h << 5) + h) + s[i]; /* as jsU_tostrhash */
+	if (L->nnames == L->namescap) {
+		L->namescap = L->namescap ? L->namescap * 2 : 64;
+		L->names = js_realloc(J, L->names, L->namescap * sizeof *L->names);
+	}
+	L->names[L->nnames].name = jsS_internhash(J, s, n, h);
+	L->names[L->nnames].hash = h;
+	*hash = h;
+	return L->names[L->nnames++].name;
+}
+
+/* Set the value on top of the stack as a member of obj, and pop it */
+static void loadset(js_State *J, js_Object *obj, const char *name, uint64_t hash)
+{
+	js_Property *ref = jsV_addownproperty(J, obj, name, hash);
+	ref->value = *js_tovalue(J, -1);
+	js_pop(J, 1);
+}
+
+static void loadmembers(js_State *J, struct loadstate *L, js_Object *obj)
+{
+	const char *name;
+	uint64_t hash;
+	uint32_t n = loadu32(J, L);
+
+	loadneed(J, L, n); /* each member takes at least a byte */
+	jsV_reserveproperties(J, obj, n);
+	while (n--) {
+		name = loadname(J, L, &hash);
+		loadvalue(J, L);
+		loadset(J, obj, name, hash);
+	}
+}
+
+static void loadarray(js_State *J, struct loadstate *L)
+{
+	js_Object *obj;
+	const char *name;
+	char buf[32];
+	uint64_t hash;
+	uint32_t i, n;
+
+	js_newarray(J);
+	obj = loadkeep(J, L);
+	n = loadu32(J, L);
+	if (n > INT_MAX)
+		loaderror(J);
+	loadneed(J, L, n); /* each element takes at least a byte */
+	jsV_reserveproperties(J, obj, n);
+	obj->u.a.length = n;
+	for (i = 0; i < n; ++i) {
+		loadneed(J, L, 1);
+		if (L->buf.data[L->buf.n] == CL_HOLE) {
+			L->buf.n++;
+			continue;
+		}
+		loadvalue(J, L);
+		name = js_itoa(buf, i);
+		hash = jsU_tostrhash(name);
+		loadset(J, obj, jsS_internhash(J, name, strlen(name), hash), hash);
+	}
+}
+
+static void loaduserdata(js_State *J, struct loadstate *L)
+{
+	js_CloneHook *hook;
+	const char *tag, *s;
+	uint32_t taglen, n;
+	int top;
+
+	tag = loadstring(J, L, &taglen);
+	s = loadstring(J, L, &n);
+	if (memchr(tag, 0, taglen))
+		loaderror(J);
+	hook = findclonehook(J, tag, taglen);
+	if (!hook || !hook->load)
+		js_typeerror(J, "cannot clone userdata '%.*s'", (int)taglen, tag);
+	top = js_gettop(J);
+	hook->load(J, s, n);
+	if (js_gettop(J) != top + 1 || !js_isuserdata(J, -1, hook->tag))
+		js_typeerror(J, "clone hook for '%s' did not push a userdata", hook->tag);
+	loadkeep(J, L);
+}
+
+static void loadvalue(js_State *J, struct loadstate *L)
+{
+	js_Object *obj;
+	const char *s;
+	uint32_t n;
+	int flags, isunicode;
+
+	switch (loadu8(J, L)) {
+	case CL_UNDEFINED: js_pushundefined(J); break;
+	case CL_NULL: js_pushnull(J); break;
+	case CL_FALSE: js_pushboolean(J, 0); break;
+	case CL_TRUE: js_pushboolean(J, 1); break;
+	case CL_INTEGER:
+		loadneed(J, L, 4);
+		js_pushnumber(J, jsbuf_geti32(J, &L->buf));
+		break;
+	case CL_NUMBER: js_pushnumber(J, loadf64(J, L)); break;
+	case CL_STRING:
+	case CL_USTRING:
+		isunicode = L->buf.data[L->buf.n - 1] == CL_USTRING;
+		s = loadstring(J, L, &n);
+		js_pushlstringu(J, s, n, isunicode);
+		break;
+	case CL_REF:
+		n = loadu32(J, L);
+		if (n >= (uint32_t)L->nobjects)
+			loaderror(J);
+		js_pushobject(J, L->objects[n]);
+		break;
+	case CL_OBJECT:
+		js_newobject(J);
+		loadmembers(J, L, loadkeep(J, L));
+		break;
+	case CL_ARRAY:
+		loadarray(J, L);
+		break;
+	case CL_SPARSE:
+		js_newarray(J);
+		obj = loadkeep(J, L);
+		n = loadu32(J, L);
+		if (n > INT_MAX)
+			loaderror(J);
+		obj->u.a.length = n;
+		loadmembers(J, L, obj);
+		break;
+	case CL_DATE:
+		obj = jsV_newobject(J, JS_CDATE, J->Date_prototype);
+		obj->u.number = loadf64(J, L);
+		js_pushobject(J, obj);
+		loadkeep(J, L);
+		break;
+	case CL_REGEXP:
+		flags = loadu8(J, L);
+		s = loadstring(J, L, &n);
+		js_pushlstring(J, s, n);
+		js_newregexp(J, js_tostring(J, -1), flags & (JS_REGEXP_G | JS_REGEXP_I | JS_REGEXP_M));
+		js_rot2pop1(J);
+		loadkeep(J, L);
+		break;
+	case CL_BOOLEAN:
+		js_newboolean(J, loadu8(J, L));
+		loadkeep(J, L);
+		break;
+	case CL_NUMBEROBJ:
+		js_newnumber(J, loadf64(J, L));
+		loadkeep(J, L);
+		break;
+	case CL_STRINGOBJ:
+		isunicode = loadu8(J, L);
+		s = loadstring(J, L, &n);
+		js_pushlstringu(J, s, n, isunicode);
+		obj = js_toobject(J, -1);
+		js_pop(J, 1);
+		js_pushobject(J, obj);
+		loadkeep(J, L);
+		break;
+	case CL_USERDATA:
+		loaduserdata(J, L);
+		break;
+	default:
+		loaderror(J);
+	}
+}
+
+void js_loadclone(js_State *J, const char *buffer, int length)
+{
+	struct loadstate L;
+
+	if (length < 5 || memcmp(buffer, CLONEMAGIC, 4))
+		loaderror(J);
+	if (buffer[4] != CLONEVERSION)
+		js_error(J, "clone data version %d is not supported", buffer[4]);
+
+	memset(&L, 0, sizeof L);
+	L.buf.data = (uint8_t *)buffer;
+	L.buf.n = 5;
+	L.buf.m = length;
+
+	if (js_try(J)) {
+		js_free(J, L.objects);
+		js_free(J, L.names);
+		js_throw(J);
+	}
+
+	loadvalue(J, &L);
+	if (L.buf.n != L.buf.m)
+		loaderror(J);
+
+	js_endtry(J);
+	js_free(J, L.objects);
+	js_free(J, L.names);
+}
@@ -16,6 +16,7 @@ static void cfunbody(JF, js_Ast *name, js_Ast *params, js_Ast *body);
 static void cexp(JF, js_Ast *exp);
 static void cstmlist(JF, js_Ast *list);
 static void cstm(JF, js_Ast *stm);
+static void cdead(JF, js_Ast *node, int isstm);
 
 void jsC_error(js_State *J, js_Ast *node, const char *fmt, ...)
 {
@@ -34,28 +35,47 @@ void jsC_error(js_State *J, js_Ast *node, const char *fmt, ...)
 	js_throw(J);
 }
 
-static const char *futurewords[] = {
-	"class", "const", "enum", "export", "extends", "import", "super",
-};
-
-static const char *strictfuturewords[] = {
-	"implements", "interface", "let", "package", "private", "protected",
-	"public", "static", "yield",
-};
-
 static void checkfutureword(JF, js_Ast *exp)
 {
-	if (jsY_findword(exp->string, futurewords, nelem(futurewords)) >= 0)
+	int kind = jsY_findreserved(exp->string);
+	if (kind == WORD_FUTURE)
 		jsC_error(J, exp, "'%s' is a future reserved word", exp->string);
-	if (F->strict) {
-		if (jsY_findword(exp->string, strictfuturewords, nelem(strictfuturewords)) >= 0)
-			jsC_error(J, exp, "'%s' is a strict mode future reserved word", exp->string);
+	if (kind == WORD_STRICT && F->strict)
+		jsC_error(J, exp, "'%s' is a strict mode future reserved word", exp->string);
+}
+
+/*
+	A function whose body is compiled on its first call keeps its parameter
+	names for 'length' and toString, and a reference to the script text.
+*/
+static void lazyfun(JF, js_Ast *params, js_Ast *body)
+{
+	for (; params; params = params->b) {
+		if (F->varlen >= F->varcap) {
+			F->varcap = F->varcap ? F->varcap * 2 : 16;
+			F->vartab = js_realloc(J, F->vartab, F->varcap * sizeof *F->vartab);
+		}
+		F->vartab[F->varlen++] = params->a->string;
 	}
+	F->numparams = F->varlen;
+	F->source = J->lazysource;
+	F->sourcepos = body->string;
+	F->sourceline = body->line;
+	++F->source->refs;
 }
 
 static js_Function *newfun(js_State *J, int line, js_Ast *name, js_Ast *params, js_Ast *body, int script, int default_strict)
 {
-	js_Function *F = jsV_newfunction(J);
+	js_Function *F;
+
+	if (J->lazycheck) {
+		/* lazy bodies were checked when they were parsed, empty ones were not */
+		if (!body)
+			jsC_checkfunction(J, line, name, params, body, default_strict);
+		return NULL;
+	}
+
+	F = jsV_newfunction(J);
 
 	F->filename = js_intern(J, J->filename);
 	F->line = line;
@@ -63,7 +83,10 @@ static js_Function *newfun(js_State *J, int line, js_Ast *name, js_Ast *params,
 	F->strict = default_strict;
 	F->name = name ? name->string : "";
 
-	cfunbody(J, F, name, params, body);
+	if (body && body->type == AST_LAZY)
+		lazyfun(J, F, params, body);
+	else
+		cfunbody(J, F, name, params, body);
 
 	return F;
 }
@@ -74,6 +97,10 @@ static void emitraw(JF, int value)
 {
 	if (value != (js_Instruction)value)
 		js_syntaxerror(J, "integer overflow in instruction coding");
+	if (J->lazycheck) {
+		++F->codelen;
+		return;
+	}
 	if (F->codelen >= F->codecap) {
 		F->codecap = F->codecap ? F->codecap * 2 : 64;
 		F->code = js_realloc(J, F->code, F->codecap * sizeof *F->code);
@@ -102,6 +129,8 @@ static void emitline(JF, js_Ast *node)
 
 static int addfunction(JF, js_Function *value)
 {
+	if (J->lazycheck)
+		return 0;
 	if (F->funlen >= F->funcap) {
 		F->funcap = F->funcap ? F->funcap * 2 : 16;
 		F->funtab = js_realloc(J, F->funtab, F->funcap * sizeof *F->funtab);
@@ -113,6 +142,8 @@ static int addfunction(JF, js_Function *value)
 static int addnumber(JF, double value)
 {
 	int i;
+	if (J->lazycheck)
+		return 0;
 	for (i = 0; i < F->numlen; ++i)
 		if (F->numtab[i] == value)
 			return i;
@@ -127,6 +158,8 @@ static int addnumber(JF, double value)
 static int addstring(JF, const char *value)
 {
 	int i;
+	if (J->lazycheck)
+		return 0;
 	for (i = 0; i < F->strlen; ++i)
 		if (!strcmp(F->strtab[i], value))
 			return i;
@@ -264,7 +297,8 @@ static void labelto(JF, int inst, int addr)
 {
 	if (addr != (js_Instruction)addr)
 		js_syntaxerror(J, "jump address integer overflow");
-	F->code[inst] = addr;
+	if (!J->lazycheck)
+		F->code[inst] = addr;
 }
 
 static void label(JF, int inst)
@@ -772,6 +806,15 @@ static void cexp(JF, js_Ast *exp)
 		break;
 
 	case EXP_LOGOR:
+		if (jsP_isliteral(exp->a)) {
+			if (jsP_istrue(exp->a)) {
+				cexp(J, F, exp->a);
+				cdead(J, F, exp->b, 0);
+			} else {
+				cexp(J, F, exp->b);
+			}
+			break;
+		}
 		cexp(J, F, exp->a);
 		emitline(J, F, exp);
 		emit(J, F, OP_DUP);
@@ -782,6 +825,15 @@ static void cexp(JF, js_Ast *exp)
 		break;
 
 	case EXP_LOGAND:
+		if (jsP_isliteral(exp->a)) {
+			if (jsP_istrue(exp->a)) {
+				cexp(J, F, exp->b);
+			} else {
+				cexp(J, F, exp->a);
+				cdead(J, F, exp->b, 0);
+			}
+			break;
+		}
 		cexp(J, F, exp->a);
 		emitline(J, F, exp);
 		emit(J, F, OP_DUP);
@@ -792,6 +844,16 @@ static void cexp(JF, js_Ast *exp)
 		break;
 
 	case EXP_COND:
+		if (jsP_isliteral(exp->a)) {
+			if (jsP_istrue(exp->a)) {
+				cexp(J, F, exp->b);
+				cdead(J, F, exp->c, 0);
+			} else {
+				cdead(J, F, exp->b, 0);
+				cexp(J, F, exp->c);
+			}
+			break;
+		}
 		cexp(J, F, exp->a);
 		emitline(J, F, exp);
 		then = emitjump(J, F, OP_JTRUE);
@@ -811,7 +873,7 @@ static void cexp(JF, js_Ast *exp)
 
 static void addjump(JF, enum js_AstType type, js_Ast *target, int inst)
 {
-	js_JumpList *jump = js_malloc(J, sizeof *jump);
+	js_JumpList *jump = jsP_alloc(J, sizeof *jump);
 	jump->type = type;
 	jump->inst = inst;
 	jump->next = target->jumps;
@@ -899,6 +961,7 @@ static js_Ast *returntarget(JF, js_Ast *node)
 static void cexit(JF, enum js_AstType T, js_Ast *node, js_Ast *target)
 {
 	js_Ast *prev;
+	int n;
 	do {
 		prev = node, node = node->parent;
 		switch (node->type) {
@@ -919,7 +982,7 @@ static void cexit(JF, enum js_AstType T, js_Ast *node, js_Ast *target)
 					emit(J, F, OP_ROT2);
 					emit(J, F, OP_POP);
 				}
-				if (T == STM_CONTINUE)
+				if (T == STM_CONTINUE && target == node)
 					emit(J, F, OP_ROT2); /* put the iterator back on top */
 			} else {
 				if (T == STM_RETURN) {
@@ -933,6 +996,15 @@ static void cexit(JF, enum js_AstType T, js_Ast *node, js_Ast *target)
 			break;
 		case STM_TRY:
 			emitline(J, F, node);
+			/* came from the copy of the finally block that rethrows */
+			if (prev == node->d) {
+				for (n = 0; n < node->pending; ++n) {
+					/* pop the pending exception, save the return or exp value */
+					if (T == STM_RETURN || F->script)
+						emit(J, F, OP_ROT2);
+					emit(J, F, OP_POP);
+				}
+			}
 			/* came from try block */
 			if (prev == node->a) {
 				emit(J, F, OP_ENDTRY);
@@ -954,15 +1026,48 @@ static void cexit(JF, enum js_AstType T, js_Ast *node, js_Ast *target)
 	} while (node != target);
 }
 
+/*
+	Code behind a constant condition that can never run is still compiled,
+	so it reports the same errors as before, and then thrown away together
+	with the break and continue jumps it added to enclosing statements.
+*/
+
+static void cdead(JF, js_Ast *node, int isstm)
+{
+	int codelen = F->codelen;
+	int funlen = F->funlen;
+	int numlen = F->numlen;
+	int strlen = F->strlen;
+	int lastline = F->lastline;
+	js_Ast *p;
+
+	if (isstm)
+		cstm(J, F, node);
+	else
+		cexp(J, F, node);
+
+	F->codelen = codelen;
+	F->funlen = funlen;
+	F->numlen = numlen;
+	F->strlen = strlen;
+	F->lastline = lastline;
+
+	for (p = node->parent; p && !isfun(p->type); p = p->parent)
+		while (p->jumps && p->jumps->inst >= codelen)
+			p->jumps = p->jumps->next;
+}
+
 /* Try/catch/finally */
 
-static void ctryfinally(JF, js_Ast *trystm, js_Ast *finallystm)
+static void ctryfinally(JF, js_Ast *stm, js_Ast *trystm, js_Ast *finallystm)
 {
 	int L1;
 	L1 = emitjump(J, F, OP_TRY);
 	{
 		/* if we get here, we have caught an exception in the try block */
+		stm->pending = 1;
 		cstm(J, F, finallystm); /* inline finally block */
+		stm->pending = 0;
 		emit(J, F, OP_THROW); /* rethrow exception */
 	}
 	label(J, F, L1);
@@ -996,7 +1101,7 @@ static void ctrycatch(JF, js_Ast *trystm, js_Ast *catchvar, js_Ast *catchstm)
 	label(J, F, L2);
 }
 
-static void ctrycatchfinally(JF, js_Ast *trystm, js_Ast *catchvar, js_Ast *catchstm, js_Ast *finallystm)
+static void ctrycatchfinally(JF, js_Ast *stm, js_Ast *trystm, js_Ast *catchvar, js_Ast *catchstm, js_Ast *finallystm)
 {
 	int L1, L2, L3;
 	L1 = emitjump(J, F, OP_TRY);
@@ -1005,7 +1110,10 @@ static void ctrycatchfinally(JF, js_Ast *trystm, js_Ast *catchvar, js_Ast *catch
 		L2 = emitjump(J, F, OP_TRY);
 		{
 			/* if we get here, we have caught an exception in the catch block */
+			/* under the one from the try block that the catch never took */
+			stm->pending = 2;
 			cstm(J, F, finallystm); /* inline finally block */
+			stm->pending = 0;
 			emit(J, F, OP_THROW); /* rethrow exception */
 		}
 		label(J, F, L2);
@@ -1119,7 +1227,17 @@ static void cstm(JF, js_Ast *stm)
 		break;
 
 	case STM_IF:
-		if (stm->c) {
+		if (jsP_isliteral(stm->a)) {
+			if (jsP_istrue(stm->a)) {
+				cstm(J, F, stm->b);
+				if (stm->c)
+					cdead(J, F, stm->c, 1);
+			} else {
+				cdead(J, F, stm->b, 1);
+				if (stm->c)
+					cstm(J, F, stm->c);
+			}
+		} else if (stm->c) {
 			cexp(J, F, stm->a);
 			emitline(J, F, stm);
 			then = emitjump(J, F, OP_JTRUE);
@@ -1142,21 +1260,37 @@ static void cstm(JF, js_Ast *stm)
 		loop = here(J, F);
 		cstm(J, F, stm->a);
 		cont = here(J, F);
-		cexp(J, F, stm->b);
-		emitline(J, F, stm);
-		emitjumpto(J, F, OP_JTRUE, loop);
+		if (jsP_isliteral(stm->b)) {
+			if (jsP_istrue(stm->b)) {
+				emitline(J, F, stm);
+				emitjumpto(J, F, OP_JUMP, loop);
+			}
+		} else {
+			cexp(J, F, stm->b);
+			emitline(J, F, stm);
+			emitjumpto(J, F, OP_JTRUE, loop);
+		}
 		labeljumps(J, F, stm->jumps, here(J,F), cont);
 		break;
 
 	case STM_WHILE:
+		if (jsP_isliteral(stm->a) && !jsP_istrue(stm->a)) {
+			cdead(J, F, stm->b, 1);
+			break;
+		}
 		loop = here(J, F);
-		cexp(J, F, stm->a);
-		emitline(J, F, stm);
-		end = emitjump(J, F, OP_JFALSE);
+		if (!jsP_isliteral(stm->a)) {
+			cexp(J, F, stm->a);
+			emitline(J, F, stm);
+			end = emitjump(J, F, OP_JFALSE);
+		} else {
+			end = 0;
+		}
 		cstm(J, F, stm->b);
 		emitline(J, F, stm);
 		emitjumpto(J, F, OP_JUMP, loop);
-		label(J, F, end);
+		if (end)
+			label(J, F, end);
 		labeljumps(J, F, stm->jumps, here(J,F), loop);
 		break;
 
@@ -1170,8 +1304,14 @@ static void cstm(JF, js_Ast *stm)
 				emit(J, F, OP_POP);
 			}
 		}
+		if (stm->b && jsP_isliteral(stm->b) && !jsP_istrue(stm->b)) {
+			cdead(J, F, stm->d, 1);
+			if (stm->c)
+				cdead(J, F, stm->c, 0);
+			break;
+		}
 		loop = here(J, F);
-		if (stm->b) {
+		if (stm->b && !jsP_isliteral(stm->b)) {
 			cexp(J, F, stm->b);
 			emitline(J, F, stm);
 			end = emitjump(J, F, OP_JFALSE);
@@ -1299,11 +1439,11 @@ static void cstm(JF, js_Ast *stm)
 		if (stm->b && stm->c) {
 			F->lightweight = 0;
 			if (stm->d)
-				ctrycatchfinally(J, F, stm->a, stm->b, stm->c, stm->d);
+				ctrycatchfinally(J, F, stm, stm->a, stm->b, stm->c, stm->d);
 			else
 				ctrycatch(J, F, stm->a, stm->b, stm->c);
 		} else {
-			ctryfinally(J, F, stm->a, stm->d);
+			ctryfinally(J, F, stm, stm->a, stm->d);
 		}
 		break;
 
@@ -1393,6 +1533,159 @@ static void cfundecs(JF, js_Ast *list)
 	}
 }
 
+/*
+	Constant propagation. A local that is assigned only once, by a 'var'
+	initializer at the top level of the function body with a literal value,
+	holds that value in every statement after the declaration. Uses there
+	are replaced by the literal and folded again. Inner functions, 'with',
+	catch scopes, 'eval' and 'arguments' can see or change locals behind
+	our back, so functions that contain any of them are left alone.
+*/
+
+static void propcount(JF, js_Ast *ident, int *count, int n)
+{
+	int i;
+	if (ident->type == EXP_IDENTIFIER || ident->type == AST_IDENTIFIER) {
+		i = findlocal(J, F, ident->string);
+		if (i > 0)
+			count[i-1] += n;
+	}
+}
+
+/* Count assignments to each local. Returns 0 if the function is not eligible. */
+static int propscan(JF, js_Ast *node, int *count)
+{
+	js_Ast *list;
+
+	while (node && node->type == AST_LIST) {
+		if (!propscan(J, F, node->a, count))
+			return 0;
+		node = node->b;
+	}
+	if (!node)
+		return 1;
+
+	if (isfun(node->type))
+		return 0;
+
+	switch (node->type) {
+	case AST_LAZY:
+	case STM_WITH:
+		return 0;
+	case STM_TRY:
+		if (node->b)
+			return 0;
+		break;
+	case EXP_IDENTIFIER:
+		if (!strcmp(node->string, "eval") || !strcmp(node->string, "arguments"))
+			return 0;
+		break;
+	case EXP_VAR:
+		if (node->b)
+			propcount(J, F, node->a, count, 1);
+		break;
+	case STM_FOR_IN:
+		propcount(J, F, node->a, count, 2);
+		break;
+	case STM_FOR_IN_VAR:
+		for (list = node->a; list; list = list->b)
+			propcount(J, F, list->a->a, count, 2);
+		break;
+	case EXP_PREINC: case EXP_PREDEC:
+	case EXP_POSTINC: case EXP_POSTDEC:
+	case EXP_DELETE:
+		propcount(J, F, node->a, count, 2);
+		break;
+	default:
+		if (node->type >= EXP_ASS && node->type <= EXP_ASS_BITOR)
+			propcount(J, F, node->a, count, 2);
+		break;
+	}
+
+	return propscan(J, F, node->a, count) && propscan(J, F, node->b, count) &&
+		propscan(J, F, node->c, count) && propscan(J, F, node->d, count);
+}
+
+/* Replace uses of known locals. Returns 1 if anything changed. */
+static int propsubst(JF, js_Ast *node, js_Ast **value)
+{
+	js_Ast *v;
+	int i, n = 0;
+
+	while (node && node->type == AST_LIST) {
+		n |= propsubst(J, F, node->a, value);
+		node = node->b;
+	}
+	if (!node)
+		return n;
+
+	if (node->type == EXP_IDENTIFIER) {
+		i = findlocal(J, F, node->string);
+		if (i > 0 && value[i-1]) {
+			v = value[i-1];
+			node->type = v->type;
+			node->number = v->number;
+			node->string = v->string;
+			return 1;
+		}
+		return 0;
+	}
+
+	/* leave callees alone, so 'x is not callable' keeps naming the variable */
+	if ((node->type == EXP_CALL || node->type == EXP_NEW) && node->a->type == EXP_IDENTIFIER)
+		return propsubst(J, F, node->b, value);
+
+	if (node->a) n |= propsubst(J, F, node->a, value);
+	if (node->b) n |= propsubst(J, F, node->b, value);
+	if (node->c) n |= propsubst(J, F, node->c, value);
+	if (node->d) n |= propsubst(J, F, node->d, value);
+	return n;
+}
+
+static void cpropagate(JF, js_Ast *body)
+{
+	js_Ast *stm, *list, *var;
+	js_Ast **value;
+	int *count;
+	int i, known = 0;
+
+	if (F->varlen == 0)
+		return;
+
+	count = jsP_alloc(J, F->varlen * sizeof *count);
+	memset(count, 0, F->varlen * sizeof *count);
+	if (!propscan(J, F, body, count))
+		return;
+
+	/* parameters start out assigned */
+	for (i = 0; i < F->numparams; ++i)
+		count[i] += 2;
+
+	value = jsP_alloc(J, F->varlen * sizeof *value);
+	memset(value, 0, F->varlen * sizeof *value);
+
+	for (; body; body = body->b) {
+		stm = body->a;
+		if (stm->type != STM_VAR) {
+			if (known && propsubst(J, F, stm, value))
+				jsP_foldconst(J, stm);
+			continue;
+		}
+		for (list = stm->a; list; list = list->b) {
+			var = list->a;
+			if (!var->b)
+				continue;
+			if (known && propsubst(J, F, var->b, value))
+				jsP_foldconst(J, var->b);
+			i = findlocal(J, F, var->a->string);
+			if (jsP_isliteral(var->b) && count[i-1] == 1) {
+				value[i-1] = var->b;
+				known = 1;
+			}
+		}
+	}
+}
+
 static void cfunbody(JF, js_Ast *name, js_Ast *params, js_Ast *body)
 {
 	F->lightweight = 1;
@@ -1401,8 +1694,8 @@ static void cfunbody(JF, js_Ast *name, js_Ast *params, js_Ast *body)
 	if (F->script)
 		F->lightweight = 0;
 
-	/* Check if first statement is 'use strict': */
-	if (body && body->type == AST_LIST && body->a && body->a->type == EXP_STRING)
+	/* Check if first statement is 'use strict' (and not a folded string): */
+	if (body && body->type == AST_LIST && body->a && body->a->type == EXP_STRING && !body->a->number)
 		if (!strcmp(body->a->string, "use strict"))
 			F->strict = 1;
 
@@ -1428,6 +1721,9 @@ static void cfunbody(JF, js_Ast *name, js_Ast *params, js_Ast *body)
 		}
 	}
 
+	if (body && !F->script && !J->lazycheck)
+		cpropagate(J, F, body);
+
 	if (F->script) {
 		emit(J, F, OP_UNDEF);
 		cstmlist(J, F, body);
@@ -1449,6 +1745,94 @@ js_Function *jsC_compilescript(js_State *J, js_Ast *prog, int default_strict)
 	return newfun(J, prog ? prog->line : 0, NULL, NULL, prog, 1, default_strict);
 }
 
+/*
+	Lazy compilation drops a function body after parsing it, but loading
+	should still fail on the errors the compiler reports, such as a break
+	outside a loop or strict mode violations. The body is compiled once
+	with J->lazycheck set: the same checks run, but no code, constants or
+	nested functions are kept, and the variable table is thrown away. Only
+	overflowing the constant tables of one function is left for the call.
+	The body is not attached to its function node yet, so a stand-in is
+	its parent for the return statements to find.
+*/
+void jsC_checkfunction(js_State *J, int line, js_Ast *name, js_Ast *params, js_Ast *body, int default_strict)
+{
+	js_Function F;
+	js_Ast fun;
+	int lazycheck = J->lazycheck;
+
+	memset(&F, 0, sizeof F);
+	F.line = line;
+	F.strict = default_strict;
+	F.name = name ? name->string : "";
+
+	memset(&fun, 0, sizeof fun);
+	fun.type = EXP_FUN;
+	fun.line = line;
+	fun.c = body;
+	if (body)
+		body->parent = &fun;
+
+	if (js_try(J)) {
+		js_free(J, F.vartab);
+		J->lazycheck = lazycheck;
+		js_throw(J);
+	}
+	J->lazycheck = 1;
+	cfunbody(J, &F, name, params, body);
+	js_endtry(J);
+	if (body)
+		body->parent = NULL;
+	js_free(J, F.vartab);
+	J->lazycheck = lazycheck;
+}
+
+static void compilelazy(js_State *J, js_Function *F)
+{
+	js_Ast *P;
+	int numparams = F->numparams;
+
+	if (js_try(J)) {
+		/* leave it as it was, the next call reports the error again */
+		F->codelen = F->funlen = F->numlen = F->strlen = 0;
+		F->varlen = F->numparams = numparams;
+		J->lazysource = NULL;
+		jsP_freeparse(J);
+		js_throw(J);
+	}
+
+	J->lazysource = F->source;
+	J->lazystrict = F->strict;
+	P = jsP_parselazy(J, F->filename, F->sourcepos, F->sourceline, F->name);
+	F->varlen = 0;
+	cfunbody(J, F, P->a, P->b, P->c);
+	J->lazysource = NULL;
+	jsP_freeparse(J);
+
+	js_endtry(J);
+}
+
+void jsC_compilelazy(js_State *J, js_Function *F)
+{
+	js_Source *S = F->source;
+	compilelazy(J, F);
+	F->source = NULL;
+	F->sourcepos = NULL;
+	if (--S->refs == 0)
+		js_free(J, S);
+}
+
+/* Compile every function in the tree that has not been called yet. */
+void jsC_compiletree(js_State *J, js_Function *F)
+{
+	int i;
+	if (F->source)
+		jsC_compilelazy(J, F);
+	for (i = 0; i < F->funlen; ++i)
+		if (F->funtab[i] != F)
+			jsC_compiletree(J, F->funtab[i]);
+}
+
 #else
 
 js_Function *jsC_compilefunction(js_State *J, js_Ast *prog)
@@ -1463,4 +1847,16 @@ js_Function *jsC_compilescript(js_State *J, js_Ast *prog, int default_strict)
 	return NULL;
 }
 
+void jsC_checkfunction(js_State *J, int line, js_Ast *name, js_Ast *params, js_Ast *body, int default_strict)
+{
+}
+
+void jsC_compilelazy(js_State *J, js_Function *F)
+{
+}
+
+void jsC_compiletree(js_State *J, js_Function *F)
+{
+}
+
 #endif
@@ -109,6 +109,13 @@ enum js_OpCode
 	OP_LINE,	/* -K- */
 };
 
+/* Script text kept for functions compiled on their first call. */
+struct js_Source
+{
+	int refs;
+	char text[1];
+};
+
 struct js_Function
 {
 	const char *name;
@@ -136,6 +143,19 @@ struct js_Function
 	const char *filename;
 	int line, lastline;
 
+	int shared; /* owned by a js_Shared, never marked or freed by the collector */
+
+	/* not compiled yet: the script text and where the parameter list starts */
+	js_Source *source;
+	const char *sourcepos;
+	int sourceline;
+
+#ifdef JS_OPSTATS
+	uint64_t nops; /* executed instructions */
+	unsigned int ncalls;
+	double time; /* seconds spent in calls, including callees */
+#endif
+
 	js_Function *gcnext;
 	int gcmark;
 };
@@ -144,5 +164,11 @@ js_Function *jsC_compilefunction(js_State *J, js_Ast *prog);
 js_Function *jsC_compilescript(js_State *J, js_Ast *prog, int default_strict);
 const char *jsC_opcodestring(enum js_OpCode opcode);
 void jsC_dumpfunction(js_State *J, js_Function *fun);
+uint32_t jsC_opcodehash(void);
+void jsC_verifyfunction(js_State *J, js_Function *F);
+void jsC_verifycode(js_State *J, js_Function *F); /* without the functions it makes */
+void jsC_checkfunction(js_State *J, int line, js_Ast *name, js_Ast *params, js_Ast *body, int default_strict);
+void jsC_compilelazy(js_State *J, js_Function *F);
+void jsC_compiletree(js_State *J, js_Function *F);
 
 #endif
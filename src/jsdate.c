@@ -746,67 +746,75 @@ static void Dp_toJSON(js_State *J)
 	js_call(J, 0);
 }
 
+static const js_Method Date_prototype_methods[] = {
+	{ "Date.prototype.valueOf", Dp_valueOf, 0 },
+	{ "Date.prototype.toString", Dp_toString, 0 },
+	{ "Date.prototype.toDateString", Dp_toDateString, 0 },
+	{ "Date.prototype.toTimeString", Dp_toTimeString, 0 },
+	{ "Date.prototype.toLocaleString", Dp_toString, 0 },
+	{ "Date.prototype.toLocaleDateString", Dp_toDateString, 0 },
+	{ "Date.prototype.toLocaleTimeString", Dp_toTimeString, 0 },
+	{ "Date.prototype.toUTCString", Dp_toUTCString, 0 },
+
+	{ "Date.prototype.getTime", Dp_valueOf, 0 },
+	{ "Date.prototype.getFullYear", Dp_getFullYear, 0 },
+	{ "Date.prototype.getUTCFullYear", Dp_getUTCFullYear, 0 },
+	{ "Date.prototype.getMonth", Dp_getMonth, 0 },
+	{ "Date.prototype.getUTCMonth", Dp_getUTCMonth, 0 },
+	{ "Date.prototype.getDate", Dp_getDate, 0 },
+	{ "Date.prototype.getUTCDate", Dp_getUTCDate, 0 },
+	{ "Date.prototype.getDay", Dp_getDay, 0 },
+	{ "Date.prototype.getUTCDay", Dp_getUTCDay, 0 },
+	{ "Date.prototype.getHours", Dp_getHours, 0 },
+	{ "Date.prototype.getUTCHours", Dp_getUTCHours, 0 },
+	{ "Date.prototype.getMinutes", Dp_getMinutes, 0 },
+	{ "Date.prototype.getUTCMinutes", Dp_getUTCMinutes, 0 },
+	{ "Date.prototype.getSeconds", Dp_getSeconds, 0 },
+	{ "Date.prototype.getUTCSeconds", Dp_getUTCSeconds, 0 },
+	{ "Date.prototype.getMilliseconds", Dp_getMilliseconds, 0 },
+	{ "Date.prototype.getUTCMilliseconds", Dp_getUTCMilliseconds, 0 },
+	{ "Date.prototype.getTimezoneOffset", Dp_getTimezoneOffset, 0 },
+
+	{ "Date.prototype.setTime", Dp_setTime, 1 },
+	{ "Date.prototype.setMilliseconds", Dp_setMilliseconds, 1 },
+	{ "Date.prototype.setUTCMilliseconds", Dp_setUTCMilliseconds, 1 },
+	{ "Date.prototype.setSeconds", Dp_setSeconds, 2 },
+	{ "Date.prototype.setUTCSeconds", Dp_setUTCSeconds, 2 },
+	{ "Date.prototype.setMinutes", Dp_setMinutes, 3 },
+	{ "Date.prototype.setUTCMinutes", Dp_setUTCMinutes, 3 },
+	{ "Date.prototype.setHours", Dp_setHours, 4 },
+	{ "Date.prototype.setUTCHours", Dp_setUTCHours, 4 },
+	{ "Date.prototype.setDate", Dp_setDate, 1 },
+	{ "Date.prototype.setUTCDate", Dp_setUTCDate, 1 },
+	{ "Date.prototype.setMonth", Dp_setMonth, 2 },
+	{ "Date.prototype.setUTCMonth", Dp_setUTCMonth, 2 },
+	{ "Date.prototype.setFullYear", Dp_setFullYear, 3 },
+	{ "Date.prototype.setUTCFullYear", Dp_setUTCFullYear, 3 },
+
+	/* ES5 */
+	{ "Date.prototype.toISOString", Dp_toISOString, 0 },
+	{ "Date.prototype.toJSON", Dp_toJSON, 1 },
+};
+
+static const js_Method Date_methods[] = {
+	{ "Date.parse", D_parse, 1 },
+	{ "Date.UTC", D_UTC, 7 },
+
+	/* ES5 */
+	{ "Date.now", D_now, 0 },
+};
+
 void jsB_initdate(js_State *J)
 {
 	J->Date_prototype->u.number = 0;
 
 	js_pushobject(J, J->Date_prototype);
 	{
-		jsB_propf(J, "Date.prototype.valueOf", Dp_valueOf, 0);
-		jsB_propf(J, "Date.prototype.toString", Dp_toString, 0);
-		jsB_propf(J, "Date.prototype.toDateString", Dp_toDateString, 0);
-		jsB_propf(J, "Date.prototype.toTimeString", Dp_toTimeString, 0);
-		jsB_propf(J, "Date.prototype.toLocaleString", Dp_toString, 0);
-		jsB_propf(J, "Date.prototype.toLocaleDateString", Dp_toDateString, 0);
-		jsB_propf(J, "Date.prototype.toLocaleTimeString", Dp_toTimeString, 0);
-		jsB_propf(J, "Date.prototype.toUTCString", Dp_toUTCString, 0);
-
-		jsB_propf(J, "Date.prototype.getTime", Dp_valueOf, 0);
-		jsB_propf(J, "Date.prototype.getFullYear", Dp_getFullYear, 0);
-		jsB_propf(J, "Date.prototype.getUTCFullYear", Dp_getUTCFullYear, 0);
-		jsB_propf(J, "Date.prototype.getMonth", Dp_getMonth, 0);
-		jsB_propf(J, "Date.prototype.getUTCMonth", Dp_getUTCMonth, 0);
-		jsB_propf(J, "Date.prototype.getDate", Dp_getDate, 0);
-		jsB_propf(J, "Date.prototype.getUTCDate", Dp_getUTCDate, 0);
-		jsB_propf(J, "Date.prototype.getDay", Dp_getDay, 0);
-		jsB_propf(J, "Date.prototype.getUTCDay", Dp_getUTCDay, 0);
-		jsB_propf(J, "Date.prototype.getHours", Dp_getHours, 0);
-		jsB_propf(J, "Date.prototype.getUTCHours", Dp_getUTCHours, 0);
-		jsB_propf(J, "Date.prototype.getMinutes", Dp_getMinutes, 0);
-		jsB_propf(J, "Date.prototype.getUTCMinutes", Dp_getUTCMinutes, 0);
-		jsB_propf(J, "Date.prototype.getSeconds", Dp_getSeconds, 0);
-		jsB_propf(J, "Date.prototype.getUTCSeconds", Dp_getUTCSeconds, 0);
-		jsB_propf(J, "Date.prototype.getMilliseconds", Dp_getMilliseconds, 0);
-		jsB_propf(J, "Date.prototype.getUTCMilliseconds", Dp_getUTCMilliseconds, 0);
-		jsB_propf(J, "Date.prototype.getTimezoneOffset", Dp_getTimezoneOffset, 0);
-
-		jsB_propf(J, "Date.prototype.setTime", Dp_setTime, 1);
-		jsB_propf(J, "Date.prototype.setMilliseconds", Dp_setMilliseconds, 1);
-		jsB_propf(J, "Date.prototype.setUTCMilliseconds", Dp_setUTCMilliseconds, 1);
-		jsB_propf(J, "Date.prototype.setSeconds", Dp_setSeconds, 2);
-		jsB_propf(J, "Date.prototype.setUTCSeconds", Dp_setUTCSeconds, 2);
-		jsB_propf(J, "Date.prototype.setMinutes", Dp_setMinutes, 3);
-		jsB_propf(J, "Date.prototype.setUTCMinutes", Dp_setUTCMinutes, 3);
-		jsB_propf(J, "Date.prototype.setHours", Dp_setHours, 4);
-		jsB_propf(J, "Date.prototype.setUTCHours", Dp_setUTCHours, 4);
-		jsB_propf(J, "Date.prototype.setDate", Dp_setDate, 1);
-		jsB_propf(J, "Date.prototype.setUTCDate", Dp_setUTCDate, 1);
-		jsB_propf(J, "Date.prototype.setMonth", Dp_setMonth, 2);
-		jsB_propf(J, "Date.prototype.setUTCMonth", Dp_setUTCMonth, 2);
-		jsB_propf(J, "Date.prototype.setFullYear", Dp_setFullYear, 3);
-		jsB_propf(J, "Date.prototype.setUTCFullYear", Dp_setUTCFullYear, 3);
-
-		/* ES5 */
-		jsB_propf(J, "Date.prototype.toISOString", Dp_toISOString, 0);
-		jsB_propf(J, "Date.prototype.toJSON", Dp_toJSON, 1);
+		jsB_methods(J, Date_prototype_methods, nelem(Date_prototype_methods));
 	}
 	js_newcconstructor(J, jsB_Date, jsB_new_Date, "Date", 0); /* 1 */
 	{
-		jsB_propf(J, "Date.parse", D_parse, 1);
-		jsB_propf(J, "Date.UTC", D_UTC, 7);
-
-		/* ES5 */
-		jsB_propf(J, "Date.now", D_now, 0);
+		jsB_methods(J, Date_methods, nelem(Date_methods));
 	}
 	js_defglobal(J, "Date", JS_DONTENUM);
 }
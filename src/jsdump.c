@@ -28,11 +28,21 @@ const char *jsP_aststring(enum js_AstType type)
 
 const char *jsC_opcodestring(enum js_OpCode opcode)
 {
-	if (opcode < nelem(opname)-1)
+	if (opcode < nelem(opname))
 		return opname[opcode];
 	return "<unknown>";
 }
 
+/* Changes whenever opcodes are added, removed or renumbered. */
+uint32_t jsC_opcodehash(void)
+{
+	uint64_t hash = 5381;
+	unsigned int i;
+	for (i = 0; i < nelem(opname) - 1; i++)
+		hash = ((hash << 5) + hash) ^ jsU_tostrhash(opname[i]);
+	return (uint32_t)(hash ^ (hash >> 32));
+}
+
 static int prec(enum js_AstType type)
 {
 	switch (type) {
@@ -866,6 +876,7 @@ void js_dumpvalue(js_State *J, js_Value v)
 	case JS_TNULL: printf("null"); break;
 	case JS_TBOOLEAN: printf(v.u.boolean ? "true" : "false"); break;
 	case JS_TNUMBER: printf("%.9g", v.u.number); break;
+	case JS_TINTEGER: printf("%d", v.u.integer); break;
 	case JS_TSHRSTR: printf("'%s'", v.u.string.u.shrstr); break;
 	case JS_TLITSTR:
 	case JS_TCONSTSTR:
@@ -893,6 +904,7 @@ void js_dumpvalue(js_State *J, js_Value v)
 		case JS_CERROR: printf("[Error]"); break;
 		case JS_CARGUMENTS: printf("[Arguments %p]", (void*)v.u.object); break;
 		case JS_CITERATOR: printf("[Iterator %p]", (void*)v.u.object); break;
+		case JS_CCOROUTINE: printf("[Coroutine %p]", (void*)v.u.object); break;
 		case JS_CUSERDATA:
 			printf("[Userdata %s %p]", v.u.object->u.user.tag, v.u.object->u.user.data);
 			break;
@@ -1006,14 +1018,26 @@ static void jsC_dumpfuncbin(js_State *J, js_Function *F, js_Buffer *sb, hashtabl
 js_Buffer js_dumpfuncbin(js_State *J, js_Function *F, int flags)
 {
 	int headerFlags = 0;
+	uint32_t length;
 	js_Buffer buf;
+	jsC_compiletree(J, F);
 	jsbuf_init(J, &buf, 512);
 	hashtable_t strings;
 	hashtable_init(&strings, sizeof(uint32_t), 256, NULL);	
-	jsbuf_puti32(J, &buf, 0x736a756d);
+	jsbuf_putu32(J, &buf, JS_BINMAGIC);
 	BITSET(headerFlags, 0, flags & JS_BINSTRIPDEBUG);
-	jsbuf_puti32(J, &buf, headerFlags);
+	jsbuf_putu32(J, &buf, headerFlags | (JS_BINVERSION << 16));
+	jsbuf_putu32(J, &buf, jsC_opcodehash());
+	jsbuf_putu32(J, &buf, 0);
+	jsbuf_putu32(J, &buf, 0);
 	jsC_dumpfuncbin(J, F, &buf, &strings, flags);
 	hashtable_term(&strings);
+
+	/* fill in the payload length and checksum */
+	length = buf.n - JS_BINHEADER;
+	buf.n = 12;
+	jsbuf_putu32(J, &buf, length);
+	jsbuf_putu32(J, &buf, jsU_checksum(buf.data + JS_BINHEADER, length));
+	buf.n = length + JS_BINHEADER;
 	return buf;
 }
@@ -111,13 +111,17 @@ DERROR(urierror, URIError)
 
 #undef DERROR
 
+static const js_Method Error_prototype_methods[] = {
+	{ "Error.prototype.toString", Ep_toString, 0 },
+};
+
 void jsB_initerror(js_State *J)
 {
 	js_pushobject(J, J->Error_prototype);
 	{
 			jsB_props(J, "name", "Error");
 			jsB_props(J, "message", "an error has occurred");
-			jsB_propf(J, "Error.prototype.toString", Ep_toString, 0);
+			jsB_methods(J, Error_prototype_methods, nelem(Error_prototype_methods));
 	}
 	js_newcconstructor(J, jsB_Error, jsB_Error, "Error", 1);
 	js_defglobal(J, "Error", JS_DONTENUM);
@@ -210,6 +210,13 @@ static void Fp_bind(js_State *J)
 	js_defproperty(J, -2, "__BoundArguments__", JS_READONLY | JS_DONTENUM | JS_DONTCONF);
 }
 
+static const js_Method Function_prototype_methods[] = {
+	{ "Function.prototype.toString", Fp_toString, 2 },
+	{ "Function.prototype.apply", Fp_apply, 2 },
+	{ "Function.prototype.call", Fp_call, 1 },
+	{ "Function.prototype.bind", Fp_bind, 1 },
+};
+
 void jsB_initfunction(js_State *J)
 {
 	J->Function_prototype->u.c.name = "Function.prototype";
@@ -219,10 +226,7 @@ void jsB_initfunction(js_State *J)
 
 	js_pushobject(J, J->Function_prototype);
 	{
-		jsB_propf(J, "Function.prototype.toString", Fp_toString, 2);
-		jsB_propf(J, "Function.prototype.apply", Fp_apply, 2);
-		jsB_propf(J, "Function.prototype.call", Fp_call, 1);
-		jsB_propf(J, "Function.prototype.bind", Fp_bind, 1);
+		jsB_methods(J, Function_prototype_methods, nelem(Function_prototype_methods));
 	}
 	js_newcconstructor(J, jsB_Function, jsB_Function, "Function", 1);
 	js_defglobal(J, "Function", JS_DONTENUM);
@@ -5,8 +5,64 @@
 
 #include "regexp.h"
 
+#include <time.h>
+
 static void jsG_markobject(js_State *J, int mark, js_Object *obj);
 
+/* Heap accounting, the sizes mirror what the allocating code asks for */
+
+static const char *jsG_classname[] = {
+	"Object", "Array", "Function", "Script", "CFunction", "Error",
+	"Boolean", "Number", "String", "RegExp", "Date", "Math", "JSON",
+	"Arguments", "Iterator", "Userdata", "Coroutine",
+};
+
+static size_t jsG_propertiessize(hashtable_t *table)
+{
+	size_t n = sizeof *table +
+		table->slot_capacity * sizeof *table->slots +
+		table->item_capacity * (sizeof *table->items_key + sizeof *table->items_slot + table->item_size) +
+		table->item_size;
+	hashtable_foreach(js_Property, ref, table)
+		if (ref->atts & JS_ACCESSOR)
+			n += sizeof(js_Accessor);
+	return n;
+}
+
+static size_t jsG_objectsize(js_Object *obj)
+{
+	size_t n = sizeof *obj;
+	js_Iterator *node;
+	js_Coroutine *co;
+	if (obj->type == JS_CREGEXP && obj->u.r.source)
+		n += strlen(obj->u.r.source) + 1;
+	if (obj->type == JS_CITERATOR)
+		for (node = obj->u.iter.head; node; node = node->next)
+			n += sizeof *node;
+	if (obj->type == JS_CCOROUTINE) {
+		co = obj->u.co;
+		n += sizeof *co;
+		n += co->stacklen * sizeof *co->stack;
+		n += co->framelen * sizeof *co->frames;
+		n += co->envlen * sizeof *co->envstack;
+		n += co->tracelen * sizeof *co->trace;
+		n += co->trylen * sizeof *co->trybuf;
+	}
+	return n;
+}
+
+static size_t jsG_functionsize(js_Function *fun)
+{
+	return sizeof *fun +
+		fun->codecap * sizeof *fun->code +
+		fun->funcap * sizeof *fun->funtab +
+		fun->numcap * sizeof *fun->numtab +
+		fun->strcap * sizeof *fun->strtab +
+		fun->varcap * sizeof *fun->vartab;
+}
+
+#define jsG_stringsize(node) (soffsetof(js_StringNode, string) + (node)->size + 1)
+
 static void jsG_freeenvironment(js_State *J, js_Environment *env)
 {
 	js_free(J, env);
@@ -14,6 +70,8 @@ static void jsG_freeenvironment(js_State *J, js_Environment *env)
 
 static void jsG_freefunction(js_State *J, js_Function *fun)
 {
+	if (fun->source && --fun->source->refs == 0)
+		js_free(J, fun->source);
 	js_free(J, fun->funtab);
 	js_free(J, fun->numtab);
 	js_free(J, fun->strtab);
@@ -24,6 +82,9 @@ static void jsG_freefunction(js_State *J, js_Function *fun)
 
 static void jsG_freeproperty(js_State *J, hashtable_t *properties)
 {
+	hashtable_foreach(js_Property, ref, properties)
+		if (ref->atts & JS_ACCESSOR)
+			js_free(J, ref->value.u.accessor);
 	hashtable_term(properties);
 	js_free(J, properties);
 }
@@ -49,6 +110,8 @@ static void jsG_freeobject(js_State *J, js_Object *obj)
 		jsG_freeiterator(J, obj->u.iter.head);
 	if (obj->type == JS_CUSERDATA && obj->u.user.finalize)
 		obj->u.user.finalize(J, obj->u.user.data);
+	if (obj->type == JS_CCOROUTINE)
+		jsR_freecoroutine(J, obj->u.co);
 	if (obj->type == JS_CSTRING) {
 		js_StringNode *strnode = jsU_ptrtostrnode(obj->u.string.u.ptr8);
 		if (strnode->isattached && !(--strnode->level))
@@ -61,6 +124,8 @@ static void jsG_freeobject(js_State *J, js_Object *obj)
 static void jsG_markfunction(js_State *J, int mark, js_Function *fun)
 {
 	int i;
+	if (fun->shared)
+		return;
 	fun->gcmark = mark;
 	for (i = 0; i < fun->funlen; ++i)
 		if (fun->funtab[i]->gcmark != mark)
@@ -79,6 +144,14 @@ static void jsG_markenvironment(js_State *J, int mark, js_Environment *env)
 
 static void jsG_markproperty(js_State *J, int mark, js_Property *node)
 {
+	if (node->atts & JS_ACCESSOR) {
+		js_Accessor *acc = node->value.u.accessor;
+		if (acc->getter && acc->getter->gcmark != mark)
+			jsG_markobject(J, mark, acc->getter);
+		if (acc->setter && acc->setter->gcmark != mark)
+			jsG_markobject(J, mark, acc->setter);
+		return;
+	}
 	if (node->value.type == JS_TMEMSTR) {
 		js_StringNode *strnode = jsU_ptrtostrnode(node->value.u.string.u.ptr8);
 		if (strnode->gcmark != mark)
@@ -86,10 +159,36 @@ static void jsG_markproperty(js_State *J, int mark, js_Property *node)
 	}
 	if (node->value.type == JS_TOBJECT && node->value.u.object->gcmark != mark)
 		jsG_markobject(J, mark, node->value.u.object);
-	if (node->getter && node->getter->gcmark != mark)
-		jsG_markobject(J, mark, node->getter);
-	if (node->setter && node->setter->gcmark != mark)
-		jsG_markobject(J, mark, node->setter);
+}
+
+static void jsG_markvalues(js_State *J, int mark, js_Value *v, int n)
+{
+	while (n--) {
+		if (v->type == JS_TMEMSTR) {
+			js_StringNode *strnode = jsU_ptrtostrnode(v->u.string.u.ptr8);
+			if (strnode->gcmark != mark)
+				strnode->gcmark = mark;
+		}
+		if (v->type == JS_TOBJECT && v->u.object->gcmark != mark)
+			jsG_markobject(J, mark, v->u.object);
+		++v;
+	}
+}
+
+static void jsG_markcoroutine(js_State *J, int mark, js_Coroutine *co)
+{
+	int i;
+	if (co->function && co->function->gcmark != mark)
+		jsG_markobject(J, mark, co->function);
+	jsG_markvalues(J, mark, co->stack, co->stacklen);
+	if (co->E && co->E->gcmark != mark)
+		jsG_markenvironment(J, mark, co->E);
+	for (i = 0; i < co->envlen; ++i)
+		if (co->envstack[i] && co->envstack[i]->gcmark != mark)
+			jsG_markenvironment(J, mark, co->envstack[i]);
+	for (i = 0; i < co->trylen; ++i)
+		if (co->trybuf[i].E->gcmark != mark)
+			jsG_markenvironment(J, mark, co->trybuf[i].E);
 }
 
 static void jsG_markobject(js_State *J, int mark, js_Object *obj)
@@ -113,22 +212,13 @@ static void jsG_markobject(js_State *J, int mark, js_Object *obj)
 		if (obj->u.f.function && obj->u.f.function->gcmark != mark)
 			jsG_markfunction(J, mark, obj->u.f.function);
 	}
+	if (obj->type == JS_CCOROUTINE)
+		jsG_markcoroutine(J, mark, obj->u.co);
 }
 
 static void jsG_markstack(js_State *J, int mark)
 {
-	js_Value *v = J->stack;
-	int n = J->top;
-	while (n--) {
-		if (v->type == JS_TMEMSTR) {
-			js_StringNode *strnode = jsU_ptrtostrnode(v->u.string.u.ptr8);
-			if (strnode->gcmark != mark)
-				strnode->gcmark = mark;
-		}
-		if (v->type == JS_TOBJECT && v->u.object->gcmark != mark)
-			jsG_markobject(J, mark, v->u.object);
-		++v;
-	}
+	jsG_markvalues(J, mark, J->stack, J->top);
 }
 
 void js_gc(js_State *J, int report)
@@ -139,6 +229,8 @@ void js_gc(js_State *J, int report)
 	js_Environment *env, *nextenv, **prevnextenv;
 	int nenv = 0, nfun = 0, nobj = 0, nstr = 0;
 	int genv = 0, gfun = 0, gobj = 0, gstr = 0;
+	size_t heap = J->internbytes;
+	clock_t start;
 	int mark;
 	int i;
 
@@ -149,6 +241,7 @@ void js_gc(js_State *J, int report)
 	}
 
 	J->gccounter = 0;
+	start = clock();
 
 	mark = J->gcmark = J->gcmark == 1 ? 2 : 1;
 
@@ -182,6 +275,7 @@ void js_gc(js_State *J, int report)
 	prevnextenv = &J->gcenv;
 	for (env = J->gcenv; env; env = nextenv) {
 		nextenv = env->gcnext;
+		heap += sizeof *env;
 		if (env->gcmark != mark) {
 			*prevnextenv = nextenv;
 			jsG_freeenvironment(J, env);
@@ -195,6 +289,7 @@ void js_gc(js_State *J, int report)
 	prevnextfun = &J->gcfun;
 	for (fun = J->gcfun; fun; fun = nextfun) {
 		nextfun = fun->gcnext;
+		heap += jsG_functionsize(fun);
 		if (fun->gcmark != mark) {
 			*prevnextfun = nextfun;
 			jsG_freefunction(J, fun);
@@ -208,6 +303,9 @@ void js_gc(js_State *J, int report)
 	prevnextobj = &J->gcobj;
 	for (obj = J->gcobj; obj; obj = nextobj) {
 		nextobj = obj->gcnext;
+		heap += jsG_objectsize(obj);
+		if (obj->properties)
+			heap += jsG_propertiessize(obj->properties);
 		if (obj->gcmark != mark) {
 			*prevnextobj = nextobj;
 			jsG_freeobject(J, obj);
@@ -221,6 +319,7 @@ void js_gc(js_State *J, int report)
 	prevnextstr = &J->gcstr;
 	for (str = J->gcstr; str; str = nextstr) {
 		nextstr = str->right;
+		heap += jsG_stringsize(str);
 		if (str->gcmark != mark && !str->isattached) {
 			*prevnextstr = nextstr;
 			js_free(J, str);
@@ -231,6 +330,12 @@ void js_gc(js_State *J, int report)
 		++nstr;
 	}
 
+	if (heap > J->gcpeak)
+		J->gcpeak = heap;
+	J->gclast = (double)(clock() - start) / CLOCKS_PER_SEC;
+	J->gctime += J->gclast;
+	++J->gccount;
+
 	if (report) {
 		char buf[256];
 		snprintf(buf, sizeof buf, "garbage collected: %d/%d envs, %d/%d funs, %d/%d objs, %d/%d strs",
@@ -249,6 +354,11 @@ void js_freestate(js_State *J)
 	if (!J)
 		return;
 
+	jsR_freeprofile(J);
+#ifdef JS_OPSTATS
+	js_free(J, J->opstats);
+#endif
+
 	for (env = J->gcenv; env; env = nextenv)
 		nextenv = env->gcnext, jsG_freeenvironment(J, env);
 	for (fun = J->gcfun; fun; fun = nextfun)
@@ -259,8 +369,75 @@ void js_freestate(js_State *J)
 		nextstr = str->right, js_free(J, str);
 
 	jsS_freestrings(J);
+	jsS_dropshared(J);
 
+	js_free(J, J->lazy);
+	js_free(J, J->lazyhash);
+	js_free(J, J->cachedir);
+	js_free(J, J->clonehooks);
+
+	js_free(J, J->arena.chunk);
 	js_free(J, J->lexbuf.text);
 	J->alloc(J->actx, J->stack, 0);
 	J->alloc(J->actx, J, 0);
 }
+
+const char *js_heapclassname(int cls)
+{
+	if (cls >= 0 && cls < nelem(jsG_classname))
+		return jsG_classname[cls];
+	return "<unknown>";
+}
+
+void js_heapstats(js_State *J, js_HeapStats *stats)
+{
+	js_Environment *env;
+	js_Function *fun;
+	js_Object *obj;
+	js_StringNode *str;
+	size_t n;
+
+	memset(stats, 0, sizeof *stats);
+
+	for (obj = J->gcobj; obj; obj = obj->gcnext) {
+		n = jsG_objectsize(obj);
+		stats->objects[obj->type].count++;
+		stats->objects[obj->type].bytes += n;
+		stats->total += n;
+		if (obj->properties) {
+			n = jsG_propertiessize(obj->properties);
+			stats->properties.count += hashtable_count(obj->properties);
+			stats->properties.bytes += n;
+			stats->total += n;
+		}
+	}
+
+	for (env = J->gcenv; env; env = env->gcnext) {
+		stats->environments.count++;
+		stats->environments.bytes += sizeof *env;
+	}
+	stats->total += stats->environments.bytes;
+
+	for (fun = J->gcfun; fun; fun = fun->gcnext) {
+		stats->functions.count++;
+		stats->functions.bytes += jsG_functionsize(fun);
+	}
+	stats->total += stats->functions.bytes;
+
+	for (str = J->gcstr; str; str = str->right) {
+		stats->memstrings.count++;
+		stats->memstrings.bytes += jsG_stringsize(str);
+	}
+	stats->total += stats->memstrings.bytes;
+
+	stats->internedstrings.count = J->nintern;
+	stats->internedstrings.bytes = J->internbytes;
+	stats->total += J->internbytes;
+
+	if (stats->total > J->gcpeak)
+		J->gcpeak = stats->total;
+	stats->peak = J->gcpeak;
+	stats->gccount = J->gccount;
+	stats->gctime = J->gctime;
+	stats->gclast = J->gclast;
+}
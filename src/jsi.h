@@ -7,6 +7,7 @@
 #include <stdarg.h>
 #include <string.h>
 #include <setjmp.h>
+#include <signal.h>
 #include <math.h>
 #include <float.h>
 #include <limits.h>
@@ -61,10 +62,17 @@ typedef struct js_Object js_Object;
 typedef struct js_String js_String;
 typedef struct js_Ast js_Ast;
 typedef struct js_Function js_Function;
+typedef struct js_Source js_Source;
 typedef struct js_Environment js_Environment;
 typedef struct js_StringNode js_StringNode;
 typedef struct js_Jumpbuf js_Jumpbuf;
 typedef struct js_StackTrace js_StackTrace;
+typedef struct js_Frame js_Frame;
+typedef struct js_Coroutine js_Coroutine;
+typedef struct js_Profile js_Profile;
+typedef struct js_Method js_Method;
+typedef struct js_LazyTable js_LazyTable;
+typedef struct js_CloneHook js_CloneHook;
 
 /* Limits */
 
@@ -83,6 +91,22 @@ typedef struct js_StackTrace js_StackTrace;
 #ifndef JS_ASTLIMIT
 #define JS_ASTLIMIT 100		/* max nested expressions */
 #endif
+#ifndef JS_ARENASIZE
+#define JS_ARENASIZE 16384	/* chunk size for syntax tree allocation */
+#endif
+#ifndef JS_CACHEMIN
+#define JS_CACHEMIN 512		/* smaller scripts are compiled without the compile cache */
+#endif
+#ifndef JS_READSIZE
+#define JS_READSIZE 8192	/* chunk size when js_loadfile streams a file */
+#endif
+
+#ifndef JS_WRITESIZE
+#define JS_WRITESIZE 8192	/* chunk size when js_stringify writes to the host */
+#endif
+#ifndef JS_INTERNCACHE
+#define JS_INTERNCACHE 256	/* recently interned names the lexer finds by hash, power of two */
+#endif
 
 /* instruction size -- change to int if you get integer overflow syntax errors */
 
@@ -96,8 +120,12 @@ typedef unsigned short js_Instruction;
 
 char *js_strdup(js_State *J, const char *s);
 const char *js_intern(js_State *J, const char *s);
+const char *jsS_internspan(js_State *J, const char *s, int n);
+const char *jsS_internhash(js_State *J, const char *s, int n, uint32_t h);
 void jsS_dumpstrings(js_State *J);
 void jsS_freestrings(js_State *J);
+void jsS_dropshared(js_State *J);
+js_State *jsS_restoresnapshot(js_Snapshot *S, js_Alloc alloc, void *actx);
 
 struct js_StringNode
 {
@@ -161,14 +189,27 @@ struct js_StackTrace
 	int line;
 };
 
+/* Call frames, used to continue suspended coroutines */
+
+struct js_Frame
+{
+	js_Function *F; /* NULL for native functions */
+	js_Instruction *pc; /* where to continue after the current call */
+	int savebot, bot;
+	int scoped; /* pops the scope on return */
+	int resumable; /* called from script without a native boundary */
+};
+
 /* Exception handling */
 
 struct js_Jumpbuf
 {
 	jmp_buf buf;
 	js_Environment *E;
+	js_Coroutine *co;
 	int envtop;
 	int tracetop;
+	int frametop;
 	int top, bot;
 	int strict;
 	js_Instruction *pc;
@@ -191,17 +232,24 @@ struct js_State
 	js_Exit exit;
 
 	js_StringNode *strings;
+	const char *interncache[JS_INTERNCACHE];
 
 	int default_strict;
 	int strict;
+	int lazycompile; /* JS_LAZY */
 
 	/* parser input source */
 	const char *filename;
 	const char *source;
 	int line;
 
+	/* js_load input: a window the lexer refills when it reaches the end */
+	struct { js_Reader read; void *data; char *buf, *end, *last; int cap; char hold; } stream;
+
 	/* lexer state */
 	struct { char *text; int len, cap; } lexbuf;
+	const char *lexpos; /* where lexchar was read */
+	const char *lexstart;
 	int lexline;
 	int lexchar;
 	int lasttoken;
@@ -212,7 +260,10 @@ struct js_State
 	int lookahead;
 	const char *text;
 	double number;
-	js_Ast *gcast; /* list of allocated nodes to free after parsing */
+	struct { void *chunk; char *next, *end; } arena; /* syntax tree memory, freed after compiling */
+	js_Source *lazysource; /* set when nested function bodies are only checked */
+	int lazystrict; /* strict mode inherited by the function body being parsed */
+	int lazycheck; /* compiling a dropped body for its errors only */
 
 	/* runtime environment */
 	js_Object *Object_prototype;
@@ -253,6 +304,13 @@ struct js_State
 	js_Object *gcobj;
 	js_StringNode *gcstr;
 
+	/* heap statistics */
+	unsigned int nintern;
+	size_t internbytes;
+	unsigned int gccount;
+	double gctime, gclast;
+	size_t gcpeak;
+
 	/* environments on the call stack but currently not in scope */
 	int envtop;
 	js_Environment *envstack[JS_ENVLIMIT];
@@ -261,6 +319,48 @@ struct js_State
 	int tracetop;
 	js_StackTrace trace[JS_ENVLIMIT];
 
+	/* backward jumps and calls tick the hook and the profiler */
+	int tickleft, tickspan;
+	volatile sig_atomic_t samplerequest; /* set by js_sampleprofile, also from signal handlers */
+	js_Hook hook;
+	int hookcount;
+	int hookleft;
+	int hooktop;
+	int inhook;
+	js_Profile *profile;
+
+	/* builtin method tables not yet turned into function objects */
+	js_LazyTable *lazy;
+	int lazylen, lazycap;
+	uint64_t *lazyhash; /* property name hashes of all tables */
+	int lazyhashlen, lazyhashcap;
+
+	/* userdata clone hooks set by js_setclonehooks */
+	js_CloneHook *clonehooks;
+	int clonehookslen, clonehookscap;
+
+	/* shared scripts loaded into this state, released by js_freestate */
+	js_Shared **shared;
+	int sharedlen, sharedcap;
+
+	/* compile cache consulted by js_loadstring */
+	js_CacheLoad cacheload;
+	js_CacheRelease cacherelease;
+	js_CacheStore cachestore;
+	void *cachectx;
+	char *cachedir; /* for the directory cache set by js_setcachedir */
+
+#ifdef JS_OPSTATS
+	int stats;
+	uint64_t *opstats; /* executed instructions per opcode */
+#endif
+
+	/* call frames and the running coroutine */
+	int frametop;
+	int opcall;
+	js_Frame frames[JS_ENVLIMIT];
+	js_Coroutine *co;
+
 	/* exception stack */
 	int trytop;
 	js_Jumpbuf trybuf[JS_TRYLIMIT];
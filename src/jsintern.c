@@ -5,18 +5,21 @@
 
 js_StringNode jsS_sentinel = { &jsS_sentinel, &jsS_sentinel, 0, 0, 0, 0, 0, 0, ""};
 
-static js_StringNode *jsS_newstringnode(js_State *J, const char *string, const char **result)
+static js_StringNode *jsS_newstringnode(js_State *J, const char *string, int size, const char **result)
 {
 	unsigned int n = 0;
-	unsigned int len = utflen2(string, &n);
+	unsigned int len = utfnlen2(string, size, &n);
 	js_StringNode *node = js_malloc(J, soffsetof(js_StringNode, string) + n + 1);
+	++J->nintern;
+	J->internbytes += soffsetof(js_StringNode, string) + n + 1;
 	node->left = node->right = &jsS_sentinel;
 	node->level = 1;
 	node->size = n;
 	node->length = len;
 	node->isattached = 0;
 	node->isunicode = n != len;
-	memcpy(node->string, string, n + 1);
+	memcpy(node->string, string, n);
+	node->string[n] = 0;
 	return *result = node->string, node;
 }
 
@@ -43,21 +46,30 @@ static js_StringNode *jsS_split(js_StringNode *node)
 	return node;
 }
 
-static js_StringNode *jsS_insert(js_State *J, js_StringNode *node, const char *string, const char **result)
+/* Compare the first n bytes of string, which has no terminator of its own, with s. */
+static int jsS_spancmp(const char *string, int n, const char *s)
+{
+	int c = strncmp(string, s, n);
+	if (c == 0 && s[n] != 0)
+		return -1;
+	return c;
+}
+
+static js_StringNode *jsS_insert(js_State *J, js_StringNode *node, const char *string, int n, const char **result)
 {
 	if (node != &jsS_sentinel) {
-		int c = strcmp(string, node->string);
+		int c = jsS_spancmp(string, n, node->string);
 		if (c < 0)
-			node->left = jsS_insert(J, node->left, string, result);
+			node->left = jsS_insert(J, node->left, string, n, result);
 		else if (c > 0)
-			node->right = jsS_insert(J, node->right, string, result);
+			node->right = jsS_insert(J, node->right, string, n, result);
 		else
 			return *result = node->string, node;
 		node = jsS_skew(node);
 		node = jsS_split(node);
 		return node;
 	}
-	return jsS_newstringnode(J, string, result);
+	return jsS_newstringnode(J, string, n, result);
 }
 
 static void dumpstringnode(js_StringNode *node, int level)
@@ -95,11 +107,31 @@ void jsS_freestrings(js_State *J)
 		jsS_freestringnode(J, J->strings);
 }
 
-const char *js_intern(js_State *J, const char *s)
+/* Intern the n bytes at s, which need not be zero terminated. */
+const char *jsS_internspan(js_State *J, const char *s, int n)
 {
 	const char *result;
 	if (!J->strings)
 		J->strings = &jsS_sentinel;
-	J->strings = jsS_insert(J, J->strings, s, &result);
+	J->strings = jsS_insert(J, J->strings, s, n, &result);
 	return result;
 }
+
+/*
+	The lexer has the djb2 hash of each name it reads (see jsY_hashname).
+	Names come back often in a script, so the last one interned in each
+	hash slot is checked before the tree. Interned strings live as long as
+	the state, so the cache never holds a freed string.
+*/
+const char *jsS_internhash(js_State *J, const char *s, int n, uint32_t h)
+{
+	const char **slot = &J->interncache[h & (JS_INTERNCACHE - 1)];
+	if (*slot && !strncmp(*slot, s, n) && (*slot)[n] == 0)
+		return *slot;
+	return *slot = jsS_internspan(J, s, n);
+}
+
+const char *js_intern(js_State *J, const char *s)
+{
+	return jsS_internspan(J, s, strlen(s));
+}
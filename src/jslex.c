@@ -106,38 +106,94 @@ const char *jsY_tokenstring(int token)
 	return "<unknown>";
 }
 
-static const char *keywords[] = {
-	"break", "case", "catch", "continue", "debugger", "default", "delete",
-	"do", "else", "false", "finally", "for", "function", "if", "in",
-	"instanceof", "new", "null", "return", "switch", "this", "throw",
-	"true", "try", "typeof", "var", "void", "while", "with",
+/*
+	Keywords and future reserved words are found with a perfect hash. The
+	slot is the top bits of the djb2 hash of the name times WORDMUL, which
+	is the first odd multiplier that gives each word below a slot of its
+	own. Adding a word means searching for a new multiplier and laying out
+	the table again.
+*/
+#define WORDMUL 214621u
+#define WORDSLOT(h) (((uint32_t)(h) * WORDMUL) >> 25)
+
+static const struct { const char *name; unsigned char len; short token; } wordtab[128] = {
+	[0] = { "in", 2, TK_IN },
+	[1] = { "super", 5, WORD_FUTURE },
+	[2] = { "continue", 8, TK_CONTINUE },
+	[3] = { "switch", 6, TK_SWITCH },
+	[6] = { "throw", 5, TK_THROW },
+	[8] = { "case", 4, TK_CASE },
+	[10] = { "export", 6, WORD_FUTURE },
+	[11] = { "private", 7, WORD_STRICT },
+	[16] = { "catch", 5, TK_CATCH },
+	[21] = { "let", 3, WORD_STRICT },
+	[29] = { "implements", 10, WORD_STRICT },
+	[32] = { "else", 4, TK_ELSE },
+	[35] = { "new", 3, TK_NEW },
+	[36] = { "debugger", 8, TK_DEBUGGER },
+	[43] = { "while", 5, TK_WHILE },
+	[46] = { "enum", 4, WORD_FUTURE },
+	[50] = { "package", 7, WORD_STRICT },
+	[52] = { "instanceof", 10, TK_INSTANCEOF },
+	[53] = { "with", 4, TK_WITH },
+	[55] = { "yield", 5, WORD_STRICT },
+	[64] = { "false", 5, TK_FALSE },
+	[66] = { "true", 4, TK_TRUE },
+	[69] = { "default", 7, TK_DEFAULT },
+	[70] = { "protected", 9, WORD_STRICT },
+	[71] = { "return", 6, TK_RETURN },
+	[74] = { "break", 5, TK_BREAK },
+	[79] = { "try", 3, TK_TRY },
+	[80] = { "function", 8, TK_FUNCTION },
+	[83] = { "import", 6, WORD_FUTURE },
+	[84] = { "extends", 7, WORD_FUTURE },
+	[87] = { "public", 6, WORD_STRICT },
+	[88] = { "interface", 9, WORD_STRICT },
+	[89] = { "var", 3, TK_VAR },
+	[99] = { "finally", 7, TK_FINALLY },
+	[101] = { "delete", 6, TK_DELETE },
+	[109] = { "for", 3, TK_FOR },
+	[112] = { "class", 5, WORD_FUTURE },
+	[113] = { "static", 6, WORD_STRICT },
+	[114] = { "null", 4, TK_NULL },
+	[118] = { "void", 4, TK_VOID },
+	[119] = { "typeof", 6, TK_TYPEOF },
+	[122] = { "this", 4, TK_THIS },
+	[124] = { "const", 5, WORD_FUTURE },
+	[126] = { "do", 2, TK_DO },
+	[127] = { "if", 2, TK_IF },
 };
 
-int jsY_findword(const char *s, const char **list, int num)
-{
-	int l = 0;
-	int r = num - 1;
-	while (l <= r) {
-		int m = (l + r) >> 1;
-		int c = strcmp(s, list[m]);
-		if (c < 0)
-			r = m - 1;
-		else if (c > 0)
-			l = m + 1;
-		else
-			return m;
-	}
-	return -1;
+#define HASHSTART 5381u
+#define HASHSTEP(h, c) ((h) * 33 + (unsigned char)(c)) /* djb2, as in jsU_tostrhash */
+
+static uint32_t jsY_hashname(const char *s, int n)
+{
+	uint32_t h = HASHSTART;
+	while (n-- > 0)
+		h = HASHSTEP(h, *s++);
+	return h;
 }
 
-static int jsY_findkeyword(js_State *J, const char *s)
+/* WORD_FUTURE or WORD_STRICT if s is a future reserved word, else 0. */
+int jsY_findreserved(const char *s)
 {
-	int i = jsY_findword(s, keywords, nelem(keywords));
-	if (i >= 0) {
-		J->text = keywords[i];
-		return TK_BREAK + i; /* first keyword + i */
+	int n = strlen(s);
+	int i = WORDSLOT(jsY_hashname(s, n));
+	if (wordtab[i].token < TK_BREAK && n > 0 && wordtab[i].len == n && !memcmp(wordtab[i].name, s, n))
+		return wordtab[i].token;
+	return 0;
+}
+
+/* Look up the n bytes at s with hash h, which need not be zero terminated. */
+static int jsY_findkeyword(js_State *J, const char *s, int n, uint32_t h)
+{
+	int i = WORDSLOT(h);
+	if (wordtab[i].token >= TK_BREAK && wordtab[i].len == n && !memcmp(wordtab[i].name, s, n)) {
+		J->text = wordtab[i].name;
+		return wordtab[i].token;
 	}
-	J->text = js_intern(J, s);
+	J->text = jsS_internhash(J, s, n, h);
 	return TK_IDENTIFIER;
 }
 
@@ -156,10 +212,102 @@ static int jsY_isdec(int c)
 	return isdigit(c);
 }
 
+/*
+	Input from js_load is lexed from a window that holds the current token
+	and the rest of the last chunk read. The window always ends on a whole
+	character, and not on a CR that may start a CR LF pair, and is followed
+	by a NUL in place of the next byte. So jsY_next only has to look any
+	further when it reads a zero, and tokens lexed in place from the source
+	stay in one piece: everything from lexstart on is kept when the window
+	is full and has to be compacted.
+*/
+
+static int jsY_wholechars(const char *buf, int n)
+{
+	int k, need;
+	unsigned char c;
+	if (n > 0 && buf[n-1] == '\r')
+		return n - 1;
+	for (k = 1; k <= 3 && k <= n; ++k) {
+		c = buf[n-k];
+		if ((c & 0xC0) != 0x80) {
+			need = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+			return need > k ? n - k : n;
+		}
+	}
+	return n;
+}
+
+/* Drop what the lexer is done with, and make room for n more bytes. */
+static void jsY_makeroom(js_State *J, int n)
+{
+	char *old = J->stream.buf;
+	const char *keep = J->lexstart ? J->lexstart : J->lexpos;
+	int drop = keep - old;
+	int last = J->stream.last - old;
+
+	memmove(old, keep, last - drop);
+	last -= drop;
+
+	/* grow when what is kept would fill more than half the window */
+	if (2 * (last + n + 1) > J->stream.cap) {
+		while (2 * (last + n + 1) > J->stream.cap)
+			J->stream.cap *= 2;
+		J->stream.buf = js_realloc(J, old, J->stream.cap);
+	}
+
+	J->stream.end = J->stream.buf + (J->stream.end - old - drop);
+	J->stream.last = J->stream.buf + last;
+	J->lexpos = J->stream.buf + (J->lexpos - old - drop);
+	if (J->lexstart)
+		J->lexstart = J->stream.buf + (J->lexstart - old - drop);
+}
+
+/* Returns 0 at the end of the input. */
+static int jsY_refill(js_State *J)
+{
+	const char *chunk;
+	int size;
+
+	*J->stream.end = J->stream.hold;
+
+	for (;;) {
+		chunk = J->stream.read ? J->stream.read(J, J->stream.data, &size) : NULL;
+		if (!chunk || size <= 0) {
+			J->stream.read = NULL;
+			break;
+		}
+		if (J->stream.last - J->stream.buf + size + 1 > J->stream.cap)
+			jsY_makeroom(J, size);
+		memcpy(J->stream.last, chunk, size);
+		J->stream.last += size;
+		if (jsY_wholechars(J->stream.buf, J->stream.last - J->stream.buf) > J->stream.end - J->stream.buf)
+			break;
+	}
+
+	*J->stream.last = 0;
+	if (J->stream.read) {
+		J->stream.end = J->stream.buf + jsY_wholechars(J->stream.buf, J->stream.last - J->stream.buf);
+	} else if (J->stream.end == J->stream.last) {
+		J->stream.end = NULL;
+		return 0;
+	} else {
+		J->stream.end = J->stream.last;
+	}
+	J->stream.hold = *J->stream.end;
+	*J->stream.end = 0;
+	return 1;
+}
+
 static void jsY_next(js_State *J)
 {
 	Rune c;
+	J->lexpos = J->source;
 	J->source += chartorune(&c, J->source);
+	if (c == 0 && J->lexpos == J->stream.end && jsY_refill(J)) {
+		J->source = J->lexpos;
+		J->source += chartorune(&c, J->source);
+	}
 	/* consume CR LF as one unit */
 	if (c == '\r' && *J->source == '\n')
 		++J->source;
@@ -210,6 +358,16 @@ static void textpush(js_State *J, Rune c)
 	J->lexbuf.len += runetochar(J->lexbuf.text + J->lexbuf.len, &c);
 }
 
+static void textpushspan(js_State *J, const char *s, int n)
+{
+	while (J->lexbuf.len + n > J->lexbuf.cap) {
+		J->lexbuf.cap = J->lexbuf.cap * 2;
+		J->lexbuf.text = js_realloc(J, J->lexbuf.text, J->lexbuf.cap);
+	}
+	memcpy(J->lexbuf.text + J->lexbuf.len, s, n);
+	J->lexbuf.len += n;
+}
+
 static char *textend(js_State *J)
 {
 	textpush(J, 0);
@@ -330,8 +488,6 @@ static int lexnumber(js_State *J)
 
 static int lexnumber(js_State *J)
 {
-	const char *s = J->source - 1;
-
 	if (jsY_accept(J, '0')) {
 		if (jsY_accept(J, 'x') || jsY_accept(J, 'X')) {
 			J->number = lexhex(J);
@@ -370,7 +526,8 @@ static int lexnumber(js_State *J)
 	if (jsY_isidentifierstart(J->lexchar))
 		jsY_error(J, "number with letter suffix");
 
-	J->number = js_strtod(s, NULL);
+	/* from lexstart, which is kept when streamed input is refilled */
+	J->number = js_strtod(J->lexstart, NULL);
 	return TK_NUMBER;
 }
 
@@ -416,14 +573,33 @@ static int lexescape(js_State *J)
 	return 0;
 }
 
+/* Printable ASCII that stands for itself inside a string literal. */
+static int jsY_isplainstring(int c, int q)
+{
+	return ((c >= 0x20 && c < 0x7F) || c == '\t') && c != q && c != '\\';
+}
+
 static int lexstring(js_State *J)
 {
-	const char *s;
+	const char *s, *p;
 
 	int q = J->lexchar;
-	jsY_next(J);
+
+	/* take the leading run without escapes or newlines straight from the source */
+	s = p = J->source;
+	while (jsY_isplainstring(*p, q))
+		++p;
+	if (*p == q) {
+		J->text = jsS_internspan(J, s, p - s);
+		J->source = p + 1;
+		jsY_next(J);
+		return TK_STRING;
+	}
 
 	textinit(J);
+	textpushspan(J, s, p - s);
+	J->source = p;
+	jsY_next(J);
 
 	while (J->lexchar != q) {
 		if (J->lexchar == 0 || J->lexchar == '\n')
@@ -541,11 +717,14 @@ static int jsY_lexx(js_State *J)
 	J->newline = 0;
 
 	while (1) {
-		J->lexline = J->line; /* save location of beginning of token */
-
+		J->lexstart = NULL; /* nothing to keep on a refill */
 		while (jsY_iswhite(J->lexchar))
 			jsY_next(J);
 
+		/* save location of beginning of token */
+		J->lexline = J->line;
+		J->lexstart = J->lexpos;
+
 		if (jsY_accept(J, '\n')) {
 			J->newline = 1;
 			if (isnlthcontext(J->lasttoken))
@@ -555,9 +734,11 @@ static int jsY_lexx(js_State *J)
 
 		if (jsY_accept(J, '/')) {
 			if (jsY_accept(J, '/')) {
+				J->lexstart = NULL;
 				lexlinecomment(J);
 				continue;
 			} else if (jsY_accept(J, '*')) {
+				J->lexstart = NULL;
 				if (lexcomment(J))
 					jsY_error(J, "multi-line comment not terminated");
 				continue;
@@ -693,6 +874,23 @@ static int jsY_lexx(js_State *J)
 			return 0; /* EOF */
 		}
 
+		/* Plain ASCII identifiers are looked up straight from the source */
+		if (J->lexchar < 0x80 && jsY_isidentifierstart(J->lexchar)) {
+			const char *s = J->source - 1;
+			const char *p = J->source;
+			uint32_t h = HASHSTEP(HASHSTART, *s);
+			int tok;
+			while (*(const unsigned char *)p < 0x80 && jsY_isidentifierpart(*p))
+				h = HASHSTEP(h, *p++);
+			/* at the end of a window the name may go on in the next chunk */
+			if (*p != '\\' && *(const unsigned char *)p < 0x80 && p != J->stream.end) {
+				tok = jsY_findkeyword(J, s, p - s, h);
+				J->source = p;
+				jsY_next(J);
+				return tok;
+			}
+		}
+
 		/* Handle \uXXXX escapes in identifiers */
 		jsY_unescape(J);
 		if (jsY_isidentifierstart(J->lexchar)) {
@@ -709,7 +907,8 @@ static int jsY_lexx(js_State *J)
 
 			textend(J);
 
-			return jsY_findkeyword(J, J->lexbuf.text);
+			return jsY_findkeyword(J, J->lexbuf.text, J->lexbuf.len - 1,
+				jsY_hashname(J->lexbuf.text, J->lexbuf.len - 1));
 		}
 
 		if (J->lexchar >= 0x20 && J->lexchar <= 0x7E)
@@ -720,152 +919,43 @@ static int jsY_lexx(js_State *J)
 
 void jsY_initlex(js_State *J, const char *filename, const char *source)
 {
-	J->filename = filename;
-	J->source = source;
-	J->line = 1;
-	J->lasttoken = 0;
-	jsY_next(J); /* load first lookahead character */
+	jsY_initlexat(J, filename, source, 1);
 }
 
-int jsY_lex(js_State *J)
+/* Set up the window for js_load, returns the source to pass to jsY_initlex. */
+const char *jsY_openstream(js_State *J, js_Reader read, void *data)
 {
-	return J->lasttoken = jsY_lexx(J);
-}
-
-static int lexjsonnumber(js_State *J)
-{
-	const char *s = J->source - 1;
-
-	if (J->lexchar == '-')
-		jsY_next(J);
-
-	if (J->lexchar == '0')
-		jsY_next(J);
-	else if (J->lexchar >= '1' && J->lexchar <= '9')
-		while (isdigit(J->lexchar))
-			jsY_next(J);
-	else
-		jsY_error(J, "unexpected non-digit");
-
-	if (jsY_accept(J, '.')) {
-		if (isdigit(J->lexchar))
-			while (isdigit(J->lexchar))
-				jsY_next(J);
-		else
-			jsY_error(J, "missing digits after decimal point");
-	}
-
-	if (jsY_accept(J, 'e') || jsY_accept(J, 'E')) {
-		if (J->lexchar == '-' || J->lexchar == '+')
-			jsY_next(J);
-		if (isdigit(J->lexchar))
-			while (isdigit(J->lexchar))
-				jsY_next(J);
-		else
-			jsY_error(J, "missing digits after exponent indicator");
-	}
-
-	J->number = js_strtod(s, NULL);
-	return TK_NUMBER;
+	J->stream.read = read;
+	J->stream.data = data;
+	J->stream.cap = JS_READSIZE;
+	J->stream.buf = js_malloc(J, J->stream.cap);
+	J->stream.buf[0] = 0;
+	J->stream.end = J->stream.last = J->stream.buf;
+	J->stream.hold = 0;
+	J->lexstart = NULL;
+	return J->stream.buf;
 }
 
-static int lexjsonescape(js_State *J)
+void jsY_closestream(js_State *J)
 {
-	int x = 0;
-
-	/* already consumed '\' */
-
-	switch (J->lexchar) {
-	default: jsY_error(J, "invalid escape sequence");
-	case 'u':
-		jsY_next(J);
-		if (!jsY_ishex(J->lexchar)) return 1; else { x |= jsY_tohex(J->lexchar) << 12; jsY_next(J); }
-		if (!jsY_ishex(J->lexchar)) return 1; else { x |= jsY_tohex(J->lexchar) << 8; jsY_next(J); }
-		if (!jsY_ishex(J->lexchar)) return 1; else { x |= jsY_tohex(J->lexchar) << 4; jsY_next(J); }
-		if (!jsY_ishex(J->lexchar)) return 1; else { x |= jsY_tohex(J->lexchar); jsY_next(J); }
-		textpush(J, x);
-		break;
-	case '"': textpush(J, '"'); jsY_next(J); break;
-	case '\\': textpush(J, '\\'); jsY_next(J); break;
-	case '/': textpush(J, '/'); jsY_next(J); break;
-	case 'b': textpush(J, '\b'); jsY_next(J); break;
-	case 'f': textpush(J, '\f'); jsY_next(J); break;
-	case 'n': textpush(J, '\n'); jsY_next(J); break;
-	case 'r': textpush(J, '\r'); jsY_next(J); break;
-	case 't': textpush(J, '\t'); jsY_next(J); break;
-	}
-	return 0;
+	if (J->stream.buf)
+		js_free(J, J->stream.buf);
+	memset(&J->stream, 0, sizeof J->stream);
 }
 
-static int lexjsonstring(js_State *J)
+/* Start part way into a script, source is on the given line. */
+void jsY_initlexat(js_State *J, const char *filename, const char *source, int line)
 {
-	const char *s;
-
-	textinit(J);
-
-	while (J->lexchar != '"') {
-		if (J->lexchar == 0)
-			jsY_error(J, "unterminated string");
-		else if (J->lexchar < 32)
-			jsY_error(J, "invalid control character in string");
-		else if (jsY_accept(J, '\\'))
-			lexjsonescape(J);
-		else {
-			textpush(J, J->lexchar);
-			jsY_next(J);
-		}
-	}
-	jsY_expect(J, '"');
-
-	s = textend(J);
-
-	J->text = js_intern(J, s);
-	return TK_STRING;
+	J->filename = filename;
+	J->source = source;
+	J->line = line;
+	J->lasttoken = 0;
+	jsY_next(J); /* load first lookahead character */
 }
 
-int jsY_lexjson(js_State *J)
+int jsY_lex(js_State *J)
 {
-	while (1) {
-		J->lexline = J->line; /* save location of beginning of token */
-
-		while (jsY_iswhite(J->lexchar) || J->lexchar == '\n')
-			jsY_next(J);
-
-		if ((J->lexchar >= '0' && J->lexchar <= '9') || J->lexchar == '-')
-			return lexjsonnumber(J);
-
-		switch (J->lexchar) {
-		case ',': jsY_next(J); return ',';
-		case ':': jsY_next(J); return ':';
-		case '[': jsY_next(J); return '[';
-		case ']': jsY_next(J); return ']';
-		case '{': jsY_next(J); return '{';
-		case '}': jsY_next(J); return '}';
-
-		case '"':
-			jsY_next(J);
-			return lexjsonstring(J);
-
-		case 'f':
-			jsY_next(J); jsY_expect(J, 'a'); jsY_expect(J, 'l'); jsY_expect(J, 's'); jsY_expect(J, 'e');
-			return TK_FALSE;
-
-		case 'n':
-			jsY_next(J); jsY_expect(J, 'u'); jsY_expect(J, 'l'); jsY_expect(J, 'l');
-			return TK_NULL;
-
-		case 't':
-			jsY_next(J); jsY_expect(J, 'r'); jsY_expect(J, 'u'); jsY_expect(J, 'e');
-			return TK_TRUE;
-
-		case 0:
-			return 0; /* EOF */
-		}
-
-		if (J->lexchar >= 0x20 && J->lexchar <= 0x7E)
-			jsY_error(J, "unexpected character: '%c'", J->lexchar);
-		jsY_error(J, "unexpected character: \\u%04X", J->lexchar);
-	}
+	return J->lasttoken = jsY_lexx(J);
 }
 
 #else
@@ -875,9 +965,14 @@ const char *jsY_tokenstring(int token)
 	return "<unknown>";
 }
 
-int jsY_findword(const char *s, const char **list, int num)
+int jsY_findreserved(const char *s)
 {
-	return -1;
+	return 0;
+}
+
+void jsY_initlexat(js_State *J, const char *filename, const char *source, int line)
+{
+	js_error(J, "lexer is disabled");
 }
 
 void jsY_initlex(js_State *J, const char *filename, const char *source)
@@ -885,12 +980,16 @@ void jsY_initlex(js_State *J, const char *filename, const char *source)
 	js_error(J, "lexer is disabled");
 }
 
-int jsY_lex(js_State *J)
+const char *jsY_openstream(js_State *J, js_Reader read, void *data)
 {
-	return 0;
+	js_error(J, "lexer is disabled");
 }
 
-int jsY_lexjson(js_State *J)
+void jsY_closestream(js_State *J)
+{
+}
+
+int jsY_lex(js_State *J)
 {
 	return 0;
 }
@@ -72,10 +72,13 @@ int jsY_ishex(int c);
 int jsY_tohex(int c);
 
 const char *jsY_tokenstring(int token);
-int jsY_findword(const char *s, const char **list, int num);
+enum { WORD_FUTURE = 1, WORD_STRICT = 2 };
+int jsY_findreserved(const char *s);
 
 void jsY_initlex(js_State *J, const char *filename, const char *source);
+void jsY_initlexat(js_State *J, const char *filename, const char *source, int line);
+const char *jsY_openstream(js_State *J, js_Reader read, void *data);
+void jsY_closestream(js_State *J);
 int jsY_lex(js_State *J);
-int jsY_lexjson(js_State *J);
 
 #endif
@@ -154,6 +154,27 @@ static void Math_min(js_State *J)
 	js_pushnumber(J, x);
 }
 
+static const js_Method Math_methods[] = {
+	{ "Math.abs", Math_abs, 1 },
+	{ "Math.acos", Math_acos, 1 },
+	{ "Math.asin", Math_asin, 1 },
+	{ "Math.atan", Math_atan, 1 },
+	{ "Math.atan2", Math_atan2, 2 },
+	{ "Math.ceil", Math_ceil, 1 },
+	{ "Math.cos", Math_cos, 1 },
+	{ "Math.exp", Math_exp, 1 },
+	{ "Math.floor", Math_floor, 1 },
+	{ "Math.log", Math_log, 1 },
+	{ "Math.max", Math_max, 0 }, /* 2 */
+	{ "Math.min", Math_min, 0 }, /* 2 */
+	{ "Math.pow", Math_pow, 2 },
+	{ "Math.random", Math_random, 0 },
+	{ "Math.round", Math_round, 1 },
+	{ "Math.sin", Math_sin, 1 },
+	{ "Math.sqrt", Math_sqrt, 1 },
+	{ "Math.tan", Math_tan, 1 },
+};
+
 void jsB_initmath(js_State *J)
 {
 	J->seed = time(NULL);
@@ -169,24 +190,7 @@ void jsB_initmath(js_State *J)
 		jsB_propn(J, "SQRT1_2", 0.7071067811865476);
 		jsB_propn(J, "SQRT2", 1.4142135623730951);
 
-		jsB_propf(J, "Math.abs", Math_abs, 1);
-		jsB_propf(J, "Math.acos", Math_acos, 1);
-		jsB_propf(J, "Math.asin", Math_asin, 1);
-		jsB_propf(J, "Math.atan", Math_atan, 1);
-		jsB_propf(J, "Math.atan2", Math_atan2, 2);
-		jsB_propf(J, "Math.ceil", Math_ceil, 1);
-		jsB_propf(J, "Math.cos", Math_cos, 1);
-		jsB_propf(J, "Math.exp", Math_exp, 1);
-		jsB_propf(J, "Math.floor", Math_floor, 1);
-		jsB_propf(J, "Math.log", Math_log, 1);
-		jsB_propf(J, "Math.max", Math_max, 0); /* 2 */
-		jsB_propf(J, "Math.min", Math_min, 0); /* 2 */
-		jsB_propf(J, "Math.pow", Math_pow, 2);
-		jsB_propf(J, "Math.random", Math_random, 0);
-		jsB_propf(J, "Math.round", Math_round, 1);
-		jsB_propf(J, "Math.sin", Math_sin, 1);
-		jsB_propf(J, "Math.sqrt", Math_sqrt, 1);
-		jsB_propf(J, "Math.tan", Math_tan, 1);
+		jsB_methods(J, Math_methods, nelem(Math_methods));
 	}
 	js_defglobal(J, "Math", JS_DONTENUM);
 }
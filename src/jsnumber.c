@@ -173,18 +173,22 @@ static void Np_toPrecision(js_State *J)
 		numtostr(J, "%.*g", width, self->u.number);
 }
 
+static const js_Method Number_prototype_methods[] = {
+	{ "Number.prototype.valueOf", Np_valueOf, 0 },
+	{ "Number.prototype.toString", Np_toString, 1 },
+	{ "Number.prototype.toLocaleString", Np_toString, 0 },
+	{ "Number.prototype.toFixed", Np_toFixed, 1 },
+	{ "Number.prototype.toExponential", Np_toExponential, 1 },
+	{ "Number.prototype.toPrecision", Np_toPrecision, 1 },
+};
+
 void jsB_initnumber(js_State *J)
 {
 	J->Number_prototype->u.number = 0;
 
 	js_pushobject(J, J->Number_prototype);
 	{
-		jsB_propf(J, "Number.prototype.valueOf", Np_valueOf, 0);
-		jsB_propf(J, "Number.prototype.toString", Np_toString, 1);
-		jsB_propf(J, "Number.prototype.toLocaleString", Np_toString, 0);
-		jsB_propf(J, "Number.prototype.toFixed", Np_toFixed, 1);
-		jsB_propf(J, "Number.prototype.toExponential", Np_toExponential, 1);
-		jsB_propf(J, "Number.prototype.toPrecision", Np_toPrecision, 1);
+		jsB_methods(J, Number_prototype_methods, nelem(Number_prototype_methods));
 	}
 	js_newcconstructor(J, jsB_Number, jsB_new_Number, "Number", 0); /* 1 */
 	{
@@ -42,6 +42,7 @@ static void Op_toString(js_State *J)
 		case JS_CJSON: js_pushconst(J, "[object JSON]"); break;
 		case JS_CARGUMENTS: js_pushconst(J, "[object Arguments]"); break;
 		case JS_CITERATOR: js_pushconst(J, "[Iterator]"); break;
+		case JS_CCOROUTINE: js_pushconst(J, "[object Coroutine]"); break;
 		case JS_CUSERDATA:
 			js_pushconst(J, "[object ");
 			js_pushconst(J, self->u.user.tag);
@@ -114,19 +115,19 @@ static void O_getOwnPropertyDescriptor(js_State *J)
 		js_pushundefined(J);
 	else {
 		js_newobject(J);
-		if (!ref->getter && !ref->setter) {
+		if (!(ref->atts & JS_ACCESSOR)) {
 			js_pushvalue(J, ref->value);
 			js_setproperty(J, -2, "value");
 			js_pushboolean(J, !(ref->atts & JS_READONLY));
 			js_setproperty(J, -2, "writable");
 		} else {
-			if (ref->getter)
-				js_pushobject(J, ref->getter);
+			if (ref->value.u.accessor->getter)
+				js_pushobject(J, ref->value.u.accessor->getter);
 			else
 				js_pushundefined(J);
 			js_setproperty(J, -2, "get");
-			if (ref->setter)
-				js_pushobject(J, ref->setter);
+			if (ref->value.u.accessor->setter)
+				js_pushobject(J, ref->value.u.accessor->setter);
 			else
 				js_pushundefined(J);
 			js_setproperty(J, -2, "set");
@@ -157,6 +158,7 @@ static void O_getOwnPropertyNames(js_State *J)
 	if (!js_isobject(J, 1))
 		js_typeerror(J, "not an object");
 	obj = js_toobject(J, 1);
+	jsV_resolveproperties(J, obj);
 
 	js_newarray(J);
 
@@ -383,6 +385,7 @@ static void O_seal(js_State *J)
 		js_typeerror(J, "not an object");
 
 	obj = js_toobject(J, 1);
+	jsV_resolveproperties(J, obj);
 	obj->extensible = 0;
 
 	if (hashtable_count(obj->properties))
@@ -408,6 +411,7 @@ static void O_isSealed(js_State *J)
 		js_typeerror(J, "not an object");
 
 	obj = js_toobject(J, 1);
+	jsV_resolveproperties(J, obj);
 	if (obj->extensible) {
 		js_pushboolean(J, 0);
 		return;
@@ -434,6 +438,7 @@ static void O_freeze(js_State *J)
 		js_typeerror(J, "not an object");
 
 	obj = js_toobject(J, 1);
+	jsV_resolveproperties(J, obj);
 	obj->extensible = 0;
 
 	if (hashtable_count(obj->properties))
@@ -461,6 +466,7 @@ static void O_isFrozen(js_State *J)
 		js_typeerror(J, "not an object");
 
 	obj = js_toobject(J, 1);
+	jsV_resolveproperties(J, obj);
 
 	if (hashtable_count(obj->properties)) {
 		if (!O_isFrozen_walk(J, obj)) {
@@ -506,33 +512,41 @@ int js_isfrozen(js_State *J)
 	return result;
 }
 
+static const js_Method Object_prototype_methods[] = {
+	{ "Object.prototype.toString", Op_toString, 0 },
+	{ "Object.prototype.toLocaleString", Op_toString, 0 },
+	{ "Object.prototype.valueOf", Op_valueOf, 0 },
+	{ "Object.prototype.hasOwnProperty", Op_hasOwnProperty, 1 },
+	{ "Object.prototype.isPrototypeOf", Op_isPrototypeOf, 1 },
+	{ "Object.prototype.propertyIsEnumerable", Op_propertyIsEnumerable, 1 },
+};
+
+static const js_Method Object_methods[] = {
+	{ "Object.getPrototypeOf", O_getPrototypeOf, 1 },
+	{ "Object.getOwnPropertyDescriptor", O_getOwnPropertyDescriptor, 2 },
+	{ "Object.getOwnPropertyNames", O_getOwnPropertyNames, 1 },
+	{ "Object.create", O_create, 2 },
+	{ "Object.defineProperty", O_defineProperty, 3 },
+	{ "Object.defineProperties", O_defineProperties, 2 },
+	{ "Object.seal", O_seal, 1 },
+	{ "Object.freeze", O_freeze, 1 },
+	{ "Object.preventExtensions", O_preventExtensions, 1 },
+	{ "Object.isSealed", O_isSealed, 1 },
+	{ "Object.isFrozen", O_isFrozen, 1 },
+	{ "Object.isExtensible", O_isExtensible, 1 },
+	{ "Object.keys", O_keys, 1 },
+};
+
 void jsB_initobject(js_State *J)
 {
 	js_pushobject(J, J->Object_prototype);
 	{
-		jsB_propf(J, "Object.prototype.toString", Op_toString, 0);
-		jsB_propf(J, "Object.prototype.toLocaleString", Op_toString, 0);
-		jsB_propf(J, "Object.prototype.valueOf", Op_valueOf, 0);
-		jsB_propf(J, "Object.prototype.hasOwnProperty", Op_hasOwnProperty, 1);
-		jsB_propf(J, "Object.prototype.isPrototypeOf", Op_isPrototypeOf, 1);
-		jsB_propf(J, "Object.prototype.propertyIsEnumerable", Op_propertyIsEnumerable, 1);
+		jsB_methods(J, Object_prototype_methods, nelem(Object_prototype_methods));
 	}
 	js_newcconstructor(J, jsB_Object, jsB_new_Object, "Object", 1);
 	{
 		/* ES5 */
-		jsB_propf(J, "Object.getPrototypeOf", O_getPrototypeOf, 1);
-		jsB_propf(J, "Object.getOwnPropertyDescriptor", O_getOwnPropertyDescriptor, 2);
-		jsB_propf(J, "Object.getOwnPropertyNames", O_getOwnPropertyNames, 1);
-		jsB_propf(J, "Object.create", O_create, 2);
-		jsB_propf(J, "Object.defineProperty", O_defineProperty, 3);
-		jsB_propf(J, "Object.defineProperties", O_defineProperties, 2);
-		jsB_propf(J, "Object.seal", O_seal, 1);
-		jsB_propf(J, "Object.freeze", O_freeze, 1);
-		jsB_propf(J, "Object.preventExtensions", O_preventExtensions, 1);
-		jsB_propf(J, "Object.isSealed", O_isSealed, 1);
-		jsB_propf(J, "Object.isFrozen", O_isFrozen, 1);
-		jsB_propf(J, "Object.isExtensible", O_isExtensible, 1);
-		jsB_propf(J, "Object.keys", O_keys, 1);
+		jsB_methods(J, Object_methods, nelem(Object_methods));
 	}
 	js_defglobal(J, "Object", JS_DONTENUM);
 }
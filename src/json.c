@@ -5,90 +5,364 @@
 
 #include "utf.h"
 
-static void jsonnext(js_State *J)
+/*
+	JSON.parse reads the text in one pass, straight from the string it is
+	given. String bodies are skipped eight bytes at a time up to the next
+	quote, backslash or control character, and only strings with escapes
+	are copied before they are pushed. Values are not interned; member
+	names are, as properties keep interned names. New objects and arrays
+	have no setters to call, so members go in through jsV_addownproperty.
+*/
+
+struct jsontext { const char *start, *p, *end; };
+
+static void jsonerror(js_State *J, struct jsontext *T, const char *fmt, ...)
 {
-	J->lookahead = jsY_lexjson(J);
+	va_list ap;
+	char msgbuf[256];
+	const char *s;
+	int line = 1;
+
+	va_start(ap, fmt);
+	vsnprintf(msgbuf, sizeof msgbuf, fmt, ap);
+	va_end(ap);
+
+	for (s = T->start; s < T->p; ++s)
+		if (*s == '\n')
+			++line;
+	js_syntaxerror(J, "JSON:%d: %s", line, msgbuf);
 }
 
-static int jsonaccept(js_State *J, int t)
+static void jsonwhite(struct jsontext *T)
 {
-	if (J->lookahead == t) {
-		jsonnext(J);
-		return 1;
+	const char *p = T->p;
+	Rune c;
+	for (;;) {
+		if (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t' || *p == '\v' || *p == '\f')
+			++p;
+		else if (*(const unsigned char *)p >= Runeself) {
+			int n = chartorune(&c, p);
+			if (!jsY_iswhite(c))
+				break;
+			p += n;
+		} else
+			break;
+	}
+	T->p = p;
+}
+
+static void jsonword(js_State *J, struct jsontext *T, const char *word)
+{
+	int i;
+	for (i = 1; word[i]; ++i) {
+		if (T->p[i] != word[i]) {
+			T->p += i;
+			jsonerror(J, T, "expected '%c'", word[i]);
+		}
 	}
+	T->p += i;
+}
+
+/* The token at T->p, for error messages */
+static int jsontoken(js_State *J, struct jsontext *T)
+{
+	Rune c;
+	switch (*T->p) {
+	case 0: return 0;
+	case '"': return TK_STRING;
+	case '-': case '0': case '1': case '2': case '3': case '4':
+	case '5': case '6': case '7': case '8': case '9': return TK_NUMBER;
+	case ',': case ':': case '[': case ']': case '{': case '}': return *T->p;
+	case 't': jsonword(J, T, "true"); return TK_TRUE;
+	case 'f': jsonword(J, T, "false"); return TK_FALSE;
+	case 'n': jsonword(J, T, "null"); return TK_NULL;
+	}
+	chartorune(&c, T->p);
+	if (c >= 0x20 && c <= 0x7E)
+		jsonerror(J, T, "unexpected character: '%c'", c);
+	jsonerror(J, T, "unexpected character: \\u%04X", c);
 	return 0;
 }
 
-static void jsonexpect(js_State *J, int t)
+static void jsonunexpected(js_State *J, struct jsontext *T, const char *expected)
+{
+	int t = jsontoken(J, T);
+	if (expected)
+		js_syntaxerror(J, "JSON: unexpected token: %s (expected %s)", jsY_tokenstring(t), expected);
+	js_syntaxerror(J, "JSON: unexpected token: %s", jsY_tokenstring(t));
+}
+
+static void jsonexpect(js_State *J, struct jsontext *T, int c)
+{
+	if (*T->p != c)
+		jsonunexpected(J, T, jsY_tokenstring(c));
+	++T->p;
+}
+
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+#define HASLESS(v, n) (((v) - ONES * (n)) & ~(v) & HIGHS)
+#define HASBYTE(v, c) HASLESS((v) ^ (ONES * (c)), 1)
+
+/* Skip characters that stand for themselves, eight at a time while the text lasts. */
+static const char *jsonplain(const char *p, const char *end, int *isunicode)
+{
+	uint64_t v, seen = 0;
+	while (end - p >= 8) {
+		memcpy(&v, p, 8);
+		if (HASLESS(v, 0x20) | HASBYTE(v, '"') | HASBYTE(v, '\\'))
+			break;
+		seen |= v;
+		p += 8;
+	}
+	while (*(const unsigned char *)p >= 0x20 && *p != '"' && *p != '\\')
+		seen |= *(const unsigned char *)p++;
+	if (seen & HIGHS)
+		*isunicode = 1;
+	return p;
+}
+
+static void jsonroom(js_State *J, int n)
+{
+	if (J->lexbuf.len + n > J->lexbuf.cap) {
+		int cap = J->lexbuf.cap ? J->lexbuf.cap : 4096;
+		while (J->lexbuf.len + n > cap)
+			cap *= 2;
+		J->lexbuf.text = js_realloc(J, J->lexbuf.text, cap);
+		J->lexbuf.cap = cap;
+	}
+}
+
+/*
+	Scan a string from after its opening quote. The text is left in place
+	if it has no escapes and is decoded into J->lexbuf if it has.
+*/
+static const char *jsonstring(js_State *J, struct jsontext *T, int *size, int *isunicode)
 {
-	if (!jsonaccept(J, t))
-		js_syntaxerror(J, "JSON: unexpected token: %s (expected %s)",
-				jsY_tokenstring(J->lookahead), jsY_tokenstring(t));
+	const char *s = T->p;
+	const char *p, *z;
+	Rune c;
+	int x;
+
+	*isunicode = 0;
+	p = jsonplain(s, T->end, isunicode);
+	if (*p == '"') {
+		*size = p - s;
+		T->p = p + 1;
+		return s;
+	}
+
+	J->lexbuf.len = 0;
+	for (;;) {
+		jsonroom(J, p - s + UTFmax);
+		memcpy(J->lexbuf.text + J->lexbuf.len, s, p - s);
+		J->lexbuf.len += p - s;
+		if (*p == '"')
+			break;
+		if (*p == 0)
+			jsonerror(J, T, "unterminated string");
+		if (*p != '\\')
+			jsonerror(J, T, "invalid control character in string");
+		switch (p[1]) {
+		case '"': c = '"'; break;
+		case '\\': c = '\\'; break;
+		case '/': c = '/'; break;
+		case 'b': c = '\b'; break;
+		case 'f': c = '\f'; break;
+		case 'n': c = '\n'; break;
+		case 'r': c = '\r'; break;
+		case 't': c = '\t'; break;
+		case 'u':
+			for (c = 0, x = 2; x < 6; ++x) {
+				if (!jsY_ishex(p[x]))
+					jsonerror(J, T, "invalid escape sequence");
+				c = (c << 4) | jsY_tohex(p[x]);
+			}
+			p += 4;
+			break;
+		default:
+			jsonerror(J, T, "invalid escape sequence");
+		}
+		p += 2;
+		J->lexbuf.len += runetochar(J->lexbuf.text + J->lexbuf.len, &c);
+		if (c >= Runeself)
+			*isunicode = 1;
+		s = p;
+		p = jsonplain(s, T->end, isunicode);
+	}
+
+	/* strings end at an escaped NUL, as they do in the script lexer */
+	z = memchr(J->lexbuf.text, 0, J->lexbuf.len);
+	*size = z ? z - J->lexbuf.text : J->lexbuf.len;
+	T->p = p + 1;
+	return J->lexbuf.text;
 }
 
-static void jsonvalue(js_State *J)
+/* Intern a member name and return its property hash */
+static const char *jsonname(js_State *J, const char *s, int n, uint64_t *hash)
 {
+	uint64_t h = 5381;
 	int i;
-	const char *name;
+	for (i = 0; i < n; ++i)
+		h = ((h << 5) + h) + s[i]; /* as jsU_tostrhash */
+	*hash = h;
+	return jsS_internhash(J, s, n, h);
+}
 
-	switch (J->lookahead) {
-	case TK_STRING:
-		js_pushstring(J, J->text);
-		jsonnext(J);
-		break;
+#define ISDIGIT(c) ((c) >= '0' && (c) <= '9')
 
-	case TK_NUMBER:
-		js_pushnumber(J, J->number);
-		jsonnext(J);
-		break;
+static void jsonnumber(js_State *J, struct jsontext *T)
+{
+	const char *s = T->p;
+	const char *p = s;
+	const char *digits;
+	double n = 0;
+
+	if (*p == '-')
+		++p;
+	digits = p;
+	if (*p == '0')
+		++p;
+	else if (*p >= '1' && *p <= '9')
+		while (ISDIGIT(*p))
+			n = n * 10 + (*p++ - '0');
+	else
+		jsonerror(J, T, "unexpected non-digit");
+
+	/* integers of up to 15 digits are exact as summed, others go to strtod */
+	if (*p == '.' || *p == 'e' || *p == 'E' || p - digits > 15) {
+		if (*p == '.') {
+			++p;
+			if (!ISDIGIT(*p))
+				jsonerror(J, T, "missing digits after decimal point");
+			while (ISDIGIT(*p))
+				++p;
+		}
+		if (*p == 'e' || *p == 'E') {
+			if (*++p == '-' || *p == '+')
+				++p;
+			if (!ISDIGIT(*p))
+				jsonerror(J, T, "missing digits after exponent indicator");
+			while (ISDIGIT(*p))
+				++p;
+		}
+		n = js_strtod(s, NULL);
+	} else if (digits != s) {
+		n = -n;
+	}
+
+	T->p = p;
+	js_pushnumber(J, n);
+}
+
+static void jsonvalue(js_State *J, struct jsontext *T);
+
+static void jsonobject(js_State *J, struct jsontext *T)
+{
+	js_Object *obj;
+	js_Property *ref;
+	const char *s, *name;
+	uint64_t hash;
+	int n, isunicode;
+
+	js_newobject(J);
+	obj = js_toobject(J, -1);
+	++T->p;
+	jsonwhite(T);
+	if (*T->p == '}') {
+		++T->p;
+		return;
+	}
+	for (;;) {
+		if (*T->p != '"')
+			jsonunexpected(J, T, "string");
+		++T->p;
+		s = jsonstring(J, T, &n, &isunicode);
+		name = jsonname(J, s, n, &hash);
+		jsonwhite(T);
+		jsonexpect(J, T, ':');
+		jsonvalue(J, T);
+		ref = jsV_addownproperty(J, obj, name, hash);
+		ref->value = *js_tovalue(J, -1);
+		js_pop(J, 1);
+		jsonwhite(T);
+		if (*T->p != ',')
+			break;
+		++T->p;
+		jsonwhite(T);
+	}
+	jsonexpect(J, T, '}');
+}
 
+static void jsonarray(js_State *J, struct jsontext *T)
+{
+	js_Object *obj;
+	js_Property *ref;
+	const char *name;
+	char buf[32];
+	uint64_t hash;
+	int i = 0;
+
+	js_newarray(J);
+	obj = js_toobject(J, -1);
+	++T->p;
+	jsonwhite(T);
+	if (*T->p == ']') {
+		++T->p;
+		return;
+	}
+	for (;;) {
+		jsonvalue(J, T);
+		name = js_itoa(buf, i);
+		name = jsonname(J, name, strlen(name), &hash);
+		ref = jsV_addownproperty(J, obj, name, hash);
+		ref->value = *js_tovalue(J, -1);
+		js_pop(J, 1);
+		obj->u.a.length = ++i;
+		jsonwhite(T);
+		if (*T->p != ',')
+			break;
+		++T->p;
+	}
+	jsonexpect(J, T, ']');
+}
+
+static void jsonvalue(js_State *J, struct jsontext *T)
+{
+	const char *s;
+	int n, isunicode;
+
+	jsonwhite(T);
+	switch (*T->p) {
 	case '{':
-		js_newobject(J);
-		jsonnext(J);
-		if (jsonaccept(J, '}'))
-			return;
-		do {
-			if (J->lookahead != TK_STRING)
-				js_syntaxerror(J, "JSON: unexpected token: %s (expected string)", jsY_tokenstring(J->lookahead));
-			name = J->text;
-			jsonnext(J);
-			jsonexpect(J, ':');
-			jsonvalue(J);
-			js_setproperty(J, -2, name);
-		} while (jsonaccept(J, ','));
-		jsonexpect(J, '}');
+		jsonobject(J, T);
 		break;
-
 	case '[':
-		js_newarray(J);
-		jsonnext(J);
-		i = 0;
-		if (jsonaccept(J, ']'))
-			return;
-		do {
-			jsonvalue(J);
-			js_setindex(J, -2, i++);
-		} while (jsonaccept(J, ','));
-		jsonexpect(J, ']');
+		jsonarray(J, T);
 		break;
-
-	case TK_TRUE:
+	case '"':
+		++T->p;
+		s = jsonstring(J, T, &n, &isunicode);
+		js_pushlstringu(J, s, n, isunicode);
+		break;
+	case '-': case '0': case '1': case '2': case '3': case '4':
+	case '5': case '6': case '7': case '8': case '9':
+		jsonnumber(J, T);
+		break;
+	case 't':
+		jsonword(J, T, "true");
 		js_pushboolean(J, 1);
-		jsonnext(J);
 		break;
-
-	case TK_FALSE:
+	case 'f':
+		jsonword(J, T, "false");
 		js_pushboolean(J, 0);
-		jsonnext(J);
 		break;
-
-	case TK_NULL:
+	case 'n':
+		jsonword(J, T, "null");
 		js_pushnull(J);
-		jsonnext(J);
 		break;
-
 	default:
-		js_syntaxerror(J, "JSON: unexpected token: %s", jsY_tokenstring(J->lookahead));
+		jsonunexpected(J, T, NULL);
 	}
 }
 
@@ -142,131 +416,217 @@ static void jsonrevive(js_State *J, const char *name)
 
 static void JSON_parse(js_State *J)
 {
-	const char *source = js_tostring(J, 1);
-	jsY_initlex(J, "JSON", source);
-	jsonnext(J);
+	struct jsontext T;
+	T.start = T.p = js_tostring(J, 1);
+	T.end = T.start + strlen(T.start);
 
 	if (js_iscallable(J, 2)) {
 		js_newobject(J);
-		jsonvalue(J);
+		jsonvalue(J, &T);
 		js_defproperty(J, -2, "", 0);
-		jsonrevive(J, "");
 	} else {
-		jsonvalue(J);
+		jsonvalue(J, &T);
 	}
+
+	jsonwhite(&T);
+	if (*T.p)
+		jsonunexpected(J, &T, jsY_tokenstring(0));
+
+	if (js_iscallable(J, 2))
+		jsonrevive(J, "");
 }
 
-void fmtnum(js_State *J, js_StringBuffer **sb, double n)
+/*
+	JSON.stringify and the host API share one serializer. It keeps a frame
+	for each open object and array instead of recursing, with the array,
+	or the object and its iterator, on the value stack, so it can stop
+	after any member and go on later. Output goes to a buffer: JSON.stringify makes a string
+	of it, js_stringify hands it to the host every JS_WRITESIZE bytes, and
+	js_readstringifier fills it only as far as the host reads. Flushed
+	text can not be taken back, so each member is checked for a JSON form
+	before its name is written.
+
+	Cycles are found by scanning the outermost FMTSCAN frames and looking
+	the deeper ones up in an open addressing table, which is only cleared
+	once a value nests that deep. Objects leave the table in the reverse
+	order they came in, so a slot can simply be emptied: anything that
+	probed past it came in later and has already left.
+*/
+
+#define FMTSCAN 16
+#define FMTSEEN (2 * JS_STACKSIZE) /* twice the most frames, and a power of two */
+
+struct jsonframe { js_Object *obj; int isarray, index, length, count, slot; };
+
+struct js_Stringifier
 {
-	if (isnan(n)) js_puts(J, sb, "null");
-	else if (isinf(n)) js_puts(J, sb, "null");
-	else if (n == 0) js_puts(J, sb, "0");
-	else {
-		char buf[40];
-		js_puts(J, sb, jsV_numbertostring(J, buf, n));
-	}
+	js_Writer write;
+	void *data;
+	char *buf;
+	int start, n, cap; /* unread output is buf[start..n] */
+	char gapbuf[11];
+	const char *gap;
+	int replacer; /* stack index of the replacer function, or 0 */
+	const char *ref; /* registry array holding the open frames between reads */
+	int started, failed;
+	int depth;
+	int hashed; /* seen has been cleared */
+	struct jsonframe frame[JS_STACKSIZE];
+	js_Object *seen[FMTSEEN];
+};
+
+static void fmtinit(js_Stringifier *S, const char *gap, js_Writer write, void *data)
+{
+	int n = gap ? strlen(gap) : 0;
+	memset(S, 0, offsetof(js_Stringifier, frame));
+	S->write = write;
+	S->data = data;
+	if (n > 10) n = 10;
+	if (n > 0)
+		memcpy(S->gapbuf, gap, n);
+	S->gapbuf[n] = 0;
+	S->gap = n > 0 ? S->gapbuf : NULL;
 }
 
-static void fmtstr(js_State *J, js_StringBuffer **sb, const char *s)
+static void fmtflush(js_State *J, js_Stringifier *S)
 {
-	static const char *HEX = "0123456789ABCDEF";
-	Rune c;
-	js_putc(J, sb, '"');
-	while (*s) {
-		s += chartorune(&c, s);
-		switch (c) {
-		case '"': js_puts(J, sb, "\\\""); break;
-		case '\\': js_puts(J, sb, "\\\\"); break;
-		case '\b': js_puts(J, sb, "\\b"); break;
-		case '\f': js_puts(J, sb, "\\f"); break;
-		case '\n': js_puts(J, sb, "\\n"); break;
-		case '\r': js_puts(J, sb, "\\r"); break;
-		case '\t': js_puts(J, sb, "\\t"); break;
-		default:
-			if (c < ' ' || c > 127) {
-				js_puts(J, sb, "\\u");
-				js_putc(J, sb, HEX[(c>>12)&15]);
-				js_putc(J, sb, HEX[(c>>8)&15]);
-				js_putc(J, sb, HEX[(c>>4)&15]);
-				js_putc(J, sb, HEX[c&15]);
-			} else {
-				js_putc(J, sb, c); break;
+	if (S->n > 0)
+		S->write(J, S->data, S->buf, S->n);
+	S->n = 0;
+}
+
+static void fmtputs(js_State *J, js_Stringifier *S, const char *s, int n)
+{
+	if (S->n + n > S->cap) {
+		if (S->write) {
+			fmtflush(J, S);
+			if (n >= S->cap) {
+				S->write(J, S->data, s, n);
+				return;
 			}
+		} else {
+			int cap = S->cap ? S->cap : 256;
+			while (S->n + n > cap)
+				cap *= 2;
+			S->buf = js_realloc(J, S->buf, cap);
+			S->cap = cap;
 		}
 	}
-	js_putc(J, sb, '"');
+	memcpy(S->buf + S->n, s, n);
+	S->n += n;
 }
 
-static void fmtindent(js_State *J, js_StringBuffer **sb, const char *gap, int level)
+static void fmtputc(js_State *J, js_Stringifier *S, int c)
 {
-	js_putc(J, sb, '\n');
-	while (level--)
-		js_puts(J, sb, gap);
+	char ch = c;
+	if (S->n < S->cap)
+		S->buf[S->n++] = ch;
+	else
+		fmtputs(J, S, &ch, 1);
 }
 
-static int fmtvalue(js_State *J, js_StringBuffer **sb, const char *key, const char *gap, int level);
+static const char digitpairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
 
-static void fmtobject(js_State *J, js_StringBuffer **sb, js_Object *obj, const char *gap, int level)
+/*
+	Write n as JSON to buf and return the length. Integers below 2^53 are
+	written two digits at a time, the others go through jsV_numbertostring.
+*/
+static int fmtnumber(js_State *J, char buf[32], double n)
 {
-	const char *key;
-	int save;
-	int i, n;
+	char digits[24], *p = digits + sizeof digits;
+	const char *s;
+	uint64_t u;
+	int len;
+
+	if (isnan(n) || isinf(n)) {
+		memcpy(buf, "null", 4);
+		return 4;
+	}
 
-	n = js_gettop(J) - 1;
-	for (i = 4; i < n; ++i)
-		if (js_isobject(J, i))
-			if (js_toobject(J, i) == js_toobject(J, -1))
-				js_typeerror(J, "cyclic object value");
+	if (n > -9007199254740992.0 && n < 9007199254740992.0 && (double)(int64_t)n == n) {
+		u = n < 0 ? -(int64_t)n : (int64_t)n;
+		while (u >= 100) {
+			p -= 2;
+			memcpy(p, digitpairs + u % 100 * 2, 2);
+			u /= 100;
+		}
+		if (u >= 10) {
+			p -= 2;
+			memcpy(p, digitpairs + u * 2, 2);
+		} else {
+			*--p = '0' + u;
+		}
+		if (n < 0)
+			*--p = '-';
+		len = digits + sizeof digits - p;
+		memcpy(buf, p, len);
+		return len;
+	}
 
-	n = 0;
-	js_putc(J, sb, '{');
-	js_pushiterator(J, -1, 1);
-	while ((key = js_nextiterator(J, -1))) {
-		save = (*sb)->n;
-		if (n) js_putc(J, sb, ',');
-		if (gap) fmtindent(J, sb, gap, level + 1);
-		fmtstr(J, sb, key);
-		js_putc(J, sb, ':');
-		if (gap)
-			js_putc(J, sb, ' ');
-		js_rot2(J);
-		if (!fmtvalue(J, sb, key, gap, level + 1))
-			(*sb)->n = save;
-		else
-			++n;
-		js_rot2(J);
-	}
-	js_pop(J, 1);
-	if (gap && n) fmtindent(J, sb, gap, level);
-	js_putc(J, sb, '}');
-}
-
-static void fmtarray(js_State *J, js_StringBuffer **sb, const char *gap, int level)
-{
-	int n, i;
+	s = jsV_numbertostring(J, buf, n);
+	len = strlen(s);
+	if (s != buf)
+		memcpy(buf, s, len);
+	return len;
+}
+
+void fmtnum(js_State *J, js_StringBuffer **sb, double n)
+{
 	char buf[32];
+	js_putm(J, sb, buf, buf + fmtnumber(J, buf, n));
+}
 
-	n = js_gettop(J) - 1;
-	for (i = 4; i < n; ++i)
-		if (js_isobject(J, i))
-			if (js_toobject(J, i) == js_toobject(J, -1))
-				js_typeerror(J, "cyclic object value");
+static void fmtstr(js_State *J, js_Stringifier *S, const char *s)
+{
+	static const char *HEX = "0123456789ABCDEF";
+	const char *run;
+	char esc[6] = { '\\', 'u' };
+	Rune c;
 
-	js_putc(J, sb, '[');
-	n = js_getlength(J, -1);
-	for (i = 0; i < n; ++i) {
-		if (i) js_putc(J, sb, ',');
-		if (gap) fmtindent(J, sb, gap, level + 1);
-		if (!fmtvalue(J, sb, js_itoa(buf, i), gap, level + 1))
-			js_puts(J, sb, "null");
+	fmtputc(J, S, '"');
+	for (;;) {
+		run = s;
+		while (*(const unsigned char *)s >= ' ' && *(const unsigned char *)s < Runeself && *s != '"' && *s != '\\')
+			++s;
+		fmtputs(J, S, run, s - run);
+		if (!*s)
+			break;
+		s += chartorune(&c, s);
+		switch (c) {
+		case '"': fmtputs(J, S, "\\\"", 2); break;
+		case '\\': fmtputs(J, S, "\\\\", 2); break;
+		case '\b': fmtputs(J, S, "\\b", 2); break;
+		case '\f': fmtputs(J, S, "\\f", 2); break;
+		case '\n': fmtputs(J, S, "\\n", 2); break;
+		case '\r': fmtputs(J, S, "\\r", 2); break;
+		case '\t': fmtputs(J, S, "\\t", 2); break;
+		default:
+			esc[2] = HEX[(c>>12)&15];
+			esc[3] = HEX[(c>>8)&15];
+			esc[4] = HEX[(c>>4)&15];
+			esc[5] = HEX[c&15];
+			fmtputs(J, S, esc, 6);
+		}
 	}
-	if (gap && n) fmtindent(J, sb, gap, level);
-	js_putc(J, sb, ']');
+	fmtputc(J, S, '"');
+}
+
+static void fmtindent(js_State *J, js_Stringifier *S, int level)
+{
+	fmtputc(J, S, '\n');
+	while (level--)
+		fmtputs(J, S, S->gap, strlen(S->gap));
 }
 
-static int fmtvalue(js_State *J, js_StringBuffer **sb, const char *key, const char *gap, int level)
+/*
+	Push the member key of the holder on top of the stack, after toJSON and
+	the replacer. Returns 0 if the member has no JSON form.
+*/
+static int fmtresolve(js_State *J, js_Stringifier *S, const char *key)
 {
-	/* replacer is in 2 */
 	/* holder is in -1 */
 
 	js_getproperty(J, -1, key);
@@ -284,8 +644,8 @@ static int fmtvalue(js_State *J, js_StringBuffer **sb, const char *key, const ch
 		}
 	}
 
-	if (js_iscallable(J, 2)) {
-		js_copy(J, 2); /* replacer function */
+	if (S->replacer) {
+		js_copy(J, S->replacer); /* replacer function */
 		js_copy(J, -3); /* holder as this */
 		js_pushstring(J, key); /* name */
 		js_copy(J, -4); /* old value */
@@ -293,84 +653,321 @@ static int fmtvalue(js_State *J, js_StringBuffer **sb, const char *key, const ch
 		js_rot2pop1(J); /* pop old value, leave new value on stack */
 	}
 
-	if (js_isobject(J, -1) && !js_iscallable(J, -1)) {
+	if (js_isobject(J, -1))
+		return !js_iscallable(J, -1);
+	return js_isboolean(J, -1) || js_isnumber(J, -1) || js_isstring(J, -1) || js_isnull(J, -1);
+}
+
+static void fmtopen(js_State *J, js_Stringifier *S, js_Object *obj, int isarray)
+{
+	struct jsonframe *F;
+	int i, slot = -1;
+
+	for (i = 0; i < S->depth && i < FMTSCAN; ++i)
+		if (S->frame[i].obj == obj)
+			js_typeerror(J, "cyclic object value");
+	if (S->depth == (int)nelem(S->frame))
+		js_rangeerror(J, "JSON: too deeply nested");
+
+	if (S->depth >= FMTSCAN) {
+		if (!S->hashed) {
+			memset(S->seen, 0, sizeof S->seen);
+			S->hashed = 1;
+		}
+		slot = ((uint32_t)((uintptr_t)obj >> 4) * 2654435769u) % FMTSEEN;
+		for (; S->seen[slot]; slot = (slot + 1) % FMTSEEN)
+			if (S->seen[slot] == obj)
+				js_typeerror(J, "cyclic object value");
+		S->seen[slot] = obj;
+	}
+
+	/* the object takes the place of its holder, with its iterator above it */
+	js_rot2pop1(J);
+	F = &S->frame[S->depth++];
+	F->obj = obj;
+	F->isarray = isarray;
+	F->index = F->count = 0;
+	F->slot = slot;
+	if (isarray)
+		F->length = js_getlength(J, -1);
+	else
+		js_pushiterator(J, -1, 1);
+	fmtputc(J, S, isarray ? '[' : '{');
+}
+
+/* Write the resolved value on top of the stack and pop it with its holder, or open it. */
+static void fmtvalue(js_State *J, js_Stringifier *S)
+{
+	char buf[32];
+
+	if (js_isobject(J, -1)) {
 		js_Object *obj = js_toobject(J, -1);
 		switch (obj->type) {
-		case JS_CNUMBER: fmtnum(J, sb, obj->u.number); break;
-		case JS_CSTRING: fmtstr(J, sb, obj->u.string.u.ptr8); break;
-		case JS_CBOOLEAN: js_puts(J, sb, obj->u.boolean ? "true" : "false"); break;
-		case JS_CARRAY: fmtarray(J, sb, gap, level); break;
-		default: fmtobject(J, sb, obj, gap, level); break;
+		case JS_CNUMBER: fmtputs(J, S, buf, fmtnumber(J, buf, obj->u.number)); break;
+		case JS_CSTRING: fmtstr(J, S, obj->u.string.u.ptr8); break;
+		case JS_CBOOLEAN: fmtputs(J, S, obj->u.boolean ? "true" : "false", obj->u.boolean ? 4 : 5); break;
+		case JS_CARRAY: fmtopen(J, S, obj, 1); return;
+		default: fmtopen(J, S, obj, 0); return;
 		}
 	}
 	else if (js_isboolean(J, -1))
-		js_puts(J, sb, js_toboolean(J, -1) ? "true" : "false");
+		fmtputs(J, S, js_toboolean(J, -1) ? "true" : "false", js_toboolean(J, -1) ? 4 : 5);
 	else if (js_isnumber(J, -1))
-		fmtnum(J, sb, js_tonumber(J, -1));
+		fmtputs(J, S, buf, fmtnumber(J, buf, js_tonumber(J, -1)));
 	else if (js_isstring(J, -1))
-		fmtstr(J, sb, js_tostring(J, -1));
-	else if (js_isnull(J, -1))
-		js_puts(J, sb, "null");
-	else {
-		js_pop(J, 1);
-		return 0;
+		fmtstr(J, S, js_tostring(J, -1));
+	else
+		fmtputs(J, S, "null", 4);
+
+	js_pop(J, 2);
+}
+
+static void fmtseparator(js_State *J, js_Stringifier *S, struct jsonframe *F)
+{
+	if (F->count++)
+		fmtputc(J, S, ',');
+	if (S->gap)
+		fmtindent(J, S, S->depth);
+}
+
+/* The own data property at index i of an array, if it holds a primitive. */
+static js_Property *fmtelement(js_State *J, js_Object *obj, int i)
+{
+	js_Property *ref = jsV_getownindex(J, obj, i);
+	if (ref && !(ref->atts & JS_ACCESSOR) && ref->value.type != JS_TOBJECT)
+		return ref;
+	return NULL;
+}
+
+/* Write the next member of the innermost open object or array, or close it. */
+static void fmtnext(js_State *J, js_Stringifier *S)
+{
+	struct jsonframe *F = &S->frame[S->depth - 1];
+	const char *key;
+	char buf[32];
+
+	/* array is in -1, or object in -2 and its iterator in -1 */
+
+	/* primitives have no toJSON, so without a replacer they go straight out */
+	if (F->isarray && !S->replacer && F->index < F->length) {
+		js_Property *ref = fmtelement(J, F->obj, F->index);
+		if (ref) {
+			js_Value v = ref->value;
+			js_Value *vp = &v;
+			F->index++;
+			fmtseparator(J, S, F);
+			switch (v.type) {
+			case JS_TBOOLEAN: fmtputs(J, S, v.u.boolean ? "true" : "false", v.u.boolean ? 4 : 5); break;
+			case JS_TINTEGER: fmtputs(J, S, buf, fmtnumber(J, buf, v.u.integer)); break;
+			case JS_TNUMBER: fmtputs(J, S, buf, fmtnumber(J, buf, v.u.number)); break;
+			case JS_TUNDEFINED: case JS_TNULL: fmtputs(J, S, "null", 4); break;
+			default: fmtstr(J, S, jsU_valtocstr(vp)); break;
+			}
+			return;
+		}
+	}
+
+	for (;;) {
+		if (F->isarray) {
+			if (F->index >= F->length)
+				break;
+			key = js_itoa(buf, F->index++);
+		} else if (!(key = js_nextiterator(J, -1))) {
+			break;
+		}
+
+		js_copy(J, F->isarray ? -1 : -2);
+		if (!fmtresolve(J, S, key)) {
+			js_pop(J, 2);
+			if (!F->isarray)
+				continue;
+			fmtseparator(J, S, F);
+			fmtputs(J, S, "null", 4);
+			return;
+		}
+
+		fmtseparator(J, S, F);
+		if (!F->isarray) {
+			fmtstr(J, S, key);
+			fmtputc(J, S, ':');
+			if (S->gap)
+				fmtputc(J, S, ' ');
+		}
+		fmtvalue(J, S);
+		return;
 	}
 
-	js_pop(J, 1);
+	--S->depth;
+	if (F->slot >= 0)
+		S->seen[F->slot] = NULL;
+	if (S->gap && F->count)
+		fmtindent(J, S, S->depth);
+	fmtputc(J, S, F->isarray ? ']' : '}');
+	js_pop(J, F->isarray ? 1 : 2);
+}
+
+/* Start on the value on top of the stack, which is popped. Returns 0 if it has no JSON form. */
+static int fmtbegin(js_State *J, js_Stringifier *S)
+{
+	js_newobject(J); /* wrapper */
+	js_rot2(J);
+	js_defproperty(J, -2, "", 0);
+	if (!fmtresolve(J, S, "")) {
+		js_pop(J, 2);
+		return 0;
+	}
+	fmtvalue(J, S);
 	return 1;
 }
 
 static void JSON_stringify(js_State *J)
 {
-	js_StringBuffer *sb = NULL;
-	char buf[12];
-	const char *s, *gap;
+	js_Stringifier S;
+	char buf[11];
+	const char *gap = NULL;
 	int n;
 
-	gap = NULL;
-
 	if (js_isnumber(J, 3)) {
 		n = js_tointeger(J, 3);
 		if (n < 0) n = 0;
 		if (n > 10) n = 10;
 		memset(buf, ' ', n);
 		buf[n] = 0;
-		if (n > 0) gap = buf;
+		gap = buf;
 	} else if (js_isstring(J, 3)) {
-		s = js_tostring(J, 3);
-		n = strlen(s);
-		if (n > 10) n = 10;
-		memcpy(buf, s, n);
-		buf[n] = 0;
-		if (n > 0) gap = buf;
+		gap = js_tostring(J, 3);
 	}
 
+	fmtinit(&S, gap, NULL, NULL);
+	S.replacer = js_iscallable(J, 2) ? 2 : 0;
+
 	if (js_try(J)) {
-		js_free(J, sb);
+		js_free(J, S.buf);
 		js_throw(J);
 	}
 
-	js_newobject(J); /* wrapper */
 	js_copy(J, 1);
-	js_defproperty(J, -2, "", 0);
-	if (!fmtvalue(J, &sb, "", gap, 0)) {
-		js_pushundefined(J);
+	if (fmtbegin(J, &S)) {
+		while (S.depth > 0)
+			fmtnext(J, &S);
+		js_pushlstringu(J, S.buf, S.n, 0); /* all ASCII, the rest is escaped */
 	} else {
-		js_putc(J, &sb, 0);
-		js_pushstring(J, sb ? sb->s : "");
-		js_rot2pop1(J);
+		js_pushundefined(J);
 	}
 
 	js_endtry(J);
-	js_free(J, sb);
+	js_free(J, S.buf);
+}
+
+int js_stringify(js_State *J, int idx, const char *gap, js_Writer write, void *data)
+{
+	js_Stringifier S;
+	int result;
+
+	fmtinit(&S, gap, write, data);
+	S.cap = JS_WRITESIZE;
+	S.buf = js_malloc(J, S.cap);
+
+	if (js_try(J)) {
+		js_free(J, S.buf);
+		js_throw(J);
+	}
+
+	js_copy(J, idx);
+	result = fmtbegin(J, &S);
+	while (S.depth > 0)
+		fmtnext(J, &S);
+	fmtflush(J, &S);
+
+	js_endtry(J);
+	js_free(J, S.buf);
+	return result;
 }
 
+js_Stringifier *js_newstringifier(js_State *J, int idx, const char *gap)
+{
+	js_Stringifier *S;
+	js_copy(J, idx);
+	S = js_malloc(J, sizeof *S);
+	fmtinit(S, gap, NULL, NULL);
+	js_newarray(J);
+	js_rot2(J);
+	js_setindex(J, -2, 0);
+	S->ref = js_ref(J);
+	return S;
+}
+
+/* Bring back the value or the open frames from the registry, run until size bytes are ready, and put them back. */
+static void fmtresume(js_State *J, js_Stringifier *S, int size)
+{
+	int i, n, base;
+
+	js_getregistry(J, S->ref);
+	base = js_gettop(J) - 1;
+	n = js_getlength(J, -1);
+	for (i = 0; i < n; ++i)
+		js_getindex(J, base, i);
+	js_remove(J, base);
+
+	if (!S->started) {
+		S->started = 1;
+		fmtbegin(J, S);
+	}
+	while (S->depth > 0 && S->n - S->start < size)
+		fmtnext(J, S);
+
+	n = js_gettop(J) - base;
+	js_newarray(J);
+	for (i = 0; i < n; ++i) {
+		js_copy(J, base + i);
+		js_setindex(J, -2, i);
+	}
+	js_setregistry(J, S->ref);
+	js_pop(J, n);
+}
+
+int js_readstringifier(js_State *J, js_Stringifier *S, char *buf, int size)
+{
+	int n;
+
+	if (S->failed)
+		js_error(J, "JSON: stringifier stopped on an earlier error");
+
+	if (S->start == S->n && (!S->started || S->depth > 0)) {
+		S->start = S->n = 0;
+		if (js_try(J)) {
+			S->failed = 1;
+			js_throw(J);
+		}
+		fmtresume(J, S, size);
+		js_endtry(J);
+	}
+
+	n = S->n - S->start;
+	if (n > size)
+		n = size;
+	memcpy(buf, S->buf + S->start, n);
+	S->start += n;
+	return n;
+}
+
+void js_freestringifier(js_State *J, js_Stringifier *S)
+{
+	js_unref(J, S->ref);
+	js_free(J, S->buf);
+	js_free(J, S);
+}
+
+static const js_Method JSON_methods[] = {
+	{ "JSON.parse", JSON_parse, 2 },
+	{ "JSON.stringify", JSON_stringify, 3 },
+};
+
 void jsB_initjson(js_State *J)
 {
 	js_pushobject(J, jsV_newobject(J, JS_CJSON, J->Object_prototype));
 	{
-		jsB_propf(J, "JSON.parse", JSON_parse, 2);
-		jsB_propf(J, "JSON.stringify", JSON_stringify, 3);
+		jsB_methods(J, JSON_methods, nelem(JSON_methods));
 	}
 	js_defglobal(J, "JSON", JS_DONTENUM);
 }
@@ -1,6 +1,8 @@
 #include "jsi.h"
 #include "jslex.h"
 #include "jsparse.h"
+#include "jscompile.h" /* for jsC_checkfunction */
+#include "jsvalue.h" /* for jsV_numbertostring */
 
 #ifndef JS_NOCOMPILER
 
@@ -21,7 +23,8 @@ static js_Ast *expression(js_State *J, int notin);
 static js_Ast *assignment(js_State *J, int notin);
 static js_Ast *memberexp(js_State *J);
 static js_Ast *statement(js_State *J);
-static js_Ast *funbody(js_State *J);
+static js_Ast *lazystart(js_State *J);
+static js_Ast *funbody(js_State *J, js_Ast *lazy, js_Ast *name, js_Ast *params);
 
 JS_NORETURN static void jsP_error(js_State *J, const char *fmt, ...) JS_PRINTFLIKE(2,3);
 
@@ -61,9 +64,57 @@ static void jsP_warning(js_State *J, const char *fmt, ...)
 	js_report(J, buf);
 }
 
+/*
+	Syntax trees and the jump lists the compiler hangs on them live in an
+	arena: nodes are carved from large chunks with a bump pointer and the
+	whole tree goes away at once in jsP_freeparse. The first chunk is kept
+	for the next parse.
+*/
+
+typedef struct js_ArenaChunk js_ArenaChunk;
+struct js_ArenaChunk { js_ArenaChunk *next; char *end; }; /* keeps the memory after it 8-byte aligned */
+
+static void jsP_growarena(js_State *J, int size)
+{
+	int cap = JS_ARENASIZE;
+	js_ArenaChunk *chunk;
+	if (size > cap - (int)sizeof *chunk)
+		cap = size + sizeof *chunk;
+	chunk = js_malloc(J, cap);
+	chunk->next = J->arena.chunk;
+	chunk->end = (char *)chunk + cap;
+	J->arena.chunk = chunk;
+	J->arena.next = (char *)(chunk + 1);
+	J->arena.end = chunk->end;
+}
+
+void *jsP_alloc(js_State *J, int size)
+{
+	char *p;
+	size = (size + 7) & ~7;
+	if (!J->arena.next || size > J->arena.end - J->arena.next)
+		jsP_growarena(J, size);
+	p = J->arena.next;
+	J->arena.next += size;
+	return p;
+}
+
+/* Drop everything allocated since the arena was at next in chunk. */
+static void jsP_releasearena(js_State *J, void *chunk, char *next)
+{
+	js_ArenaChunk *top;
+	while (J->arena.chunk != chunk) {
+		top = J->arena.chunk;
+		J->arena.chunk = top->next;
+		js_free(J, top);
+	}
+	J->arena.next = next;
+	J->arena.end = chunk ? ((js_ArenaChunk *)chunk)->end : NULL;
+}
+
 static js_Ast *jsP_newnode(js_State *J, enum js_AstType type, int line, js_Ast *a, js_Ast *b, js_Ast *c, js_Ast *d)
 {
-	js_Ast *node = js_malloc(J, sizeof *node);
+	js_Ast *node = jsP_alloc(J, sizeof *node);
 
 	node->type = type;
 	node->line = line;
@@ -75,6 +126,7 @@ static js_Ast *jsP_newnode(js_State *J, enum js_AstType type, int line, js_Ast *
 	node->string = NULL;
 	node->jumps = NULL;
 	node->casejump = 0;
+	node->pending = 0;
 
 	node->parent = NULL;
 	if (a) a->parent = node;
@@ -82,9 +134,6 @@ static js_Ast *jsP_newnode(js_State *J, enum js_AstType type, int line, js_Ast *
 	if (c) c->parent = node;
 	if (d) d->parent = node;
 
-	node->gcnext = J->gcast;
-	J->gcast = node;
-
 	return node;
 }
 
@@ -114,25 +163,23 @@ static js_Ast *jsP_newnumnode(js_State *J, enum js_AstType type, double n)
 	return node;
 }
 
-static void jsP_freejumps(js_State *J, js_JumpList *node)
-{
-	while (node) {
-		js_JumpList *next = node->next;
-		js_free(J, node);
-		node = next;
-	}
-}
-
 void jsP_freeparse(js_State *J)
 {
-	js_Ast *node = J->gcast;
-	while (node) {
-		js_Ast *next = node->gcnext;
-		jsP_freejumps(J, node->jumps);
-		js_free(J, node);
-		node = next;
+	js_ArenaChunk *chunk = J->arena.chunk, *next;
+	while (chunk) {
+		next = chunk->next;
+		/* keep the first chunk for the next parse, unless it was sized for one large allocation */
+		if (!next && chunk->end == (char *)chunk + JS_ARENASIZE) {
+			J->arena.chunk = chunk;
+			J->arena.next = (char *)(chunk + 1);
+			J->arena.end = chunk->end;
+			return;
+		}
+		js_free(J, chunk);
+		chunk = next;
 	}
-	J->gcast = NULL;
+	J->arena.chunk = NULL;
+	J->arena.next = J->arena.end = NULL;
 }
 
 /* Lookahead */
@@ -225,7 +272,7 @@ static js_Ast *propname(js_State *J)
 
 static js_Ast *propassign(js_State *J)
 {
-	js_Ast *name, *value, *arg, *body;
+	js_Ast *name, *value, *arg, *body, *lazy;
 	int line = J->lexline;
 
 	name = propname(J);
@@ -233,18 +280,20 @@ static js_Ast *propassign(js_State *J)
 	if (J->lookahead != ':' && name->type == AST_IDENTIFIER) {
 		if (!strcmp(name->string, "get")) {
 			name = propname(J);
+			lazy = lazystart(J);
 			jsP_expect(J, '(');
 			jsP_expect(J, ')');
-			body = funbody(J);
+			body = funbody(J, lazy, NULL, NULL);
 			return EXP3(PROP_GET, name, NULL, body);
 		}
 		if (!strcmp(name->string, "set")) {
 			name = propname(J);
+			lazy = lazystart(J);
 			jsP_expect(J, '(');
-			arg = identifier(J);
+			arg = LIST(identifier(J));
 			jsP_expect(J, ')');
-			body = funbody(J);
-			return EXP3(PROP_SET, name, LIST(arg), body);
+			body = funbody(J, lazy, NULL, arg);
+			return EXP3(PROP_SET, name, arg, body);
 		}
 	}
 
@@ -283,35 +332,38 @@ static js_Ast *parameters(js_State *J)
 
 static js_Ast *fundec(js_State *J, int line)
 {
-	js_Ast *a, *b, *c;
+	js_Ast *a, *b, *c, *lazy;
 	a = identifier(J);
+	lazy = lazystart(J);
 	jsP_expect(J, '(');
 	b = parameters(J);
 	jsP_expect(J, ')');
-	c = funbody(J);
+	c = funbody(J, lazy, a, b);
 	return jsP_newnode(J, AST_FUNDEC, line, a, b, c, 0);
 }
 
 static js_Ast *funstm(js_State *J, int line)
 {
-	js_Ast *a, *b, *c;
+	js_Ast *a, *b, *c, *lazy;
 	a = identifier(J);
+	lazy = lazystart(J);
 	jsP_expect(J, '(');
 	b = parameters(J);
 	jsP_expect(J, ')');
-	c = funbody(J);
+	c = funbody(J, lazy, a, b);
 	/* rewrite function statement as "var X = function X() {}" */
 	return STM1(VAR, LIST(EXP2(VAR, a, EXP3(FUN, a, b, c))));
 }
 
 static js_Ast *funexp(js_State *J, int line)
 {
-	js_Ast *a, *b, *c;
+	js_Ast *a, *b, *c, *lazy;
 	a = identifieropt(J);
+	lazy = lazystart(J);
 	jsP_expect(J, '(');
 	b = parameters(J);
 	jsP_expect(J, ')');
-	c = funbody(J);
+	c = funbody(J, lazy, a, b);
 	return EXP3(FUN, a, b, c);
 }
 
@@ -942,17 +994,48 @@ static js_Ast *script(js_State *J, int terminator)
 	if (J->lookahead == terminator)
 		return NULL;
 	head = tail = LIST(scriptelement(J));
+	if (head->a->type == EXP_STRING && !strcmp(head->a->string, "use strict"))
+		J->lazystrict = 1;
 	while (J->lookahead != terminator)
 		tail = tail->b = LIST(scriptelement(J));
 	return jsP_list(head);
 }
 
-static js_Ast *funbody(js_State *J)
+/*
+	With lazy compilation, nested function bodies are parsed to find syntax
+	errors and where they end, but their trees are dropped again. A lazy
+	node holding the position of the parameter list takes their place, for
+	jsP_parselazy to start from when the function is first called. The
+	compiler checks each body before it is dropped, so that the errors it
+	reports still make loading fail; J->lazystrict holds the strict mode
+	the body inherits.
+*/
+
+static js_Ast *lazystart(js_State *J)
+{
+	js_Ast *node;
+	if (!J->lazysource)
+		return NULL;
+	node = jsP_newnode(J, AST_LAZY, J->lexline, 0, 0, 0, 0);
+	node->string = J->lexstart;
+	return node;
+}
+
+static js_Ast *funbody(js_State *J, js_Ast *lazy, js_Ast *name, js_Ast *params)
 {
 	js_Ast *a;
+	void *chunk = J->arena.chunk;
+	char *next = J->arena.next;
+	int strict = J->lazystrict;
 	jsP_expect(J, '{');
 	a = script(J, '}');
 	jsP_expect(J, '}');
+	J->lazystrict = strict;
+	if (lazy && a) {
+		jsC_checkfunction(J, lazy->line, name, params, a, strict);
+		jsP_releasearena(J, chunk, next);
+		return lazy;
+	}
 	return a;
 }
 
@@ -987,28 +1070,147 @@ static int jsP_setnumnode(js_Ast *node, double x)
 	return 1;
 }
 
-static int jsP_foldconst(js_Ast *node)
+static int jsP_setboolnode(js_Ast *node, int x)
+{
+	node->type = x ? EXP_TRUE : EXP_FALSE;
+	node->a = node->b = node->c = node->d = NULL;
+	return 1;
+}
+
+/*
+	A folded string that is the left operand of another '+' is kept in the
+	arena and only interned once the chain of concatenations ends, so long
+	runs of "a" + "b" + "c" do not fill the string table with prefixes.
+	Folded strings are also marked so they are never taken for a directive
+	prologue: ("use " + "strict") does not make a function strict.
+*/
+#define FOLDED 1
+#define PENDING 2
+
+static int jsP_setstrnode(js_State *J, js_Ast *node, const char *s, int n)
+{
+	char *p;
+	node->type = EXP_STRING;
+	node->a = node->b = node->c = node->d = NULL;
+	if (node->parent && node->parent->type == EXP_ADD && node->parent->a == node) {
+		p = jsP_alloc(J, n + 1);
+		memcpy(p, s, n);
+		p[n] = 0;
+		node->string = p;
+		node->number = PENDING;
+	} else {
+		node->string = jsS_internspan(J, s, n);
+		node->number = FOLDED;
+	}
+	return 1;
+}
+
+static void jsP_internpending(js_State *J, js_Ast *node)
+{
+	if (node && node->type == EXP_STRING && node->number == PENDING) {
+		node->string = js_intern(J, node->string);
+		node->number = FOLDED;
+	}
+}
+
+int jsP_isliteral(js_Ast *node)
+{
+	switch (node->type) {
+	case EXP_NUMBER: case EXP_STRING: case EXP_TRUE: case EXP_FALSE: case EXP_NULL:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+int jsP_istrue(js_Ast *node)
+{
+	switch (node->type) {
+	case EXP_NUMBER: return node->number != 0 && !isnan(node->number);
+	case EXP_STRING: return node->string[0] != 0;
+	case EXP_TRUE: return 1;
+	default: return 0;
+	}
+}
+
+static const char *jsP_literaltostring(js_State *J, js_Ast *node, char buf[32])
+{
+	switch (node->type) {
+	case EXP_NUMBER: return jsV_numbertostring(J, buf, node->number);
+	case EXP_STRING: return node->string;
+	case EXP_TRUE: return "true";
+	case EXP_FALSE: return "false";
+	default: return "null";
+	}
+}
+
+static int jsP_foldconcat(js_State *J, js_Ast *node)
+{
+	char abuf[32], bbuf[32];
+	const char *x = jsP_literaltostring(J, node->a, abuf);
+	const char *y = jsP_literaltostring(J, node->b, bbuf);
+	int nx = strlen(x), ny = strlen(y);
+	char *s = jsP_alloc(J, nx + ny);
+	memcpy(s, x, nx);
+	memcpy(s + nx, y, ny);
+	return jsP_setstrnode(J, node, s, nx + ny);
+}
+
+/* Same type literals, compared as by === */
+static int jsP_literalequal(js_Ast *a, js_Ast *b)
+{
+	switch (a->type) {
+	case EXP_NUMBER: return a->number == b->number;
+	case EXP_STRING: return !strcmp(a->string, b->string);
+	case EXP_NULL: return 1;
+	default: return a->type == b->type;
+	}
+}
+
+static int jsP_sametype(js_Ast *a, js_Ast *b)
+{
+	int ta = a->type == EXP_FALSE ? EXP_TRUE : a->type;
+	int tb = b->type == EXP_FALSE ? EXP_TRUE : b->type;
+	return ta == tb;
+}
+
+/* Fold operators on literal operands. Returns 1 if node is a literal afterwards. */
+int jsP_foldconst(js_State *J, js_Ast *node)
 {
 	double x, y;
-	int a, b;
+	int a, b, n;
 
 	if (node->type == AST_LIST) {
 		while (node) {
-			jsP_foldconst(node->a);
+			jsP_foldconst(J, node->a);
 			node = node->b;
 		}
 		return 0;
 	}
 
-	if (node->type == EXP_NUMBER)
+	if (jsP_isliteral(node))
 		return 1;
 
-	a = node->a ? jsP_foldconst(node->a) : 0;
-	b = node->b ? jsP_foldconst(node->b) : 0;
-	if (node->c) jsP_foldconst(node->c);
-	if (node->d) jsP_foldconst(node->d);
+	a = node->a ? jsP_foldconst(J, node->a) : 0;
+	b = node->b ? jsP_foldconst(J, node->b) : 0;
+	if (node->c) jsP_foldconst(J, node->c);
+	if (node->d) jsP_foldconst(J, node->d);
 
 	if (a) {
+		switch (node->type) {
+		default: break;
+		case EXP_LOGNOT: return jsP_setboolnode(node, !jsP_istrue(node->a));
+		case EXP_TYPEOF:
+			switch (node->a->type) {
+			case EXP_NUMBER: return jsP_setstrnode(J, node, "number", 6);
+			case EXP_STRING: return jsP_setstrnode(J, node, "string", 6);
+			case EXP_NULL: return jsP_setstrnode(J, node, "object", 6);
+			default: return jsP_setstrnode(J, node, "boolean", 7);
+			}
+		}
+	}
+
+	if (a && node->a->type == EXP_NUMBER) {
 		x = node->a->number;
 		switch (node->type) {
 		default: break;
@@ -1016,8 +1218,29 @@ static int jsP_foldconst(js_Ast *node)
 		case EXP_POS: return jsP_setnumnode(node, x);
 		case EXP_BITNOT: return jsP_setnumnode(node, ~toint32(x));
 		}
+	}
+
+	if (a && b) {
+		if (node->type == EXP_ADD && (node->a->type == EXP_STRING || node->b->type == EXP_STRING))
+			return jsP_foldconcat(J, node);
+
+		switch (node->type) {
+		default: break;
+		case EXP_STRICTEQ:
+		case EXP_STRICTNE:
+			n = jsP_sametype(node->a, node->b) && jsP_literalequal(node->a, node->b);
+			return jsP_setboolnode(node, node->type == EXP_STRICTEQ ? n : !n);
+		case EXP_EQ:
+		case EXP_NE:
+			/* loose equality between different types converts, leave it */
+			if (!jsP_sametype(node->a, node->b))
+				break;
+			n = jsP_literalequal(node->a, node->b);
+			return jsP_setboolnode(node, node->type == EXP_EQ ? n : !n);
+		}
 
-		if (b) {
+		if (node->a->type == EXP_NUMBER && node->b->type == EXP_NUMBER) {
+			x = node->a->number;
 			y = node->b->number;
 			switch (node->type) {
 			default: break;
@@ -1032,10 +1255,19 @@ static int jsP_foldconst(js_Ast *node)
 			case EXP_BITAND: return jsP_setnumnode(node, toint32(x) & toint32(y));
 			case EXP_BITXOR: return jsP_setnumnode(node, toint32(x) ^ toint32(y));
 			case EXP_BITOR: return jsP_setnumnode(node, toint32(x) | toint32(y));
+			case EXP_LT: return jsP_setboolnode(node, x < y);
+			case EXP_GT: return jsP_setboolnode(node, x > y);
+			case EXP_LE: return jsP_setboolnode(node, x <= y);
+			case EXP_GE: return jsP_setboolnode(node, x >= y);
 			}
 		}
 	}
 
+	if (node->type == EXP_ADD) {
+		jsP_internpending(J, node->a);
+		jsP_internpending(J, node->b);
+	}
+
 	return 0;
 }
 
@@ -1050,11 +1282,32 @@ js_Ast *jsP_parse(js_State *J, const char *filename, const char *source)
 	J->astdepth = 0;
 	p = script(J, 0);
 	if (p)
-		jsP_foldconst(p);
+		jsP_foldconst(J, p);
 
 	return p;
 }
 
+/* Parse the parameters and body of a function left by lazystart. */
+js_Ast *jsP_parselazy(js_State *J, const char *filename, const char *source, int line, const char *name)
+{
+	js_Ast *a = NULL, *b, *c;
+
+	jsY_initlexat(J, filename, source, line);
+	jsP_next(J);
+	J->astdepth = 0;
+	if (name[0])
+		a = jsP_newstrnode(J, AST_IDENTIFIER, name);
+	jsP_expect(J, '(');
+	b = parameters(J);
+	jsP_expect(J, ')');
+	jsP_expect(J, '{');
+	c = script(J, '}');
+	if (c)
+		jsP_foldconst(J, c);
+
+	return EXP3(FUN, a, b, c);
+}
+
 js_Ast *jsP_parsefunction(js_State *J, const char *filename, const char *params, const char *body)
 {
 	js_Ast *p = NULL;
@@ -1072,7 +1325,6 @@ js_Ast *jsP_parsefunction(js_State *J, const char *filename, const char *params,
 
 void jsP_freeparse(js_State *J)
 {
-	J->gcast = NULL;
 }
 
 js_Ast *jsP_parse(js_State *J, const char *filename, const char *source)
@@ -1080,6 +1332,11 @@ js_Ast *jsP_parse(js_State *J, const char *filename, const char *source)
 	return NULL;
 }
 
+js_Ast *jsP_parselazy(js_State *J, const char *filename, const char *source, int line, const char *name)
+{
+	return NULL;
+}
+
 js_Ast *jsP_parsefunction(js_State *J, const char *filename, const char *params, const char *body)
 {
 	return NULL;
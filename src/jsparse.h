@@ -6,6 +6,7 @@ enum js_AstType
 	AST_LIST,
 	AST_FUNDEC,
 	AST_IDENTIFIER,
+	AST_LAZY, /* function body left for jsC_compilelazy */
 
 	EXP_IDENTIFIER,
 	EXP_NUMBER,
@@ -132,12 +133,17 @@ struct js_Ast
 	const char *string;
 	js_JumpList *jumps; /* list of break/continue jumps to patch */
 	int casejump; /* for switch case clauses */
-	js_Ast *gcnext; /* next in alloc list */
+	int pending; /* exceptions left on the stack while compiling a finally block */
 };
 
 js_Ast *jsP_parsefunction(js_State *J, const char *filename, const char *params, const char *body);
 js_Ast *jsP_parse(js_State *J, const char *filename, const char *source);
+js_Ast *jsP_parselazy(js_State *J, const char *filename, const char *source, int line, const char *name);
 void jsP_freeparse(js_State *J);
+void *jsP_alloc(js_State *J, int size);
+int jsP_foldconst(js_State *J, js_Ast *node);
+int jsP_isliteral(js_Ast *node);
+int jsP_istrue(js_Ast *node);
 
 const char *jsP_aststring(enum js_AstType type);
 void jsP_dumpsyntax(js_State *J, js_Ast *prog, int minify);
@@ -0,0 +1,257 @@
+#include "jsi.h"
+#include "jscompile.h"
+#include "jsvalue.h"
+#include "jsrun.h"
+
+/*
+	Sampling profiler. Every interval ticks (backward jumps and calls) the
+	current call stack is recorded. Stacks are counted in a hash table and
+	their frames stored once in a flat array, since the trace entries only
+	hold pointers to interned names and file names.
+*/
+
+typedef struct js_ProfileStack
+{
+	int count;
+	int depth;
+	int first; /* index of the outermost frame in js_Profile.frames */
+} js_ProfileStack;
+
+static uint64_t jsR_hashtrace(const js_StackTrace *trace, int n)
+{
+	uint64_t h = 14695981039346656037ULL;
+	while (n--) {
+		h = (h ^ (uintptr_t)trace->name) * 1099511628211ULL;
+		h = (h ^ (uintptr_t)trace->file) * 1099511628211ULL;
+		h = (h ^ (unsigned int)trace->line) * 1099511628211ULL;
+		++trace;
+	}
+	return h;
+}
+
+static int jsR_sametrace(const js_StackTrace *a, const js_StackTrace *b, int n)
+{
+	while (n--) {
+		if (a->name != b->name || a->file != b->file || a->line != b->line)
+			return 0;
+		++a, ++b;
+	}
+	return 1;
+}
+
+static void jsR_sample(js_State *J, js_Profile *P)
+{
+	const js_StackTrace *trace = J->trace + 1; /* skip the "-top-" entry */
+	int depth = J->tracetop;
+	uint64_t key = jsR_hashtrace(trace, depth);
+	js_ProfileStack *stack, item;
+
+	++P->nsamples;
+
+	/* collisions move on to the next key */
+	while ((stack = hashtable_find(&P->stacks, key)) != NULL) {
+		if (stack->depth == depth && jsR_sametrace(P->frames + stack->first, trace, depth)) {
+			++stack->count;
+			return;
+		}
+		++key;
+	}
+
+	if (P->nframes + depth > P->capframes) {
+		int cap = P->capframes ? P->capframes : 256;
+		while (cap < P->nframes + depth)
+			cap *= 2;
+		P->frames = js_realloc(J, P->frames, cap * sizeof *P->frames);
+		P->capframes = cap;
+	}
+	memcpy(P->frames + P->nframes, trace, depth * sizeof *trace);
+
+	item.count = 1;
+	item.depth = depth;
+	item.first = P->nframes;
+	P->nframes += depth;
+	hashtable_insert(&P->stacks, key, &item);
+}
+
+void jsR_profiletick(js_State *J, int ticks, int sample)
+{
+	js_Profile *P = J->profile;
+	if (P->interval) {
+		P->left -= ticks;
+		if (P->left <= 0) {
+			P->left = P->interval;
+			sample = 1;
+		}
+	}
+	if (sample && P->left)
+		jsR_sample(J, P);
+}
+
+void jsR_freeprofile(js_State *J)
+{
+	js_Profile *P = J->profile;
+	if (P) {
+		hashtable_term(&P->stacks);
+		js_free(J, P->frames);
+		js_free(J, P);
+		J->profile = NULL;
+	}
+}
+
+void js_startprofile(js_State *J, int interval)
+{
+	js_Profile *P;
+
+	jsR_freeprofile(J);
+
+	P = js_malloc(J, sizeof *P);
+	memset(P, 0, sizeof *P);
+	hashtable_init(&P->stacks, sizeof(js_ProfileStack), 64, NULL);
+	P->interval = interval > 0 ? interval : 0;
+	P->left = P->interval ? P->interval : INT_MAX;
+
+	J->profile = P;
+	jsR_resettick(J);
+}
+
+void js_stopprofile(js_State *J)
+{
+	js_Profile *P = J->profile;
+	if (P) {
+		P->interval = 0;
+		P->left = 0;
+	}
+	J->samplerequest = 0;
+	jsR_resettick(J);
+}
+
+void js_sampleprofile(js_State *J)
+{
+	/* only a flag the interpreter polls, the tick counters are not touched */
+	J->samplerequest = 1;
+}
+
+int js_profilesamples(js_State *J)
+{
+	return J->profile ? J->profile->nsamples : 0;
+}
+
+static void jsR_putframe(js_State *J, js_StringBuffer **sb, const js_StackTrace *frame)
+{
+	char buf[32];
+	if (frame->name[0]) {
+		js_puts(J, sb, frame->name);
+		js_puts(J, sb, " (");
+	}
+	js_puts(J, sb, frame->file);
+	if (frame->line > 0) {
+		snprintf(buf, sizeof buf, ":%d", frame->line);
+		js_puts(J, sb, buf);
+	}
+	if (frame->name[0])
+		js_putc(J, sb, ')');
+}
+
+void js_dumpprofile(js_State *J)
+{
+	js_Profile *P = J->profile;
+	js_StringBuffer *sb = NULL;
+	js_ProfileStack *stack;
+	char buf[32];
+	int i, k, n;
+
+	if (!P || P->nsamples == 0) {
+		js_pushliteral(J, "");
+		return;
+	}
+
+	if (js_try(J)) {
+		js_free(J, sb);
+		js_throw(J);
+	}
+
+	stack = hashtable_items(&P->stacks);
+	n = hashtable_count(&P->stacks);
+	for (i = 0; i < n; ++i, ++stack) {
+		for (k = 0; k < stack->depth; ++k) {
+			if (k > 0)
+				js_putc(J, &sb, ';');
+			jsR_putframe(J, &sb, P->frames + stack->first + k);
+		}
+		snprintf(buf, sizeof buf, " %d\n", stack->count);
+		js_puts(J, &sb, buf);
+	}
+	js_putc(J, &sb, 0);
+	js_pushstring(J, sb->s);
+
+	js_endtry(J);
+	js_free(J, sb);
+}
+
+/*
+	Execution statistics. Counting an instruction costs a test of J->stats
+	even when disabled, so they are only compiled in with JS_OPSTATS.
+*/
+
+#define JS_OPCOUNT (OP_LINE + 1)
+
+void js_setstats(js_State *J, int enable)
+{
+#ifdef JS_OPSTATS
+	js_Function *F;
+	if (enable) {
+		if (!J->opstats)
+			J->opstats = js_malloc(J, JS_OPCOUNT * sizeof *J->opstats);
+		memset(J->opstats, 0, JS_OPCOUNT * sizeof *J->opstats);
+		for (F = J->gcfun; F; F = F->gcnext) {
+			F->nops = 0;
+			F->ncalls = 0;
+			F->time = 0;
+		}
+	}
+	J->stats = enable && J->opstats;
+#endif
+}
+
+void js_getstats(js_State *J)
+{
+#ifdef JS_OPSTATS
+	js_Function *F;
+	int i;
+#endif
+
+	js_newobject(J);
+	js_newobject(J);
+#ifdef JS_OPSTATS
+	for (i = 0; J->opstats && i < JS_OPCOUNT; ++i) {
+		if (J->opstats[i]) {
+			js_pushnumber(J, J->opstats[i]);
+			js_setproperty(J, -2, jsC_opcodestring(i));
+		}
+	}
+#endif
+	js_setproperty(J, -2, "opcodes");
+
+	js_newarray(J);
+#ifdef JS_OPSTATS
+	for (i = 0, F = J->gcfun; F; F = F->gcnext) {
+		if (!F->ncalls && !F->nops)
+			continue;
+		js_newobject(J);
+		js_pushstring(J, F->name);
+		js_setproperty(J, -2, "name");
+		js_pushstring(J, F->filename);
+		js_setproperty(J, -2, "file");
+		js_pushnumber(J, F->line);
+		js_setproperty(J, -2, "line");
+		js_pushnumber(J, F->ncalls);
+		js_setproperty(J, -2, "calls");
+		js_pushnumber(J, F->nops);
+		js_setproperty(J, -2, "instructions");
+		js_pushnumber(J, F->time);
+		js_setproperty(J, -2, "time");
+		js_setindex(J, -2, i++);
+	}
+#endif
+	js_setproperty(J, -2, "functions");
+}
@@ -1,24 +1,83 @@
 #include "jsi.h"
 #include "jsvalue.h"
 
-static js_Property *newproperty(js_State *J, js_Object *obj, const char *name)
+static js_Property *insertproperty(js_State *J, js_Object *obj, const char *name, uint64_t hash)
 {
-	js_Property node; 
-	node.name = js_intern(J, name); 
-	node.hash = jsU_tostrhash(name);
+	js_Property node;
+	node.name = name;
 	node.atts = 0;
 	node.value.type = JS_TUNDEFINED;
 	node.value.u.number = 0;
-	node.getter = NULL;
-	node.setter = NULL;
-	js_Property *prop = hashtable_insert(obj->properties, node.hash, &node);
+	js_Property *prop = hashtable_insert(obj->properties, hash, &node);
 	obj->count = hashtable_count(obj->properties);
 	return prop;
 }
 
+static js_Property *newproperty(js_State *J, js_Object *obj, const char *name)
+{
+	return insertproperty(J, obj, js_intern(J, name), jsU_tostrhash(name));
+}
+
+/* Find the entry of a builtin method table that has not been created yet */
+static int lazyfind(js_State *J, js_Object *obj, uint64_t hash)
+{
+	js_LazyTable *lazy = &J->lazy[obj->lazy - 1];
+	const uint64_t *h = J->lazyhash + lazy->hash;
+	int i;
+	for (i = 0; i < lazy->n; ++i)
+		if (h[i] == hash && !(lazy->done >> i & 1))
+			return i;
+	return -1;
+}
+
+static void lazydone(js_State *J, js_Object *obj, int i)
+{
+	js_LazyTable *lazy = &J->lazy[obj->lazy - 1];
+	lazy->done |= (uint64_t)1 << i;
+	if (lazy->done == (lazy->n == 64 ? ~(uint64_t)0 : ((uint64_t)1 << lazy->n) - 1))
+		obj->lazy = 0;
+}
+
+static js_Property *lazymethod(js_State *J, js_Object *obj, int i)
+{
+	const js_Method *m = &J->lazy[obj->lazy - 1].methods[i];
+	const char *pname = strrchr(m->name, '.');
+	js_Property *ref;
+	pname = pname ? pname + 1 : m->name;
+	lazydone(J, obj, i);
+	js_newcfunction(J, m->function, m->name, m->length);
+	ref = newproperty(J, obj, pname);
+	ref->value = *js_tovalue(J, -1);
+	ref->atts = JS_DONTENUM;
+	js_pop(J, 1);
+	return ref;
+}
+
+/* Called when a lookup misses, creates the builtin method of that name if there is one */
+static js_Property *lazyproperty(js_State *J, js_Object *obj, uint64_t hash)
+{
+	int i = lazyfind(J, obj, hash);
+	return i < 0 ? NULL : lazymethod(J, obj, i);
+}
+
+/* Create all remaining builtin methods, before walking all own properties */
+void jsV_resolveproperties(js_State *J, js_Object *obj)
+{
+	while (obj->lazy) {
+		js_LazyTable *lazy = &J->lazy[obj->lazy - 1];
+		int i = 0;
+		while (lazy->done >> i & 1)
+			++i;
+		lazymethod(J, obj, i);
+	}
+}
+
 static js_Property *addproperty(js_State *J, js_Object *obj, const char *name)
 {
-	js_Property *property = hashtable_find(obj->properties, jsU_tostrhash(name));
+	uint64_t hash = jsU_tostrhash(name);
+	js_Property *property = hashtable_find(obj->properties, hash);
+	if (!property && obj->lazy)
+		property = lazyproperty(J, obj, hash);
 	if (property)
 		return property;
 	return newproperty(J, obj, name);
@@ -26,10 +85,39 @@ static js_Property *addproperty(js_State *J, js_Object *obj, const char *name)
 
 static void freeproperty(js_State *J, js_Object *obj, uint64_t hash)
 {
+	js_Property *ref = hashtable_find(obj->properties, hash);
+	if (ref)
+		jsV_clearaccessor(J, ref);
 	hashtable_remove(obj->properties, hash);
 	obj->count = hashtable_count(obj->properties);
 }
 
+/* Turn a property into an accessor property, keeping an existing getter/setter pair */
+js_Accessor *jsV_setaccessor(js_State *J, js_Property *ref)
+{
+	js_Accessor *acc;
+	if (ref->atts & JS_ACCESSOR)
+		return ref->value.u.accessor;
+	acc = js_malloc(J, sizeof *acc);
+	acc->getter = NULL;
+	acc->setter = NULL;
+	ref->value.type = JS_TUNDEFINED;
+	ref->value.u.accessor = acc;
+	ref->atts |= JS_ACCESSOR;
+	return acc;
+}
+
+/* Turn an accessor property back into an undefined data property */
+void jsV_clearaccessor(js_State *J, js_Property *ref)
+{
+	if (ref->atts & JS_ACCESSOR) {
+		js_free(J, ref->value.u.accessor);
+		ref->value.type = JS_TUNDEFINED;
+		ref->value.u.number = 0;
+		ref->atts &= ~JS_ACCESSOR;
+	}
+}
+
 js_Object *jsV_newobject(js_State *J, enum js_Class type, js_Object *prototype)
 {
 	js_Object *obj = js_malloc(J, sizeof *obj);
@@ -49,7 +137,11 @@ js_Object *jsV_newobject(js_State *J, enum js_Class type, js_Object *prototype)
 
 js_Property *jsV_getownproperty(js_State *J, js_Object *obj, const char *name)
 {
-	return (js_Property*)hashtable_find(obj->properties, jsU_tostrhash(name));
+	uint64_t hash = jsU_tostrhash(name);
+	js_Property *ref = (js_Property*)hashtable_find(obj->properties, hash);
+	if (!ref && obj->lazy)
+		ref = lazyproperty(J, obj, hash);
+	return ref;
 }
 
 js_Property *jsV_getpropertyx(js_State *J, js_Object *obj, const char *name, int *own)
@@ -58,6 +150,8 @@ js_Property *jsV_getpropertyx(js_State *J, js_Object *obj, const char *name, int
 	*own = 1;
 	do {
 		js_Property *ref = (js_Property*)hashtable_find(obj->properties, hash);
+		if (!ref && obj->lazy)
+			ref = lazyproperty(J, obj, hash);
 		if (ref)
 			return ref;
 		obj = obj->prototype;
@@ -66,11 +160,40 @@ js_Property *jsV_getpropertyx(js_State *J, js_Object *obj, const char *name, int
 	return NULL;
 }
 
+/* The property hash of the name of array index i, without making the name. */
+uint64_t jsV_indexhash(int i)
+{
+	char digits[12], *p = digits + sizeof digits;
+	uint64_t hash = 5381;
+
+	do *--p = '0' + i % 10; while (i /= 10);
+	while (p < digits + sizeof digits)
+		hash = ((hash << 5) + hash) + *p++; /* as jsU_tostrhash */
+	return hash;
+}
+
+/* The own property at array index i, without making the name. */
+js_Property *jsV_getownindex(js_State *J, js_Object *obj, int i)
+{
+	return hashtable_find(obj->properties, jsV_indexhash(i));
+}
+
+/* Size the property table of an empty object for n properties up front. */
+void jsV_reserveproperties(js_State *J, js_Object *obj, int n)
+{
+	if (n > 8 && hashtable_count(obj->properties) == 0) {
+		hashtable_term(obj->properties);
+		hashtable_init(obj->properties, sizeof(js_Property), n, 0);
+	}
+}
+
 js_Property *jsV_getproperty(js_State *J, js_Object *obj, const char *name)
 {
 	uint64_t hash = jsU_tostrhash(name);
 	do {
 		js_Property *ref = (js_Property*)hashtable_find(obj->properties, hash);
+		if (!ref && obj->lazy)
+			ref = lazyproperty(J, obj, hash);
 		if (ref)
 			return ref;
 		obj = obj->prototype;
@@ -90,10 +213,26 @@ static js_Property *jsV_getenumproperty(js_State *J, js_Object *obj, const char
 	return NULL;
 }
 
+/*
+	Add an own data property to an object the caller has just made, so there
+	are no setters or builtin methods to look for. The name must be interned
+	and hash must be its jsU_tostrhash. Used to build the result of JSON.parse.
+*/
+js_Property *jsV_addownproperty(js_State *J, js_Object *obj, const char *name, uint64_t hash)
+{
+	js_Property *ref = hashtable_find(obj->properties, hash);
+	if (ref)
+		return ref;
+	return insertproperty(J, obj, name, hash);
+}
+
 js_Property *jsV_setproperty(js_State *J, js_Object *obj, const char *name)
 {
 	if (!obj->extensible) {
-		js_Property *property = (js_Property*)hashtable_find(obj->properties, jsU_tostrhash(name));
+		uint64_t hash = jsU_tostrhash(name);
+		js_Property *property = (js_Property*)hashtable_find(obj->properties, hash);
+		if (!property && obj->lazy)
+			property = lazyproperty(J, obj, hash);
 		if (J->strict && !property)
 			js_typeerror(J, "object is non-extensible");
 		return property;
@@ -192,13 +192,17 @@ static void Rp_exec(js_State *J)
 	js_RegExp_prototype_exec(J, js_toregexp(J, 0), js_tostring(J, 1));
 }
 
+static const js_Method RegExp_prototype_methods[] = {
+	{ "RegExp.prototype.toString", Rp_toString, 0 },
+	{ "RegExp.prototype.test", Rp_test, 0 },
+	{ "RegExp.prototype.exec", Rp_exec, 0 },
+};
+
 void jsB_initregexp(js_State *J)
 {
 	js_pushobject(J, J->RegExp_prototype);
 	{
-		jsB_propf(J, "RegExp.prototype.toString", Rp_toString, 0);
-		jsB_propf(J, "RegExp.prototype.test", Rp_test, 0);
-		jsB_propf(J, "RegExp.prototype.exec", Rp_exec, 0);
+		jsB_methods(J, RegExp_prototype_methods, nelem(RegExp_prototype_methods));
 	}
 	js_newcconstructor(J, jsB_RegExp, jsB_new_RegExp, "RegExp", 1);
 	js_defglobal(J, "RegExp", JS_DONTENUM);
@@ -242,6 +242,9 @@ static void reprvalue(js_State *J, js_StringBuffer **sb)
 		case JS_CITERATOR:
 			js_puts(J, sb, "[iterator ");
 			break;
+		case JS_CCOROUTINE:
+			js_puts(J, sb, "[coroutine]");
+			break;
 		case JS_CUSERDATA:
 			js_puts(J, sb, "[userdata ");
 			js_puts(J, sb, obj->u.user.tag);
@@ -7,7 +7,11 @@
 
 #include "utf.h"
 
-static void jsR_run(js_State *J, js_Function *F);
+#ifdef JS_OPSTATS
+#include <time.h>
+#endif
+
+static void jsR_run(js_State *J, js_Function *F, js_Instruction *pc);
 
 typedef struct { int current; } js_LocalScope;
 void js_createlocalscope(js_State *J, js_LocalScope *scope, int offset);
@@ -127,6 +131,23 @@ void js_pushnumber(js_State *J, double v)
 	++TOP;
 }
 
+static void jsR_pushinteger(js_State *J, int v)
+{
+	CHECKSTACK(1);
+	STACK[TOP].type = JS_TINTEGER;
+	STACK[TOP].u.integer = v;
+	++TOP;
+}
+
+/* push the result of integer arithmetic, falling back to a double on overflow */
+static void jsR_pushint64(js_State *J, int64_t v)
+{
+	if (v >= INT_MIN && v <= INT_MAX)
+		jsR_pushinteger(J, (int)v);
+	else
+		js_pushnumber(J, (double)v);
+}
+
 void js_pushshrstr(js_State *J, const char *v, int len) 
 { 
 	int n = M_MIN(len, soffsetof(js_Value, type));
@@ -154,7 +175,7 @@ void js_pushstringu(js_State *J, const char *v, int isunicode)
 	strnode->size = size;
 	strnode->isunicode = isunicode;
 	value->u.string.u.ptr8 = strnode->string;
-	value->u.string.isunicode = isunicode;
+	jsV_strisunicode(value) = isunicode;
 	++TOP;
 }
 
@@ -187,7 +208,7 @@ void js_pushlstringu(js_State *J, const char *str, int n, int isunicode)
 		strnode->isunicode = isunicode;
 		value->type = JS_TMEMSTR;
 		value->u.string.u.ptr8 = strnode->string;
-		value->u.string.isunicode = isunicode;
+		jsV_strisunicode(value) = isunicode;
 	}
 	++TOP;
 }
@@ -234,7 +255,7 @@ void js_pushlstring(js_State *J, const char *v, int n)
 		strnode->size = size;
 		strnode->isunicode = isunicode;
 		STACK[TOP].u.string.u.ptr8 = strnode->string;
-		STACK[TOP].u.string.isunicode = isunicode;
+		jsV_strisunicode(&STACK[TOP]) = isunicode;
 	}
 	++TOP;
 }
@@ -246,7 +267,7 @@ void js_pushliteral(js_State *J, const char *v)
 	node = jsU_ptrtostrnode(v);
 	STACK[TOP].type = JS_TLITSTR;
 	STACK[TOP].u.string.u.ptr8 = v;
-	STACK[TOP].u.string.isunicode = node->isunicode;
+	jsV_strisunicode(&STACK[TOP]) = node->isunicode;
 	++TOP;
 }
 
@@ -255,7 +276,7 @@ void js_pushconst(js_State *J, const char *v)
 	CHECKSTACK(1);
 	STACK[TOP].type = JS_TCONSTSTR;
 	STACK[TOP].u.string.u.ptr8 = v;
-	STACK[TOP].u.string.isunicode = 1;
+	jsV_strisunicode(&STACK[TOP]) = 1;
 	++TOP;
 }
 
@@ -264,7 +285,7 @@ void js_pushconstu(js_State *J, const char *v, int isunicode)
 	CHECKSTACK(1);
 	STACK[TOP].type = JS_TCONSTSTR;
 	STACK[TOP].u.string.u.ptr8 = v;
-	STACK[TOP].u.string.isunicode = isunicode;
+	jsV_strisunicode(&STACK[TOP]) = isunicode;
 	++TOP;
 }
 
@@ -292,7 +313,7 @@ void js_currentfunction(js_State *J)
 
 js_Value *stackidx(js_State *J, int idx)
 {
-	static js_Value undefined = { {0}, {0}, JS_TUNDEFINED };
+	static js_Value undefined = { .type = JS_TUNDEFINED };
 	idx = idx < 0 ? TOP + idx : BOT + idx;
 	if (idx < 0 || idx >= TOP)
 		return &undefined;
@@ -308,7 +329,7 @@ int js_isdefined(js_State *J, int idx) { return stackidx(J, idx)->type != JS_TUN
 int js_isundefined(js_State *J, int idx) { return stackidx(J, idx)->type == JS_TUNDEFINED; }
 int js_isnull(js_State *J, int idx) { return stackidx(J, idx)->type == JS_TNULL; }
 int js_isboolean(js_State *J, int idx) { return stackidx(J, idx)->type == JS_TBOOLEAN; }
-int js_isnumber(js_State *J, int idx) { return stackidx(J, idx)->type == JS_TNUMBER; }
+int js_isnumber(js_State *J, int idx) { js_Value *v = stackidx(J, idx); return jsV_isnumber(v); }
 int js_isstring(js_State *J, int idx) { enum js_Type t = stackidx(J, idx)->type; return t == JS_TSHRSTR || t == JS_TLITSTR || t == JS_TMEMSTR || t == JS_TCONSTSTR; }
 int js_isprimitive(js_State *J, int idx) { return stackidx(J, idx)->type != JS_TOBJECT; }
 int js_isobject(js_State *J, int idx) { return stackidx(J, idx)->type == JS_TOBJECT; }
@@ -362,7 +383,8 @@ const char *js_typeof(js_State *J, int idx)
 	case JS_TUNDEFINED: return "undefined";
 	case JS_TNULL: return "object";
 	case JS_TBOOLEAN: return "boolean";
-	case JS_TNUMBER: return "number";
+	case JS_TNUMBER:
+	case JS_TINTEGER: return "number";
 	case JS_TSHRSTR:
 	case JS_TLITSTR:
 	case JS_TCONSTSTR:
@@ -391,12 +413,18 @@ int js_tointeger(js_State *J, int idx)
 
 int js_toint32(js_State *J, int idx)
 {
-	return jsV_numbertoint32(jsV_tonumber(J, stackidx(J, idx)));
+	js_Value *v = stackidx(J, idx);
+	if (v->type == JS_TINTEGER)
+		return v->u.integer;
+	return jsV_numbertoint32(jsV_tonumber(J, v));
 }
 
 unsigned int js_touint32(js_State *J, int idx)
 {
-	return jsV_numbertouint32(jsV_tonumber(J, stackidx(J, idx)));
+	js_Value *v = stackidx(J, idx);
+	if (v->type == JS_TINTEGER)
+		return (unsigned int)v->u.integer;
+	return jsV_numbertouint32(jsV_tonumber(J, v));
 }
 
 short js_toint16(js_State *J, int idx)
@@ -427,7 +455,8 @@ js_Object *jsV_toobjectP(js_State *J, js_Value *v)
 	case JS_TUNDEFINED: js_typeerror(J, "cannot convert undefined to object");
 	case JS_TNULL: js_typeerror(J, "cannot convert null to object");
 	case JS_TBOOLEAN: return J->Boolean_prototype;
-	case JS_TNUMBER: return J->Number_prototype;
+	case JS_TNUMBER:
+	case JS_TINTEGER: return J->Number_prototype;
 	case JS_TLITSTR:
 	case JS_TCONSTSTR:
 	case JS_TMEMSTR: return J->String_prototype;
@@ -714,10 +743,14 @@ static int jsR_hasproperty(js_State *J, js_Object *obj, const char *name)
 
 	ref = jsV_getproperty(J, obj, name);
 	if (ref) {
-		if (ref->getter) {
-			js_pushobject(J, ref->getter);
-			js_pushobject(J, obj);
-			js_call(J, 0);
+		if (ref->atts & JS_ACCESSOR) {
+			if (ref->value.u.accessor->getter) {
+				js_pushobject(J, ref->value.u.accessor->getter);
+				js_pushobject(J, obj);
+				js_call(J, 0);
+			} else {
+				js_pushundefined(J);
+			}
 		} else {
 			js_pushvalue(J, ref->value);
 		}
@@ -816,19 +849,19 @@ static void jsR_setproperty(js_State *J, js_Object *obj, const char *name)
 
 	/* First try to find a setter in prototype chain */
 	ref = jsV_getpropertyx(J, obj, name, &own);
-	if (ref) {
-		if (ref->setter) {
-			js_pushobject(J, ref->setter);
+	if (ref && (ref->atts & JS_ACCESSOR)) {
+		if (ref->value.u.accessor->setter) {
+			js_pushobject(J, ref->value.u.accessor->setter);
 			js_pushobject(J, obj);
 			js_pushvalue(J, *value);
 			js_call(J, 1);
 			js_pop(J, 1);
 			return;
-		} else {
-			if (J->strict)
-				if (ref->getter)
-					js_typeerror(J, "setting property '%s' that only has a getter", name);
 		}
+		if (J->strict)
+			js_typeerror(J, "setting property '%s' that only has a getter", name);
+		if (own)
+			return;
 	}
 
 	/* Property not found on this object, so create one */
@@ -896,24 +929,30 @@ static void jsR_defproperty(js_State *J, js_Object *obj, const char *name,
 	ref = jsV_setproperty(J, obj, name);
 	if (ref) {
 		if (value) {
-			if (!(ref->atts & JS_READONLY))
+			if (ref->atts & JS_READONLY) {
+				if (J->strict)
+					js_typeerror(J, "'%s' is read-only", name);
+			} else if (ref->atts & JS_ACCESSOR) {
+				if (!(ref->atts & JS_DONTCONF)) {
+					jsV_clearaccessor(J, ref);
+					ref->value = *value;
+				} else if (J->strict)
+					js_typeerror(J, "'%s' is non-configurable", name);
+			} else {
 				ref->value = *value;
-			else if (J->strict)
-				js_typeerror(J, "'%s' is read-only", name);
-		}
-		if (getter) {
-			if (!(ref->atts & JS_DONTCONF))
-				ref->getter = getter;
-			else if (J->strict)
-				js_typeerror(J, "'%s' is non-configurable", name);
+			}
 		}
-		if (setter) {
-			if (!(ref->atts & JS_DONTCONF))
-				ref->setter = setter;
-			else if (J->strict)
+		if (getter || setter) {
+			if (!(ref->atts & JS_DONTCONF)) {
+				js_Accessor *acc = jsV_setaccessor(J, ref);
+				if (getter)
+					acc->getter = getter;
+				if (setter)
+					acc->setter = setter;
+			} else if (J->strict)
 				js_typeerror(J, "'%s' is non-configurable", name);
 		}
-		ref->atts |= atts;
+		ref->atts |= atts & ~JS_ACCESSOR;
 	}
 
 	return;
@@ -1187,10 +1226,14 @@ static int js_hasvar(js_State *J, const char *name)
 	do {
 		js_Property *ref = jsV_getproperty(J, E->variables, name);
 		if (ref) {
-			if (ref->getter) {
-				js_pushobject(J, ref->getter);
-				js_pushobject(J, E->variables);
-				js_call(J, 0);
+			if (ref->atts & JS_ACCESSOR) {
+				if (ref->value.u.accessor->getter) {
+					js_pushobject(J, ref->value.u.accessor->getter);
+					js_pushobject(J, E->variables);
+					js_call(J, 0);
+				} else {
+					js_pushundefined(J);
+				}
 			} else {
 				js_pushvalue(J, ref->value);
 			}
@@ -1207,12 +1250,15 @@ static void js_setvar(js_State *J, const char *name)
 	do {
 		js_Property *ref = jsV_getproperty(J, E->variables, name);
 		if (ref) {
-			if (ref->setter) {
-				js_pushobject(J, ref->setter);
-				js_pushobject(J, E->variables);
-				js_copy(J, -3);
-				js_call(J, 1);
-				js_pop(J, 1);
+			if (ref->atts & JS_ACCESSOR) {
+				if (ref->value.u.accessor->setter) {
+					js_pushobject(J, ref->value.u.accessor->setter);
+					js_pushobject(J, E->variables);
+					js_copy(J, -3);
+					js_call(J, 1);
+					js_pop(J, 1);
+				} else if (J->strict)
+					js_typeerror(J, "setting variable '%s' that only has a getter", name);
 				return;
 			}
 			if (!(ref->atts & JS_READONLY))
@@ -1277,7 +1323,7 @@ static void jsR_calllwfunction(js_State *J, int n, js_Function *F, js_Environmen
 	for (i = n; i < F->varlen; ++i)
 		js_pushundefined(J);
 
-	jsR_run(J, F);
+	jsR_run(J, F, F->code);
 	v = *stackidx(J, -1);
 	TOP = --BOT; /* clear stack */
 	js_pushvalue(J, v);
@@ -1320,7 +1366,7 @@ static void jsR_callfunction(js_State *J, int n, js_Function *F, js_Environment
 		js_pop(J, 1);
 	}
 
-	jsR_run(J, F);
+	jsR_run(J, F, F->code);
 	v = *stackidx(J, -1);
 	TOP = --BOT; /* clear stack */
 	js_pushvalue(J, v);
@@ -1345,7 +1391,7 @@ static void jsR_callscript(js_State *J, int n, js_Function *F, js_Environment *s
 		js_pop(J, 1);
 	}
 
-	jsR_run(J, F);
+	jsR_run(J, F, F->code);
 	v = *stackidx(J, -1);
 	TOP = --BOT; /* clear stack */
 	js_pushvalue(J, v);
@@ -1378,21 +1424,77 @@ static void jsR_pushtrace(js_State *J, const char *name, const char *file, int l
 	J->trace[J->tracetop].line = line;
 }
 
+/* there is always a trace entry per frame, so the trace limit covers both */
+static void jsR_pushframe(js_State *J, js_Function *F, int savebot, int scoped, int opcall)
+{
+	js_Frame *frame = &J->frames[J->frametop];
+	frame->F = F;
+	frame->pc = NULL;
+	frame->savebot = savebot;
+	frame->bot = BOT;
+	frame->scoped = scoped;
+	frame->resumable = opcall && J->co &&
+		(J->frametop == J->co->framebase || frame[-1].resumable);
+	++J->frametop;
+}
+
+#ifdef JS_OPSTATS
+static void jsR_callstats(js_State *J, int n, js_Object *obj)
+{
+	js_Function *F = obj->u.f.function;
+	clock_t start = clock();
+	int i, outermost = 1;
+
+	/* recursive calls are already timed by the outermost one */
+	for (i = 0; i < J->frametop - 1; ++i)
+		if (J->frames[i].F == F)
+			outermost = 0;
+
+	if (obj->type == JS_CSCRIPT)
+		jsR_callscript(J, n, F, obj->u.f.scope);
+	else if (F->lightweight)
+		jsR_calllwfunction(J, n, F, obj->u.f.scope);
+	else
+		jsR_callfunction(J, n, F, obj->u.f.scope);
+
+	if (F->shared)
+		return;
+	++F->ncalls;
+	if (outermost)
+		F->time += (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+#endif
+
 void js_call(js_State *J, int n)
 {
 	js_Object *obj;
 	int savebot;
+	int opcall = J->opcall;
+
+	J->opcall = 0;
 
 	if (!js_iscallable(J, -n-2))
 		js_typeerror(J, "%s is not callable", js_typeof(J, -n-2));
 
 	obj = js_toobject(J, -n-2);
 
+	if (obj->type == JS_CFUNCTION && obj->u.f.function->source)
+		jsC_compilelazy(J, obj->u.f.function);
+
 	savebot = BOT;
 	BOT = TOP - n - 1;
 
+#ifdef JS_OPSTATS
+	if (J->stats && (obj->type == JS_CFUNCTION || obj->type == JS_CSCRIPT)) {
+		jsR_pushtrace(J, obj->u.f.function->name, obj->u.f.function->filename, obj->u.f.function->line);
+		jsR_pushframe(J, obj->u.f.function, savebot, obj->type == JS_CFUNCTION || obj->u.f.scope, opcall);
+		jsR_callstats(J, n, obj);
+		--J->tracetop;
+	} else
+#endif
 	if (obj->type == JS_CFUNCTION) {
 		jsR_pushtrace(J, obj->u.f.function->name, obj->u.f.function->filename, obj->u.f.function->line);
+		jsR_pushframe(J, obj->u.f.function, savebot, 1, opcall);
 		if (obj->u.f.function->lightweight)
 			jsR_calllwfunction(J, n, obj->u.f.function, obj->u.f.scope);
 		else
@@ -1400,14 +1502,17 @@ void js_call(js_State *J, int n)
 		--J->tracetop;
 	} else if (obj->type == JS_CSCRIPT) {
 		jsR_pushtrace(J, obj->u.f.function->name, obj->u.f.function->filename, obj->u.f.function->line);
+		jsR_pushframe(J, obj->u.f.function, savebot, obj->u.f.scope != NULL, opcall);
 		jsR_callscript(J, n, obj->u.f.function, obj->u.f.scope);
 		--J->tracetop;
 	} else if (obj->type == JS_CCFUNCTION) {
 		jsR_pushtrace(J, obj->u.c.name, "native", 0);
+		jsR_pushframe(J, NULL, savebot, 0, opcall);
 		jsR_callcfunction(J, n, obj->u.c.length, obj->u.c.function);
 		--J->tracetop;
 	}
 
+	--J->frametop;
 	BOT = savebot;
 }
 
@@ -1555,8 +1660,10 @@ void *js_savetrypc(js_State *J, js_Instruction *pc)
 	if (J->trytop == JS_TRYLIMIT)
 		js_error(J, "try: exception stack overflow");
 	J->trybuf[J->trytop].E = J->E;
+	J->trybuf[J->trytop].co = J->co;
 	J->trybuf[J->trytop].envtop = J->envtop;
 	J->trybuf[J->trytop].tracetop = J->tracetop;
+	J->trybuf[J->trytop].frametop = J->frametop;
 	J->trybuf[J->trytop].top = J->top;
 	J->trybuf[J->trytop].bot = J->bot;
 	J->trybuf[J->trytop].strict = J->strict;
@@ -1569,8 +1676,10 @@ void *js_savetry(js_State *J)
 	if (J->trytop == JS_TRYLIMIT)
 		js_error(J, "try: exception stack overflow");
 	J->trybuf[J->trytop].E = J->E;
+	J->trybuf[J->trytop].co = J->co;
 	J->trybuf[J->trytop].envtop = J->envtop;
 	J->trybuf[J->trytop].tracetop = J->tracetop;
+	J->trybuf[J->trytop].frametop = J->frametop;
 	J->trybuf[J->trytop].top = J->top;
 	J->trybuf[J->trytop].bot = J->bot;
 	J->trybuf[J->trytop].strict = J->strict;
@@ -1591,11 +1700,14 @@ void js_throw(js_State *J)
 		js_Value v = *stackidx(J, -1);
 		--J->trytop;
 		J->E = J->trybuf[J->trytop].E;
+		J->co = J->trybuf[J->trytop].co;
 		J->envtop = J->trybuf[J->trytop].envtop;
 		J->tracetop = J->trybuf[J->trytop].tracetop;
+		J->frametop = J->trybuf[J->trytop].frametop;
 		J->top = J->trybuf[J->trytop].top;
 		J->bot = J->trybuf[J->trytop].bot;
 		J->strict = J->trybuf[J->trytop].strict;
+		J->inhook = 0;
 		js_pushvalue(J, v);
 		longjmp(J->trybuf[J->trytop].buf, 1);
 	}
@@ -1604,6 +1716,289 @@ void js_throw(js_State *J)
 	abort();
 }
 
+/* Coroutines */
+
+void jsR_freecoroutine(js_State *J, js_Coroutine *co)
+{
+	js_free(J, co->stack);
+	js_free(J, co->frames);
+	js_free(J, co->envstack);
+	js_free(J, co->trace);
+	js_free(J, co->trybuf);
+	js_free(J, co);
+}
+
+static void *jsR_savearray(js_State *J, void *copy, const void *from, int n, int size)
+{
+	copy = js_realloc(J, copy, n > 0 ? n * size : 1);
+	if (n > 0)
+		memcpy(copy, from, n * size);
+	return copy;
+}
+
+static js_Coroutine *js_tocoroutine(js_State *J, int idx)
+{
+	js_Value *v = stackidx(J, idx);
+	if (v->type == JS_TOBJECT && v->u.object->type == JS_CCOROUTINE)
+		return v->u.object->u.co;
+	js_typeerror(J, "not a coroutine");
+}
+
+void js_newcoroutine(js_State *J)
+{
+	js_Coroutine *co;
+	js_Object *obj;
+
+	if (!js_iscallable(J, -1))
+		js_typeerror(J, "coroutine body is not callable");
+
+	co = js_malloc(J, sizeof *co);
+	memset(co, 0, sizeof *co);
+	co->function = js_toobject(J, -1);
+	co->status = JS_COSUSPENDED;
+
+	obj = jsV_newobject(J, JS_CCOROUTINE, J->Object_prototype);
+	obj->u.co = co;
+	js_pop(J, 1);
+	js_pushobject(J, obj);
+}
+
+int js_iscoroutine(js_State *J, int idx)
+{
+	js_Value *v = stackidx(J, idx);
+	return v->type == JS_TOBJECT && v->u.object->type == JS_CCOROUTINE;
+}
+
+int js_costatus(js_State *J, int idx)
+{
+	return js_tocoroutine(J, idx)->status;
+}
+
+int js_isyieldable(js_State *J)
+{
+	js_Frame *frame;
+	int i;
+
+	if (!J->co || J->frametop <= J->co->framebase)
+		return 0;
+
+	/* only a native function called straight from script, or the hook, can yield */
+	frame = &J->frames[J->frametop - 1];
+	if (!frame->resumable)
+		return 0;
+	if (frame->F ? !J->inhook : frame->bot != BOT)
+		return 0;
+
+	/* the native function must not have an open js_try */
+	for (i = J->co->trybase; i < J->trytop; ++i)
+		if (!J->trybuf[i].pc)
+			return 0;
+
+	return 1;
+}
+
+void js_yield(js_State *J)
+{
+	js_Coroutine *co = J->co;
+	js_Frame *frame;
+	int i, top;
+
+	if (!js_isyieldable(J))
+		js_error(J, "cannot yield across a native call boundary");
+
+	frame = &J->frames[J->frametop - 1];
+	if (frame->F) {
+		/* from the hook, the script continues where it was interrupted */
+		if (TOP == J->hooktop)
+			js_pushundefined(J);
+		top = J->hooktop;
+		co->native = 0;
+		co->bot = BOT - co->stackbase;
+		co->framelen = J->frametop - co->framebase;
+		co->tracelen = J->tracetop - co->tracebase;
+	} else {
+		/* the native call is dropped, js_resume pushes its return value */
+		top = frame->bot - 1;
+		co->native = 1;
+		co->bot = frame->savebot - co->stackbase;
+		co->framelen = J->frametop - 1 - co->framebase;
+		co->tracelen = J->tracetop - 1 - co->tracebase;
+	}
+	co->E = J->E;
+	co->stacklen = top - co->stackbase;
+	co->envlen = J->envtop - co->envbase;
+	co->trylen = J->trytop - co->trybase;
+
+	co->stack = jsR_savearray(J, co->stack, STACK + co->stackbase, co->stacklen, sizeof *STACK);
+	co->frames = jsR_savearray(J, co->frames, J->frames + co->framebase, co->framelen, sizeof *J->frames);
+	co->envstack = jsR_savearray(J, co->envstack, J->envstack + co->envbase, co->envlen, sizeof *J->envstack);
+	co->trace = jsR_savearray(J, co->trace, J->trace + co->tracebase + 1, co->tracelen, sizeof *J->trace);
+	co->trybuf = jsR_savearray(J, co->trybuf, J->trybuf + co->trybase, co->trylen, sizeof *J->trybuf);
+
+	for (i = 0; i < co->framelen; ++i) {
+		co->frames[i].savebot -= co->stackbase;
+		co->frames[i].bot -= co->stackbase;
+	}
+	for (i = 0; i < co->trylen; ++i) {
+		co->trybuf[i].top -= co->stackbase;
+		co->trybuf[i].bot -= co->stackbase;
+		co->trybuf[i].envtop -= co->envbase;
+		co->trybuf[i].tracetop -= co->tracebase;
+		co->trybuf[i].frametop -= co->framebase;
+	}
+
+	/* unwind to js_resume, passing the value on top of the stack */
+	co->status = JS_COSUSPENDED;
+	J->trytop = co->trybase;
+	js_throw(J);
+}
+
+static void jsR_restorecoroutine(js_State *J, js_Coroutine *co, js_Value *result)
+{
+	js_Frame *base;
+	int i;
+
+	if (TOP + co->stacklen + 1 > JS_STACKSIZE)
+		js_stackoverflow(J);
+	if (J->envtop + co->envlen > JS_ENVLIMIT || J->tracetop + co->tracelen + 1 >= JS_ENVLIMIT)
+		js_error(J, "call stack overflow");
+	if (J->trytop + co->trylen > JS_TRYLIMIT)
+		js_error(J, "try: exception stack overflow");
+
+	memcpy(STACK + TOP, co->stack, co->stacklen * sizeof *STACK);
+	memcpy(J->frames + J->frametop, co->frames, co->framelen * sizeof *J->frames);
+	memcpy(J->envstack + J->envtop, co->envstack, co->envlen * sizeof *J->envstack);
+	memcpy(J->trace + J->tracetop + 1, co->trace, co->tracelen * sizeof *J->trace);
+	memcpy(J->trybuf + J->trytop, co->trybuf, co->trylen * sizeof *J->trybuf);
+
+	for (i = 0; i < co->framelen; ++i) {
+		J->frames[J->frametop + i].savebot += TOP;
+		J->frames[J->frametop + i].bot += TOP;
+	}
+	for (i = 0; i < co->trylen; ++i) {
+		J->trybuf[J->trytop + i].top += TOP;
+		J->trybuf[J->trytop + i].bot += TOP;
+		J->trybuf[J->trytop + i].envtop += J->envtop;
+		J->trybuf[J->trytop + i].tracetop += J->tracetop;
+		J->trybuf[J->trytop + i].frametop += J->frametop;
+	}
+
+	/* the bottom frame returns to whoever resumes us this time */
+	if (co->framelen > 0) {
+		base = &J->frames[J->frametop];
+		base->savebot = BOT;
+		if (base->scoped)
+			J->envstack[J->envtop] = J->E;
+		BOT = TOP + co->bot;
+		J->E = co->E;
+	}
+
+	TOP += co->stacklen;
+	J->frametop += co->framelen;
+	J->envtop += co->envlen;
+	J->tracetop += co->tracelen;
+	J->trytop += co->trylen;
+
+	/* drop the references held by the copy */
+	co->E = NULL;
+	co->stacklen = co->framelen = co->envlen = co->tracelen = co->trylen = 0;
+
+	if (co->native)
+		js_pushvalue(J, *result);
+}
+
+static void jsR_finishframe(js_State *J, js_Frame *frame)
+{
+	js_Value v = *stackidx(J, -1);
+	TOP = --BOT; /* clear stack */
+	js_pushvalue(J, v);
+	if (frame->scoped)
+		jsR_restorescope(J);
+	--J->tracetop;
+	--J->frametop;
+	BOT = frame->savebot;
+}
+
+static void jsR_resumeframes(js_State *J, js_Coroutine *co, int savestrict)
+{
+	js_Instruction * volatile pc = NULL;
+	js_Frame *frame;
+	volatile int i;
+
+	/* the try blocks of the suspended frames land here */
+	for (i = co->trybase; i < J->trytop; ++i) {
+		if (setjmp(J->trybuf[i].buf)) {
+			pc = J->trybuf[J->trytop].pc;
+			break;
+		}
+	}
+
+	while (J->frametop > co->framebase) {
+		frame = &J->frames[J->frametop - 1];
+		J->strict = J->frametop - 1 > co->framebase ? frame[-1].F->strict : savestrict;
+		jsR_run(J, frame->F, pc ? pc : frame->pc);
+		pc = NULL;
+		jsR_finishframe(J, frame);
+	}
+}
+
+int js_resume(js_State *J, int idx, int n)
+{
+	js_Coroutine *co = js_tocoroutine(J, idx);
+	js_Coroutine *saveco = J->co;
+	int savetop = TOP - n;
+	js_Value result;
+
+	if (co->status != JS_COSUSPENDED)
+		js_error(J, "cannot resume %s coroutine", co->status == JS_CORUNNING ? "running" : "dead");
+
+	if (js_try(J)) {
+		/* clean up the stack to only hold the yielded value or error object */
+		STACK[savetop] = STACK[TOP-1];
+		TOP = savetop + 1;
+		if (co->status == JS_COSUSPENDED)
+			return JS_COYIELD;
+		co->status = JS_CODEAD;
+		return JS_COERROR;
+	}
+
+	co->status = JS_CORUNNING;
+	co->stackbase = savetop;
+	co->framebase = J->frametop;
+	co->envbase = J->envtop;
+	co->tracebase = J->tracetop;
+	co->trybase = J->trytop;
+	J->co = co;
+
+	if (co->function) {
+		/* first resume calls the body with the arguments */
+		if (TOP + 2 > JS_STACKSIZE)
+			js_stackoverflow(J);
+		memmove(STACK + savetop + 2, STACK + savetop, n * sizeof *STACK);
+		STACK[savetop].type = JS_TOBJECT;
+		STACK[savetop].u.object = co->function;
+		STACK[savetop+1].type = JS_TUNDEFINED;
+		TOP += 2;
+		co->function = NULL;
+		J->opcall = 1;
+		js_call(J, n);
+	} else {
+		/* the first argument is the result of the suspended call */
+		if (n > 0)
+			result = STACK[savetop];
+		else
+			result.type = JS_TUNDEFINED;
+		TOP = savetop;
+		jsR_restorecoroutine(J, co, &result);
+		jsR_resumeframes(J, co, J->strict);
+	}
+
+	co->status = JS_CODEAD;
+	J->co = saveco;
+	js_endtry(J);
+	return JS_CODONE;
+}
+
 /* Main interpreter loop */
 
 static void jsR_dumpstack(js_State *J)
@@ -1657,7 +2052,98 @@ void js_trap(js_State *J, int pc)
 	js_stacktrace(J);
 }
 
-static void jsR_run(js_State *J, js_Function *F)
+void jsR_resettick(js_State *J)
+{
+	int n = J->hook ? J->hookleft : 0;
+	if (J->profile && J->profile->left > 0 && (!n || J->profile->left < n))
+		n = J->profile->left;
+	J->tickspan = J->tickleft = n;
+}
+
+static void jsR_callhook(js_State *J, js_Frame *frame, js_Instruction *pc)
+{
+	int savetop = TOP;
+
+	if (J->inhook)
+		return;
+
+	/* where a coroutine suspended by the hook continues */
+	frame->pc = pc;
+	J->hooktop = TOP;
+
+	J->inhook = 1;
+	J->hook(J);
+	J->inhook = 0;
+
+	TOP = savetop;
+}
+
+static void jsR_ontick(js_State *J, js_Frame *frame, js_Instruction *pc)
+{
+	int ticks = J->tickspan - J->tickleft; /* only those that ran */
+	int sample = J->samplerequest;
+	int hook = 0;
+	J->samplerequest = 0;
+	if (J->profile)
+		jsR_profiletick(J, ticks, sample);
+	if (J->hook) {
+		J->hookleft -= ticks;
+		if (J->hookleft <= 0) {
+			J->hookleft = J->hookcount;
+			hook = 1;
+		}
+	}
+	jsR_resettick(J);
+	if (hook)
+		jsR_callhook(J, frame, pc);
+}
+
+#define jsR_tick(J) ((J->tickspan && --J->tickleft <= 0) || J->samplerequest)
+
+/* Small integer fast paths, checked before the generic coercions */
+#define jsR_topint(J) (TOP > BOT && STACK[TOP-1].type == JS_TINTEGER)
+#define jsR_intpair(J) (TOP - BOT >= 2 && STACK[TOP-2].type == JS_TINTEGER && STACK[TOP-1].type == JS_TINTEGER)
+
+/* Number and string operand pairs, which need no coercion */
+#define jsR_operands(J) (TOP - BOT >= 2 && (vx = &STACK[TOP-2], vy = &STACK[TOP-1], 1))
+#define jsR_numpair(J) (jsR_operands(J) && jsV_isnumber(vx) && jsV_isnumber(vy))
+#define jsR_strpair(J) (jsR_operands(J) && jsV_isstring(vx) && jsV_isstring(vy))
+#define jsR_tonum(v) ((v)->type == JS_TINTEGER ? (double)(v)->u.integer : (v)->u.number)
+#define jsR_popnumpair(J) (x = jsR_tonum(vx), y = jsR_tonum(vy), TOP -= 2)
+
+#define jsR_fastcompare(J, op) \
+	if (jsR_intpair(J)) { \
+		b = STACK[TOP-2].u.integer op STACK[TOP-1].u.integer; \
+		TOP -= 2; \
+		js_pushboolean(J, b); \
+		break; \
+	} \
+	if (jsR_numpair(J)) { \
+		jsR_popnumpair(J); \
+		js_pushboolean(J, x op y); \
+		break; \
+	} \
+	if (jsR_strpair(J)) { \
+		b = strcmp(jsU_valtocstr(vx), jsU_valtocstr(vy)) op 0; \
+		TOP -= 2; \
+		js_pushboolean(J, b); \
+		break; \
+	}
+
+#define jsR_fastequal(J, eq) \
+	if (jsR_numpair(J)) { \
+		jsR_popnumpair(J); \
+		js_pushboolean(J, (x == y) == eq); \
+		break; \
+	} \
+	if (jsR_strpair(J)) { \
+		b = !strcmp(jsU_valtocstr(vx), jsU_valtocstr(vy)); \
+		TOP -= 2; \
+		js_pushboolean(J, b == eq); \
+		break; \
+	}
+
+static void jsR_run(js_State *J, js_Function *F, js_Instruction *pc)
 {
 	js_Function **FT = F->funtab;
 	double *NT = F->numtab;
@@ -1665,13 +2151,14 @@ static void jsR_run(js_State *J, js_Function *F)
 	const char **VT = F->vartab-1;
 	int lightweight = F->lightweight;
 	js_Instruction *pcstart = F->code;
-	js_Instruction *pc = F->code;
+	js_Frame *frame = &J->frames[J->frametop - 1];
 	enum js_OpCode opcode;
 	int offset;
 	int savestrict;
 
 	const char *str;
 	js_Object *obj;
+	js_Value *vx, *vy;
 	double x, y;
 	unsigned int ux, uy;
 	int ix, iy, okay;
@@ -1686,6 +2173,14 @@ static void jsR_run(js_State *J, js_Function *F)
 
 		opcode = *pc++;
 
+#ifdef JS_OPSTATS
+		if (J->stats) {
+			++J->opstats[opcode];
+			if (!F->shared)
+				++F->nops;
+		}
+#endif
+
 		switch (opcode) {
 		case OP_POP: js_pop(J, 1); break;
 		case OP_DUP: js_dup(J); break;
@@ -1694,7 +2189,7 @@ static void jsR_run(js_State *J, js_Function *F)
 		case OP_ROT3: js_rot3(J); break;
 		case OP_ROT4: js_rot4(J); break;
 
-		case OP_INTEGER: js_pushnumber(J, *pc++ - 32768); break;
+		case OP_INTEGER: jsR_pushinteger(J, *pc++ - 32768); break;
 		case OP_NUMBER: js_pushnumber(J, NT[*pc++]); break;
 		case OP_STRING: js_pushliteral(J, ST[*pc++]); break;
 
@@ -1887,10 +2382,16 @@ static void jsR_run(js_State *J, js_Function *F)
 			break;
 
 		case OP_CALL:
-			js_call(J, *pc++);
+			if (jsR_tick(J))
+				jsR_ontick(J, frame, pc - 1);
+			frame->pc = ++pc;
+			J->opcall = 1;
+			js_call(J, pc[-1]);
 			break;
 
 		case OP_NEW:
+			if (jsR_tick(J))
+				jsR_ontick(J, frame, pc - 1);
 			js_construct(J, *pc++);
 			break;
 
@@ -1917,7 +2418,7 @@ static void jsR_run(js_State *J, js_Function *F)
 		case OP_BITNOT:
 			ix = js_toint32(J, -1);
 			js_pop(J, 1);
-			js_pushnumber(J, ~ix);
+			jsR_pushinteger(J, ~ix);
 			break;
 
 		case OP_LOGNOT:
@@ -1927,18 +2428,34 @@ static void jsR_run(js_State *J, js_Function *F)
 			break;
 
 		case OP_INC:
+			if (jsR_topint(J)) {
+				ix = STACK[--TOP].u.integer;
+				jsR_pushint64(J, (int64_t)ix + 1);
+				break;
+			}
 			x = js_tonumber(J, -1);
 			js_pop(J, 1);
 			js_pushnumber(J, x + 1);
 			break;
 
 		case OP_DEC:
+			if (jsR_topint(J)) {
+				ix = STACK[--TOP].u.integer;
+				jsR_pushint64(J, (int64_t)ix - 1);
+				break;
+			}
 			x = js_tonumber(J, -1);
 			js_pop(J, 1);
 			js_pushnumber(J, x - 1);
 			break;
 
 		case OP_POSTINC:
+			if (jsR_topint(J)) {
+				ix = STACK[--TOP].u.integer;
+				jsR_pushint64(J, (int64_t)ix + 1);
+				jsR_pushinteger(J, ix);
+				break;
+			}
 			x = js_tonumber(J, -1);
 			js_pop(J, 1);
 			js_pushnumber(J, x + 1);
@@ -1946,6 +2463,12 @@ static void jsR_run(js_State *J, js_Function *F)
 			break;
 
 		case OP_POSTDEC:
+			if (jsR_topint(J)) {
+				ix = STACK[--TOP].u.integer;
+				jsR_pushint64(J, (int64_t)ix - 1);
+				jsR_pushinteger(J, ix);
+				break;
+			}
 			x = js_tonumber(J, -1);
 			js_pop(J, 1);
 			js_pushnumber(J, x - 1);
@@ -1955,6 +2478,11 @@ static void jsR_run(js_State *J, js_Function *F)
 		/* Multiplicative operators */
 
 		case OP_MUL:
+			if (jsR_numpair(J)) {
+				jsR_popnumpair(J);
+				js_pushnumber(J, x * y);
+				break;
+			}
 			x = js_tonumber(J, -2);
 			y = js_tonumber(J, -1);
 			js_pop(J, 2);
@@ -1962,6 +2490,11 @@ static void jsR_run(js_State *J, js_Function *F)
 			break;
 
 		case OP_DIV:
+			if (jsR_numpair(J)) {
+				jsR_popnumpair(J);
+				js_pushnumber(J, x / y);
+				break;
+			}
 			x = js_tonumber(J, -2);
 			y = js_tonumber(J, -1);
 			js_pop(J, 2);
@@ -1969,6 +2502,11 @@ static void jsR_run(js_State *J, js_Function *F)
 			break;
 
 		case OP_MOD:
+			if (jsR_numpair(J)) {
+				jsR_popnumpair(J);
+				js_pushnumber(J, fmod(x, y));
+				break;
+			}
 			x = js_tonumber(J, -2);
 			y = js_tonumber(J, -1);
 			js_pop(J, 2);
@@ -1978,10 +2516,30 @@ static void jsR_run(js_State *J, js_Function *F)
 		/* Additive operators */
 
 		case OP_ADD:
+			if (jsR_intpair(J)) {
+				TOP -= 2;
+				jsR_pushint64(J, (int64_t)STACK[TOP].u.integer + STACK[TOP+1].u.integer);
+				break;
+			}
+			if (jsR_numpair(J)) {
+				jsR_popnumpair(J);
+				js_pushnumber(J, x + y);
+				break;
+			}
 			js_concat(J);
 			break;
 
 		case OP_SUB:
+			if (jsR_intpair(J)) {
+				TOP -= 2;
+				jsR_pushint64(J, (int64_t)STACK[TOP].u.integer - STACK[TOP+1].u.integer);
+				break;
+			}
+			if (jsR_numpair(J)) {
+				jsR_popnumpair(J);
+				js_pushnumber(J, x - y);
+				break;
+			}
 			x = js_tonumber(J, -2);
 			y = js_tonumber(J, -1);
 			js_pop(J, 2);
@@ -1994,29 +2552,29 @@ static void jsR_run(js_State *J, js_Function *F)
 			ix = js_toint32(J, -2);
 			uy = js_touint32(J, -1);
 			js_pop(J, 2);
-			js_pushnumber(J, ix << (uy & 0x1F));
+			jsR_pushinteger(J, (int)((unsigned int)ix << (uy & 0x1F)));
 			break;
 
 		case OP_SHR:
 			ix = js_toint32(J, -2);
 			uy = js_touint32(J, -1);
 			js_pop(J, 2);
-			js_pushnumber(J, ix >> (uy & 0x1F));
+			jsR_pushinteger(J, ix >> (uy & 0x1F));
 			break;
 
 		case OP_USHR:
 			ux = js_touint32(J, -2);
 			uy = js_touint32(J, -1);
 			js_pop(J, 2);
-			js_pushnumber(J, ux >> (uy & 0x1F));
+			jsR_pushint64(J, ux >> (uy & 0x1F));
 			break;
 
 		/* Relational operators */
 
-		case OP_LT: b = js_compare(J, &okay); js_pop(J, 2); js_pushboolean(J, okay && b < 0); break;
-		case OP_GT: b = js_compare(J, &okay); js_pop(J, 2); js_pushboolean(J, okay && b > 0); break;
-		case OP_LE: b = js_compare(J, &okay); js_pop(J, 2); js_pushboolean(J, okay && b <= 0); break;
-		case OP_GE: b = js_compare(J, &okay); js_pop(J, 2); js_pushboolean(J, okay && b >= 0); break;
+		case OP_LT: jsR_fastcompare(J, <) b = js_compare(J, &okay); js_pop(J, 2); js_pushboolean(J, okay && b < 0); break;
+		case OP_GT: jsR_fastcompare(J, >) b = js_compare(J, &okay); js_pop(J, 2); js_pushboolean(J, okay && b > 0); break;
+		case OP_LE: jsR_fastcompare(J, <=) b = js_compare(J, &okay); js_pop(J, 2); js_pushboolean(J, okay && b <= 0); break;
+		case OP_GE: jsR_fastcompare(J, >=) b = js_compare(J, &okay); js_pop(J, 2); js_pushboolean(J, okay && b >= 0); break;
 
 		case OP_INSTANCEOF:
 			b = js_instanceof(J);
@@ -2026,10 +2584,10 @@ static void jsR_run(js_State *J, js_Function *F)
 
 		/* Equality */
 
-		case OP_EQ: b = js_equal(J); js_pop(J, 2); js_pushboolean(J, b); break;
-		case OP_NE: b = js_equal(J); js_pop(J, 2); js_pushboolean(J, !b); break;
-		case OP_STRICTEQ: b = js_strictequal(J); js_pop(J, 2); js_pushboolean(J, b); break;
-		case OP_STRICTNE: b = js_strictequal(J); js_pop(J, 2); js_pushboolean(J, !b); break;
+		case OP_EQ: jsR_fastequal(J, 1) b = js_equal(J); js_pop(J, 2); js_pushboolean(J, b); break;
+		case OP_NE: jsR_fastequal(J, 0) b = js_equal(J); js_pop(J, 2); js_pushboolean(J, !b); break;
+		case OP_STRICTEQ: jsR_fastequal(J, 1) b = js_strictequal(J); js_pop(J, 2); js_pushboolean(J, b); break;
+		case OP_STRICTNE: jsR_fastequal(J, 0) b = js_strictequal(J); js_pop(J, 2); js_pushboolean(J, !b); break;
 
 		case OP_JCASE:
 			offset = *pc++;
@@ -2048,21 +2606,21 @@ static void jsR_run(js_State *J, js_Function *F)
 			ix = js_toint32(J, -2);
 			iy = js_toint32(J, -1);
 			js_pop(J, 2);
-			js_pushnumber(J, ix & iy);
+			jsR_pushinteger(J, ix & iy);
 			break;
 
 		case OP_BITXOR:
 			ix = js_toint32(J, -2);
 			iy = js_toint32(J, -1);
 			js_pop(J, 2);
-			js_pushnumber(J, ix ^ iy);
+			jsR_pushinteger(J, ix ^ iy);
 			break;
 
 		case OP_BITOR:
 			ix = js_toint32(J, -2);
 			iy = js_toint32(J, -1);
 			js_pop(J, 2);
-			js_pushnumber(J, ix | iy);
+			jsR_pushinteger(J, ix | iy);
 			break;
 
 		/* Try and Catch */
@@ -2116,23 +2674,32 @@ static void jsR_run(js_State *J, js_Function *F)
 			break;
 
 		case OP_JUMP:
-			pc = pcstart + *pc;
+			offset = *pc;
+			if (offset < pc - pcstart && jsR_tick(J))
+				jsR_ontick(J, frame, pcstart + offset);
+			pc = pcstart + offset;
 			break;
 
 		case OP_JTRUE:
 			offset = *pc++;
 			b = js_toboolean(J, -1);
 			js_pop(J, 1);
-			if (b)
+			if (b) {
+				if (offset < pc - pcstart && jsR_tick(J))
+					jsR_ontick(J, frame, pcstart + offset);
 				pc = pcstart + offset;
+			}
 			break;
 
 		case OP_JFALSE:
 			offset = *pc++;
 			b = js_toboolean(J, -1);
 			js_pop(J, 1);
-			if (!b)
+			if (!b) {
+				if (offset < pc - pcstart && jsR_tick(J))
+					jsR_ontick(J, frame, pcstart + offset);
 				pc = pcstart + offset;
+			}
 			break;
 
 		case OP_RETURN:
@@ -12,4 +12,40 @@ struct js_Environment
 	int gcmark;
 };
 
+struct js_Coroutine
+{
+	js_Object *function; /* body, until the first resume */
+	int status;
+	int native; /* suspended inside a native function call */
+
+	/* where the running coroutine starts on the shared stacks */
+	int stackbase, framebase, envbase, tracebase, trybase;
+
+	/* copy of the stacks while suspended, indices relative to the bases */
+	js_Environment *E;
+	int bot;
+	int stacklen, framelen, envlen, tracelen, trylen;
+	js_Value *stack;
+	js_Frame *frames;
+	js_Environment **envstack;
+	js_StackTrace *trace;
+	js_Jumpbuf *trybuf;
+};
+
+void jsR_freecoroutine(js_State *J, js_Coroutine *co);
+
+struct js_Profile
+{
+	int interval; /* ticks between samples, 0 when driven by js_sampleprofile */
+	int left;
+	int nsamples;
+	hashtable_t stacks; /* js_ProfileStack by hash of the trace */
+	js_StackTrace *frames;
+	int nframes, capframes;
+};
+
+void jsR_resettick(js_State *J);
+void jsR_profiletick(js_State *J, int ticks, int sample);
+void jsR_freeprofile(js_State *J);
+
 #endif
@@ -0,0 +1,750 @@
+#include "jsi.h"
+#include "jsparse.h"
+#include "jscompile.h"
+#include "jsvalue.h"
+#include "jsrun.h"
+#include "utf.h"
+
+#include <errno.h>
+
+#if !defined(JS_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define JS_MMAP 1
+#endif
+#ifdef JS_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+	Shared scripts. A script is compiled once in one state and its function
+	tree, constants and strings are copied into a block that no state owns.
+	The copied functions are flagged as shared: the garbage collector never
+	marks, counts or frees them and nothing writes to them while they run,
+	so several states on different threads can create closures from the
+	same bytecode at once. Each state that loads a shared script keeps a
+	reference until it is freed.
+
+	The strings carry a regular js_StringNode header since literal values
+	point straight into them. The left link chains them for freeing.
+
+	A shared script can also be mapped from an image file, see below. Its
+	functions and strings then live in the mapping instead.
+*/
+
+#if defined(__GNUC__) || defined(__clang__)
+#define jsS_atomicadd(p, n) __atomic_add_fetch(p, n, __ATOMIC_ACQ_REL)
+#else
+#define jsS_atomicadd(p, n) (*(p) += (n))
+#endif
+
+struct js_Shared
+{
+	int refs;
+	js_Alloc alloc;
+	void *actx;
+	js_Function *function;
+	js_StringNode *strings;
+	void *map; /* image mapped by js_mapshared */
+	size_t mapsize;
+};
+
+/* Map or read a whole file into S->map, returns 0 and sets errno on failure. */
+#ifdef JS_MMAP
+static int jsS_mapfile(js_Shared *S, const char *filename)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) < 0 || st.st_size == 0 || st.st_size > INT_MAX) {
+		if (errno == 0)
+			errno = EINVAL;
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+	S->map = map;
+	S->mapsize = st.st_size;
+	return 1;
+}
+
+static void jsS_protect(js_Shared *S)
+{
+	mprotect(S->map, S->mapsize, PROT_READ);
+}
+
+static void jsS_unmapfile(js_Shared *S)
+{
+	munmap(S->map, S->mapsize);
+}
+#else
+static int jsS_mapfile(js_Shared *S, const char *filename)
+{
+	FILE *f;
+	void *map;
+	long n;
+
+	f = fopen(filename, "rb");
+	if (!f)
+		return 0;
+	if (fseek(f, 0, SEEK_END) < 0 || (n = ftell(f)) <= 0 || n > INT_MAX || fseek(f, 0, SEEK_SET) < 0) {
+		if (errno == 0)
+			errno = EINVAL;
+		fclose(f);
+		return 0;
+	}
+	map = S->alloc(S->actx, NULL, (int)n);
+	if (!map || fread(map, 1, (size_t)n, f) != (size_t)n) {
+		if (map)
+			S->alloc(S->actx, map, 0);
+		errno = map ? EIO : ENOMEM;
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+	S->map = map;
+	S->mapsize = n;
+	return 1;
+}
+
+static void jsS_protect(js_Shared *S)
+{
+	(void)S;
+}
+
+static void jsS_unmapfile(js_Shared *S)
+{
+	S->alloc(S->actx, S->map, 0);
+}
+#endif
+
+static void jsS_freesharedfunction(js_Shared *S, js_Function *F)
+{
+	int i;
+	if (!F)
+		return;
+	if (F->funtab)
+		for (i = 0; i < F->funlen; ++i)
+			jsS_freesharedfunction(S, F->funtab[i]);
+	S->alloc(S->actx, F->funtab, 0);
+	S->alloc(S->actx, F->numtab, 0);
+	S->alloc(S->actx, F->strtab, 0);
+	S->alloc(S->actx, F->vartab, 0);
+	S->alloc(S->actx, F->code, 0);
+	S->alloc(S->actx, F, 0);
+}
+
+static void jsS_freeshared(js_Shared *S)
+{
+	js_StringNode *node, *next;
+	if (S->map) {
+		jsS_unmapfile(S);
+		S->alloc(S->actx, S, 0);
+		return;
+	}
+	jsS_freesharedfunction(S, S->function);
+	for (node = S->strings; node; node = next) {
+		next = node->left;
+		S->alloc(S->actx, node, 0);
+	}
+	S->alloc(S->actx, S, 0);
+}
+
+static const char *jsS_sharestring(js_State *J, js_Shared *S, hashtable_t *strings, const char *s)
+{
+	js_StringNode *node, **found;
+	unsigned int size = 0, len;
+	uint64_t key = (uint64_t)(uintptr_t)s;
+
+	if (!s)
+		return NULL;
+	found = hashtable_find(strings, key);
+	if (found)
+		return (*found)->string;
+
+	len = utflen2(s, &size);
+	node = js_malloc(J, soffsetof(js_StringNode, string) + size + 1);
+	memset(node, 0, soffsetof(js_StringNode, string));
+	node->left = S->strings;
+	node->right = &jsS_sentinel;
+	node->level = 1;
+	node->length = len;
+	node->size = size;
+	node->isunicode = size != len;
+	memcpy(node->string, s, size + 1);
+	S->strings = node;
+	hashtable_insert(strings, key, &node);
+	return node->string;
+}
+
+static const char **jsS_sharestrings(js_State *J, js_Shared *S, hashtable_t *strings, const char **tab, int n)
+{
+	const char **copy;
+	int i;
+	if (n == 0)
+		return NULL;
+	copy = js_malloc(J, n * sizeof *copy);
+	memset(copy, 0, n * sizeof *copy);
+	for (i = 0; i < n; ++i)
+		copy[i] = jsS_sharestring(J, S, strings, tab[i]);
+	return copy;
+}
+
+static void *jsS_sharearray(js_State *J, const void *data, int size)
+{
+	void *copy;
+	if (size == 0)
+		return NULL;
+	copy = js_malloc(J, size);
+	memcpy(copy, data, size);
+	return copy;
+}
+
+/* The copy is linked into *slot before filling, so a failed copy can be freed. */
+static void jsS_sharefunction(js_State *J, js_Shared *S, hashtable_t *strings, js_Function *F, js_Function **slot)
+{
+	js_Function *C = js_malloc(J, sizeof *C);
+	int i;
+
+	memcpy(C, F, sizeof *C);
+	C->code = NULL;
+	C->funtab = NULL;
+	C->numtab = NULL;
+	C->strtab = NULL;
+	C->vartab = NULL;
+	C->funlen = 0;
+	C->gcnext = NULL;
+	C->gcmark = 0;
+	C->shared = 1;
+	*slot = C;
+
+	C->name = jsS_sharestring(J, S, strings, F->name);
+	C->filename = jsS_sharestring(J, S, strings, F->filename);
+
+	C->code = jsS_sharearray(J, F->code, F->codelen * sizeof *F->code);
+	C->codecap = F->codelen;
+	C->numtab = jsS_sharearray(J, F->numtab, F->numlen * sizeof *F->numtab);
+	C->numcap = F->numlen;
+	C->strtab = jsS_sharestrings(J, S, strings, F->strtab, F->strlen);
+	C->strcap = F->strlen;
+	C->vartab = jsS_sharestrings(J, S, strings, F->vartab, F->varlen);
+	C->varcap = F->varlen;
+
+	if (F->funlen > 0) {
+		C->funtab = js_malloc(J, F->funlen * sizeof *C->funtab);
+		memset(C->funtab, 0, F->funlen * sizeof *C->funtab);
+		C->funlen = C->funcap = F->funlen;
+		for (i = 0; i < F->funlen; ++i)
+			jsS_sharefunction(J, S, strings, F->funtab[i], &C->funtab[i]);
+	}
+
+#ifdef JS_OPSTATS
+	C->nops = 0;
+	C->ncalls = 0;
+	C->time = 0;
+#endif
+}
+
+js_Shared *js_compileshared(js_State *J, const char *filename, const char *source)
+{
+	js_Shared *volatile S = NULL;
+	hashtable_t strings;
+	js_Function *F;
+	js_Ast *P;
+
+	hashtable_init(&strings, sizeof(js_StringNode*), 256, NULL);
+
+	if (js_try(J)) {
+		jsP_freeparse(J);
+		hashtable_term(&strings);
+		if (S)
+			jsS_freeshared(S);
+		js_throw(J);
+	}
+
+	P = jsP_parse(J, filename, source);
+	F = jsC_compilescript(J, P, J->default_strict);
+	jsP_freeparse(J);
+
+	S = js_malloc(J, sizeof *S);
+	memset(S, 0, sizeof *S);
+	S->refs = 1;
+	S->alloc = J->alloc;
+	S->actx = J->actx;
+	jsS_sharefunction(J, S, &strings, F, &S->function);
+
+	js_endtry(J);
+	hashtable_term(&strings);
+	return S;
+}
+
+/*
+	Images. js_dumpimage writes a script's function tree in the layout it
+	has in memory, so that js_mapshared can map the file and run it in
+	place as a shared script. The file starts with a header followed by
+
+		js_Function[nfun]	the functions, the script function first
+		pointer tables		funtab, strtab and vartab of each function
+		uint64_t[nreloc]	offsets of every pointer slot in the file
+		js_Instruction[]	code, each function padded to 8 bytes
+		double[]		numtab of each function
+		js_StringNode[]		strings, each padded to 8 bytes
+
+	Pointer slots hold offsets from the start of the file. Mapping the file
+	privately and adding the base address to each slot listed in the
+	relocation table is the only work done at load time: the functions and
+	tables end up in a few private pages, while code, numbers and strings
+	are used directly from the page cache. The strings carry a
+	js_StringNode header so literal values can point at them; property
+	names are interned by each state on first use, like any other literal.
+
+	The layout depends on the engine build: the header records the format
+	version and the sizes it was written with, and js_mapshared refuses
+	files that do not match.
+*/
+
+#define JS_IMAGEMAGIC 0x696a756d /* "muji" */
+#define JS_IMAGEVERSION 1
+
+#define jsS_align8(n) (((n) + 7) & ~(uint64_t)7)
+
+typedef struct js_ImageHeader js_ImageHeader;
+
+struct js_ImageHeader
+{
+	uint32_t magic;
+	uint16_t version;
+	uint8_t ptrsize;
+	uint8_t instrsize;
+	uint16_t funsize;
+	uint16_t nodesize;
+	uint16_t opcount;
+	uint16_t reserved;
+	uint32_t nfun;
+	uint32_t nreloc;
+	uint32_t opcodes;
+	uint64_t size;
+	uint64_t reloc;
+	uint64_t root;
+};
+
+typedef struct { js_Function *F; int index; } js_ImageFunction;
+typedef struct { const char *s; uint64_t offset; } js_ImageString;
+
+typedef struct
+{
+	hashtable_t funs;
+	hashtable_t strings;
+	uint64_t tables, code, nums, strs;
+	int nreloc;
+	unsigned char *image;
+	uint64_t *reloc;
+} js_ImageWriter;
+
+static void jsS_imagestring(js_ImageWriter *W, const char *s)
+{
+	js_ImageString item;
+	unsigned int size = 0;
+	if (!s || hashtable_find(&W->strings, (uint64_t)(uintptr_t)s))
+		return;
+	utflen2(s, &size);
+	item.s = s;
+	item.offset = W->strs;
+	W->strs += jsS_align8(soffsetof(js_StringNode, string) + size + 1);
+	hashtable_insert(&W->strings, (uint64_t)(uintptr_t)s, &item);
+}
+
+static void jsS_imagecollect(js_ImageWriter *W, js_Function *F)
+{
+	js_ImageFunction item;
+	int i;
+
+	item.F = F;
+	item.index = hashtable_count(&W->funs);
+	hashtable_insert(&W->funs, (uint64_t)(uintptr_t)F, &item);
+
+	W->tables += (F->funlen + F->strlen + F->varlen) * sizeof(void*);
+	W->code += jsS_align8(F->codelen * sizeof(js_Instruction));
+	W->nums += F->numlen * sizeof(double);
+	W->nreloc += F->funlen + F->strlen + F->varlen;
+	W->nreloc += (F->name != NULL) + (F->filename != NULL) + (F->codelen > 0);
+	W->nreloc += (F->funlen > 0) + (F->numlen > 0) + (F->strlen > 0) + (F->varlen > 0);
+
+	jsS_imagestring(W, F->name);
+	jsS_imagestring(W, F->filename);
+	for (i = 0; i < F->strlen; ++i)
+		jsS_imagestring(W, F->strtab[i]);
+	for (i = 0; i < F->varlen; ++i)
+		jsS_imagestring(W, F->vartab[i]);
+	for (i = 0; i < F->funlen; ++i)
+		jsS_imagecollect(W, F->funtab[i]);
+}
+
+/* Store a file offset in a pointer slot and record the slot for relocation. */
+static void jsS_imageslot(js_ImageWriter *W, void *slot, uint64_t target)
+{
+	uintptr_t value = (uintptr_t)target;
+	memcpy(slot, &value, sizeof value);
+	W->reloc[W->nreloc++] = (unsigned char*)slot - W->image;
+}
+
+static uint64_t jsS_imagestringat(js_ImageWriter *W, uint64_t base, const char *s)
+{
+	js_ImageString *item = hashtable_find(&W->strings, (uint64_t)(uintptr_t)s);
+	return base + item->offset + soffsetof(js_StringNode, string);
+}
+
+int js_dumpimage(js_State *J, int idx, char **buffer)
+{
+	js_ImageWriter W;
+	js_ImageHeader *H;
+	js_ImageFunction *funs;
+	js_ImageString *strs;
+	js_Object *obj;
+	uint64_t funbase, tabbase, relbase, codebase, numbase, strbase, size;
+	uint64_t tab, code, num;
+	int i, k, nfun, nstr;
+
+	obj = js_toobject(J, idx);
+	if (obj->type != JS_CSCRIPT)
+		js_typeerror(J, "expected script value");
+	jsC_compiletree(J, obj->u.f.function);
+
+	memset(&W, 0, sizeof W);
+	hashtable_init(&W.funs, sizeof(js_ImageFunction), 64, NULL);
+	hashtable_init(&W.strings, sizeof(js_ImageString), 256, NULL);
+
+	if (js_try(J)) {
+		hashtable_term(&W.funs);
+		hashtable_term(&W.strings);
+		js_throw(J);
+	}
+
+	jsS_imagecollect(&W, obj->u.f.function);
+	nfun = hashtable_count(&W.funs);
+	nstr = hashtable_count(&W.strings);
+	funs = hashtable_items(&W.funs);
+	strs = hashtable_items(&W.strings);
+
+	funbase = jsS_align8(sizeof(js_ImageHeader));
+	tabbase = funbase + nfun * jsS_align8(sizeof(js_Function));
+	relbase = jsS_align8(tabbase + W.tables);
+	codebase = relbase + W.nreloc * sizeof(uint64_t);
+	numbase = codebase + W.code;
+	strbase = numbase + W.nums;
+	size = strbase + W.strs;
+	if (size > INT_MAX)
+		js_rangeerror(J, "image too large");
+
+	W.image = js_malloc(J, (int)size);
+	memset(W.image, 0, size);
+	W.reloc = (uint64_t*)(W.image + relbase);
+	W.nreloc = 0;
+
+	tab = tabbase;
+	code = codebase;
+	num = numbase;
+	for (i = 0; i < nfun; ++i) {
+		js_Function *F = funs[i].F;
+		js_Function *C = (js_Function*)(W.image + funbase + i * jsS_align8(sizeof(js_Function)));
+
+		memcpy(C, F, sizeof *C);
+		C->name = NULL;
+		C->filename = NULL;
+		C->code = NULL;
+		C->funtab = NULL;
+		C->numtab = NULL;
+		C->strtab = NULL;
+		C->vartab = NULL;
+		C->codecap = F->codelen;
+		C->funcap = F->funlen;
+		C->numcap = F->numlen;
+		C->strcap = F->strlen;
+		C->varcap = F->varlen;
+		C->shared = 1;
+		C->gcnext = NULL;
+		C->gcmark = 0;
+#ifdef JS_OPSTATS
+		C->nops = 0;
+		C->ncalls = 0;
+		C->time = 0;
+#endif
+
+		if (F->name)
+			jsS_imageslot(&W, &C->name, jsS_imagestringat(&W, strbase, F->name));
+		if (F->filename)
+			jsS_imageslot(&W, &C->filename, jsS_imagestringat(&W, strbase, F->filename));
+
+		if (F->codelen > 0) {
+			jsS_imageslot(&W, &C->code, code);
+			memcpy(W.image + code, F->code, F->codelen * sizeof *F->code);
+			code += jsS_align8(F->codelen * sizeof *F->code);
+		}
+		if (F->numlen > 0) {
+			jsS_imageslot(&W, &C->numtab, num);
+			memcpy(W.image + num, F->numtab, F->numlen * sizeof *F->numtab);
+			num += F->numlen * sizeof *F->numtab;
+		}
+		if (F->funlen > 0) {
+			jsS_imageslot(&W, &C->funtab, tab);
+			for (k = 0; k < F->funlen; ++k) {
+				js_ImageFunction *child = hashtable_find(&W.funs, (uint64_t)(uintptr_t)F->funtab[k]);
+				jsS_imageslot(&W, W.image + tab, funbase + child->index * jsS_align8(sizeof(js_Function)));
+				tab += sizeof(void*);
+			}
+		}
+		if (F->strlen > 0) {
+			jsS_imageslot(&W, &C->strtab, tab);
+			for (k = 0; k < F->strlen; ++k) {
+				jsS_imageslot(&W, W.image + tab, jsS_imagestringat(&W, strbase, F->strtab[k]));
+				tab += sizeof(void*);
+			}
+		}
+		if (F->varlen > 0) {
+			jsS_imageslot(&W, &C->vartab, tab);
+			for (k = 0; k < F->varlen; ++k) {
+				jsS_imageslot(&W, W.image + tab, jsS_imagestringat(&W, strbase, F->vartab[k]));
+				tab += sizeof(void*);
+			}
+		}
+	}
+
+	for (i = 0; i < nstr; ++i) {
+		js_StringNode *node = (js_StringNode*)(W.image + strbase + strs[i].offset);
+		unsigned int len, n = 0;
+		len = utflen2(strs[i].s, &n);
+		node->level = 1;
+		node->length = len;
+		node->size = n;
+		node->isunicode = n != len;
+		memcpy(node->string, strs[i].s, n + 1);
+	}
+
+	H = (js_ImageHeader*)W.image;
+	H->magic = JS_IMAGEMAGIC;
+	H->version = JS_IMAGEVERSION;
+	H->ptrsize = sizeof(void*);
+	H->instrsize = sizeof(js_Instruction);
+	H->funsize = sizeof(js_Function);
+	H->nodesize = soffsetof(js_StringNode, string);
+	H->opcount = OP_LINE + 1;
+	H->opcodes = jsC_opcodehash();
+	H->nfun = nfun;
+	H->nreloc = W.nreloc;
+	H->size = size;
+	H->reloc = relbase;
+	H->root = funbase;
+
+	js_endtry(J);
+	hashtable_term(&W.funs);
+	hashtable_term(&W.strings);
+	*buffer = (char*)W.image;
+	return (int)size;
+}
+
+/* Check the header and turn the pointer slots from offsets into addresses. */
+static const char *jsS_relocimage(unsigned char *image, uint64_t size)
+{
+	js_ImageHeader *H = (js_ImageHeader*)image;
+	uint64_t *reloc;
+	uintptr_t value;
+	uint32_t i;
+
+	if (size < sizeof *H || H->magic != JS_IMAGEMAGIC)
+		return "not a bytecode image";
+	if (H->version != JS_IMAGEVERSION || H->ptrsize != sizeof(void*) ||
+		H->instrsize != sizeof(js_Instruction) || H->funsize != sizeof(js_Function) ||
+		H->nodesize != soffsetof(js_StringNode, string) || H->opcount != OP_LINE + 1 ||
+		H->opcodes != jsC_opcodehash())
+		return "bytecode image was made by a different engine build";
+	if (H->size != size || H->nfun == 0 || H->reloc % 8 != 0 ||
+		H->reloc + (uint64_t)H->nreloc * sizeof *reloc > size ||
+		H->root % 8 != 0 || H->root + sizeof(js_Function) > size)
+		return "truncated bytecode image";
+
+	reloc = (uint64_t*)(image + H->reloc);
+	for (i = 0; i < H->nreloc; ++i) {
+		if (reloc[i] % sizeof(void*) != 0 || reloc[i] + sizeof(void*) > size)
+			return "corrupt bytecode image";
+		memcpy(&value, image + reloc[i], sizeof value);
+		if (value >= size)
+			return "corrupt bytecode image";
+		value += (uintptr_t)image;
+		memcpy(image + reloc[i], &value, sizeof value);
+	}
+	return NULL;
+}
+
+/* A relocated pointer must be NULL or land n bytes inside the image, aligned for its type. */
+static int jsS_imagerange(unsigned char *image, uint64_t size, const void *p, uint64_t n, int align)
+{
+	uint64_t at = (const unsigned char*)p - image;
+	if (!p)
+		return n == 0;
+	if ((const unsigned char*)p < image || at > size || n > size - at)
+		return 0;
+	return at % align == 0;
+}
+
+/* A string must sit in a whole node that describes it. */
+static int jsS_imagestr(unsigned char *image, uint64_t size, const char *s)
+{
+	const js_StringNode *node;
+	unsigned int len, n = 0;
+	if (!s || (const unsigned char*)s < image + soffsetof(js_StringNode, string))
+		return 0;
+	node = (const js_StringNode*)(s - soffsetof(js_StringNode, string));
+	if (!jsS_imagerange(image, size, node, soffsetof(js_StringNode, string), 8))
+		return 0;
+	if (!jsS_imagerange(image, size, s, (uint64_t)node->size + 1, 1) || s[node->size] != 0)
+		return 0;
+	len = utfnlen2(s, node->size, &n);
+	return n == node->size && len == node->length && node->isunicode == (n != len) &&
+		!memchr(s, 0, node->size);
+}
+
+/*
+	Check every relocated function the way js_loadbin checks what it reads:
+	tables must lie inside the image and hold strings and functions from
+	it, and function tables may only point forward so the functions form a
+	tree (or a DAG) without cycles. The code itself is left to the verifier.
+*/
+static const char *jsS_checkimage(unsigned char *image, uint64_t size)
+{
+	js_ImageHeader *H = (js_ImageHeader*)image;
+	uint64_t funbase = jsS_align8(sizeof(js_ImageHeader));
+	uint64_t stride = jsS_align8(sizeof(js_Function));
+	js_Function *F;
+	uint32_t i;
+	int k;
+
+	if (H->root != funbase || H->nfun > (size - funbase) / stride)
+		return "corrupt bytecode image";
+	for (i = 0; i < H->nfun; ++i) {
+		F = (js_Function*)(image + funbase + i * stride);
+		if (F->codelen < 0 || F->numlen < 0 || F->strlen < 0 || F->varlen < 0 || F->funlen < 0)
+			return "corrupt bytecode image";
+		if ((F->script | F->lightweight | F->strict | F->arguments) & ~1 ||
+			F->numparams < 0 || F->numparams > F->varlen)
+			return "corrupt bytecode image";
+		if (!F->shared || F->source || F->sourcepos || F->gcnext)
+			return "corrupt bytecode image";
+		if ((F->name && !jsS_imagestr(image, size, F->name)) ||
+			(F->filename && !jsS_imagestr(image, size, F->filename)))
+			return "corrupt bytecode image";
+		if (!jsS_imagerange(image, size, F->code, (uint64_t)F->codelen * sizeof *F->code, sizeof *F->code) ||
+			!jsS_imagerange(image, size, F->numtab, (uint64_t)F->numlen * sizeof *F->numtab, 8) ||
+			!jsS_imagerange(image, size, F->strtab, (uint64_t)F->strlen * sizeof *F->strtab, sizeof(void*)) ||
+			!jsS_imagerange(image, size, F->vartab, (uint64_t)F->varlen * sizeof *F->vartab, sizeof(void*)) ||
+			!jsS_imagerange(image, size, F->funtab, (uint64_t)F->funlen * sizeof *F->funtab, sizeof(void*)))
+			return "corrupt bytecode image";
+		for (k = 0; k < F->strlen; ++k)
+			if (!jsS_imagestr(image, size, F->strtab[k]))
+				return "corrupt bytecode image";
+		for (k = 0; k < F->varlen; ++k)
+			if (!jsS_imagestr(image, size, F->vartab[k]))
+				return "corrupt bytecode image";
+		for (k = 0; k < F->funlen; ++k) {
+			uint64_t at = (unsigned char*)F->funtab[k] - image;
+			if ((unsigned char*)F->funtab[k] < image || at < funbase || (at - funbase) % stride != 0 ||
+				(at - funbase) / stride <= i || (at - funbase) / stride >= H->nfun)
+				return "corrupt bytecode image";
+		}
+	}
+	return NULL;
+}
+
+/* Run the bytecode verifier on each function of the image. */
+static void jsS_verifyimage(js_State *J, unsigned char *image)
+{
+	js_ImageHeader *H = (js_ImageHeader*)image;
+	uint32_t i;
+	for (i = 0; i < H->nfun; ++i)
+		jsC_verifycode(J, (js_Function*)(image + H->root + i * jsS_align8(sizeof(js_Function))));
+}
+
+js_Shared *js_mapshared(js_State *J, const char *filename)
+{
+	js_Shared *S;
+	const char *error;
+	int err;
+
+	S = js_malloc(J, sizeof *S);
+	memset(S, 0, sizeof *S);
+	S->refs = 1;
+	S->alloc = J->alloc;
+	S->actx = J->actx;
+
+	errno = 0;
+	if (!jsS_mapfile(S, filename)) {
+		err = errno;
+		js_free(J, S);
+		js_error(J, "cannot map file '%s': %s", filename, strerror(err));
+	}
+
+	error = jsS_relocimage(S->map, S->mapsize);
+	if (!error)
+		error = jsS_checkimage(S->map, S->mapsize);
+	if (error) {
+		jsS_unmapfile(S);
+		js_free(J, S);
+		js_error(J, "%s: %s", filename, error);
+	}
+	if (js_try(J)) {
+		jsS_unmapfile(S);
+		js_free(J, S);
+		js_throw(J);
+	}
+	jsS_verifyimage(J, S->map);
+	js_endtry(J);
+	jsS_protect(S);
+	S->function = (js_Function*)((unsigned char*)S->map + ((js_ImageHeader*)S->map)->root);
+	return S;
+}
+
+js_Shared *js_retainshared(js_Shared *S)
+{
+	jsS_atomicadd(&S->refs, 1);
+	return S;
+}
+
+void js_releaseshared(js_Shared *S)
+{
+	if (S && jsS_atomicadd(&S->refs, -1) == 0)
+		jsS_freeshared(S);
+}
+
+void js_loadshared(js_State *J, js_Shared *S)
+{
+	int i;
+	for (i = 0; i < J->sharedlen; ++i)
+		if (J->shared[i] == S)
+			break;
+	if (i == J->sharedlen) {
+		if (J->sharedlen == J->sharedcap) {
+			int cap = J->sharedcap ? J->sharedcap * 2 : 4;
+			J->shared = js_realloc(J, J->shared, cap * sizeof *J->shared);
+			J->sharedcap = cap;
+		}
+		J->shared[J->sharedlen++] = js_retainshared(S);
+	}
+	js_newscript(J, S->function, J->GE);
+}
+
+void jsS_dropshared(js_State *J)
+{
+	int i;
+	for (i = 0; i < J->sharedlen; ++i)
+		js_releaseshared(J->shared[i]);
+	js_free(J, J->shared);
+	J->shared = NULL;
+	J->sharedlen = J->sharedcap = 0;
+}
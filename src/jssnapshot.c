@@ -0,0 +1,641 @@
+#include "jsi.h"
+#include "jscompile.h"
+#include "jsvalue.h"
+#include "jsrun.h"
+
+#include "regexp.h"
+
+/*
+	State snapshots. A snapshot is an image of a resting state's heap: every
+	object, property table, environment, function and string is copied into
+	one data block as a record, and every pointer between records is written
+	down as a relocation. A new state is made by allocating each record,
+	copying its bytes and patching the relocations, without running jsB_init
+	or any script.
+
+	Pointers that do not lead into the heap (C functions, constant strings,
+	shared scripts, the string tree sentinel) are copied as they are, so a
+	snapshot can only be instantiated in the process that made it.
+*/
+
+enum {
+	SNAP_OBJECT,
+	SNAP_PROPERTIES,
+	SNAP_SLOTS,
+	SNAP_ITEMS,
+	SNAP_ACCESSOR,
+	SNAP_ITERATOR,
+	SNAP_ENVIRONMENT,
+	SNAP_FUNCTION,
+	SNAP_FUNCTAB,
+	SNAP_STRTAB,
+	SNAP_INTERN,
+	SNAP_MEMSTR,
+	SNAP_STACK,
+	SNAP_BYTES,
+};
+
+typedef struct js_SnapRecord js_SnapRecord;
+typedef struct js_SnapReloc js_SnapReloc;
+
+struct js_SnapRecord
+{
+	int kind;
+	int system; /* allocated with malloc, like the property hash tables */
+	size_t offset, size, cap;
+};
+
+struct js_SnapReloc
+{
+	int rec; /* -1 for a field of js_State */
+	int target;
+	size_t offset, addend;
+};
+
+/* Pointer fields of js_State that lead into the heap */
+static const size_t snaproots[] = {
+	offsetof(js_State, Object_prototype),
+	offsetof(js_State, Array_prototype),
+	offsetof(js_State, Function_prototype),
+	offsetof(js_State, Boolean_prototype),
+	offsetof(js_State, Number_prototype),
+	offsetof(js_State, String_prototype),
+	offsetof(js_State, RegExp_prototype),
+	offsetof(js_State, Date_prototype),
+	offsetof(js_State, Error_prototype),
+	offsetof(js_State, EvalError_prototype),
+	offsetof(js_State, RangeError_prototype),
+	offsetof(js_State, ReferenceError_prototype),
+	offsetof(js_State, SyntaxError_prototype),
+	offsetof(js_State, TypeError_prototype),
+	offsetof(js_State, URIError_prototype),
+	offsetof(js_State, R),
+	offsetof(js_State, G),
+	offsetof(js_State, E),
+	offsetof(js_State, GE),
+	offsetof(js_State, stack),
+	offsetof(js_State, gcenv),
+	offsetof(js_State, gcfun),
+	offsetof(js_State, gcobj),
+	offsetof(js_State, gcstr),
+	offsetof(js_State, strings),
+	offsetof(js_State, lazy),
+	offsetof(js_State, lazyhash),
+};
+
+#define SNAPROOTS (int)nelem(snaproots)
+#define snapfield(base, offset) ((void**)((char*)(base) + (offset)))
+
+struct js_Snapshot
+{
+	js_Alloc alloc;
+	void *actx;
+
+	int nrec, reccap;
+	js_SnapRecord *rec;
+	int nreloc, reloccap;
+	js_SnapReloc *reloc;
+	int nregexp, regexpcap;
+	int *regexp; /* regexp objects, compiled again in each new state */
+	char *data;
+	size_t datalen, datacap;
+
+	void *roots[nelem(snaproots)];
+	js_Shared **shared;
+	int sharedlen;
+
+	/* scalar state */
+	js_Report report;
+	js_Panic panic;
+	js_Exit exit;
+	int default_strict, strict, lazycompile;
+	unsigned int seed;
+	int nextref;
+	int lazylen, lazycap, lazyhashlen, lazyhashcap;
+	int top;
+	int gcmark;
+	unsigned int nintern;
+	size_t internbytes;
+};
+
+typedef struct
+{
+	js_State *J;
+	js_Snapshot *S;
+	hashtable_t map; /* heap address to record index */
+	const void **src;
+} js_SnapBuilder;
+
+static void freesnapshot(js_Snapshot *S)
+{
+	int i;
+	for (i = 0; i < S->sharedlen; ++i)
+		js_releaseshared(S->shared[i]);
+	S->alloc(S->actx, S->shared, 0);
+	S->alloc(S->actx, S->rec, 0);
+	S->alloc(S->actx, S->reloc, 0);
+	S->alloc(S->actx, S->regexp, 0);
+	S->alloc(S->actx, S->data, 0);
+	S->alloc(S->actx, S, 0);
+}
+
+static int addrecord(js_SnapBuilder *B, int kind, int system, const void *key, const void *src, size_t size, size_t cap)
+{
+	js_State *J = B->J;
+	js_Snapshot *S = B->S;
+	js_SnapRecord *rec;
+	int i;
+
+	if (!src)
+		return -1;
+
+	if (S->nrec == S->reccap) {
+		S->reccap = S->reccap ? S->reccap * 2 : 256;
+		S->rec = js_realloc(J, S->rec, S->reccap * sizeof *S->rec);
+		B->src = js_realloc(J, B->src, S->reccap * sizeof *B->src);
+	}
+	while (S->datalen + ((size + 7) & ~(size_t)7) > S->datacap) {
+		S->datacap = S->datacap ? S->datacap * 2 : 65536;
+		S->data = js_realloc(J, S->data, S->datacap);
+	}
+
+	i = S->nrec++;
+	rec = &S->rec[i];
+	rec->kind = kind;
+	rec->system = system;
+	rec->offset = S->datalen;
+	rec->size = size;
+	rec->cap = cap;
+	memcpy(S->data + S->datalen, src, size);
+	S->datalen += (size + 7) & ~(size_t)7;
+	B->src[i] = src;
+	hashtable_insert(&B->map, (uint64_t)(uintptr_t)key, &i);
+	return i;
+}
+
+static void addreloc(js_SnapBuilder *B, int rec, size_t offset, int target, size_t addend)
+{
+	js_State *J = B->J;
+	js_Snapshot *S = B->S;
+	js_SnapReloc *r;
+	if (S->nreloc == S->reloccap) {
+		S->reloccap = S->reloccap ? S->reloccap * 2 : 1024;
+		S->reloc = js_realloc(J, S->reloc, S->reloccap * sizeof *S->reloc);
+	}
+	r = &S->reloc[S->nreloc++];
+	r->rec = rec;
+	r->target = target;
+	r->offset = offset;
+	r->addend = addend;
+}
+
+/* Pointers that are not found in the heap are left as they are. */
+static void relocptr(js_SnapBuilder *B, int rec, size_t offset, const void *p)
+{
+	int *found;
+	if (!p)
+		return;
+	found = hashtable_find(&B->map, (uint64_t)(uintptr_t)p);
+	if (found)
+		addreloc(B, rec, offset, *found, (const char*)p - (const char*)B->src[*found]);
+}
+
+static void relocvalue(js_SnapBuilder *B, int rec, size_t offset, const js_Value *v)
+{
+	offset += offsetof(js_Value, u);
+	switch (v->type) {
+	case JS_TOBJECT: relocptr(B, rec, offset, v->u.object); break;
+	case JS_TLITSTR:
+	case JS_TMEMSTR: relocptr(B, rec, offset, v->u.string.u.ptr8); break;
+	default: break;
+	}
+}
+
+/* String records are found by their text, links between nodes point at the header. */
+static void relocnode(js_SnapBuilder *B, int rec, size_t offset, const js_StringNode *node)
+{
+	int *found;
+	if (!node || node == &jsS_sentinel)
+		return;
+	found = hashtable_find(&B->map, (uint64_t)(uintptr_t)node->string);
+	if (found)
+		addreloc(B, rec, offset, *found, 0);
+}
+
+#define RELOC(B, rec, base, field) \
+	relocptr(B, rec, (const char*)&(base)->field - (const char*)(base), (base)->field)
+
+static void addproperties(js_SnapBuilder *B, hashtable_t *table)
+{
+	size_t itemsize = table->item_capacity * (sizeof *table->items_key + sizeof *table->items_slot + table->item_size) + table->item_size;
+	addrecord(B, SNAP_PROPERTIES, 0, table, table, sizeof *table, sizeof *table);
+	addrecord(B, SNAP_SLOTS, 1, table->slots, table->slots,
+		table->slot_capacity * sizeof *table->slots, table->slot_capacity * sizeof *table->slots);
+	addrecord(B, SNAP_ITEMS, 1, table->items_key, table->items_key, itemsize, itemsize);
+	hashtable_foreach(js_Property, ref, table)
+		if (ref->atts & JS_ACCESSOR)
+			addrecord(B, SNAP_ACCESSOR, 0, ref->value.u.accessor, ref->value.u.accessor, sizeof(js_Accessor), sizeof(js_Accessor));
+}
+
+static void addobject(js_SnapBuilder *B, js_Object *obj)
+{
+	js_State *J = B->J;
+	js_Snapshot *S = B->S;
+	js_Iterator *node;
+	int i;
+
+	if (obj->type == JS_CUSERDATA)
+		js_error(J, "cannot snapshot userdata (%s)", obj->u.user.tag);
+	if (obj->type == JS_CCOROUTINE)
+		js_error(J, "cannot snapshot a coroutine");
+
+	i = addrecord(B, SNAP_OBJECT, 0, obj, obj, sizeof *obj, sizeof *obj);
+	if (obj->properties)
+		addproperties(B, obj->properties);
+
+	if (obj->type == JS_CREGEXP) {
+		((js_Object*)(S->data + S->rec[i].offset))->u.r.prog = NULL;
+		if (S->nregexp == S->regexpcap) {
+			S->regexpcap = S->regexpcap ? S->regexpcap * 2 : 16;
+			S->regexp = js_realloc(J, S->regexp, S->regexpcap * sizeof *S->regexp);
+		}
+		S->regexp[S->nregexp++] = i;
+		addrecord(B, SNAP_BYTES, 0, obj->u.r.source, obj->u.r.source, strlen(obj->u.r.source) + 1, strlen(obj->u.r.source) + 1);
+	}
+
+	if (obj->type == JS_CITERATOR)
+		for (node = obj->u.iter.head; node; node = node->next)
+			addrecord(B, SNAP_ITERATOR, 0, node, node, sizeof *node, sizeof *node);
+}
+
+static void addfunction(js_SnapBuilder *B, js_Function *F)
+{
+	addrecord(B, SNAP_FUNCTION, 0, F, F, sizeof *F, sizeof *F);
+	addrecord(B, SNAP_BYTES, 0, F->code, F->code, F->codelen * sizeof *F->code, F->codecap * sizeof *F->code);
+	addrecord(B, SNAP_FUNCTAB, 0, F->funtab, F->funtab, F->funlen * sizeof *F->funtab, F->funcap * sizeof *F->funtab);
+	addrecord(B, SNAP_BYTES, 0, F->numtab, F->numtab, F->numlen * sizeof *F->numtab, F->numcap * sizeof *F->numtab);
+	addrecord(B, SNAP_STRTAB, 0, F->strtab, F->strtab, F->strlen * sizeof *F->strtab, F->strcap * sizeof *F->strtab);
+	addrecord(B, SNAP_STRTAB, 0, F->vartab, F->vartab, F->varlen * sizeof *F->vartab, F->varcap * sizeof *F->vartab);
+}
+
+static void addinterned(js_SnapBuilder *B, js_StringNode *node)
+{
+	size_t size = soffsetof(js_StringNode, string) + node->size + 1;
+	if (node == &jsS_sentinel)
+		return;
+	addrecord(B, SNAP_INTERN, 0, node->string, node, size, size);
+	addinterned(B, node->left);
+	addinterned(B, node->right);
+}
+
+static void relocrecord(js_SnapBuilder *B, int i)
+{
+	js_Snapshot *S = B->S;
+	js_SnapRecord *rec = &S->rec[i];
+	const void *src = B->src[i];
+	size_t k, n;
+
+	switch (rec->kind) {
+	case SNAP_OBJECT: {
+		const js_Object *obj = src;
+		RELOC(B, i, obj, properties);
+		RELOC(B, i, obj, prototype);
+		RELOC(B, i, obj, R);
+		RELOC(B, i, obj, gcnext);
+		switch (obj->type) {
+		case JS_CFUNCTION:
+		case JS_CSCRIPT:
+			RELOC(B, i, obj, u.f.function);
+			RELOC(B, i, obj, u.f.scope);
+			break;
+		case JS_CSTRING:
+			RELOC(B, i, obj, u.string.u.ptr8);
+			break;
+		case JS_CREGEXP:
+			RELOC(B, i, obj, u.r.source);
+			break;
+		case JS_CITERATOR:
+			RELOC(B, i, obj, u.iter.target);
+			RELOC(B, i, obj, u.iter.head);
+			break;
+		default:
+			break;
+		}
+		break;
+	}
+
+	case SNAP_PROPERTIES: {
+		const hashtable_t *table = src;
+		const char *items = (const char*)table->items_key;
+		int *found = hashtable_find(&B->map, (uint64_t)(uintptr_t)items);
+		RELOC(B, i, table, slots);
+		addreloc(B, i, offsetof(hashtable_t, items_key), *found, 0);
+		addreloc(B, i, offsetof(hashtable_t, items_slot), *found, (const char*)table->items_slot - items);
+		addreloc(B, i, offsetof(hashtable_t, items_data), *found, (const char*)table->items_data - items);
+		addreloc(B, i, offsetof(hashtable_t, swap_temp), *found, (const char*)table->swap_temp - items);
+		break;
+	}
+
+	case SNAP_ITEMS: {
+		/* the table record comes right before its slots and items */
+		const hashtable_t *table = B->src[i - 2];
+		const char *items = src;
+		const js_Property *ref = table->items_data;
+		int count = hashtable_count(table);
+		for (k = 0; k < (size_t)count; ++k, ++ref) {
+			size_t offset = (const char*)ref - items;
+			relocptr(B, i, offset + offsetof(js_Property, name), ref->name);
+			if (ref->atts & JS_ACCESSOR)
+				relocptr(B, i, offset + offsetof(js_Property, value) + offsetof(js_Value, u), ref->value.u.accessor);
+			else
+				relocvalue(B, i, offset + offsetof(js_Property, value), &ref->value);
+		}
+		break;
+	}
+
+	case SNAP_ACCESSOR: {
+		const js_Accessor *acc = src;
+		RELOC(B, i, acc, getter);
+		RELOC(B, i, acc, setter);
+		break;
+	}
+
+	case SNAP_ITERATOR: {
+		const js_Iterator *node = src;
+		RELOC(B, i, node, name);
+		RELOC(B, i, node, next);
+		break;
+	}
+
+	case SNAP_ENVIRONMENT: {
+		const js_Environment *env = src;
+		RELOC(B, i, env, outer);
+		RELOC(B, i, env, variables);
+		RELOC(B, i, env, gcnext);
+		break;
+	}
+
+	case SNAP_FUNCTION: {
+		const js_Function *F = src;
+		RELOC(B, i, F, name);
+		RELOC(B, i, F, filename);
+		RELOC(B, i, F, code);
+		RELOC(B, i, F, funtab);
+		RELOC(B, i, F, numtab);
+		RELOC(B, i, F, strtab);
+		RELOC(B, i, F, vartab);
+		RELOC(B, i, F, gcnext);
+		break;
+	}
+
+	case SNAP_FUNCTAB:
+	case SNAP_STRTAB: {
+		const void *const *tab = src;
+		n = rec->size / sizeof *tab;
+		for (k = 0; k < n; ++k)
+			relocptr(B, i, k * sizeof *tab, tab[k]);
+		break;
+	}
+
+	case SNAP_INTERN: {
+		const js_StringNode *node = src;
+		relocnode(B, i, offsetof(js_StringNode, left), node->left);
+		relocnode(B, i, offsetof(js_StringNode, right), node->right);
+		break;
+	}
+
+	case SNAP_MEMSTR: {
+		const js_StringNode *node = src;
+		relocnode(B, i, offsetof(js_StringNode, right), node->right);
+		break;
+	}
+
+	case SNAP_STACK: {
+		const js_Value *v = src;
+		n = rec->size / sizeof *v;
+		for (k = 0; k < n; ++k)
+			relocvalue(B, i, k * sizeof *v, &v[k]);
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+js_Snapshot *js_snapshot(js_State *J)
+{
+	js_SnapBuilder B;
+	js_Snapshot *volatile S = NULL;
+	js_Environment *env;
+	js_Function *fun;
+	js_Object *obj;
+	js_StringNode *str;
+	int i;
+
+	if (J->frametop > 0 || J->envtop > 0 || J->co || J->E != J->GE)
+		js_error(J, "cannot snapshot a running state");
+
+	if (!J->gcpause)
+		js_gc(J, 0);
+
+	/* functions not called yet point into their script text, which is not copied */
+	do {
+		i = 0;
+		for (fun = J->gcfun; fun; fun = fun->gcnext)
+			if (fun->source) {
+				jsC_compilelazy(J, fun);
+				i = 1;
+			}
+	} while (i);
+
+	B.J = J;
+	B.src = NULL;
+	hashtable_init(&B.map, sizeof(int), 4096, NULL);
+
+	if (js_try(J)) {
+		hashtable_term(&B.map);
+		js_free(J, B.src);
+		if (S)
+			freesnapshot(S);
+		js_throw(J);
+	}
+
+	S = js_malloc(J, sizeof *S);
+	memset(S, 0, sizeof *S);
+	S->alloc = J->alloc;
+	S->actx = J->actx;
+	B.S = S;
+
+	/* Copy every heap block and note where it came from */
+	for (obj = J->gcobj; obj; obj = obj->gcnext)
+		addobject(&B, obj);
+	for (env = J->gcenv; env; env = env->gcnext)
+		addrecord(&B, SNAP_ENVIRONMENT, 0, env, env, sizeof *env, sizeof *env);
+	for (fun = J->gcfun; fun; fun = fun->gcnext)
+		addfunction(&B, fun);
+	for (str = J->gcstr; str; str = str->right) {
+		size_t size = soffsetof(js_StringNode, string) + str->size + 1;
+		addrecord(&B, SNAP_MEMSTR, 0, str->string, str, size, size);
+	}
+	if (J->strings)
+		addinterned(&B, J->strings);
+	addrecord(&B, SNAP_BYTES, 0, J->lazy, J->lazy, J->lazylen * sizeof *J->lazy, J->lazycap * sizeof *J->lazy);
+	addrecord(&B, SNAP_BYTES, 0, J->lazyhash, J->lazyhash, J->lazyhashlen * sizeof *J->lazyhash, J->lazyhashcap * sizeof *J->lazyhash);
+	addrecord(&B, SNAP_STACK, 0, J->stack, J->stack, J->top * sizeof *J->stack, JS_STACKSIZE * sizeof *J->stack);
+
+	/* Turn pointers between blocks into relocations */
+	for (i = 0; i < S->nrec; ++i)
+		relocrecord(&B, i);
+	for (i = 0; i < SNAPROOTS; ++i) {
+		S->roots[i] = *snapfield(J, snaproots[i]);
+		relocptr(&B, -1, snaproots[i], S->roots[i]);
+	}
+	relocnode(&B, -1, offsetof(js_State, gcstr), J->gcstr);
+	relocnode(&B, -1, offsetof(js_State, strings), J->strings);
+
+	if (J->sharedlen > 0) {
+		S->shared = js_malloc(J, J->sharedlen * sizeof *S->shared);
+		for (i = 0; i < J->sharedlen; ++i)
+			S->shared[S->sharedlen++] = js_retainshared(J->shared[i]);
+	}
+
+	S->report = J->report;
+	S->panic = J->panic;
+	S->exit = J->exit;
+	S->default_strict = J->default_strict;
+	S->lazycompile = J->lazycompile;
+	S->strict = J->strict;
+	S->seed = J->seed;
+	S->nextref = J->nextref;
+	S->lazylen = J->lazylen;
+	S->lazycap = J->lazycap;
+	S->lazyhashlen = J->lazyhashlen;
+	S->lazyhashcap = J->lazyhashcap;
+	S->top = J->top;
+	S->gcmark = J->gcmark;
+	S->nintern = J->nintern;
+	S->internbytes = J->internbytes;
+
+	js_endtry(J);
+	hashtable_term(&B.map);
+	js_free(J, B.src);
+	return S;
+}
+
+void js_freesnapshot(js_Snapshot *S)
+{
+	if (S)
+		freesnapshot(S);
+}
+
+size_t js_snapshotsize(js_Snapshot *S)
+{
+	return sizeof *S + S->datalen +
+		S->nrec * sizeof *S->rec +
+		S->nreloc * sizeof *S->reloc +
+		S->nregexp * sizeof *S->regexp;
+}
+
+static void freerecords(js_Alloc alloc, void *actx, js_Snapshot *S, void **block, int n)
+{
+	int i;
+	for (i = 0; i < n; ++i) {
+		if (S->rec[i].system)
+			free(block[i]);
+		else
+			alloc(actx, block[i], 0);
+	}
+	alloc(actx, block, 0);
+}
+
+js_State *jsS_restoresnapshot(js_Snapshot *S, js_Alloc alloc, void *actx)
+{
+	js_State *J;
+	void **block;
+	js_SnapRecord *rec;
+	js_SnapReloc *r;
+	int i;
+
+	J = alloc(actx, NULL, sizeof *J);
+	if (!J)
+		return NULL;
+	memset(J, 0, sizeof(*J));
+	J->actx = actx;
+	J->alloc = alloc;
+
+	block = alloc(actx, NULL, S->nrec * sizeof *block);
+	if (!block) {
+		alloc(actx, J, 0);
+		return NULL;
+	}
+
+	for (i = 0; i < S->nrec; ++i) {
+		rec = &S->rec[i];
+		block[i] = rec->system ? malloc(rec->cap) : alloc(actx, NULL, rec->cap);
+		if (!block[i]) {
+			freerecords(alloc, actx, S, block, i);
+			alloc(actx, J, 0);
+			return NULL;
+		}
+		memcpy(block[i], S->data + rec->offset, rec->size);
+	}
+
+	for (i = 0; i < SNAPROOTS; ++i)
+		*snapfield(J, snaproots[i]) = S->roots[i];
+
+	for (i = 0, r = S->reloc; i < S->nreloc; ++i, ++r) {
+		char *base = r->rec < 0 ? (char*)J : (char*)block[r->rec];
+		*snapfield(base, r->offset) = (char*)block[r->target] + r->addend;
+	}
+
+	J->trace[0].name = "-top-";
+	J->trace[0].file = "native";
+	J->trace[0].line = 0;
+
+	J->report = S->report;
+	J->panic = S->panic;
+	J->exit = S->exit;
+	J->default_strict = S->default_strict;
+	J->lazycompile = S->lazycompile;
+	J->strict = S->strict;
+	J->seed = S->seed;
+	J->nextref = S->nextref;
+	J->lazylen = S->lazylen;
+	J->lazycap = S->lazycap;
+	J->lazyhashlen = S->lazyhashlen;
+	J->lazyhashcap = S->lazyhashcap;
+	J->top = S->top;
+	J->gcmark = S->gcmark;
+	J->nintern = S->nintern;
+	J->internbytes = S->internbytes;
+
+	/* The state is whole from here on, js_freestate can clean up after a failure */
+	for (i = 0; i < S->nregexp; ++i) {
+		js_Object *obj = block[S->regexp[i]];
+		const char *error;
+		int opts = 0;
+		if (obj->u.r.flags & JS_REGEXP_I) opts |= REG_ICASE;
+		if (obj->u.r.flags & JS_REGEXP_M) opts |= REG_NEWLINE;
+		obj->u.r.prog = js_regcompx(alloc, actx, obj->u.r.source, opts, &error);
+		if (!obj->u.r.prog) {
+			alloc(actx, block, 0);
+			js_freestate(J);
+			return NULL;
+		}
+	}
+	alloc(actx, block, 0);
+
+	if (S->sharedlen > 0) {
+		J->shared = alloc(actx, NULL, S->sharedlen * sizeof *J->shared);
+		if (!J->shared) {
+			js_freestate(J);
+			return NULL;
+		}
+		for (i = 0; i < S->sharedlen; ++i)
+			J->shared[i] = js_retainshared(S->shared[i]);
+		J->sharedlen = J->sharedcap = S->sharedlen;
+	}
+
+	return J;
+}
@@ -1,4 +1,5 @@
 #include "jsi.h"
+#include "jslex.h"
 #include "jsparse.h"
 #include "jscompile.h"
 #include "jsvalue.h"
@@ -7,6 +8,17 @@
 
 #include <errno.h>
 #include <assert.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define js_processid() ((unsigned long)getpid())
+#elif defined(_WIN32)
+#include <process.h>
+#define js_processid() ((unsigned long)_getpid())
+#else
+#define js_processid() ((unsigned long)clock())
+#endif
 
 static void *js_defaultalloc(void *actx, void *ptr, int size)
 {
@@ -57,6 +69,15 @@ int js_ploadfile(js_State *J, const char *filename)
 	return 0;
 }
 
+int js_pload(js_State *J, const char *filename, js_Reader reader, void *data)
+{
+	if (js_try(J))
+		return 1;
+	js_load(J, filename, reader, data);
+	js_endtry(J);
+	return 0;
+}
+
 const char *js_trystring(js_State *J, int idx, const char *error)
 {
 	const char *s;
@@ -133,32 +154,85 @@ int js_checkinteger(js_State *J, int idx, int error)
 	return v;
 }
 
-static void js_loadstringx(js_State *J, const char *filename, const char *source, int iseval)
+static js_Function *js_compilecached(js_State *J, const char *filename, const char *source);
+
+static js_Function *js_compile(js_State *J, const char *filename, const char *source, int strict, int lazy)
 {
+	js_Source *volatile S = NULL;
 	js_Ast *P;
 	js_Function *F;
+	int n;
 
 	if (js_try(J)) {
+		J->lazysource = NULL;
 		jsP_freeparse(J);
+		if (S && --S->refs == 0)
+			js_free(J, S);
 		js_throw(J);
 	}
 
-	P = jsP_parse(J, filename, source);
-	F = jsC_compilescript(J, P, iseval ? J->strict : J->default_strict);
+	if (lazy) {
+		/* functions compiled on their first call parse their body from a copy of the script */
+		n = strlen(source);
+		S = js_malloc(J, soffsetof(js_Source, text) + n + 1);
+		S->refs = 1;
+		memcpy(S->text, source, n + 1);
+		J->lazysource = S;
+		J->lazystrict = strict;
+	}
+
+	P = jsP_parse(J, filename, S ? S->text : source);
+	F = jsC_compilescript(J, P, strict);
+	J->lazysource = NULL;
 	jsP_freeparse(J);
-	js_newscript(J, F, iseval ? (J->strict ? J->E : NULL) : J->GE);
 
 	js_endtry(J);
+	if (S && --S->refs == 0)
+		js_free(J, S);
+	return F;
+}
+
+/*
+	Streamed input is parsed from a window over the chunks and never held in
+	full, so there is no script text to hash for the compile cache or to
+	parse function bodies from later: it is always compiled in one go.
+*/
+static js_Function *js_compilereader(js_State *J, const char *filename, js_Reader reader, void *data, int strict)
+{
+	js_Ast *P;
+	js_Function *F;
+
+	if (js_try(J)) {
+		jsY_closestream(J);
+		jsP_freeparse(J);
+		js_throw(J);
+	}
+
+	P = jsP_parse(J, filename, jsY_openstream(J, reader, data));
+	jsY_closestream(J);
+	F = jsC_compilescript(J, P, strict);
+	jsP_freeparse(J);
+
+	js_endtry(J);
+	return F;
+}
+
+void js_load(js_State *J, const char *filename, js_Reader reader, void *data)
+{
+	js_Function *F = js_compilereader(J, filename, reader, data, J->default_strict);
+	js_newscript(J, F, J->GE);
 }
 
 void js_loadeval(js_State *J, const char *filename, const char *source)
 {
-	js_loadstringx(J, filename, source, 1);
+	js_Function *F = js_compile(J, filename, source, J->strict, 0);
+	js_newscript(J, F, J->strict ? J->E : NULL);
 }
 
 void js_loadstring(js_State *J, const char *filename, const char *source)
 {
-	js_loadstringx(J, filename, source, 0);
+	js_Function *F = js_compilecached(J, filename, source);
+	js_newscript(J, F, J->GE);
 }
 
 void js_loadstringE(js_State *J, const char *filename, const char *source)
@@ -166,21 +240,51 @@ void js_loadstringE(js_State *J, const char *filename, const char *source)
 	if (!js_isobject(J, -1))
 		js_typeerror(J, "expected object");
 
-	js_Ast *P;
-	js_Function *F;
+	js_Function *F = js_compilecached(J, filename, source);
+	js_Environment *env = jsR_newenvironment(J, js_toobject(J, -1), J->GE);
+	js_newscript(J, F, env);
+}
+
+struct js_FileReader
+{
+	FILE *file;
+	const char *filename;
+	char buf[JS_READSIZE];
+};
+
+static const char *js_readfile(js_State *J, void *data, int *size)
+{
+	struct js_FileReader *R = data;
+	*size = fread(R->buf, 1, sizeof R->buf, R->file);
+	if (*size == 0 && ferror(R->file))
+		js_error(J, "cannot read data from file '%s': %s", R->filename, strerror(errno));
+	return R->buf;
+}
+
+static void js_streamfile(js_State *J, const char *filename, FILE *f)
+{
+	struct js_FileReader *R;
 
 	if (js_try(J)) {
-		jsP_freeparse(J);
+		fclose(f);
 		js_throw(J);
 	}
+	R = js_malloc(J, sizeof *R);
+	js_endtry(J);
 
-	P = jsP_parse(J, filename, source);
-	F = jsC_compilescript(J, P, J->default_strict);
-	jsP_freeparse(J);
+	R->file = f;
+	R->filename = filename;
 
-	js_Environment *env = jsR_newenvironment(J, js_toobject(J, -1), J->GE);
-	js_newscript(J, F, env);
-	
+	if (js_try(J)) {
+		js_free(J, R);
+		fclose(f);
+		js_throw(J);
+	}
+
+	js_load(J, filename, js_readfile, R);
+
+	js_free(J, R);
+	fclose(f);
 	js_endtry(J);
 }
 
@@ -195,6 +299,12 @@ void js_loadfile(js_State *J, const char *filename)
 		js_error(J, "cannot open file '%s': %s", filename, strerror(errno));
 	}
 
+	/* the compile cache and JS_LAZY need the whole text, otherwise read it in chunks */
+	if (!J->cacheload && !J->cachestore && !J->lazycompile) {
+		js_streamfile(J, filename, f);
+		return;
+	}
+
 	if (fseek(f, 0, SEEK_END) < 0) {
 		fclose(f);
 		js_error(J, "cannot seek in file '%s': %s", filename, strerror(errno));
@@ -270,30 +380,60 @@ int js_dofile(js_State *J, const char *filename)
 	return 0;
 }
 
+/* Fail instead of reading past the end of a damaged binary. */
+static void js_loadfuncbin_need(js_State *J, js_Buffer *sb, uint32_t n)
+{
+	if (sb->m - sb->n < n)
+		js_error(J, "invalid binary: truncated");
+}
+
+static int js_loadfuncbin_length(js_State *J, js_Buffer *sb, int size)
+{
+	int len;
+	js_loadfuncbin_need(J, sb, 4);
+	len = jsbuf_geti32(J, sb);
+	if (len < 0 || (uint32_t)len > (sb->m - sb->n) / size)
+		js_error(J, "invalid binary: bad table length");
+	return len;
+}
+
 static const char* js_loadfuncbin_string(js_State *J, js_Buffer *sb, hashtable_t *strings) 
 {
-	uint32_t id = jsbuf_getu16(J, sb);
+	uint32_t id;
+	const char **found;
+	js_loadfuncbin_need(J, sb, 2);
+	id = jsbuf_getu16(J, sb);
 	if (id == 0xFFFF) {
-		const char* temps = jsbuf_gets(J, sb);
-		const char *str = js_intern(J, temps);
-		uint64_t addr = (uint64_t)str;
+		const char *temps, *str;
+		uint64_t addr;
+		if (!memchr(sb->data + sb->n, 0, sb->m - sb->n))
+			js_error(J, "invalid binary: unterminated string");
+		temps = jsbuf_gets(J, sb);
+		str = js_intern(J, temps);
+		addr = (uint64_t)str;
 		hashtable_insert(strings, (hashtable_count(strings) + 1), &addr);
 		return str;
 	} else if (id == 0)
 		return jsS_sentinel.string;
-	return *(const char**)hashtable_find(strings, id);
+	found = hashtable_find(strings, id);
+	if (!found)
+		js_error(J, "invalid binary: bad string id");
+	return *found;
 }
 
 static js_Function* js_loadfuncbin(js_State *J, js_Buffer *sb, hashtable_t *strings, int flags) 
 {
-	int tempi, len, i;
+	int tempi, len, i, meta = 0;
 	js_Function *F = jsV_newfunction(J);
+	js_loadfuncbin_need(J, sb, 1);
 	if (jsbuf_geti8(J, sb) != BF_FUNCDECL)
 		js_error(J, "invalid binary");
 	while (sb->n < sb->m) {
 		tempi = jsbuf_geti8(J, sb);
-		if (tempi == BF_FUNCMETA) {
+		if (tempi == BF_FUNCMETA && !meta) {
+			meta = 1;
 			F->name = (flags & JS_BINSTRIPDEBUG) ? "" : js_loadfuncbin_string(J, sb, strings); 
+			js_loadfuncbin_need(J, sb, 3);
 			tempi = jsbuf_geti8(J, sb);
 			F->script = BITGET(tempi, 0); 
 			F->lightweight = BITGET(tempi, 1); 
@@ -303,65 +443,102 @@ static js_Function* js_loadfuncbin(js_State *J, js_Buffer *sb, hashtable_t *stri
 			F->filename = (flags & JS_BINSTRIPDEBUG) ? "" : js_loadfuncbin_string(J, sb, strings);
 			if (!(flags & JS_BINSTRIPDEBUG))
 			{
+				js_loadfuncbin_need(J, sb, 8);
 				F->line = jsbuf_geti32(J, sb);
 				F->lastline = jsbuf_geti32(J, sb);
 			}
-		} else if (tempi == BF_FUNCNUMS) {
-			len = jsbuf_geti32(J, sb);
+		} else if (tempi == BF_FUNCNUMS && !F->numtab) {
+			len = js_loadfuncbin_length(J, sb, 8);
 			F->numtab = js_malloc(J, sizeof(double) * len);
 			F->numlen = len;
 			for (i = 0; i < len; ++i)
 				F->numtab[i] = jsbuf_getf64(J, sb);
-		} else if (tempi == BF_FUNCSTRS) {
-			len = jsbuf_geti32(J, sb);
+		} else if (tempi == BF_FUNCSTRS && !F->strtab) {
+			len = js_loadfuncbin_length(J, sb, 2);
 			F->strtab = js_malloc(J, sizeof(char*) * len);
 			F->strlen = len;
 			for (i = 0; i < len; ++i)
 				F->strtab[i] = js_loadfuncbin_string(J, sb, strings);
-		} else if (tempi == BF_FUNCVARS) {
-			len = jsbuf_geti32(J, sb);
+		} else if (tempi == BF_FUNCVARS && !F->vartab) {
+			len = js_loadfuncbin_length(J, sb, 2);
 			F->vartab = js_malloc(J, sizeof(char*) * len);
 			F->varlen = len;
 			for (i = 0; i < len; ++i)
 				F->vartab[i] = js_loadfuncbin_string(J, sb, strings);
-		} else if (tempi == BF_FUNCCODE) {
-			len = jsbuf_geti32(J, sb);
+		} else if (tempi == BF_FUNCCODE && !F->code) {
+			len = js_loadfuncbin_length(J, sb, 2);
 			F->code = js_malloc(J, sizeof(js_Instruction) * len);
 			F->codelen = len;
 			for (i = 0; i < len; ++i) {
+				js_loadfuncbin_need(J, sb, 2);
 				tempi = jsbuf_getu16(J, sb);
-				if (tempi == 0xFFFF) 
+				if (tempi == 0xFFFF) {
+					js_loadfuncbin_need(J, sb, 4);
 					F->code[i] = jsbuf_geti32(J, sb);
-				else 
+				} else 
 					F->code[i] = tempi;
 			}
-		} else if (tempi == BF_FUNCFUNS) {
-			len = jsbuf_geti32(J, sb);
+		} else if (tempi == BF_FUNCFUNS && !F->funtab) {
+			len = js_loadfuncbin_length(J, sb, 1);
 			F->funtab = js_malloc(J, sizeof(js_Function*) * len);
-			F->funlen = len;
-			for (i = 0; i < len; ++i)
-				F->funtab[i] = js_loadfuncbin(J, sb, strings, flags);
+			/* the collector walks funtab up to funlen */
+			for (i = 0; i < len; ++i) {
+				js_Function *C = js_loadfuncbin(J, sb, strings, flags);
+				F->funtab[F->funlen++] = C;
+			}
 		} else if (tempi == BF_FUNCDECL) {
 			sb->n--;
 			break;
 		} else
 			js_error(J, "invalid binary");
 	}
+	if (!meta)
+		js_error(J, "invalid binary: missing function header");
 	return F;
 }
 
-static js_Function* js_loadfuncblob(js_State *J, const char *source, int length)
+static int js_checkbinheader(const char *source, int length, int *flags)
+{
+	const uint8_t *p = (const uint8_t*)source;
+	uint32_t word[5];
+	int i;
+	if (length < JS_BINHEADER)
+		return JS_BINCORRUPT;
+	for (i = 0; i < 5; ++i, p += 4)
+		word[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+	if (word[0] != JS_BINMAGIC)
+		return JS_BINCORRUPT;
+	if ((word[1] >> 16) != JS_BINVERSION || word[2] != jsC_opcodehash())
+		return JS_BINSTALE;
+	if (word[3] != (uint32_t)length - JS_BINHEADER)
+		return JS_BINCORRUPT;
+	if (word[4] != jsU_checksum((const uint8_t*)source + JS_BINHEADER, word[3]))
+		return JS_BINCORRUPT;
+	*flags = word[1] & 0xFFFF;
+	return JS_BINOK;
+}
+
+int js_checkbin(const char *source, int length)
 {
 	int flags;
+	return js_checkbinheader(source, length, &flags);
+}
+
+static js_Function* js_loadfuncblob(js_State *J, const char *source, int length)
+{
+	int flags = 0;
 	js_Buffer buf;
 	js_Function *F;
 	hashtable_t strings;
-	if (length < 8)
-		js_error(J, "invalid binary");
+	int check = js_checkbinheader(source, length, &flags);
+	if (check == JS_BINSTALE)
+		js_error(J, "invalid binary: made by a different engine version");
+	if (check != JS_BINOK)
+		js_error(J, "invalid binary: damaged or truncated");
 	hashtable_init(&strings, sizeof(uint64_t), 256, NULL);
 	jsbuf_init(J, &buf, length);
 	jsbuf_putb(J, &buf, (uint8_t*)source, length);
-	buf.n = 0; // reset cursor
+	buf.n = JS_BINHEADER; // skip the header
 	buf.m = length; // reset length for reference
 	if (js_try(J))
 	{
@@ -369,10 +546,10 @@ static js_Function* js_loadfuncblob(js_State *J, const char *source, int length)
 		hashtable_term(&strings);
 		js_throw(J);
 	}
-	if (jsbuf_geti32(J, &buf) != 0x736a756d)
-		js_error(J, "invalid binary");
-	flags = jsbuf_geti32(J, &buf);
 	F = js_loadfuncbin(J, &buf, &strings, flags);
+	if (buf.n != buf.m)
+		js_error(J, "invalid binary: trailing data");
+	jsC_verifyfunction(J, F);
 	js_endtry(J);
 	jsbuf_free(J, &buf);
 	hashtable_term(&strings);
@@ -466,6 +643,263 @@ int js_ploadbinfile(js_State *J, const char *filename)
 	return 0;
 }
 
+/*
+	Compile cache. Scripts loaded by js_loadstring are looked up by a key
+	made from a hash of the source, the file name, the strict mode default
+	and the bytecode version and opcode hash, so entries written by another
+	engine version are never found. On a miss the script is compiled and
+	its bytecode, with debug information, is handed to the store callback.
+	Cached bytecode is loaded like js_loadbin, including the verifier; if
+	it does not load the script is compiled and stored again.
+*/
+
+static void js_cachekey(js_State *J, const char *filename, const char *source, char *key)
+{
+	uint64_t h = 14695981039346656037ULL; /* FNV-1a */
+	const unsigned char *p;
+	for (p = (const unsigned char*)source; *p; ++p)
+		h = (h ^ *p) * 1099511628211ULL;
+	h *= 1099511628211ULL; /* the 0 byte ending the source keeps it apart from the filename */
+	for (p = (const unsigned char*)filename; *p; ++p)
+		h = (h ^ *p) * 1099511628211ULL;
+	h = (h ^ (J->default_strict ? 2 : 1)) * 1099511628211ULL;
+	sprintf(key, "%016" PRIx64 "-%02x%08" PRIx32, h, JS_BINVERSION, jsC_opcodehash());
+}
+
+static js_Function *js_compilecached(js_State *J, const char *filename, const char *source)
+{
+	js_Function *volatile F = NULL;
+	const char *data;
+	char key[32];
+	js_Buffer buf;
+	int n;
+
+	if (!J->cacheload && !J->cachestore)
+		return js_compile(J, filename, source, J->default_strict, J->lazycompile);
+	if (strlen(source) < JS_CACHEMIN)
+		return js_compile(J, filename, source, J->default_strict, J->lazycompile);
+
+	js_cachekey(J, filename, source, key);
+
+	if (J->cacheload) {
+		data = J->cacheload(J->cachectx, key, &n);
+		if (data) {
+			if (js_checkbin(data, n) == JS_BINOK) {
+				if (js_try(J))
+					js_pop(J, 1);
+				else {
+					F = js_loadfuncblob(J, data, n);
+					js_endtry(J);
+				}
+			}
+			if (J->cacherelease)
+				J->cacherelease(J->cachectx, data);
+			if (F)
+				return F;
+		}
+	}
+
+	/* the stored bytecode needs every function compiled anyway */
+	F = js_compile(J, filename, source, J->default_strict, J->lazycompile && !J->cachestore);
+
+	if (J->cachestore) {
+		if (js_try(J)) {
+			/* too many strings for the bytecode format, run it uncached */
+			js_pop(J, 1);
+		} else {
+			buf = js_dumpfuncbin(J, F, 0);
+			js_endtry(J);
+			J->cachestore(J->cachectx, key, (const char*)buf.data, buf.n);
+			jsbuf_free(J, &buf);
+		}
+	}
+
+	return F;
+}
+
+/*
+	A compile context is a state of its own. The lexer, parser and compiler
+	keep everything in the js_State they are given and there is no global
+	data, so contexts on different threads never touch each other. Their
+	output is the binary format, whose strings are interned again by the
+	state that loads it.
+*/
+
+struct js_Compiler
+{
+	js_State *J;
+	char *error;
+};
+
+js_Compiler *js_newcompiler(js_Alloc alloc, void *actx, int flags)
+{
+	js_Compiler *C;
+
+	if (!alloc)
+		alloc = js_defaultalloc;
+
+	C = alloc(actx, NULL, sizeof *C);
+	if (!C)
+		return NULL;
+	C->error = NULL;
+	C->J = js_newstate(alloc, actx, flags & JS_STRICT);
+	if (!C->J) {
+		alloc(actx, C, 0);
+		return NULL;
+	}
+	return C;
+}
+
+void js_freecompiler(js_Compiler *C)
+{
+	js_Alloc alloc = C->J->alloc;
+	void *actx = C->J->actx;
+	if (C->error)
+		js_free(C->J, C->error);
+	js_freestate(C->J);
+	alloc(actx, C, 0);
+}
+
+int js_compilebin(js_Compiler *C, const char *filename, const char *source, char **buf)
+{
+	js_State *J = C->J;
+	js_Function *F;
+	js_Buffer out;
+	const char *s;
+	int n;
+
+	if (C->error)
+		js_free(J, C->error);
+	C->error = NULL;
+
+	if (js_try(J)) {
+		s = js_trystring(J, -1, "Error");
+		n = strlen(s) + 1;
+		C->error = J->alloc(J->actx, NULL, n);
+		if (C->error)
+			memcpy(C->error, s, n);
+		js_pop(J, 1);
+		js_gc(J, 0);
+		return -1;
+	}
+	F = js_compile(J, filename, source, J->default_strict, 0);
+	out = js_dumpfuncbin(J, F, 0);
+	js_endtry(J);
+
+	/* the function is garbage now, and nothing else runs the collector here */
+	js_gc(J, 0);
+
+	*buf = (char*)out.data;
+	return out.n;
+}
+
+const char *js_compileerror(js_Compiler *C)
+{
+	return C->error;
+}
+
+void js_freebin(js_Compiler *C, char *buf)
+{
+	js_free(C->J, buf);
+}
+
+void js_setcompilecache(js_State *J, js_CacheLoad load, js_CacheRelease release, js_CacheStore store, void *cctx)
+{
+	J->cacheload = load;
+	J->cacherelease = release;
+	J->cachestore = store;
+	J->cachectx = cctx;
+}
+
+/* The directory cache keeps one <key>.jsb file per script. */
+
+static char *js_cachepath(js_State *J, const char *key, const char *suffix)
+{
+	int n = strlen(J->cachedir) + strlen(key) + strlen(suffix) + 2;
+	char *path = J->alloc(J->actx, NULL, n);
+	if (path)
+		sprintf(path, "%s/%s%s", J->cachedir, key, suffix);
+	return path;
+}
+
+static const char *js_dircacheload(void *cctx, const char *key, int *length)
+{
+	js_State *J = cctx;
+	char *path, *data = NULL;
+	FILE *f;
+	long n;
+
+	path = js_cachepath(J, key, ".jsb");
+	if (!path)
+		return NULL;
+	f = fopen(path, "rb");
+	J->alloc(J->actx, path, 0);
+	if (!f)
+		return NULL;
+	if (fseek(f, 0, SEEK_END) == 0 && (n = ftell(f)) > 0 && n < INT_MAX && fseek(f, 0, SEEK_SET) == 0) {
+		data = J->alloc(J->actx, NULL, (int)n);
+		if (data && fread(data, 1, (size_t)n, f) != (size_t)n) {
+			J->alloc(J->actx, data, 0);
+			data = NULL;
+		}
+		*length = (int)n;
+	}
+	fclose(f);
+	return data;
+}
+
+static void js_dircacherelease(void *cctx, const char *data)
+{
+	js_State *J = cctx;
+	J->alloc(J->actx, (void*)data, 0);
+}
+
+/*
+	Write to a temporary file first so that readers never see a partial entry.
+	The name holds the process id and the state, as forked workers share
+	heap addresses and states on other threads share the process.
+*/
+static void js_dircachestore(void *cctx, const char *key, const char *data, int length)
+{
+	js_State *J = cctx;
+	char suffix[48];
+	char *path, *temp;
+	FILE *f;
+	int ok;
+
+	sprintf(suffix, ".%lx.%lx.tmp", js_processid(), (unsigned long)(uintptr_t)J);
+	path = js_cachepath(J, key, ".jsb");
+	temp = js_cachepath(J, key, suffix);
+	if (path && temp) {
+		f = fopen(temp, "wb");
+		if (f) {
+			ok = fwrite(data, 1, (size_t)length, f) == (size_t)length;
+			ok = (fclose(f) == 0) && ok;
+			if (!ok || rename(temp, path) != 0)
+				remove(temp);
+		}
+	}
+	if (path)
+		J->alloc(J->actx, path, 0);
+	if (temp)
+		J->alloc(J->actx, temp, 0);
+}
+
+void js_setcachedir(js_State *J, const char *dir)
+{
+	char *copy = NULL;
+	if (dir) {
+		copy = js_malloc(J, strlen(dir) + 1);
+		strcpy(copy, dir);
+	}
+	js_free(J, J->cachedir);
+	J->cachedir = copy;
+	if (dir)
+		js_setcompilecache(J, js_dircacheload, js_dircacherelease, js_dircachestore, J);
+	else
+		js_setcompilecache(J, NULL, NULL, NULL, NULL);
+}
+
 js_Panic js_atpanic(js_State *J, js_Panic panic)
 {
 	js_Panic old = J->panic;
@@ -484,6 +918,16 @@ void js_setreport(js_State *J, js_Report report)
 	J->report = report;
 }
 
+void js_sethook(js_State *J, js_Hook hook, int count)
+{
+	if (count <= 0)
+		hook = NULL;
+	J->hook = hook;
+	J->hookcount = count;
+	J->hookleft = count;
+	jsR_resettick(J);
+}
+
 void js_setcontext(js_State *J, void *uctx)
 {
 	J->uctx = uctx;
@@ -500,8 +944,10 @@ void *js_saveexit(js_State *J)
 		js_error(J, "exit buffer already set");
 	J->exitbufset = 1;
 	J->exitbuf.E = J->E;
+	J->exitbuf.co = J->co;
 	J->exitbuf.envtop = J->envtop;
 	J->exitbuf.tracetop = J->tracetop;
+	J->exitbuf.frametop = J->frametop;
 	J->exitbuf.top = J->top;
 	J->exitbuf.bot = J->bot;
 	J->exitbuf.strict = J->strict;
@@ -513,8 +959,10 @@ void js_exit(js_State *J, int status)
 {
 	if (J->exitbufset) {
 		J->E = J->exitbuf.E;
+		J->co = J->exitbuf.co;
 		J->envtop = J->exitbuf.envtop;
 		J->tracetop = J->exitbuf.tracetop;
+		J->frametop = J->exitbuf.frametop;
 		J->top = J->exitbuf.top;
 		J->bot = J->exitbuf.bot;
 		J->strict = J->exitbuf.strict;
@@ -530,8 +978,9 @@ js_State *js_newstate(js_Alloc alloc, void *actx, int flags)
 {
 	js_State *J;
 
-	assert(sizeof(js_Value) == 24);
-	assert(soffsetof(js_Value, type) == 23);
+	assert(sizeof(js_Value) == JS_VALUESIZE);
+	assert(soffsetof(js_Value, type) == JS_VALUESIZE - 1);
+	assert(JS_CCOROUTINE + 1 == JS_HEAPCLASSES);
 
 	if (!alloc)
 		alloc = js_defaultalloc;
@@ -545,6 +994,8 @@ js_State *js_newstate(js_Alloc alloc, void *actx, int flags)
 
 	if (flags & JS_STRICT)
 		J->strict = J->default_strict = 1;
+	if (flags & JS_LAZY)
+		J->lazycompile = 1;
 
 	J->trace[0].name = "-top-";
 	J->trace[0].file = "native";
@@ -572,3 +1023,10 @@ js_State *js_newstate(js_Alloc alloc, void *actx, int flags)
 
 	return J;
 }
+
+js_State *js_newstatefrom(js_Snapshot *S, js_Alloc alloc, void *actx)
+{
+	if (!alloc)
+		alloc = js_defaultalloc;
+	return jsS_restoresnapshot(S, alloc, actx);
+}
@@ -838,6 +838,35 @@ static void Sp_split(js_State *J)
 	}
 }
 
+static const js_Method String_prototype_methods[] = {
+	{ "String.prototype.toString", Sp_toString, 0 },
+	{ "String.prototype.valueOf", Sp_valueOf, 0 },
+	{ "String.prototype.charAt", Sp_charAt, 1 },
+	{ "String.prototype.charCodeAt", Sp_charCodeAt, 1 },
+	{ "String.prototype.concat", Sp_concat, 0 }, /* 1 */
+	{ "String.prototype.indexOf", Sp_indexOf, 1 },
+	{ "String.prototype.lastIndexOf", Sp_lastIndexOf, 1 },
+	{ "String.prototype.localeCompare", Sp_localeCompare, 1 },
+	{ "String.prototype.match", Sp_match, 1 },
+	{ "String.prototype.replace", Sp_replace, 2 },
+	{ "String.prototype.search", Sp_search, 1 },
+	{ "String.prototype.slice", Sp_slice, 2 },
+	{ "String.prototype.split", Sp_split, 2 },
+	{ "String.prototype.substring", Sp_substring, 2 },
+	{ "String.prototype.substr", Sp_substr, 2 },
+	{ "String.prototype.toLowerCase", Sp_toLowerCase, 0 },
+	{ "String.prototype.toLocaleLowerCase", Sp_toLowerCase, 0 },
+	{ "String.prototype.toUpperCase", Sp_toUpperCase, 0 },
+	{ "String.prototype.toLocaleUpperCase", Sp_toUpperCase, 0 },
+
+	/* ES5 */
+	{ "String.prototype.trim", Sp_trim, 0 },
+};
+
+static const js_Method String_methods[] = {
+	{ "String.fromCharCode", S_fromCharCode, 0 }, /* 1 */
+};
+
 void jsB_initstring(js_State *J)
 {
 	J->String_prototype->u.string.u.ptr8 = jsS_sentinel.string;
@@ -845,32 +874,11 @@ void jsB_initstring(js_State *J)
 
 	js_pushobject(J, J->String_prototype);
 	{
-		jsB_propf(J, "String.prototype.toString", Sp_toString, 0);
-		jsB_propf(J, "String.prototype.valueOf", Sp_valueOf, 0);
-		jsB_propf(J, "String.prototype.charAt", Sp_charAt, 1);
-		jsB_propf(J, "String.prototype.charCodeAt", Sp_charCodeAt, 1);
-		jsB_propf(J, "String.prototype.concat", Sp_concat, 0); /* 1 */
-		jsB_propf(J, "String.prototype.indexOf", Sp_indexOf, 1);
-		jsB_propf(J, "String.prototype.lastIndexOf", Sp_lastIndexOf, 1);
-		jsB_propf(J, "String.prototype.localeCompare", Sp_localeCompare, 1);
-		jsB_propf(J, "String.prototype.match", Sp_match, 1);
-		jsB_propf(J, "String.prototype.replace", Sp_replace, 2);
-		jsB_propf(J, "String.prototype.search", Sp_search, 1);
-		jsB_propf(J, "String.prototype.slice", Sp_slice, 2);
-		jsB_propf(J, "String.prototype.split", Sp_split, 2);
-		jsB_propf(J, "String.prototype.substring", Sp_substring, 2);
-		jsB_propf(J, "String.prototype.substr", Sp_substr, 2);
-		jsB_propf(J, "String.prototype.toLowerCase", Sp_toLowerCase, 0);
-		jsB_propf(J, "String.prototype.toLocaleLowerCase", Sp_toLowerCase, 0);
-		jsB_propf(J, "String.prototype.toUpperCase", Sp_toUpperCase, 0);
-		jsB_propf(J, "String.prototype.toLocaleUpperCase", Sp_toUpperCase, 0);
-
-		/* ES5 */
-		jsB_propf(J, "String.prototype.trim", Sp_trim, 0);
+		jsB_methods(J, String_prototype_methods, nelem(String_prototype_methods));
 	}
 	js_newcconstructor(J, jsB_String, jsB_new_String, "String", 0); /* 1 */
 	{
-		jsB_propf(J, "String.fromCharCode", S_fromCharCode, 0); /* 1 */
+		jsB_methods(J, String_methods, nelem(String_methods));
 	}
 	js_defglobal(J, "String", JS_DONTENUM);
 }
@@ -301,6 +301,23 @@ const char* jsbuf_gets(js_State *J, js_Buffer *buf)
 	return start;
 }
 
+/* Adler-32, summed in blocks small enough that the sums cannot overflow */
+uint32_t jsU_checksum(const uint8_t *data, uint32_t n)
+{
+	uint32_t a = 1, b = 0, k;
+	while (n > 0) {
+		k = n < 5552 ? n : 5552;
+		n -= k;
+		while (k--) {
+			a += *data++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
+
 uint64_t jsU_tostrhash(const char *str)
 {
 	uint64_t hash = 5381;
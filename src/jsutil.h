@@ -23,7 +23,7 @@
 		v->type == JS_TSHRSTR ? 0 : \
 			(v->type == JS_TLITSTR || \
 			v->type == JS_TMEMSTR ||  \
-			v->type == JS_TCONSTSTR) ? v->u.string.isunicode : \
+			v->type == JS_TCONSTSTR) ? jsV_strisunicode(v) : \
 				(v->type == JS_TOBJECT && v->u.object->type == JS_CSTRING) ? \
 					v->u.object->u.string.isunicode : 0)
 #define jsU_ptrtostrnode(p) \
@@ -41,6 +41,7 @@
 					v->u.object->u.string.u.ptr8 : ""))
 
 uint64_t jsU_tostrhash(const char *str);
+uint32_t jsU_checksum(const uint8_t *data, uint32_t n);
 
 /* String buffer */
 
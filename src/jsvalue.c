@@ -124,6 +124,7 @@ int jsV_toboolean(js_State *J, js_Value *v)
 	case JS_TNULL: return 0;
 	case JS_TBOOLEAN: return v->u.boolean;
 	case JS_TNUMBER: return v->u.number != 0 && !isnan(v->u.number);
+	case JS_TINTEGER: return v->u.integer != 0;
 	case JS_TLITSTR:
 	case JS_TCONSTSTR:
 	case JS_TMEMSTR: return v->u.string.u.ptr8[0] != 0;
@@ -213,6 +214,7 @@ double jsV_tonumber(js_State *J, js_Value *v)
 	case JS_TNULL: return 0;
 	case JS_TBOOLEAN: return v->u.boolean;
 	case JS_TNUMBER: return v->u.number;
+	case JS_TINTEGER: return v->u.integer;
 	case JS_TLITSTR:
 	case JS_TCONSTSTR:
 	case JS_TMEMSTR: return jsV_stringtonumber(J, v->u.string.u.ptr8);
@@ -301,8 +303,12 @@ const char *jsV_tostring(js_State *J, js_Value *v)
 	case JS_TLITSTR:
 	case JS_TCONSTSTR:
 	case JS_TMEMSTR: return v->u.string.u.ptr8;
+	case JS_TINTEGER:
 	case JS_TNUMBER:
-		p = jsV_numbertostring(J, buf, v->u.number);
+		if (v->type == JS_TINTEGER)
+			p = js_itoa(buf, v->u.integer);
+		else
+			p = jsV_numbertostring(J, buf, v->u.number);
 		if (p == buf) {
 			int n = strlen(p);
 			if (n <= soffsetof(js_Value, type)) {
@@ -315,13 +321,13 @@ const char *jsV_tostring(js_State *J, js_Value *v)
 				js_StringNode *node = jsV_newmemstring(J, p, n);
 				v->type = JS_TMEMSTR;
 				v->u.string.u.ptr8 = node->string;
-				v->u.string.isunicode = 0;
+				jsV_strisunicode(v) = 0;
 				return node->string;
 			}
 		} else {
 			v->type = JS_TCONSTSTR;
 			v->u.string.u.ptr8 = p;
-			v->u.string.isunicode = 0;
+			jsV_strisunicode(v) = 0;
 		}
 		return p;
 	case JS_TOBJECT:
@@ -369,7 +375,7 @@ js_Object *jsV_newstringfrom(js_State *J, js_Value *v)
 		case JS_TLITSTR:
 			// already interned string, just set up referernce
 			obj->u.string.u.ptr8 = v->u.string.u.ptr8;
-			obj->u.string.isunicode = v->u.string.isunicode;
+			obj->u.string.isunicode = jsV_strisunicode(v);
 			break;
 		case JS_TCONSTSTR:
 			strnode = jsU_ptrtostrnode(js_intern(J, v->u.string.u.ptr8));
@@ -402,6 +408,7 @@ js_Object *jsV_toobject(js_State *J, js_Value *v)
 	case JS_TNULL: js_typeerror(J, "cannot convert null to object");
 	case JS_TBOOLEAN: return jsV_newboolean(J, v->u.boolean);
 	case JS_TNUMBER: return jsV_newnumber(J, v->u.number);
+	case JS_TINTEGER: return jsV_newnumber(J, v->u.integer);
 	case JS_TLITSTR:
 	case JS_TCONSTSTR:
 	case JS_TMEMSTR: return jsV_newstringfrom(J, v);
@@ -633,8 +640,9 @@ void js_concat(js_State *J)
 		const char *sa = jsV_tostring(J, v1);
 		const char *sb = jsV_tostring(J, v2);
 		int isunicode = jsU_valisstru(v1) + jsU_valisstru(v2);
-		int l1 = jsV_getstrsize(J, v1);
-		int l2 = jsV_getstrsize(J, v2);
+		/* undefined, null and booleans are not converted in place */
+		int l1 = jsV_isstring(v1) ? jsV_getstrsize(J, v1) : (int)strlen(sa);
+		int l2 = jsV_isstring(v2) ? jsV_getstrsize(J, v2) : (int)strlen(sb);
 		/* TODO: create js_String directly */
 		char *sab = js_malloc(J, l1 + l2);
 		memcpy(sab, sa, l1);
@@ -659,6 +667,10 @@ int js_compare(js_State *J, int *okay)
 {
 	js_Value *v1 = js_tovalue(J, -2);
 	js_Value *v2 = js_tovalue(J, -1);
+	if (v1->type == JS_TINTEGER && v2->type == JS_TINTEGER) {
+		*okay = 1;
+		return v1->u.integer < v2->u.integer ? -1 : v1->u.integer > v2->u.integer;
+	}
 	jsV_toprimitive(J, v1, JS_HNUMBER);
 	jsV_toprimitive(J, v2, JS_HNUMBER);
 	*okay = 1;
@@ -678,7 +690,13 @@ int js_equal(js_State *J)
 	js_Value *x = js_tovalue(J, -2);
 	js_Value *y = js_tovalue(J, -1);
 
+	if (x->type == JS_TINTEGER && y->type == JS_TINTEGER)
+		return x->u.integer == y->u.integer;
+
 retry:
+	/* again after each jsV_toprimitive, which may give a small integer */
+	jsV_widen(x);
+	jsV_widen(y);
 	if (jsV_isstring(x) && jsV_isstring(y))
 		return !strcmp(jsU_valtocstr(x), jsU_valtocstr(y));
 
@@ -726,6 +744,11 @@ int js_strictequal(js_State *J)
 	js_Value *x = js_tovalue(J, -2);
 	js_Value *y = js_tovalue(J, -1);
 
+	if (x->type == JS_TINTEGER && y->type == JS_TINTEGER)
+		return x->u.integer == y->u.integer;
+	jsV_widen(x);
+	jsV_widen(y);
+
 	if (jsV_isstring(x) && jsV_isstring(y))
 		return !strcmp(jsU_valtocstr(x), jsU_valtocstr(y));
 
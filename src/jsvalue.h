@@ -2,6 +2,7 @@
 #define js_value_h
 
 typedef struct js_Property js_Property;
+typedef struct js_Accessor js_Accessor;
 typedef struct js_Iterator js_Iterator;
 
 /* Hint to ToPrimitive() */
@@ -20,7 +21,8 @@ enum js_Type {
 	JS_TLITSTR, /* script literal strings */
 	JS_TMEMSTR,
 	JS_TOBJECT,
-	JS_TCONSTSTR /* constant strings, never deallocated */
+	JS_TCONSTSTR, /* constant strings, never deallocated */
+	JS_TINTEGER /* numbers that fit in an int32, produced by the interpreter */
 };
 
 enum js_Class {
@@ -40,6 +42,7 @@ enum js_Class {
 	JS_CARGUMENTS,
 	JS_CITERATOR,
 	JS_CUSERDATA,
+	JS_CCOROUTINE,
 };
 
 /*
@@ -47,6 +50,11 @@ enum js_Class {
 	last byte, and using 0 as the tag for short strings, we can use the
 	entire js_Value as string storage by letting the type tag serve double
 	purpose as the string zero terminator.
+
+	With JS_COMPACTVALUE the value shrinks from 24 to 16 bytes, short strings
+	hold up to 15 bytes and the unicode flag of other strings moves into the
+	padding, where it overlaps short string storage just like the regular
+	layout does.
 */
 
 struct js_String
@@ -63,14 +71,39 @@ struct js_Value
 {
 	union {
 		int boolean;
+		int integer;
 		double number;
+#ifdef JS_COMPACTVALUE
+		struct {
+			union {
+				char shrstr[8];
+				const char *ptr8;
+				const uint16_t *ptr16;
+			} u;
+		} string;
+#else
 		js_String string;
+#endif
 		js_Object *object;
+		js_Accessor *accessor; /* only in properties with JS_ACCESSOR */
 	} u;
+#ifdef JS_COMPACTVALUE
+	char pad[6]; /* extra storage for shrstr */
+	char isunicode; /* unicode flag for non-short strings */
+#else
 	char pad[7]; /* extra storage for shrstr */
+#endif
 	char type; /* type tag and zero terminator for shrstr */
 };
 
+#ifdef JS_COMPACTVALUE
+#define JS_VALUESIZE 16
+#define jsV_strisunicode(v) ((v)->isunicode)
+#else
+#define JS_VALUESIZE 24
+#define jsV_strisunicode(v) ((v)->u.string.isunicode)
+#endif
+
 struct js_Regexp
 {
 	void *prog;
@@ -85,6 +118,7 @@ struct js_Object
 	int extensible;
 	hashtable_t *properties;
 	int count; /* number of properties, for array sparseness check */
+	unsigned short lazy; /* 1 + index of the builtin method table in J->lazy, 0 for none */
 	js_Object *prototype;
 	js_Object *R; /* local registry for hidden properties */
 	union {
@@ -117,21 +151,62 @@ struct js_Object
 			js_Delete delete;
 			js_Finalize finalize;
 		} user;
+		js_Coroutine *co;
 	} u;
 	js_Object *gcnext;
 	int gcmark;
 };
 
-struct js_Property
+/*
+	Accessors are rare, so data properties only store their value. A property
+	with a getter or setter has the JS_ACCESSOR attribute and its value slot
+	points to a separately allocated getter/setter pair.
+*/
+
+enum { JS_ACCESSOR = 0x80 };
+
+struct js_Accessor
 {
-    js_Value value;
-	const char *name;
 	js_Object *getter;
 	js_Object *setter;
-	uint64_t hash;
+};
+
+struct js_Property
+{
+	js_Value value;
+	const char *name;
 	int atts;
 };
 
+/*
+	Builtin methods are described by static tables and only become function
+	objects when a lookup misses on the object that owns the table. The done
+	mask records which entries were created or deleted, so at most 64 methods
+	fit in one table.
+*/
+
+struct js_Method
+{
+	const char *name;
+	js_CFunction function;
+	int length;
+};
+
+struct js_LazyTable
+{
+	const js_Method *methods;
+	int n;
+	int hash; /* first name hash in J->lazyhash */
+	uint64_t done;
+};
+
+struct js_CloneHook
+{
+	const char *tag; /* interned */
+	js_CloneSave save;
+	js_CloneLoad load;
+};
+
 struct js_Iterator
 {
 	const char *name;
@@ -171,8 +246,15 @@ js_Property *jsV_getownproperty(js_State *J, js_Object *obj, const char *name);
 js_Property *jsV_getpropertyx(js_State *J, js_Object *obj, const char *name, int *own);
 js_Property *jsV_getproperty(js_State *J, js_Object *obj, const char *name);
 js_Property *jsV_setproperty(js_State *J, js_Object *obj, const char *name);
+js_Property *jsV_addownproperty(js_State *J, js_Object *obj, const char *name, uint64_t hash);
+uint64_t jsV_indexhash(int i);
+js_Property *jsV_getownindex(js_State *J, js_Object *obj, int i);
+void jsV_reserveproperties(js_State *J, js_Object *obj, int n);
+js_Accessor *jsV_setaccessor(js_State *J, js_Property *ref);
+void jsV_clearaccessor(js_State *J, js_Property *ref);
 js_Property *jsV_nextproperty(js_State *J, js_Object *obj, const char *name);
 void jsV_delproperty(js_State *J, js_Object *obj, const char *name);
+void jsV_resolveproperties(js_State *J, js_Object *obj);
 
 js_Object *jsV_newiterator(js_State *J, js_Object *obj, int own);
 const char *jsV_nextiterator(js_State *J, js_Object *iter);
@@ -189,6 +271,15 @@ int jsV_getstrsize(js_State *J, js_Value *v);
 
 const char* jsV_resolvetypename(js_State *J, js_Value *value, const char* keyName);
 
+/*
+	Binary header: magic, flags with the format version in the high half,
+	opcode set hash, payload length and payload checksum, as 32-bit words.
+	Files from before the version word read as version 0.
+*/
+#define JS_BINMAGIC 0x736a756d
+#define JS_BINVERSION 1
+#define JS_BINHEADER 20
+
 typedef enum {
 	BF_NOOP,
 	BF_FUNCDECL,
@@ -207,10 +298,13 @@ js_Function *jsV_newfunction(js_State *J);
 #define jsV_isundefined(v) (v->type == JS_TUNDEFINED)
 #define jsV_isnull(v) (v->type == JS_TNULL)
 #define jsV_isboolean(v) (v->type == JS_TBOOLEAN)
-#define jsV_isnumber(v) (v->type == JS_TNUMBER)
-#define jsV_isstring(v) (v->type == JS_TSHRSTR || v->type == JS_TLITSTR || v->type == JS_TMEMSTR || v->type == JS_TCONSTSTR)
+#define jsV_isnumber(v) ((v)->type == JS_TNUMBER || (v)->type == JS_TINTEGER)
+#define jsV_isstring(v) ((v)->type == JS_TSHRSTR || (v)->type == JS_TLITSTR || (v)->type == JS_TMEMSTR || (v)->type == JS_TCONSTSTR)
 #define jsV_isprimitive(v) (v->type != JS_TOBJECT)
 #define jsV_isobject(v) (v->type == JS_TOBJECT)
 #define jsV_iscoercible(v) (v->type != JS_TUNDEFINED && v->type != JS_TNULL)
 
+/* turn a small integer into a double in place */
+#define jsV_widen(v) if ((v)->type == JS_TINTEGER) { (v)->u.number = (v)->u.integer; (v)->type = JS_TNUMBER; }
+
 #endif
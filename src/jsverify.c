@@ -0,0 +1,387 @@
+#include "jsi.h"
+#include "jscompile.h"
+
+/*
+	Bytecode verifier. The interpreter trusts the code it runs: operands
+	index the constant tables without bounds checks, jumps are taken as
+	they are and the value stack is assumed to hold what each instruction
+	consumes. That holds for code from the compiler but not for bytecode
+	read from a file, so loaded functions go through this pass first.
+
+	One walk over the code checks opcodes and operands and marks where
+	instructions start. A second walk follows the control flow and tracks
+	the operand stack depth: jumps must land on an instruction, the depth
+	must never drop below zero and must be the same on every path into an
+	instruction, and code must not run off the end of the function.
+
+	The same walk tracks the scopes the code opens: TRY pushes an exception
+	handler for the block at its target, WITH and CATCH push an environment.
+	Each scope is a bit on a stack packed in an integer above a marker bit,
+	so a path with nothing open holds 1. ENDTRY, ENDWITH and ENDCATCH must
+	close a scope of their kind, the stack must be the same on every path
+	into an instruction, and RETURN must find it empty.
+*/
+
+#define VERIFYERROR(msg) js_error(J, "invalid bytecode in %s at %d: %s", F->name ? F->name : "?", pc, msg)
+
+/* Operand count, values needed on the stack and change in stack depth. */
+static const struct { unsigned char operands, need; signed char delta; } optab[OP_LINE + 1] = {
+	[OP_POP] = { 0, 1, -1 },
+	[OP_DUP] = { 0, 1, 1 },
+	[OP_DUP2] = { 0, 2, 2 },
+	[OP_ROT2] = { 0, 2, 0 },
+	[OP_ROT3] = { 0, 3, 0 },
+	[OP_ROT4] = { 0, 4, 0 },
+
+	[OP_INTEGER] = { 1, 0, 1 },
+	[OP_NUMBER] = { 1, 0, 1 },
+	[OP_STRING] = { 1, 0, 1 },
+	[OP_CLOSURE] = { 1, 0, 1 },
+
+	[OP_NEWARRAY] = { 0, 0, 1 },
+	[OP_NEWOBJECT] = { 0, 0, 1 },
+	[OP_NEWREGEXP] = { 2, 0, 1 },
+
+	[OP_UNDEF] = { 0, 0, 1 },
+	[OP_NULL] = { 0, 0, 1 },
+	[OP_TRUE] = { 0, 0, 1 },
+	[OP_FALSE] = { 0, 0, 1 },
+
+	[OP_THIS] = { 0, 0, 1 },
+	[OP_CURRENT] = { 0, 0, 1 },
+
+	[OP_GETLOCAL] = { 1, 0, 1 },
+	[OP_SETLOCAL] = { 1, 1, 0 },
+	[OP_DELLOCAL] = { 1, 0, 1 },
+
+	[OP_HASVAR] = { 1, 0, 1 },
+	[OP_GETVAR] = { 1, 0, 1 },
+	[OP_SETVAR] = { 1, 1, 0 },
+	[OP_DELVAR] = { 1, 0, 1 },
+
+	[OP_IN] = { 0, 2, -1 },
+
+	[OP_INITPROP] = { 0, 3, -2 },
+	[OP_INITGETTER] = { 0, 3, -2 },
+	[OP_INITSETTER] = { 0, 3, -2 },
+
+	[OP_GETPROP] = { 0, 2, -1 },
+	[OP_GETPROP_S] = { 1, 1, 0 },
+	[OP_SETPROP] = { 0, 3, -2 },
+	[OP_SETPROP_S] = { 1, 2, -1 },
+	[OP_DELPROP] = { 0, 2, -1 },
+	[OP_DELPROP_S] = { 1, 1, 0 },
+
+	[OP_ITERATOR] = { 0, 1, 0 },
+	[OP_NEXTITER] = { 0, 1, 0 }, /* depth set at the following JFALSE */
+
+	[OP_EVAL] = { 0, 1, 0 },
+	[OP_CALL] = { 1, 2, -1 }, /* and the arguments */
+	[OP_NEW] = { 1, 1, 0 }, /* and the arguments */
+
+	[OP_TYPEOF] = { 0, 1, 0 },
+	[OP_POS] = { 0, 1, 0 },
+	[OP_NEG] = { 0, 1, 0 },
+	[OP_BITNOT] = { 0, 1, 0 },
+	[OP_LOGNOT] = { 0, 1, 0 },
+	[OP_INC] = { 0, 1, 0 },
+	[OP_DEC] = { 0, 1, 0 },
+	[OP_POSTINC] = { 0, 1, 1 },
+	[OP_POSTDEC] = { 0, 1, 1 },
+
+	[OP_MUL] = { 0, 2, -1 },
+	[OP_DIV] = { 0, 2, -1 },
+	[OP_MOD] = { 0, 2, -1 },
+	[OP_ADD] = { 0, 2, -1 },
+	[OP_SUB] = { 0, 2, -1 },
+	[OP_SHL] = { 0, 2, -1 },
+	[OP_SHR] = { 0, 2, -1 },
+	[OP_USHR] = { 0, 2, -1 },
+	[OP_LT] = { 0, 2, -1 },
+	[OP_GT] = { 0, 2, -1 },
+	[OP_LE] = { 0, 2, -1 },
+	[OP_GE] = { 0, 2, -1 },
+	[OP_EQ] = { 0, 2, -1 },
+	[OP_NE] = { 0, 2, -1 },
+	[OP_STRICTEQ] = { 0, 2, -1 },
+	[OP_STRICTNE] = { 0, 2, -1 },
+	[OP_JCASE] = { 1, 2, -1 }, /* -2 when jumping */
+	[OP_BITAND] = { 0, 2, -1 },
+	[OP_BITXOR] = { 0, 2, -1 },
+	[OP_BITOR] = { 0, 2, -1 },
+
+	[OP_INSTANCEOF] = { 0, 2, -1 },
+
+	[OP_THROW] = { 0, 1, 0 },
+
+	[OP_TRY] = { 1, 0, 0 },
+	[OP_ENDTRY] = { 0, 0, 0 },
+
+	[OP_CATCH] = { 1, 1, -1 },
+	[OP_ENDCATCH] = { 0, 0, 0 },
+
+	[OP_WITH] = { 0, 1, -1 },
+	[OP_ENDWITH] = { 0, 0, 0 },
+
+	[OP_DEBUGGER] = { 0, 0, 0 },
+	[OP_JUMP] = { 1, 0, 0 },
+	[OP_JTRUE] = { 1, 1, -1 },
+	[OP_JFALSE] = { 1, 1, -1 },
+	[OP_RETURN] = { 0, 1, 0 },
+
+	[OP_LINE] = { 1, 0, 0 },
+};
+
+static void checkoperands(js_State *J, js_Function *F, int pc)
+{
+	js_Instruction *code = F->code;
+	enum js_OpCode op = code[pc];
+	int arg = code[pc + 1];
+
+	switch (op) {
+	case OP_NUMBER:
+		if (arg < 0 || arg >= F->numlen)
+			VERIFYERROR("number index out of range");
+		break;
+	case OP_STRING: case OP_NEWREGEXP:
+	case OP_HASVAR: case OP_GETVAR: case OP_SETVAR: case OP_DELVAR:
+	case OP_GETPROP_S: case OP_SETPROP_S: case OP_DELPROP_S:
+	case OP_CATCH:
+		if (arg < 0 || arg >= F->strlen)
+			VERIFYERROR("string index out of range");
+		break;
+	case OP_CLOSURE:
+		if (arg < 0 || arg >= F->funlen)
+			VERIFYERROR("function index out of range");
+		break;
+	case OP_GETLOCAL: case OP_SETLOCAL: case OP_DELLOCAL:
+		if (arg < 1 || arg > F->varlen)
+			VERIFYERROR("local index out of range");
+		break;
+	case OP_CALL: case OP_NEW:
+		if (arg < 0)
+			VERIFYERROR("negative argument count");
+		break;
+	default:
+		break;
+	}
+}
+
+#define UNSEEN -1	/* instruction not reached yet */
+#define OPERAND -2	/* not the start of an instruction */
+
+#define NOSCOPE 1	/* the marker bit of an empty scope stack */
+#define ENVSCOPE 0	/* WITH or CATCH */
+#define TRYSCOPE 1
+
+static uint64_t pushscope(js_State *J, js_Function *F, int pc, uint64_t scope, int kind)
+{
+	if (scope >> 63)
+		VERIFYERROR("scopes nested too deep");
+	return scope << 1 | kind;
+}
+
+static uint64_t popscope(js_State *J, js_Function *F, int pc, uint64_t scope, int kind)
+{
+	if (scope == NOSCOPE || (int)(scope & 1) != kind)
+		VERIFYERROR("scope closed without being opened");
+	return scope >> 1;
+}
+
+static int jumptarget(js_State *J, js_Function *F, int pc, const int *depth)
+{
+	int target = F->code[pc + 1];
+	if (target < 0 || target >= F->codelen || depth[target] == OPERAND)
+		VERIFYERROR("bad jump target");
+	return target;
+}
+
+/* Record the depth and scopes on entry to target. Returns 1 if it has not been visited before. */
+static int setdepth(js_State *J, js_Function *F, int pc, int *depth, uint64_t *scopes, int target, int d, uint64_t scope)
+{
+	if (target >= F->codelen)
+		VERIFYERROR("code runs off the end of the function");
+	if (d < 0)
+		VERIFYERROR("stack underflow");
+	if (d > JS_STACKSIZE)
+		VERIFYERROR("stack overflow");
+	if (depth[target] == UNSEEN) {
+		depth[target] = d;
+		scopes[target] = scope;
+		return 1;
+	}
+	if (depth[target] != d)
+		VERIFYERROR("stack depth differs between paths");
+	if (scopes[target] != scope)
+		VERIFYERROR("open scopes differ between paths");
+	return 0;
+}
+
+#define BRANCH(target, d, s) if (setdepth(J, F, pc, depth, scopes, target, d, s)) work[nwork++] = target
+
+static void verifycode(js_State *J, js_Function *F, int *depth, int *work, uint64_t *scopes)
+{
+	js_Instruction *code = F->code;
+	int pc, next, n, nwork, need, delta, d;
+	uint64_t s;
+	enum js_OpCode op;
+
+	if (F->numparams < 0 || F->numparams > F->varlen)
+		js_error(J, "invalid bytecode in %s: more parameters than variables", F->name ? F->name : "?");
+	if (F->codelen == 0)
+		js_error(J, "invalid bytecode in %s: function has no code", F->name ? F->name : "?");
+
+	for (pc = 0; pc < F->codelen; pc = next) {
+		if ((unsigned int)code[pc] > OP_LINE)
+			VERIFYERROR("unknown opcode");
+		depth[pc] = UNSEEN;
+		n = optab[code[pc]].operands;
+		next = pc + 1 + n;
+		if (next > F->codelen)
+			VERIFYERROR("truncated instruction");
+		if (n > 0) {
+			checkoperands(J, F, pc);
+			depth[pc + 1] = OPERAND;
+			if (n > 1)
+				depth[pc + 2] = OPERAND;
+		}
+	}
+
+	/* follow each path until it ends or joins one already seen */
+	nwork = 0;
+	depth[0] = 0;
+	scopes[0] = NOSCOPE;
+	work[nwork++] = 0;
+	while (nwork > 0) {
+		pc = work[--nwork];
+		d = depth[pc];
+		s = scopes[pc];
+		for (;;) {
+			op = code[pc];
+			next = pc + 1 + optab[op].operands;
+			need = optab[op].need;
+			delta = optab[op].delta;
+			if (op == OP_CALL || op == OP_NEW) {
+				need += code[pc + 1];
+				delta -= code[pc + 1];
+			}
+			if (d < need)
+				VERIFYERROR("stack underflow");
+
+			switch (op) {
+			case OP_THROW:
+				next = -1;
+				break;
+			case OP_RETURN:
+				if (s != NOSCOPE)
+					VERIFYERROR("return with open scopes");
+				next = -1;
+				break;
+			case OP_JUMP:
+				BRANCH(jumptarget(J, F, pc, depth), d, s);
+				next = -1;
+				break;
+			case OP_JTRUE:
+			case OP_JFALSE:
+				BRANCH(jumptarget(J, F, pc, depth), d - 1, s);
+				d -= 1;
+				break;
+			case OP_JCASE:
+				/* a match pops both values and jumps */
+				BRANCH(jumptarget(J, F, pc, depth), d - 2, s);
+				d -= 1;
+				break;
+			case OP_TRY:
+				/* the handler follows with the exception pushed, the block is the target */
+				BRANCH(jumptarget(J, F, pc, depth), d, pushscope(J, F, pc, s, TRYSCOPE));
+				d += 1;
+				break;
+			case OP_ENDTRY:
+				s = popscope(J, F, pc, s, TRYSCOPE);
+				break;
+			case OP_WITH:
+			case OP_CATCH:
+				s = pushscope(J, F, pc, s, ENVSCOPE);
+				d += delta;
+				break;
+			case OP_ENDWITH:
+			case OP_ENDCATCH:
+				s = popscope(J, F, pc, s, ENVSCOPE);
+				break;
+			case OP_NEXTITER:
+				/* either <iobj> <name> true or false, always tested by a JFALSE */
+				if (next >= F->codelen || code[next] != OP_JFALSE)
+					VERIFYERROR("iterator result is not tested");
+				if (!setdepth(J, F, pc, depth, scopes, next, d + 2, s))
+					VERIFYERROR("stack depth differs between paths");
+				pc = next;
+				next = pc + 2;
+				BRANCH(jumptarget(J, F, pc, depth), d - 1, s);
+				d += 1;
+				break;
+			default:
+				d += delta;
+				break;
+			}
+
+			if (next < 0 || !setdepth(J, F, pc, depth, scopes, next, d, s))
+				break;
+			pc = next;
+		}
+	}
+}
+
+static int maxcodelen(js_Function *F)
+{
+	int i, n, max = F->codelen;
+	for (i = 0; i < F->funlen; ++i) {
+		n = maxcodelen(F->funtab[i]);
+		if (n > max)
+			max = n;
+	}
+	return max;
+}
+
+static void verifyfunction(js_State *J, js_Function *F, int *depth, int *work, uint64_t *scopes)
+{
+	int i;
+	verifycode(J, F, depth, work, scopes);
+	for (i = 0; i < F->funlen; ++i)
+		verifyfunction(J, F->funtab[i], depth, work, scopes);
+}
+
+static void verifyblock(js_State *J, js_Function *F, uint64_t *block, int n, int nested)
+{
+	int *depth = (int*)(block + n);
+	if (js_try(J)) {
+		js_free(J, block);
+		js_throw(J);
+	}
+	if (nested)
+		verifyfunction(J, F, depth, depth + n, block);
+	else
+		verifycode(J, F, depth, depth + n, block);
+	js_endtry(J);
+	js_free(J, block);
+}
+
+/* One block for the scratch arrays: scopes, then depths and the work list. */
+static uint64_t *newblock(js_State *J, int n)
+{
+	int slot = sizeof(uint64_t) + 2 * sizeof(int);
+	if (n > (INT_MAX - 1) / slot)
+		js_error(J, "invalid bytecode: function too large");
+	return js_malloc(J, n * slot + 1);
+}
+
+void jsC_verifyfunction(js_State *J, js_Function *F)
+{
+	/* shared by all the functions */
+	int n = maxcodelen(F);
+	verifyblock(J, F, newblock(J, n), n, 1);
+}
+
+void jsC_verifycode(js_State *J, js_Function *F)
+{
+	verifyblock(J, F, newblock(J, F->codelen), F->codelen, 0);
+}
@@ -253,6 +253,49 @@ static const char *require_js =
 ;
 #endif
 
+#ifdef JS_OPSTATS
+static const char *stats_js =
+	"(function (stats) {\n"
+	"function lpad(s, n) { s = String(s); while (s.length < n) s = ' ' + s; return s; }\n"
+	"function rpad(s, n) { s = String(s); while (s.length < n) s += ' '; return s; }\n"
+	"var ops = stats.opcodes, names = Object.keys(ops), total = 0;\n"
+	"names.forEach(function (k) { total += ops[k]; });\n"
+	"names.sort(function (a, b) { return ops[b] - ops[a]; });\n"
+	"print(rpad('opcode', 16) + lpad('count', 14) + lpad('%', 8));\n"
+	"names.forEach(function (k) {\n"
+	"	print(rpad(k, 16) + lpad(ops[k], 14) + lpad((ops[k] * 100 / total).toFixed(2), 8));\n"
+	"});\n"
+	"var funs = stats.functions.sort(function (a, b) { return b.instructions - a.instructions; });\n"
+	"print('\\n' + rpad('function', 40) + lpad('calls', 10) + lpad('instructions', 14) + lpad('time (s)', 10));\n"
+	"funs.slice(0, 30).forEach(function (f) {\n"
+	"	var where = (f.name || '(anonymous)') + ' (' + f.file + ':' + f.line + ')';\n"
+	"	print(rpad(where, 40) + lpad(f.calls, 10) + lpad(f.instructions, 14) + lpad(f.time.toFixed(3), 10));\n"
+	"});\n"
+	"})\n"
+;
+#endif
+
+static void print_stats(js_State *J)
+{
+#ifdef JS_OPSTATS
+	js_setstats(J, 0);
+	if (js_ploadstring(J, "[stats]", stats_js)) {
+		fprintf(stderr, "%s\n", js_trystring(J, -1, "Error"));
+		js_pop(J, 1);
+		return;
+	}
+	js_pushundefined(J);
+	js_call(J, 0);
+	js_pushundefined(J);
+	js_getstats(J);
+	if (js_pcall(J, 1))
+		fprintf(stderr, "%s\n", js_trystring(J, -1, "Error"));
+	js_pop(J, 1);
+#else
+	fprintf(stderr, "statistics are not available, build with -DMUJS_OPSTATS=ON\n");
+#endif
+}
+
 static int eval_print(js_State *J, const char *source)
 {
 	if (js_ploadstring(J, "[stdin]", source)) {
@@ -312,6 +355,7 @@ static void usage(void)
 	fprintf(stderr, "\t-c: Precompile script.\n");
 	fprintf(stderr, "\t-f: Load precompiled script.\n");
 	fprintf(stderr, "\t-d: Strip debug info from precompiled script.\n");
+	fprintf(stderr, "\t-p: Print opcode and function statistics after running the script.\n");
 	exit(1);
 }
 
@@ -327,9 +371,10 @@ int main(int argc, char **argv)
 	int loadprecompile = 0;
 	int stripdebug = 0;
 	int dumpast = 0;
+	int stats = 0;
 	int i, c;
 
-	while ((c = xgetopt(argc, argv, "isecfda")) != -1) {
+	while ((c = xgetopt(argc, argv, "isecfdap")) != -1) {
 		switch (c) {
 		default: usage(); break;
 		case 'i': interactive = 1; break;
@@ -339,6 +384,7 @@ int main(int argc, char **argv)
 		case 'f': loadprecompile = 1; break;
 		case 'd': stripdebug = 1; break;
 		case 'a': dumpast = 1; break;
+		case 'p': stats = 1; break;
 		}
 	}
 
@@ -373,6 +419,8 @@ int main(int argc, char **argv)
 #ifndef JS_NOCOMPILER
 	js_dostring(J, require_js);
 #endif
+	if (stats)
+		js_setstats(J, 1);
 	if (xoptind == argc) {
 		interactive = 1;
 	} else if (dumpast) {
@@ -382,6 +430,7 @@ int main(int argc, char **argv)
 			printf("%s\n", "error: no script was specified");
 			goto fail;
 		}
+		const char *filename = argv[c];
 		if (js_try(J)) {
 			if (source) {
 				free(source);
@@ -389,7 +438,6 @@ int main(int argc, char **argv)
 			printf("%s\n", js_tostring(J, -1));
 			goto fail;
 		}
-		const char *filename = argv[c];
 		source = read_file(J, filename);
 		if (js_try(J)) {
 			jsP_freeparse(J);
@@ -461,6 +509,9 @@ int main(int argc, char **argv)
 			status = 1;
 	}
 
+	if (stats)
+		print_stats(J);
+
 	if (interactive) {
 		if (isatty(0)) {
 			using_history();
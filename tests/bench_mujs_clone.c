@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <mujs/mujs.h>
+
+double get_time()
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+#define RECORDS 20000
+#define ROUNDS 5
+
+static const char *makedoc =
+	"var doc = [];\n"
+	"for (var i = 0; i < %d; i++)\n"
+	"	doc.push({ id: i, name: 'user ' + i, email: 'user' + i + '@example.com', score: i %% 1000 + 0.25,\n"
+	"		active: (i & 1) == 1, tags: ['alpha', 'beta', 'tag ' + i %% 17], note: 'line one\\nline \"two\"',\n"
+	"		location: { lat: -(i %% 90) - 0.125, lon: i * 1e-3, city: null } });\n";
+
+int main(int arg, const char **argv)
+{
+	double start, total;
+	js_State *A, *B;
+	char source[1024], *buf;
+	int i, n = 0;
+
+	printf("<clone>\n");
+
+	A = js_newstate(NULL, NULL, 0);
+	B = js_newstate(NULL, NULL, 0);
+	snprintf(source, sizeof source, makedoc, RECORDS);
+	js_dostring(A, source);
+
+	/* JSON round trip from A to B, collecting garbage outside the timing */
+	total = 0;
+	for (i = 0; i < ROUNDS; i++) {
+		start = get_time();
+		js_getglobal(A, "JSON");
+		js_getproperty(A, -1, "stringify");
+		js_rot2(A);
+		js_getglobal(A, "doc");
+		js_call(A, 1);
+		n = js_getlength(A, -1);
+		js_getglobal(B, "JSON");
+		js_getproperty(B, -1, "parse");
+		js_rot2(B);
+		js_pushstring(B, js_tostring(A, -1));
+		js_call(B, 1);
+		js_pop(A, 1);
+		js_pop(B, 1);
+		total += get_time() - start;
+		js_gc(A, 0);
+		js_gc(B, 0);
+	}
+	printf("JSON round trip: %d bytes, %f us per copy\n", n, total * 1e6 / ROUNDS);
+
+	/* structured clone from A to B */
+	total = 0;
+	for (i = 0; i < ROUNDS; i++) {
+		start = get_time();
+		js_getglobal(A, "doc");
+		n = js_dumpclone(A, -1, &buf);
+		js_pop(A, 1);
+		js_loadclone(B, buf, n);
+		js_pop(B, 1);
+		js_free(A, buf);
+		total += get_time() - start;
+		js_gc(A, 0);
+		js_gc(B, 0);
+	}
+	printf("js_dumpclone + js_loadclone: %d bytes, %f us per copy\n", n, total * 1e6 / ROUNDS);
+
+	js_freestate(A);
+	js_freestate(B);
+	return 0;
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <mujs/mujs.h>
+
+double get_time()
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+#define MODULES 500
+#define COMPILES 20
+#define CHUNK 4096
+
+/* heap in use and its high water mark, to compare streamed and whole loads */
+static size_t live, peak;
+
+static void *alloc(void *actx, void *ptr, int size)
+{
+	size_t *p = ptr ? (size_t *)ptr - 1 : NULL;
+	if (p)
+		live -= *p;
+	if (size == 0) {
+		free(p);
+		return NULL;
+	}
+	p = realloc(p, sizeof *p + size);
+	*p = size;
+	live += size;
+	if (live > peak)
+		peak = live;
+	return p + 1;
+}
+
+struct reader { const char *s; int n; };
+
+static const char *readchunk(js_State *J, void *data, int *size)
+{
+	struct reader *R = data;
+	const char *s = R->s;
+	*size = R->n < CHUNK ? R->n : CHUNK;
+	R->s += *size;
+	R->n -= *size;
+	return s;
+}
+
+int main(int arg, const char **argv)
+{
+	double start, end;
+	char *source;
+	js_HeapStats stats;
+	size_t base;
+	js_State *J;
+	int i, lazy, p = 0;
+
+	printf("<compile>\n");
+
+	source = malloc(MODULES * 600);
+	for (i = 0; i < MODULES; i++)
+		p += sprintf(source + p,
+			"var module%d = (function (exports) {\n"
+			"  var name = 'module %d', count = 0;\n"
+			"  function update(options, value) {\n"
+			"    if (options && options.enabled !== false) {\n"
+			"      for (var key in options) count += key.length;\n"
+			"      return { name: name, value: value * %d, label: \"item\" + count };\n"
+			"    }\n"
+			"    return null;\n"
+			"  }\n"
+			"  exports.update = update;\n"
+			"  exports.reset = function () { count = 0; };\n"
+			"  return exports;\n"
+			"})({});\n", i, i, i);
+	printf("source: %d bytes\n", p);
+
+	/* the caller holds the whole text for js_loadstring, js_load only sees one chunk at a time */
+	for (i = 0; i < 2; i++) {
+		struct reader R = { source, p };
+		J = js_newstate(alloc, NULL, 0);
+		js_gc(J, 0);
+		base = peak = live;
+		start = get_time();
+		if (i)
+			js_load(J, "bench.js", readchunk, &R);
+		else
+			js_loadstring(J, "bench.js", source);
+		end = get_time();
+		printf("%s: %f us, peak heap %u bytes over the empty state\n", i ? "js_load (4K chunks)" : "js_loadstring + source",
+			(end - start) * 1e6, (unsigned int)(peak - base + (i ? 0 : p)));
+		js_freestate(J);
+	}
+
+	for (lazy = 0; lazy < 2; lazy++) {
+		J = js_newstate(NULL, NULL, lazy ? JS_LAZY : 0);
+		start = get_time();
+		for (i = 0; i < COMPILES; i++) {
+			js_loadstring(J, "bench.js", source);
+			js_pop(J, 1);
+			js_gc(J, 0);
+		}
+		end = get_time();
+		printf("js_loadstring%s: %f us per compile, ", lazy ? " (JS_LAZY)" : "", (end - start) * 1e6 / COMPILES);
+
+		js_loadstring(J, "bench.js", source);
+		js_heapstats(J, &stats);
+		printf("%u functions, %u bytes\n", stats.functions.count, (unsigned int)stats.functions.bytes);
+		js_freestate(J);
+	}
+
+	free(source);
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <mujs/mujs.h>
+
+double get_time()
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+#define FUNCTIONS 2000
+#define LOADS 200
+
+static void write_file(const char *filename, const char *data, int n)
+{
+	FILE *f = fopen(filename, "wb");
+	fwrite(data, 1, n, f);
+	fclose(f);
+}
+
+int main(int arg, const char **argv)
+{
+	double start, end;
+	char *source, *data;
+	js_Shared *S;
+	js_State *J;
+	int i, n, p = 0;
+
+	printf("<image>\n");
+
+	source = malloc(FUNCTIONS * 200);
+	for (i = 0; i < FUNCTIONS; i++)
+		p += sprintf(source + p, "function f%d(a, b) { var s = 'label %d'; return a * %d.5 + b.length + s.length; }\n", i, i, i);
+
+	J = js_newstate(NULL, NULL, 0);
+	js_loadstring(J, "bench.js", source);
+	n = js_dumpscript(J, -1, &data, 0);
+	write_file("bench_image.jsb", data, n);
+	js_free(J, data);
+	printf("bytecode: %d bytes, ", n);
+	n = js_dumpimage(J, -1, &data);
+	write_file("bench_image.jsi", data, n);
+	js_free(J, data);
+	printf("image: %d bytes\n", n);
+	js_pop(J, 1);
+
+	start = get_time();
+	for (i = 0; i < LOADS; i++) {
+		js_loadbinfile(J, "bench_image.jsb");
+		js_pop(J, 1);
+		js_gc(J, 0);
+	}
+	end = get_time();
+	printf("js_loadbinfile: %f us per load\n", (end - start) * 1e6 / LOADS);
+
+	start = get_time();
+	for (i = 0; i < LOADS; i++) {
+		S = js_mapshared(J, "bench_image.jsi");
+		js_releaseshared(S);
+	}
+	end = get_time();
+	printf("js_mapshared: %f us per map\n", (end - start) * 1e6 / LOADS);
+
+	S = js_mapshared(J, "bench_image.jsi");
+	start = get_time();
+	for (i = 0; i < LOADS; i++) {
+		js_loadshared(J, S);
+		js_pop(J, 1);
+	}
+	end = get_time();
+	printf("js_loadshared: %f us per load\n", (end - start) * 1e6 / LOADS);
+	js_releaseshared(S);
+
+	js_freestate(J);
+	remove("bench_image.jsb");
+	remove("bench_image.jsi");
+	free(source);
+	return 0;
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <mujs/mujs.h>
+
+double get_time()
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+#define RECORDS 20000
+#define PARSES 5
+#define CHUNK 4096
+
+static void discard(js_State *J, void *data, const char *s, int n)
+{
+	*(int *)data += n;
+}
+
+static size_t used, peak;
+
+static void *peak_alloc(void *actx, void *ptr, int size)
+{
+	size_t *p = ptr ? (size_t *)ptr - 1 : NULL;
+	if (p)
+		used -= *p;
+	if (size == 0) {
+		free(p);
+		return NULL;
+	}
+	p = realloc(p, size + sizeof(size_t));
+	*p = size;
+	used += size;
+	if (used > peak)
+		peak = used;
+	return p + 1;
+}
+
+static size_t peak_reset(void)
+{
+	size_t last = peak - used;
+	peak = used;
+	return last;
+}
+
+static char *makejson(int *size)
+{
+	char *text = malloc(RECORDS * 300);
+	int i, p = 0;
+	p += sprintf(text + p, "[\n");
+	for (i = 0; i < RECORDS; i++)
+		p += sprintf(text + p,
+			"  {\"id\": %d, \"name\": \"user %d\", \"email\": \"user%d@example.com\", \"score\": %d.%02d,"
+			" \"active\": %s, \"tags\": [\"alpha\", \"beta\", \"tag %d\"], \"note\": \"line one\\nline \\\"two\\\"\","
+			" \"location\": {\"lat\": -%d.125, \"lon\": %de-3, \"city\": null}}%s\n",
+			i, i, i, i % 1000, i % 100, i & 1 ? "true" : "false", i % 17, i % 90, i, i + 1 < RECORDS ? "," : "");
+	p += sprintf(text + p, "]\n");
+	*size = p;
+	return text;
+}
+
+int main(int arg, const char **argv)
+{
+	double start, end;
+	js_HeapStats stats;
+	unsigned int interned;
+	js_Stringifier *S;
+	js_State *J;
+	char *text, chunk[CHUNK];
+	int i, n, size;
+	size_t peak;
+
+	printf("<json>\n");
+
+	text = makejson(&size);
+	J = js_newstate(peak_alloc, NULL, 0);
+	js_pushstring(J, text);
+	js_setglobal(J, "text");
+
+	js_heapstats(J, &stats);
+	interned = stats.internedstrings.count;
+	start = get_time();
+	for (i = 0; i < PARSES; i++) {
+		js_getglobal(J, "JSON");
+		js_getproperty(J, -1, "parse");
+		js_rot2(J);
+		js_getglobal(J, "text");
+		if (js_pcall(J, 1)) {
+			printf("JSON.parse: %s\n", js_tostring(J, -1));
+			return 1;
+		}
+		js_pop(J, 1);
+		js_gc(J, 0);
+	}
+	end = get_time();
+	js_heapstats(J, &stats);
+	printf("JSON.parse: %d bytes, %f us per parse, %.1f MB/s, %u strings interned\n", size,
+		(end - start) * 1e6 / PARSES, size * (double)PARSES / (end - start) / 1e6,
+		stats.internedstrings.count - interned);
+
+	js_getglobal(J, "JSON");
+	js_getproperty(J, -1, "parse");
+	js_rot2(J);
+	js_getglobal(J, "text");
+	js_call(J, 1);
+	js_setglobal(J, "doc");
+	js_gc(J, 0);
+
+	peak_reset();
+	start = get_time();
+	for (i = 0; i < PARSES; i++) {
+		js_getglobal(J, "JSON");
+		js_getproperty(J, -1, "stringify");
+		js_rot2(J);
+		js_getglobal(J, "doc");
+		js_call(J, 1);
+		n = js_getlength(J, -1);
+		js_pop(J, 1);
+		js_gc(J, 0);
+	}
+	end = get_time();
+	peak = peak_reset();
+	printf("JSON.stringify: %d bytes, %f us per call, %.1f MB/s, %zu bytes peak above live heap\n", n,
+		(end - start) * 1e6 / PARSES, n * (double)PARSES / (end - start) / 1e6, peak);
+
+	start = get_time();
+	for (i = 0; i < PARSES; i++) {
+		js_getglobal(J, "doc");
+		n = 0;
+		js_stringify(J, -1, NULL, discard, &n);
+		js_pop(J, 1);
+	}
+	end = get_time();
+	peak = peak_reset();
+	printf("js_stringify: %d bytes, %f us per call, %.1f MB/s, %zu bytes peak above live heap\n", n,
+		(end - start) * 1e6 / PARSES, n * (double)PARSES / (end - start) / 1e6, peak);
+
+	start = get_time();
+	for (i = 0; i < PARSES; i++) {
+		js_getglobal(J, "doc");
+		S = js_newstringifier(J, -1, NULL);
+		js_pop(J, 1);
+		n = 0;
+		while ((size = js_readstringifier(J, S, chunk, CHUNK)) > 0)
+			n += size;
+		js_freestringifier(J, S);
+	}
+	end = get_time();
+	peak = peak_reset();
+	printf("js_readstringifier: %d bytes, %f us per call, %.1f MB/s, %zu bytes peak above live heap\n", n,
+		(end - start) * 1e6 / PARSES, n * (double)PARSES / (end - start) / 1e6, peak);
+
+	js_freestate(J);
+	free(text);
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <mujs/mujs.h>
+
+double get_time()
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+struct benchmark {
+	const char *name;
+	const char *source;
+};
+
+static const struct benchmark benchmarks[] = {
+	{ "integer loop",
+		"var s = 0;\n"
+		"for (var i = 0; i < 2000000; i++) s = (s + i * 3 - (i >> 1)) | 0;\n"
+		"s;\n" },
+	{ "double loop",
+		"var s = 0.5;\n"
+		"for (var i = 0; i < 2000000; i++) s = s * 0.999 + i / 7 - 0.25;\n"
+		"s;\n" },
+	{ "number compare",
+		"var n = 0, x = 0.5;\n"
+		"for (var i = 0; i < 2000000; i++) { if (x < i && i != 7 && x <= 1.5) n++; x += 0.000001; }\n"
+		"n;\n" },
+	{ "string compare",
+		"var a = ['apple', 'banana', 'cherry', 'a rather long string literal', 'another long string literal'];\n"
+		"var n = 0;\n"
+		"for (var i = 0; i < 1000000; i++) { var x = a[i % 5], y = a[(i + 1) % 5]; if (x < y) n++; if (x === y) n--; if (x != 'cherry') n++; }\n"
+		"n;\n" },
+	{ "mixed",
+		"var n = 0, s = '';\n"
+		"for (var i = 0; i < 500000; i++) { if ('10' < i) n++; if (i == '42') n++; s = 'k' + (i & 15); if (s == 'k3') n++; }\n"
+		"n;\n" },
+};
+
+void benchmark_run(js_State *J, const struct benchmark *b)
+{
+	double start, end;
+	start = get_time();
+	if (js_ploadstring(J, b->name, b->source)) {
+		printf("%s: %s\n", b->name, js_tostring(J, -1));
+		js_pop(J, 1);
+		return;
+	}
+	js_pushundefined(J);
+	if (js_pcall(J, 0)) {
+		printf("%s: %s\n", b->name, js_tostring(J, -1));
+		js_pop(J, 1);
+		return;
+	}
+	end = get_time();
+	printf("%s: %f (%s)\n", b->name, end - start, js_tostring(J, -1));
+	js_pop(J, 1);
+}
+
+int main(int arg, const char **argv)
+{
+	js_State *J = js_newstate(NULL, NULL, 0);
+	printf("<operators>\n");
+	for (unsigned int i = 0; i < sizeof benchmarks / sizeof *benchmarks; i++)
+		benchmark_run(J, &benchmarks[i]);
+	js_freestate(J);
+	return 0;
+}
@@ -0,0 +1,123 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime, sysconf */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <mujs/mujs.h>
+
+/* wall clock, the workers run at the same time */
+double get_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define MODULES 200
+#define FUNCTIONS 40
+#define MAXTHREADS 64
+
+static char *sources[MODULES];
+static char *bins[MODULES];
+static int lengths[MODULES];
+static int next;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *worker(void *arg)
+{
+	js_Compiler *C = arg;
+	int i;
+	for (;;) {
+		pthread_mutex_lock(&lock);
+		i = next++;
+		pthread_mutex_unlock(&lock);
+		if (i >= MODULES)
+			break;
+		lengths[i] = js_compilebin(C, "module.js", sources[i], &bins[i]);
+		if (lengths[i] < 0)
+			fprintf(stderr, "%s\n", js_compileerror(C));
+	}
+	return NULL;
+}
+
+static char *module(int m)
+{
+	char *s = malloc(FUNCTIONS * 400 + 100);
+	int i, p = 0;
+	p += sprintf(s + p, "var module%d = (function (exports) {\n  var count = 0;\n", m);
+	for (i = 0; i < FUNCTIONS; i++)
+		p += sprintf(s + p,
+			"  exports.f%d = function (options, value) {\n"
+			"    if (options && options.enabled !== false) {\n"
+			"      for (var key in options) count += key.length;\n"
+			"      return { name: 'f%d', value: value * %d, label: \"item\" + count };\n"
+			"    }\n"
+			"    return null;\n"
+			"  };\n", i, i, m);
+	sprintf(s + p, "  return exports;\n})({});\n");
+	return s;
+}
+
+int main(int argc, const char **argv)
+{
+	pthread_t threads[MAXTHREADS];
+	js_Compiler *compilers[MAXTHREADS];
+	double start, mid, end;
+	js_State *J;
+	int i, n, nthreads;
+
+	printf("<parallel>\n");
+
+	nthreads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > MAXTHREADS)
+		nthreads = MAXTHREADS;
+
+	for (i = 0; i < MODULES; i++)
+		sources[i] = module(i);
+
+	J = js_newstate(NULL, NULL, 0);
+	start = get_time();
+	for (i = 0; i < MODULES; i++) {
+		js_loadstring(J, "module.js", sources[i]);
+		js_pop(J, 1);
+	}
+	end = get_time();
+	printf("js_loadstring: %f ms for %d modules\n", (end - start) * 1e3, MODULES);
+	js_freestate(J);
+
+	/* one worker, then one per core */
+	for (n = 1; n <= nthreads; n = n < nthreads ? nthreads : n + 1) {
+		for (i = 0; i < n; i++)
+			compilers[i] = js_newcompiler(NULL, NULL, 0);
+		next = 0;
+
+		J = js_newstate(NULL, NULL, 0);
+		start = get_time();
+		for (i = 0; i < n; i++)
+			pthread_create(&threads[i], NULL, worker, compilers[i]);
+		for (i = 0; i < n; i++)
+			pthread_join(threads[i], NULL);
+		mid = get_time();
+		for (i = 0; i < MODULES; i++) {
+			js_loadbin(J, bins[i], lengths[i]);
+			js_pop(J, 1);
+		}
+		end = get_time();
+		printf("%d threads: %f ms (compile %f ms, js_loadbin %f ms)\n", n,
+			(end - start) * 1e3, (mid - start) * 1e3, (end - mid) * 1e3);
+		js_freestate(J);
+
+		/* all contexts share the default allocator */
+		for (i = 0; i < MODULES; i++)
+			js_freebin(compilers[0], bins[i]);
+		for (i = 0; i < n; i++)
+			js_freecompiler(compilers[i]);
+	}
+
+	for (i = 0; i < MODULES; i++)
+		free(sources[i]);
+	return 0;
+}
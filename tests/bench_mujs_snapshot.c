@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <mujs/mujs.h>
+
+double get_time()
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static const char *library =
+	"var util = {\n"
+	"	clamp: function (x, lo, hi) { return x < lo ? lo : x > hi ? hi : x; },\n"
+	"	range: function (n) { var a = []; for (var i = 0; i < n; i++) a.push(i); return a; },\n"
+	"	pad: function (s, n) { s = String(s); while (s.length < n) s = ' ' + s; return s; },\n"
+	"	words: function (s) { return s.split(/\\s+/).filter(function (w) { return w.length > 0; }); },\n"
+	"	format: function (fmt) { var args = arguments; return fmt.replace(/\\{(\\d+)\\}/g, function (m, i) { return args[+i + 1]; }); },\n"
+	"};\n"
+	"function Point(x, y) { this.x = x; this.y = y; }\n"
+	"Point.prototype.add = function (p) { return new Point(this.x + p.x, this.y + p.y); };\n"
+	"Point.prototype.toString = function () { return '(' + this.x + ', ' + this.y + ')'; };\n"
+	"var colors = { red: '#f00', green: '#0f0', blue: '#00f', white: '#fff', black: '#000' };\n"
+	"var table = util.range(64).map(function (i) { return { id: i, name: 'entry ' + i, square: i * i }; });\n";
+
+#define STATES 2000
+
+int main(int arg, const char **argv)
+{
+	double start, end;
+	js_Snapshot *S;
+	js_State *J;
+	int i;
+
+	printf("<snapshot>\n");
+
+	start = get_time();
+	for (i = 0; i < STATES; i++) {
+		J = js_newstate(NULL, NULL, 0);
+		js_dostring(J, library);
+		js_freestate(J);
+	}
+	end = get_time();
+	printf("js_newstate + library: %f us per state\n", (end - start) * 1e6 / STATES);
+
+	J = js_newstate(NULL, NULL, 0);
+	js_dostring(J, library);
+	S = js_snapshot(J);
+	js_freestate(J);
+
+	start = get_time();
+	for (i = 0; i < STATES; i++)
+		js_freestate(js_newstatefrom(S, NULL, NULL));
+	end = get_time();
+	printf("js_newstatefrom: %f us per state, snapshot %zu bytes\n", (end - start) * 1e6 / STATES, js_snapshotsize(S));
+
+	js_freesnapshot(S);
+	return 0;
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <mujs/mujs.h>
+
+double get_time()
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+struct benchmark {
+	const char *name;
+	const char *source;
+};
+
+static const struct benchmark benchmarks[] = {
+	{ "property heavy",
+		"var list = [];\n"
+		"for (var i = 0; i < 20000; i++) list.push({ id: i, name: 'item' + i, x: i * 0.5, y: -i, visible: (i & 1) == 0, tag: 'short' });\n"
+		"var s = 0;\n"
+		"for (var k = 0; k < 10; k++) for (var i = 0; i < list.length; i++) { var o = list[i]; if (o.visible) s += o.x + o.y; }\n"
+		"s;\n" },
+	{ "array heavy",
+		"var rows = [];\n"
+		"for (var i = 0; i < 200; i++) { var row = []; for (var j = 0; j < 500; j++) row.push(i * j); rows.push(row); }\n"
+		"var s = 0;\n"
+		"for (var k = 0; k < 5; k++) for (var i = 0; i < rows.length; i++) { var row = rows[i]; for (var j = 0; j < row.length; j++) s = (s + row[j]) | 0; }\n"
+		"s;\n" },
+};
+
+void benchmark_run(const struct benchmark *b)
+{
+	double start, end;
+	js_HeapStats stats;
+	js_State *J = js_newstate(NULL, NULL, 0);
+	js_gc(J, 0);
+	js_heapstats(J, &stats);
+	size_t base = stats.total;
+	start = get_time();
+	if (js_ploadstring(J, b->name, b->source)) {
+		printf("%s: %s\n", b->name, js_tostring(J, -1));
+		js_freestate(J);
+		return;
+	}
+	js_pushundefined(J);
+	if (js_pcall(J, 0)) {
+		printf("%s: %s\n", b->name, js_tostring(J, -1));
+		js_freestate(J);
+		return;
+	}
+	end = get_time();
+	js_heapstats(J, &stats);
+	printf("%s: %f, heap %zu bytes, properties %zu bytes (%s)\n", b->name, end - start,
+		stats.total - base, stats.properties.bytes, js_tostring(J, -1));
+	js_freestate(J);
+}
+
+int main(int arg, const char **argv)
+{
+	printf("<values>\n");
+	for (unsigned int i = 0; i < sizeof benchmarks / sizeof *benchmarks; i++)
+		benchmark_run(&benchmarks[i]);
+	return 0;
+}
@@ -335,6 +335,1224 @@ MU_TEST(it_should_swap_stack_values)
 	mu_assert_int_eq(40, js_toint32(J, 0));
 }
 
+static void co_wait(js_State *J)
+{
+	js_copy(J, 1);
+	js_yield(J);
+}
+
+MU_TEST(it_should_suspend_and_resume_script_from_native_function)
+{
+	js_newcfunction(J, co_wait, "wait", 1);
+	js_setglobal(J, "wait");
+	js_dostring(J,
+		"function step(i) { return wait(i) * 2; }\n"
+		"function task(n) {\n"
+		"	var sum = 0;\n"
+		"	for (var i = 0; i < n; ++i) {\n"
+		"		try { sum += step(i); if (i == 1) throw 100; }\n"
+		"		catch (e) { sum += e; }\n"
+		"		finally { sum += 1; }\n"
+		"	}\n"
+		"	return sum;\n"
+		"}\n");
+	js_getglobal(J, "task");
+	js_newcoroutine(J);
+	js_pushnumber(J, 3);
+	mu_assert_int_eq(JS_COYIELD, js_resume(J, -2, 1));
+	mu_assert_int_eq(0, js_tointeger(J, -1));
+	js_pop(J, 1);
+	js_pushnumber(J, 10);
+	mu_assert_int_eq(JS_COYIELD, js_resume(J, -2, 1));
+	mu_assert_int_eq(1, js_tointeger(J, -1));
+	js_pop(J, 1);
+	js_pushnumber(J, 20);
+	mu_assert_int_eq(JS_COYIELD, js_resume(J, -2, 1));
+	mu_assert_int_eq(2, js_tointeger(J, -1));
+	js_pop(J, 1);
+	js_gc(J, 0);
+	js_pushnumber(J, 30);
+	mu_assert_int_eq(JS_CODONE, js_resume(J, -2, 1));
+	mu_assert_int_eq(20 + 40 + 100 + 60 + 3, js_tointeger(J, -1));
+	js_pop(J, 1);
+	mu_assert_int_eq(JS_CODEAD, js_costatus(J, -1));
+}
+
+MU_TEST(it_should_not_yield_across_native_call_boundary)
+{
+	js_newcfunction(J, co_wait, "wait", 1);
+	js_setglobal(J, "wait");
+	mu_assert(!js_isyieldable(J), "should not yield outside of coroutine");
+	js_loadstring(J, "test.js", "[1].forEach(function (x) { wait(x); });");
+	js_newcoroutine(J);
+	mu_assert_int_eq(JS_COERROR, js_resume(J, -1, 0));
+	mu_assert(js_iserror(J, -1), "should return error");
+	js_pop(J, 1);
+	mu_assert_int_eq(JS_CODEAD, js_costatus(J, -1));
+}
+
+static int hook_calls;
+
+static void hook_abort(js_State *J)
+{
+	if (++hook_calls == 100)
+		js_error(J, "budget exceeded");
+}
+
+MU_TEST(it_should_abort_infinite_loop_from_hook)
+{
+	hook_calls = 0;
+	js_sethook(J, hook_abort, 10);
+	js_ploadstring(J, "test.js", "while (true) {}");
+	js_pushundefined(J);
+	mu_assert_int_eq(1, js_pcall(J, 0));
+	js_getproperty(J, -1, "message");
+	mu_assert_string_eq("budget exceeded", js_tostring(J, -1));
+	mu_assert_int_eq(100, hook_calls);
+	js_sethook(J, NULL, 0);
+}
+
+static void hook_yield(js_State *J)
+{
+	js_yield(J);
+}
+
+MU_TEST(it_should_suspend_coroutine_from_hook)
+{
+	int slices = 0;
+	js_sethook(J, hook_yield, 50);
+	js_dostring(J,
+		"function count(n) { var k = 0; for (var i = 0; i < n; ++i) k += i; return k; }\n"
+		"function task() { var s = 0; for (var i = 0; i < 10; ++i) s += count(100); return s; }\n");
+	js_getglobal(J, "task");
+	js_newcoroutine(J);
+	while (js_resume(J, -1, 0) == JS_COYIELD) {
+		js_pop(J, 1);
+		++slices;
+	}
+	js_sethook(J, NULL, 0);
+	mu_assert(slices > 10, "should run in slices");
+	mu_assert_int_eq(49500, js_tointeger(J, -1));
+}
+
+MU_TEST(it_should_sample_call_stacks)
+{
+	const char *stacks;
+	js_startprofile(J, 1);
+	js_ploadstring(J, "test.js",
+		"function inner(n) { var k = 0; for (var i = 0; i < n; ++i) k += i; return k; }\n"
+		"function outer() { var s = 0; for (var i = 0; i < 10; ++i) s += inner(100); return s; }\n"
+		"outer();\n");
+	js_pushundefined(J);
+	mu_assert_int_eq(0, js_pcall(J, 0));
+	js_stopprofile(J);
+	mu_assert(js_profilesamples(J) > 1000, "should take a sample every tick");
+	js_dumpprofile(J);
+	stacks = js_tostring(J, -1);
+	mu_assert(strstr(stacks, "test.js:3;outer (test.js:2);inner (test.js:1) ") != NULL, stacks);
+}
+
+static void hook_count(js_State *J)
+{
+	++hook_calls;
+}
+
+static void sample_now(js_State *J)
+{
+	if (js_toboolean(J, 1))
+		js_sampleprofile(J);
+	js_pushundefined(J);
+}
+
+MU_TEST(it_should_not_count_requested_samples_as_ticks)
+{
+	int i, calls[2];
+
+	js_newcfunction(J, sample_now, "sample", 1);
+	js_setglobal(J, "sample");
+	js_sethook(J, hook_count, 1000);
+	for (i = 0; i < 2; i++) {
+		hook_calls = 0;
+		js_startprofile(J, 0);
+		js_pushboolean(J, i);
+		js_setglobal(J, "requested");
+		js_dostring(J, "for (var i = 0; i < 100000; ++i) if (i % 100 == 0) sample(requested);");
+		js_stopprofile(J);
+		calls[i] = hook_calls;
+	}
+	js_sethook(J, NULL, 0);
+
+	/* the hook budget is the same whether or not samples were requested */
+	mu_assert_int_eq(calls[0], calls[1]);
+	mu_check(calls[0] > 100 && calls[0] < 400);
+	mu_assert_int_eq(1000, js_profilesamples(J));
+}
+
+MU_TEST(it_should_count_executed_opcodes_and_calls)
+{
+	js_setstats(J, 1);
+	js_dostring(J, "function sq(x) { return x * x; }\nfor (var i = 0; i < 10; ++i) sq(i);\n");
+	js_setstats(J, 0);
+	js_getstats(J);
+	js_getproperty(J, -1, "opcodes");
+	mu_assert(js_isobject(J, -1), "should have opcode counters");
+	js_getproperty(J, -2, "functions");
+	mu_assert(js_isarray(J, -1), "should have function counters");
+#ifdef JS_OPSTATS
+	js_getproperty(J, -2, "mul");
+	mu_assert_int_eq(10, js_tointeger(J, -1));
+	js_pop(J, 1);
+	mu_assert_int_eq(2, js_getlength(J, -1));
+	js_getindex(J, -1, 0);
+	js_getproperty(J, -1, "name");
+	if (strcmp(js_tostring(J, -1), "sq")) {
+		js_pop(J, 2);
+		js_getindex(J, -1, 1);
+		js_getproperty(J, -1, "name");
+	}
+	mu_assert_string_eq("sq", js_tostring(J, -1));
+	js_getproperty(J, -2, "calls");
+	mu_assert_int_eq(10, js_tointeger(J, -1));
+#endif
+}
+
+MU_TEST(it_should_report_heap_statistics)
+{
+	js_HeapStats before, after;
+	js_gc(J, 0);
+	js_heapstats(J, &before);
+	js_dostring(J, "var keep = []; for (var i = 0; i < 100; ++i) keep.push({ n: i, s: 'a string too long to fit in a value ' + i });");
+	js_heapstats(J, &after);
+	mu_assert_string_eq("Object", js_heapclassname(0));
+	mu_assert_string_eq("Array", js_heapclassname(1));
+	mu_assert(after.objects[0].count >= before.objects[0].count + 100, "should count new objects");
+	mu_assert(after.properties.count >= before.properties.count + 200, "should count new properties");
+	mu_assert(after.memstrings.count >= before.memstrings.count + 100, "should count new strings");
+	mu_assert(after.total > before.total, "should grow");
+	mu_assert(after.peak >= after.total, "peak should cover the current heap");
+	js_dostring(J, "keep = null;");
+	js_gc(J, 0);
+	js_heapstats(J, &before);
+	mu_assert(before.total < after.total, "should shrink after collection");
+	mu_assert(before.peak >= after.total, "should remember the peak");
+	mu_assert(before.gccount > after.gccount, "should count collections");
+}
+
+MU_TEST(it_should_overflow_integer_arithmetic_to_doubles)
+{
+	js_dostring(J,
+		"var a = 2147483647, b = -2147483648;\n"
+		"var r = [a + 1, b - 1, ++a, --b, a++ - 1, 1 << 31, -1 >>> 0, (0 - 0) === 0, 1 / (1 - 1), 2 == 2.0, 2 === '2'].join();\n");
+	js_getglobal(J, "r");
+	mu_assert_string_eq("2147483648,-2147483649,2147483648,-2147483649,2147483647,-2147483648,4294967295,true,Infinity,true,false", js_tostring(J, -1));
+	js_dostring(J, "var t = typeof (1 + 1), o = {}; o[1 + 1] = 'two';");
+	js_getglobal(J, "o");
+	js_getproperty(J, -1, "2");
+	mu_assert_string_eq("two", js_tostring(J, -1));
+	js_getglobal(J, "t");
+	mu_assert_string_eq("number", js_tostring(J, -1));
+	js_dostring(J, "var n = 3 + 4;");
+	js_getglobal(J, "n");
+	mu_assert(js_isnumber(J, -1), "small integers should be numbers");
+	mu_assert_double_eq(7, js_tonumber(J, -1));
+}
+
+MU_TEST(it_should_compare_numbers_and_strings_without_coercion)
+{
+	js_dostring(J,
+		"var nan = 0 / 0, r = [1.5 < 2, 2 < 1.5, nan < 1, nan >= 1, nan == nan, nan != nan, 0.5 + 0.25,\n"
+		"'a' < 'b', 'b' <= 'a', 'abc' == 'abc', 'abc' !== 'abd', '10' < '9', '10' < 9, 1 == '1', 1 + '1'].join();\n");
+	js_getglobal(J, "r");
+	mu_assert_string_eq("true,false,false,false,false,true,0.75,true,false,true,true,true,false,true,11", js_tostring(J, -1));
+}
+
+MU_TEST(it_should_keep_accessors_out_of_line)
+{
+	js_dostring(J,
+		"var o = { plain: 1 };\n"
+		"(function () { var hidden = 'kept'; Object.defineProperty(o, 'x', { get: function () { return hidden; }, set: function (v) { hidden = v; }, configurable: true }); })();\n");
+	js_gc(J, 0);
+	js_dostring(J, "o.x = o.x + '!'; var r = [o.x, o.plain, 'x' in o, typeof Object.getOwnPropertyDescriptor(o, 'x').get];\n");
+	js_dostring(J, "delete o.x; o.x = 2; r.push(o.x, typeof Object.getOwnPropertyDescriptor(o, 'x').get); r = r.join();\n");
+	js_getglobal(J, "r");
+	mu_assert_string_eq("kept!,1,true,function,2,undefined", js_tostring(J, -1));
+}
+
+MU_TEST(it_should_share_compiled_script_between_states)
+{
+	js_State *A = js_newstate(NULL, NULL, 0);
+	js_State *B = js_newstate(NULL, NULL, 0);
+	js_State *C = js_newstate(NULL, NULL, 0);
+	js_Shared *S = js_compileshared(A, "shared.js",
+		"var greeting = 'héllo from a shared script';\n"
+		"function make(n) { return function () { return greeting + ' ' + (n + 1); }; }\n"
+		"var result = make(counter)();\n");
+	js_freestate(A);
+
+	js_pushnumber(B, 1);
+	js_setglobal(B, "counter");
+	js_loadshared(B, S);
+	js_pushundefined(B);
+	js_call(B, 0);
+	js_gc(B, 0);
+	js_getglobal(B, "result");
+	mu_assert_string_eq("héllo from a shared script 2", js_tostring(B, -1));
+
+	js_pushnumber(C, 41);
+	js_setglobal(C, "counter");
+	js_loadshared(C, S);
+	js_releaseshared(S);
+	js_pushundefined(C);
+	js_call(C, 0);
+	js_getglobal(C, "result");
+	mu_assert_string_eq("héllo from a shared script 42", js_tostring(C, -1));
+	js_getglobal(C, "make");
+	mu_assert_string_eq("function make(n) { [byte code] }", js_tostring(C, -1));
+
+	js_freestate(B);
+	js_freestate(C);
+}
+
+MU_TEST(it_should_create_states_from_snapshot)
+{
+	js_State *A = js_newstate(NULL, NULL, 0);
+	js_State *B, *C;
+	js_Snapshot *S;
+	js_dostring(A,
+		"var counter = 0;\n"
+		"function make(n) { return function () { return ++counter + n; }; }\n"
+		"var next = make(100);\n"
+		"var words = /(\\w+) (\\w+)/;\n"
+		"var box = { get twice() { return this.v * 2; }, v: 21 };\n"
+		"var text = ''; for (var i = 0; i < 20; i++) text += 'x' + i;\n");
+	S = js_snapshot(A);
+	js_freestate(A);
+
+	B = js_newstatefrom(S, NULL, NULL);
+	C = js_newstatefrom(S, NULL, NULL);
+	js_freesnapshot(S);
+
+	js_dostring(B, "counter = 10; var r = [next(), next(), box.twice, words.exec('hello world')[2], text.length].join();");
+	js_gc(B, 0);
+	js_getglobal(B, "r");
+	mu_assert_string_eq("111,112,42,world,50", js_tostring(B, -1));
+
+	js_dostring(C, "var r = [next(), typeof r, JSON.stringify({ a: [1, 'b'] }), [3, 1, 2].sort().join('')].join();");
+	js_getglobal(C, "r");
+	mu_assert_string_eq("101,undefined,{\"a\":[1,\"b\"]},123", js_tostring(C, -1));
+
+	js_freestate(B);
+	js_freestate(C);
+}
+
+MU_TEST(it_should_create_builtin_methods_on_first_use)
+{
+	js_State *J = js_newstate(NULL, NULL, 0);
+	js_HeapStats before, after;
+	int cfunction = 0;
+	while (strcmp(js_heapclassname(cfunction), "CFunction"))
+		++cfunction;
+	js_heapstats(J, &before);
+
+	js_dostring(J, "var r = [[3, 1, 2].sort().join(''), Math.max(4, 7), parseInt('12')].join();");
+	js_getglobal(J, "r");
+	mu_assert_string_eq("123,7,12", js_tostring(J, -1));
+	js_pop(J, 1);
+	js_heapstats(J, &after);
+	mu_assert_int_eq(before.objects[cfunction].count + 4, after.objects[cfunction].count);
+
+	js_dostring(J,
+		"delete Array.prototype.shift;\n"
+		"Array.prototype.reverse = 5;\n"
+		"var seen = []; for (var k in Array.prototype) seen.push(k);\n"
+		"var r = [typeof [].shift, [].reverse, seen.join('|'), Object.getOwnPropertyNames(Math).length,\n"
+		"	Object.getOwnPropertyDescriptor(Math, 'sin').enumerable, 'trim' in String.prototype].join();");
+	js_getglobal(J, "r");
+	mu_assert_string_eq("undefined,5,,26,false,true", js_tostring(J, -1));
+
+	js_freestate(J);
+}
+
+MU_TEST(it_should_run_mapped_bytecode_image)
+{
+	js_State *A = js_newstate(NULL, NULL, 0);
+	js_State *B = js_newstate(NULL, NULL, 0);
+	js_Shared *S;
+	char *image;
+	FILE *f;
+	int n, failed = 0;
+
+	js_loadstring(A, "image.js",
+		"var names = ['zero', 'one', 'twö'];\n"
+		"function pick(i) { return names[i % names.length] + ':' + (i * 1.5); }\n"
+		"var result = [pick(1), pick(2), pick(4)].join();\n");
+	n = js_dumpimage(A, -1, &image);
+	f = fopen("test_image.jsi", "wb");
+	fwrite(image, 1, n, f);
+	fclose(f);
+	js_free(A, image);
+	js_freestate(A);
+
+	S = js_mapshared(B, "test_image.jsi");
+	js_loadshared(B, S);
+	js_releaseshared(S);
+	js_pushundefined(B);
+	js_call(B, 0);
+	js_gc(B, 0);
+	js_getglobal(B, "result");
+	mu_assert_string_eq("one:1.5,twö:3,one:6", js_tostring(B, -1));
+
+	f = fopen("test_image.jsi", "wb");
+	fwrite("muj", 1, 3, f);
+	fclose(f);
+	if (js_try(B))
+		failed = 1;
+	else {
+		js_mapshared(B, "test_image.jsi");
+		js_endtry(B);
+	}
+	mu_check(failed);
+	remove("test_image.jsi");
+
+	js_freestate(B);
+}
+
+static void update_bin_checksum(char *bin, int n)
+{
+	uint32_t a = 1, b = 0;
+	int i;
+	for (i = 20; i < n; i++) {
+		a = (a + (uint8_t)bin[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	a |= b << 16;
+	memcpy(bin + 16, &a, 4);
+}
+
+MU_TEST(it_should_reject_damaged_or_stale_bytecode)
+{
+	char *bin;
+	int n;
+
+	js_loadstring(J, "bin.js", "var a = [1, 'two', 3.5]; a.length;");
+	n = js_dumpscript(J, -1, &bin, JS_BINSTRIPDEBUG);
+	js_pop(J, 1);
+	mu_assert_int_eq(JS_BINOK, js_checkbin(bin, n));
+	mu_assert_int_eq(JS_BINCORRUPT, js_checkbin(bin, n - 1));
+
+	js_loadbin(J, bin, n);
+	js_pushundefined(J);
+	js_call(J, 0);
+	mu_assert_int_eq(3, js_tointeger(J, -1));
+	js_pop(J, 1);
+
+	bin[n - 5] ^= 0x40;
+	mu_assert_int_eq(JS_BINCORRUPT, js_checkbin(bin, n));
+	update_bin_checksum(bin, n);
+	mu_assert_int_eq(JS_BINOK, js_checkbin(bin, n));
+	/* the checksum matches but the code does not */
+	bin[n - 2] = (char)0xfe;
+	bin[n - 1] = 0;
+	update_bin_checksum(bin, n);
+	mu_check(js_ploadbin(J, bin, n));
+	mu_check(strstr(js_tostring(J, -1), "invalid bytecode") != NULL);
+	js_pop(J, 1);
+
+	bin[6]++;
+	mu_assert_int_eq(JS_BINSTALE, js_checkbin(bin, n));
+	mu_check(js_ploadbin(J, bin, n));
+	js_pop(J, 1);
+
+	js_free(J, bin);
+}
+
+struct test_cache {
+	char key[64];
+	char *data;
+	int length;
+	int loads, hits, stores;
+};
+
+static const char *test_cache_load(void *cctx, const char *key, int *length)
+{
+	struct test_cache *cache = cctx;
+	cache->loads++;
+	if (!cache->data || strcmp(cache->key, key))
+		return NULL;
+	cache->hits++;
+	*length = cache->length;
+	return cache->data;
+}
+
+static void test_cache_store(void *cctx, const char *key, const char *data, int length)
+{
+	struct test_cache *cache = cctx;
+	cache->stores++;
+	free(cache->data);
+	cache->data = malloc(length);
+	memcpy(cache->data, data, length);
+	cache->length = length;
+	snprintf(cache->key, sizeof cache->key, "%s", key);
+}
+
+MU_TEST(it_should_cache_compiled_scripts)
+{
+	struct test_cache cache = { "", NULL, 0, 0, 0, 0 };
+	char source[1024];
+	js_State *A;
+	int i, n, total = 0;
+
+	n = sprintf(source, "var total = 0;\n");
+	for (i = 0; n < 700; i++) {
+		n += sprintf(source + n, "function add%d(x) { return x + %d; } total = add%d(total);\n", i, i, i);
+		total += i;
+	}
+
+	for (i = 0; i < 3; i++) {
+		A = js_newstate(NULL, NULL, 0);
+		js_setcompilecache(A, test_cache_load, NULL, test_cache_store, &cache);
+		if (i == 2)
+			cache.data[cache.length - 1] ^= 1; /* damaged entries are compiled again */
+		js_dostring(A, source);
+		js_getglobal(A, "total");
+		mu_assert_int_eq(total, js_tointeger(A, -1));
+		js_freestate(A);
+	}
+	mu_assert_int_eq(3, cache.loads);
+	mu_assert_int_eq(2, cache.hits);
+	mu_assert_int_eq(2, cache.stores);
+
+	/* short scripts are not worth a lookup */
+	A = js_newstate(NULL, NULL, 0);
+	js_setcompilecache(A, test_cache_load, NULL, test_cache_store, &cache);
+	js_dostring(A, "var x = 1;");
+	mu_assert_int_eq(3, cache.loads);
+
+	/* the text moving from the source to the filename changes the key */
+	strcpy(source + n, "//a");
+	js_loadstring(A, ".js", source);
+	source[n + 2] = 0;
+	js_loadstring(A, "a.js", source);
+	mu_assert_int_eq(5, cache.loads);
+	mu_assert_int_eq(2, cache.hits);
+	mu_assert_int_eq(4, cache.stores);
+	js_freestate(A);
+	free(cache.data);
+}
+
+MU_TEST(it_should_lex_identifiers_and_strings_from_source)
+{
+	js_State *A = js_newstate(NULL, NULL, 0);
+	char *source;
+	int i, n;
+
+	js_dostring(A,
+		"var inx = 1, \\u0069f2 = 2, café = 3, $_9 = 4;\n"
+		"var s = ['plain', 'tab\\there', \"it's\", 'café', 'a\\\\b', ''].join('|');\n"
+		"var r = [inx, if2, café, $_9, inx instanceof Object].join() + '|' + s;\n");
+	js_getglobal(A, "r");
+	mu_assert_string_eq("1,2,3,4,false|plain|tab\there|it's|café|a\\b|", js_tostring(A, -1));
+	js_pop(A, 1);
+
+	/* a script with more syntax tree than fits in one arena chunk, then a small one */
+	source = malloc(2000 * 40);
+	n = sprintf(source, "var sum = 0;\n");
+	for (i = 0; i < 2000; i++)
+		n += sprintf(source + n, "sum = sum + (%d * 2 - %d);\n", i, i);
+	js_dostring(A, source);
+	js_dostring(A, "sum = sum + 1;");
+	js_getglobal(A, "sum");
+	mu_assert_int_eq(1999000 + 1, js_tointeger(A, -1));
+	free(source);
+	js_freestate(A);
+}
+
+MU_TEST(it_should_compile_functions_on_first_call)
+{
+	const char *source =
+		"function add(a, b) { return a + b; }\n"
+		"function counter() { var n = 0; return function () { return ++n; }; }\n"
+		"var fact = function f(n) { return n <= 1 ? 1 : n * f(n - 1); };\n"
+		"var obj = { get x() { return 42; }, set y(v) { this.z = v * 2; } };\n"
+		"function strict() { 'use strict'; return this === undefined; }\n"
+		"var c = counter(); c();\n"
+		"obj.y = 4;\n"
+		"var r = [add(1, 2), add.length, fact(5), c(), obj.x, obj.z, strict(), String(add)].join();\n";
+	static const char *broken[] = {
+		"print(1); function f() { if (f) break; }",
+		"var o = { get x() { for (;;) { var g = function () { continue; }; } } };",
+		"'use strict'; function f() { with (f) {} }",
+		"function f() { 'use strict'; return function (a, a) { return a; }; }",
+		"function f() { 'use strict'; var g = function () { eval = 1; }; }",
+		"var o = { set x(v) { 'use strict'; delete v; } };",
+		"function f() { function g() { } return function () { 'use strict'; var arguments; }; }",
+	};
+	js_State *E = js_newstate(NULL, NULL, 0);
+	js_State *L = js_newstate(NULL, NULL, JS_LAZY);
+	js_State *S = js_newstate(NULL, NULL, JS_LAZY | JS_STRICT);
+	char *a, *b;
+	int i, na, nb;
+
+	/* compile errors in a function body still fail the load */
+	for (i = 0; i < (int)(sizeof broken / sizeof *broken); i++) {
+		mu_check(js_ploadstring(E, "broken.js", broken[i]) != 0);
+		mu_check(js_ploadstring(L, "broken.js", broken[i]) != 0);
+		mu_assert_string_eq(js_tostring(E, -1), js_tostring(L, -1));
+		js_pop(E, 1);
+		js_pop(L, 1);
+	}
+	mu_check(js_ploadstring(L, "loose.js", "function f() { with (f) {} }") == 0);
+	js_pop(L, 1);
+	mu_check(js_ploadstring(S, "strict.js", "function f() { with (f) {} }") != 0);
+	mu_check(strstr(js_tostring(S, -1), "SyntaxError: strict.js:1: 'with' statements are not allowed in strict mode") != NULL);
+	js_pop(S, 1);
+	js_freestate(S);
+
+	mu_check(js_ploadstring(L, "lazy.js", source) == 0);
+	js_pushundefined(L);
+	js_call(L, 0);
+	js_pop(L, 1);
+	js_getglobal(L, "r");
+	mu_assert_string_eq("3,2,120,2,42,8,true,function add(a,b) { [byte code] }", js_tostring(L, -1));
+	js_pop(L, 1);
+
+	/* syntax errors are still found when the script is loaded */
+	mu_check(js_ploadstring(L, "bad.js", "function f() { return function () { var = 1; }; }") != 0);
+	js_pop(L, 1);
+
+	/* bytecode is the same once every function has been compiled */
+	source = "function f(x) { function g(y) { return { get v() { return x + y; } }; } return g(x).v; }\nvar r = f(2);";
+	js_loadstring(E, "same.js", source);
+	js_loadstring(L, "same.js", source);
+	na = js_dumpscript(E, -1, &a, 0);
+	nb = js_dumpscript(L, -1, &b, 0);
+	mu_assert_int_eq(na, nb);
+	mu_check(memcmp(a, b, na) == 0);
+	js_free(E, a);
+	js_free(L, b);
+
+	js_freestate(E);
+	js_freestate(L);
+}
+
+MU_TEST(it_should_fold_constants_and_drop_dead_code)
+{
+	const char *source =
+		"function f(a) {\n"
+		"  var n = 6, s = 'v' + n;\n"
+		"  var t = typeof n + ':' + !0 + ':' + (1 < 2) + ':' + ('1' === 1) + ':' + 'a' + null;\n"
+		"  var b = a; b = 1;\n"
+		"  if (n * 7 === 42) return [s, t, b, n > 5 ? 'big' : 'small', 0 || 'or', 1 && 'and'].join();\n"
+		"  return 'unreachable';\n"
+		"}\n"
+		"function g() { 'use ' + 'strict'; h = 1; return typeof h; }\n"
+		"var i = 0, r; while (true) { if (++i > 3) break; } do { i++; } while (false);\n"
+		"r = [f(2), g(), i].join('|');\n";
+	const char *folded = "function f() { if (false) { throw 'x' + 1; } return 1 + 2 * 3; }";
+	const char *plain = "function f() { return 7; }";
+	char *a, *b;
+	int na, nb;
+
+	js_loadstring(J, "fold.js", source);
+	js_pushundefined(J);
+	js_call(J, 0);
+	js_pop(J, 1);
+	js_getglobal(J, "r");
+	mu_assert_string_eq("v6,number:true:true:false:anull,1,big,or,and|number|5", js_tostring(J, -1));
+	js_pop(J, 1);
+
+	/* the runtime agrees with the folded concatenation */
+	js_dostring(J, "var t = true, r = 'a' + t + null;");
+	js_getglobal(J, "r");
+	mu_assert_string_eq("atruenull", js_tostring(J, -1));
+	js_pop(J, 1);
+
+	/* code that can never run still reports its errors */
+	mu_check(js_ploadstring(J, "dead.js", "function f() { if (false) { break; } }") != 0);
+	mu_check(strstr(js_tostring(J, -1), "unlabelled break must be inside loop or switch") != NULL);
+	js_pop(J, 1);
+	mu_check(js_ploadstring(J, "dead.js", "function f() { return 0 ? (1 = 2) : 3; }") != 0);
+	js_pop(J, 1);
+
+	/* and leaves nothing behind */
+	js_loadstring(J, "same.js", folded);
+	js_loadstring(J, "same.js", plain);
+	na = js_dumpscript(J, -2, &a, 0);
+	nb = js_dumpscript(J, -1, &b, 0);
+	mu_assert_int_eq(nb, na);
+	mu_check(memcmp(a, b, na) == 0);
+	js_free(J, a);
+	js_free(J, b);
+	js_pop(J, 2);
+}
+
+struct chunk_reader { const char *s; int step; char buf[8]; };
+
+static const char *read_chunk(js_State *L, void *data, int *size)
+{
+	struct chunk_reader *R = data;
+	int n = strlen(R->s);
+	if (n > R->step)
+		n = R->step;
+	if (n == 0)
+		return NULL;
+	/* the chunk only has to stay valid until the next call */
+	memcpy(R->buf, R->s, n);
+	R->s += n;
+	*size = n;
+	return R->buf;
+}
+
+static const char *read_error(js_State *L, void *data, int *size)
+{
+	js_error(L, "connection reset");
+}
+
+MU_TEST(it_should_load_source_from_a_reader)
+{
+	const char *source =
+		"var caf\xc3\xa9 = 'd\xc3\xa9j\xc3\xa0 vu',\r\n"
+		"    n = 12345.678e-1, /* comment\r\n spanning lines */ long_name_that_spans_chunks = 'escaped \\u0041';\r\n"
+		"var r = [caf\xc3\xa9, n, long_name_that_spans_chunks].join('|');\r\n"
+		"throw new Error('line');";
+	struct chunk_reader R;
+	int step;
+
+	for (step = 1; step <= 8; step++) {
+		R.s = source;
+		R.step = step;
+		js_load(J, "chunks.js", read_chunk, &R);
+		js_pushundefined(J);
+		mu_check(js_pcall(J, 0) != 0);
+		mu_check(strstr(js_tostring(J, -1), "at chunks.js:5") != NULL);
+		js_pop(J, 1);
+		js_getglobal(J, "r");
+		mu_assert_string_eq("d\xc3\xa9j\xc3\xa0 vu|1234.5678|escaped A", js_tostring(J, -1));
+		js_pop(J, 1);
+	}
+
+	/* syntax errors report the line, errors from the reader are passed on */
+	R.s = "var a = 1;\nvar = 2;";
+	R.step = 3;
+	mu_check(js_pload(J, "chunks.js", read_chunk, &R) != 0);
+	mu_assert_string_eq("SyntaxError: chunks.js:2: unexpected token: '=' (expected identifier)", js_tostring(J, -1));
+	js_pop(J, 1);
+	mu_check(js_pload(J, "chunks.js", read_error, NULL) != 0);
+	mu_assert_string_eq("Error: connection reset", js_tostring(J, -1));
+	js_pop(J, 1);
+}
+
+MU_TEST(it_should_compile_in_a_separate_context)
+{
+	const char *source = "function twice(x) { return 2 * x; }\nvar r = twice(21) + ':' + 'done';";
+	js_Compiler *C = js_newcompiler(NULL, NULL, 0);
+	char *bin, *dump;
+	int n, m;
+
+	n = js_compilebin(C, "module.js", source, &bin);
+	mu_check(n > 0);
+	mu_check(js_compileerror(C) == NULL);
+
+	/* the same binary as a dump of the script compiled in the state */
+	js_loadstring(J, "module.js", source);
+	m = js_dumpscript(J, -1, &dump, 0);
+	js_pop(J, 1);
+	mu_assert_int_eq(m, n);
+	mu_check(memcmp(bin, dump, n) == 0);
+	js_free(J, dump);
+
+	js_loadbin(J, bin, n);
+	js_pushundefined(J);
+	js_call(J, 0);
+	js_pop(J, 1);
+	js_getglobal(J, "r");
+	mu_assert_string_eq("42:done", js_tostring(J, -1));
+	js_pop(J, 1);
+	js_freebin(C, bin);
+
+	/* errors are kept until the next compile */
+	mu_assert_int_eq(-1, js_compilebin(C, "bad.js", "var r = ;", &bin));
+	mu_check(strstr(js_compileerror(C), "SyntaxError: bad.js:1: unexpected token in expression: ';'") != NULL);
+	n = js_compilebin(C, "good.js", "1", &bin);
+	mu_check(n > 0);
+	mu_check(js_compileerror(C) == NULL);
+	js_freebin(C, bin);
+
+	js_freecompiler(C);
+}
+
+MU_TEST(it_should_find_keywords_and_reserved_words)
+{
+	js_State *A = js_newstate(NULL, NULL, 0);
+	char *source;
+	int i, n;
+
+	/* every keyword, and names that are near one */
+	js_dostring(A,
+		"function f(a) {\n"
+		"	var r = [];\n"
+		"	switch (a) { case 1: r.push('one'); break; default: r.push('other'); }\n"
+		"	do { if (a in {}) continue; else break; } while (false);\n"
+		"	try { throw null; } catch (e) { r.push(typeof e); } finally { r.push(this !== undefined); }\n"
+		"	for (var i = 0; i < 1; i++) with ({}) r.push(new Object() instanceof Object, void 0, true);\n"
+		"	debugger; delete r.x;\n"
+		"	return r.join();\n"
+		"}\n"
+		"var iff = 1, dot = 2, thiss = 3, newer = 4, classy = 5, letter = 6, yields = 7, in2 = 8;\n"
+		"var yield = 9, let = 10;\n"
+		"var r = f(1) + '|' + [iff, dot, thiss, newer, classy, letter, yields, in2, yield, let].join();\n");
+	js_getglobal(A, "r");
+	mu_assert_string_eq("one,object,true,true,,true|1,2,3,4,5,6,7,8,9,10", js_tostring(A, -1));
+	js_pop(A, 1);
+
+	mu_check(js_ploadstring(A, "a.js", "var class = 1;"));
+	mu_check(strstr(js_tostring(A, -1), "'class' is a future reserved word") != NULL);
+	js_pop(A, 1);
+	mu_check(js_ploadstring(A, "b.js", "'use strict'; function f(yield) {}"));
+	mu_check(strstr(js_tostring(A, -1), "'yield' is a strict mode future reserved word") != NULL);
+	js_pop(A, 1);
+
+	/* more names than the intern cache has slots, each used twice */
+	source = malloc(1000 * 40);
+	n = sprintf(source, "var sum = 0;\n");
+	for (i = 0; i < 1000; i++)
+		n += sprintf(source + n, "var n%d = %d; sum = sum + n%d;\n", i, i, i);
+	js_dostring(A, source);
+	js_getglobal(A, "sum");
+	mu_assert_int_eq(499500, js_tointeger(A, -1));
+	free(source);
+	js_freestate(A);
+}
+
+MU_TEST(it_should_parse_json_in_one_pass)
+{
+	js_dostring(J,
+		"var v = JSON.parse(' {\"n\": [1, -0, 2.5e3, 9007199254740993, true, null], \"a\": 1,\\n'\n"
+		"	+ ' \"long plain string past eight bytes\": \"caf\\u00e9 \\\\u2603 tab\\\\there, quote \\\\\" end\",\\n'\n"
+		"	+ ' \"a\": {\"nested\": [[], {}]}, \"b\": \"\"} ');\n"
+		"var r = [JSON.stringify(v), 1 / v.n[1], v.n.length, Object.keys(v).join()].join('|');\n");
+	js_getglobal(J, "r");
+	mu_assert_string_eq("{\"n\":[1,0,2500,9007199254740992,true,null],\"a\":{\"nested\":[[],{}]},"
+		"\"long plain string past eight bytes\":\"caf\\u00E9 \\u2603 tab\\there, quote \\\" end\",\"b\":\"\"}"
+		"|-Infinity|6|n,a,long plain string past eight bytes,b", js_tostring(J, -1));
+	js_pop(J, 1);
+
+	/* members are defined, not assigned through setters on the prototype */
+	js_dostring(J,
+		"Object.defineProperty(Object.prototype, 'trap', { set: function () { throw 'setter'; }, configurable: true });\n"
+		"var t = JSON.parse('{\"trap\": 1}');\n"
+		"delete Object.prototype.trap;\n"
+		"var a = JSON.parse('[\"x\", \"y\"]'); a.push('z');\n"
+		"var r = [t.trap, a.length, a.join('')].join();\n");
+	js_getglobal(J, "r");
+	mu_assert_string_eq("1,3,xyz", js_tostring(J, -1));
+	js_pop(J, 1);
+
+	js_dostring(J,
+		"function fails(s) { try { JSON.parse(s); return 'parsed'; } catch (e) { return e.message; } }\n"
+		"var r = [fails('[1, 2] 3'), fails('{\\n\"a\": \"\\\\x\"}'), fails('{\"a\" 1}'), fails('[1,]')].join('|');\n");
+	js_getglobal(J, "r");
+	mu_assert_string_eq("JSON: unexpected token: (number) (expected (end-of-file))|JSON:2: invalid escape sequence"
+		"|JSON: unexpected token: (number) (expected ':')|JSON: unexpected token: ']'", js_tostring(J, -1));
+	js_pop(J, 1);
+}
+
+struct json_sink { char buf[40000]; int n, calls; };
+
+static void write_json(js_State *L, void *data, const char *s, int n)
+{
+	struct json_sink *W = data;
+	memcpy(W->buf + W->n, s, n);
+	W->n += n;
+	W->buf[W->n] = 0;
+	W->calls++;
+}
+
+static int read_fails(js_Stringifier *S)
+{
+	char buf[16];
+	if (js_try(J)) {
+		js_pop(J, 1);
+		return 1;
+	}
+	js_readstringifier(J, S, buf, sizeof buf);
+	js_endtry(J);
+	return 0;
+}
+
+MU_TEST(it_should_stringify_to_the_host)
+{
+	static struct json_sink W;
+	js_Stringifier *S;
+	char buf[7];
+	int n, total;
+
+	js_dostring(J,
+		"var doc = { id: 1, list: [1.5, -0, 1e21, 9007199254740991, 'caf\\u00e9', null, undefined, true],\n"
+		"	big: new Array(3001).join('long text '), nested: { a: [[], {}], toJSON: undefined } };\n"
+		"var text = JSON.stringify(doc), pretty = JSON.stringify(doc, null, '  ');\n");
+
+	/* written in chunks, with the long string passed straight through */
+	js_getglobal(J, "doc");
+	W.n = W.calls = 0;
+	mu_check(js_stringify(J, -1, NULL, write_json, &W));
+	mu_check(W.calls > 2);
+	js_getglobal(J, "text");
+	mu_check(!strcmp(js_tostring(J, -1), W.buf));
+	js_pop(J, 1);
+	W.n = 0;
+	js_stringify(J, -1, "  ", write_json, &W);
+	js_getglobal(J, "pretty");
+	mu_check(!strcmp(js_tostring(J, -1), W.buf));
+	js_pop(J, 1);
+
+	/* read a few bytes at a time, collecting garbage in between */
+	S = js_newstringifier(J, -1, NULL);
+	js_pop(J, 1);
+	total = 0;
+	while ((n = js_readstringifier(J, S, buf, sizeof buf)) > 0) {
+		memcpy(W.buf + total, buf, n);
+		total += n;
+		js_gc(J, 0);
+	}
+	W.buf[total] = 0;
+	mu_assert_int_eq(0, js_readstringifier(J, S, buf, sizeof buf));
+	js_freestringifier(J, S);
+	js_getglobal(J, "text");
+	mu_check(!strcmp(js_tostring(J, -1), W.buf));
+	js_pop(J, 1);
+
+	/* no JSON form, and errors */
+	js_pushundefined(J);
+	W.n = W.calls = 0;
+	mu_check(!js_stringify(J, -1, NULL, write_json, &W));
+	mu_assert_int_eq(0, W.calls);
+	S = js_newstringifier(J, -1, NULL);
+	mu_assert_int_eq(0, js_readstringifier(J, S, buf, sizeof buf));
+	js_freestringifier(J, S);
+	js_pop(J, 1);
+
+	js_dostring(J, "var cyclic = { a: [] }; cyclic.a.push(cyclic);");
+	js_getglobal(J, "cyclic");
+	S = js_newstringifier(J, -1, NULL);
+	js_pop(J, 1);
+	mu_check(read_fails(S));
+	mu_check(read_fails(S));
+	js_freestringifier(J, S);
+}
+
+MU_TEST(it_should_stringify_deep_and_shared_values)
+{
+	js_Stringifier *S;
+	char buf[64];
+	int n, total;
+
+	js_dostring(J,
+		"var deep = [], c = deep, shared = { s: 1 };\n"
+		"for (var i = 0; i < 60; i++) { c.push(shared, { n: [] }); c = c[1].n; }\n"
+		"var text = JSON.stringify(deep);\n"
+		"var cyclic = {}, d = cyclic;\n"
+		"for (var i = 0; i < 50; i++) d = d.n = { x: [i] };\n"
+		"var far = cyclic; for (var i = 0; i < 30; i++) far = far.n;\n"
+		"var holes = [1, , 'two', -0, 1.5]; holes[7] = false;\n"
+		"Object.defineProperty(holes, '2', { get: function () { return 'got'; } });\n"
+		"Array.prototype[1] = 'inherited';\n"
+		"var holesText = JSON.stringify(holes);\n"
+		"delete Array.prototype[1];\n");
+
+	/* cycles back to a frame that is scanned, and to one in the table */
+	mu_assert_int_eq(1, js_dostring(J, "d.back = cyclic.n.n.n; JSON.stringify(cyclic);"));
+	mu_assert_int_eq(1, js_dostring(J, "d.back = far; JSON.stringify(cyclic);"));
+	mu_assert_int_eq(0, js_dostring(J, "d.back = far.x; JSON.stringify(cyclic);"));
+	js_dostring(J, "var r = JSON.parse(text); for (var i = 0; i < 60; i++) r = r[1].n; var ok = r.length === 0;");
+	js_getglobal(J, "ok");
+	mu_check(js_toboolean(J, -1));
+	js_pop(J, 1);
+	js_getglobal(J, "holesText");
+	mu_assert_string_eq("[1,\"inherited\",\"got\",0,1.5,null,null,false]", js_tostring(J, -1));
+	js_pop(J, 1);
+
+	/* pulled, the open frames go through the registry between reads */
+	js_getglobal(J, "deep");
+	S = js_newstringifier(J, -1, NULL);
+	js_pop(J, 1);
+	js_getglobal(J, "text");
+	total = 0;
+	while ((n = js_readstringifier(J, S, buf, sizeof buf)) > 0) {
+		mu_check(!memcmp(js_tostring(J, -1) + total, buf, n));
+		total += n;
+	}
+	mu_assert_int_eq(js_getlength(J, -1), total);
+	js_pop(J, 1);
+	js_freestringifier(J, S);
+}
+
+static int points[8][2], npoints;
+
+static void save_point(js_State *L, void *data, js_Writer write, void *wdata)
+{
+	write(L, wdata, data, sizeof points[0]);
+}
+
+static void load_point(js_State *L, const char *s, int n)
+{
+	int *p = points[1 + npoints++ % 7];
+	if (n != sizeof points[0])
+		js_error(L, "bad point");
+	memcpy(p, s, n);
+	js_getglobal(L, "Object");
+	js_getproperty(L, -1, "prototype");
+	js_rot2pop1(L);
+	js_newuserdata(L, "point", p, NULL);
+}
+
+static int load_fails(js_State *L, const char *buf, int n)
+{
+	if (js_try(L)) {
+		js_pop(L, 1);
+		return 1;
+	}
+	js_loadclone(L, buf, n);
+	js_endtry(L);
+	js_pop(L, 1);
+	return 0;
+}
+
+/* The error message if the value on top of the stack can not be cloned, left above it */
+static const char *dump_error(js_State *L)
+{
+	char *buf;
+	if (js_try(L))
+		return js_tostring(L, -1);
+	js_dumpclone(L, -1, &buf);
+	js_endtry(L);
+	js_free(L, buf);
+	return NULL;
+}
+
+MU_TEST(it_should_clone_values_between_states)
+{
+	js_State *B = js_newstate(NULL, NULL, 0);
+	char *buf, *copy;
+	int i, n, failures;
+
+	points[0][0] = 3, points[0][1] = 4;
+	npoints = 0;
+	js_setclonehooks(J, "point", save_point, load_point);
+	js_setclonehooks(B, "point", save_point, load_point);
+	js_newobject(J);
+	js_newuserdata(J, "point", points[0], NULL);
+	js_setglobal(J, "point");
+
+	js_dostring(J,
+		"var shared = { name: 'shared' };\n"
+		"var value = { u: undefined, n: null, z: -0, nan: NaN, big: 1e300, i: -7, s: 'caf\\u00e9',\n"
+		"	a: [1, , 'x', shared], sparse: [], date: new Date(86400000), re: /a+b/gi,\n"
+		"	wrapped: [new Number(2), new String('s'), new Boolean(false)], point: point,\n"
+		"	shared: shared, again: shared };\n"
+		"value.sparse[100] = 1; value.sparse.extra = 'e';\n"
+		"value.self = value;\n"
+		"Object.defineProperty(value, 'hidden', { value: 1, enumerable: false });\n"
+		"Object.defineProperty(value, 'computed', { get: function () { return 6 * 7; }, enumerable: true });\n");
+	js_getglobal(J, "value");
+	n = js_dumpclone(J, -1, &buf);
+	js_pop(J, 1);
+	mu_check(n > 0);
+
+	js_loadclone(B, buf, n);
+	js_setglobal(B, "v");
+	js_getglobal(B, "v");
+	js_getproperty(B, -1, "point");
+	mu_check(js_touserdata(B, -1, "point") == points[1]);
+	mu_assert_int_eq(4, points[1][1]);
+	js_pop(B, 2);
+	js_dostring(B,
+		"var keys = Object.keys(v).join();\n"
+		"var ok = [ 'u' in v && v.u === undefined, v.n === null, 1 / v.z === -Infinity, v.nan !== v.nan,\n"
+		"	v.big === 1e300, v.i === -7, v.s === 'caf\\u00e9', v.a.length === 4, !(1 in v.a), v.a[2] === 'x',\n"
+		"	v.a[3] === v.shared, v.again === v.shared, v.self === v, v.shared.name === 'shared',\n"
+		"	v.sparse.length === 101, v.sparse[100] === 1, v.sparse.extra === 'e',\n"
+		"	v.date instanceof Date, v.date.getTime() === 86400000, v.re instanceof RegExp,\n"
+		"	v.re.source === 'a+b', v.re.global && v.re.ignoreCase && !v.re.multiline,\n"
+		"	typeof v.wrapped[0] === 'object' && v.wrapped[0] == 2, v.wrapped[1] == 's', v.wrapped[2].valueOf() === false,\n"
+		"	!('hidden' in v), v.computed === 42 ].join();\n");
+	js_getglobal(B, "keys");
+	mu_assert_string_eq("u,n,z,nan,big,i,s,a,sparse,date,re,wrapped,point,shared,again,self,computed", js_tostring(B, -1));
+	js_getglobal(B, "ok");
+	mu_check(!strstr(js_tostring(B, -1), "false"));
+	js_pop(B, 2);
+
+	/* every truncation and a flip of each byte is caught or loads a value, never read past the end */
+	copy = malloc(n);
+	failures = 0;
+	for (i = 0; i < n; ++i)
+		failures += load_fails(B, buf, i);
+	mu_assert_int_eq(n, failures);
+	for (i = 0; i < n; ++i) {
+		memcpy(copy, buf, n);
+		copy[i] ^= 0x5a;
+		load_fails(B, copy, n);
+	}
+	free(copy);
+	js_free(J, buf);
+
+	/* values without a binary form */
+	js_dostring(J, "var f = { f: function () {} };");
+	js_getglobal(J, "f");
+	mu_assert_string_eq("TypeError: cannot clone Function object", dump_error(J));
+	js_pop(J, 2);
+	js_newobject(J);
+	js_newuserdata(J, "unknown", NULL, NULL);
+	mu_assert_string_eq("TypeError: cannot clone userdata 'unknown'", dump_error(J));
+	js_pop(J, 2);
+
+	js_freestate(B);
+}
+
+MU_TEST(it_should_keep_counting_opcodes_when_profiling_starts)
+{
+	js_setstats(J, 1);
+	js_startprofile(J, 10);
+	mu_assert_int_eq(0, js_dostring(J, "var s = 0; for (var i = 0; i < 100; ++i) s += i * i;\n"));
+	js_startprofile(J, 10);
+	mu_assert_int_eq(0, js_dostring(J, "s = s * 2;\n"));
+	js_stopprofile(J);
+	js_setstats(J, 0);
+	js_getstats(J);
+	js_getproperty(J, -1, "opcodes");
+	mu_assert(js_isobject(J, -1), "should have opcode counters");
+#ifdef JS_OPSTATS
+	js_getproperty(J, -1, "mul");
+	mu_assert_int_eq(101, js_tointeger(J, -1));
+#endif
+}
+
+MU_TEST(it_should_compare_objects_converted_to_small_integers)
+{
+	js_dostring(J,
+		"var o = { valueOf: function () { return 1; } }, p = { toString: function () { return 2; } };\n"
+		"var r = [o == 1, 1 == o, o == '1', p == 2, o != 1, o == 2, 1.5 == o].join();\n");
+	js_getglobal(J, "r");
+	mu_assert_string_eq("true,true,true,true,false,false,false", js_tostring(J, -1));
+}
+
+MU_TEST(it_should_check_every_table_of_a_mapped_image)
+{
+	js_State *B = js_newstate(NULL, NULL, 0);
+	js_Shared *S;
+	char *image, *copy;
+	const char *error;
+	FILE *f;
+	int i, n, corrupt = 0, invalid = 0;
+
+	js_sethook(B, hook_abort, 10);
+	js_loadstring(J, "image.js",
+		"var names = ['zero', 'one'];\n"
+		"function pick(i) { try { return names[i % 2] + i * 1.5; } catch (e) { return e; } }\n"
+		"pick(1);\n");
+	n = js_dumpimage(J, -1, &image);
+	js_pop(J, 1);
+	copy = malloc(n);
+
+	/* make each word past the header huge, one at a time */
+	for (i = 64; i + 4 <= n; i += 4) {
+		memcpy(copy, image, n);
+		memcpy(copy + i, "\xff\xff\xff\x3f", 4);
+		f = fopen("test_image.jsi", "wb");
+		fwrite(copy, 1, n, f);
+		fclose(f);
+		if (js_try(B)) {
+			error = js_tostring(B, -1);
+			corrupt += strstr(error, "corrupt bytecode image") != NULL;
+			invalid += strstr(error, "invalid bytecode") != NULL;
+			js_pop(B, 1);
+			continue;
+		}
+		S = js_mapshared(B, "test_image.jsi");
+		js_endtry(B);
+		/* what passes may compute something else, but must run safely */
+		js_loadshared(B, S);
+		js_releaseshared(S);
+		js_pushundefined(B);
+		hook_calls = 0;
+		js_pcall(B, 0);
+		js_pop(B, 1);
+	}
+	mu_check(corrupt > 0);
+	mu_check(invalid > 0);
+
+	remove("test_image.jsi");
+	free(copy);
+	js_free(J, image);
+	js_freestate(B);
+}
+
+MU_TEST(it_should_reject_bytecode_that_closes_unopened_scopes)
+{
+	char *bin;
+	int i, n;
+
+	js_loadstring(J, "bin.js", "debugger; debugger; x = 1;");
+	n = js_dumpscript(J, -1, &bin, JS_BINSTRIPDEBUG);
+	js_pop(J, 1);
+
+	/* the two debugger instructions are the only equal pair of opcodes */
+	for (i = 20; i + 4 <= n; ++i)
+		if (bin[i] && bin[i] == bin[i + 2] && !bin[i + 1] && !bin[i + 3])
+			break;
+	mu_check(i + 4 <= n);
+	/* ENDWITH comes right before DEBUGGER; at the top level it would leave no scope at all */
+	bin[i]--;
+	bin[i + 2]--;
+	update_bin_checksum(bin, n);
+	mu_assert_int_eq(JS_BINOK, js_checkbin(bin, n));
+	mu_check(js_ploadbin(J, bin, n));
+	mu_check(strstr(js_tostring(J, -1), "scope closed without being opened") != NULL);
+	js_pop(J, 1);
+
+	js_free(J, bin);
+}
+
+MU_TEST(it_should_leave_finally_blocks_with_break_and_continue)
+{
+	static const char *scripts[] = {
+		"function a() { var n = 0; while (1) { try { n++; } finally { break; } } return n; }\nvar r = a();",
+		"var r = 0; for (var k in { x: 1, y: 2 }) { try { r++; } finally { break; } }",
+		"var r = 0; l: { try { r = 1; } finally { break l; } r = 2; }",
+		"function c() { var i = 0; while (i < 100000) { i++; try { throw 1; } finally { continue; } } return i; }\nvar r = c();",
+		"var r = 0; while (r < 100000) { r++; try { throw 1; } finally { continue; } }",
+		"function d() { var n = 0; for (var k in { x: 1, y: 2 }) { try { throw k; } catch (e) { n++; throw e; } finally { continue; } } return n; }\nvar r = d();",
+		"function e() { l: for (var k in { x: 1 }) { try { throw 1; } finally { break l; } } return 3; }\nvar r = e();",
+		"function f() { try { throw 1; } finally { return 7; } }\nvar r = f();",
+	};
+	static const int results[] = { 1, 1, 1, 100000, 100000, 2, 3, 7 };
+	char *bin;
+	int i, n;
+
+	for (i = 0; i < (int)(sizeof scripts / sizeof *scripts); i++) {
+		js_loadstring(J, "finally.js", scripts[i]);
+		n = js_dumpscript(J, -1, &bin, 0);
+		js_pushundefined(J);
+		js_call(J, 0);
+		js_pop(J, 1);
+		js_getglobal(J, "r");
+		mu_assert_int_eq(results[i], js_tointeger(J, -1));
+		js_pop(J, 1);
+
+		/* the verifier accepts the same code back */
+		js_pushundefined(J);
+		js_setglobal(J, "r");
+		mu_check(js_ploadbin(J, bin, n) == 0);
+		js_pushundefined(J);
+		js_call(J, 0);
+		js_pop(J, 1);
+		js_getglobal(J, "r");
+		mu_assert_int_eq(results[i], js_tointeger(J, -1));
+		js_pop(J, 1);
+		js_free(J, bin);
+	}
+}
+
 MU_TEST_SUITE(test_suite) {
 	MU_SUITE_CONFIGURE(&test_setup, &test_teardown);
 	MU_RUN_TEST(it_should_offset_bottom_of_stack);
@@ -359,6 +1577,38 @@ MU_TEST_SUITE(test_suite) {
 	MU_RUN_TEST(it_should_insert_new_entry_into_the_object);
 	MU_RUN_TEST(it_should_insert_new_entry_into_the_object_2);
 	MU_RUN_TEST(it_should_swap_stack_values);
+	MU_RUN_TEST(it_should_suspend_and_resume_script_from_native_function);
+	MU_RUN_TEST(it_should_not_yield_across_native_call_boundary);
+	MU_RUN_TEST(it_should_abort_infinite_loop_from_hook);
+	MU_RUN_TEST(it_should_suspend_coroutine_from_hook);
+	MU_RUN_TEST(it_should_sample_call_stacks);
+	MU_RUN_TEST(it_should_count_executed_opcodes_and_calls);
+	MU_RUN_TEST(it_should_report_heap_statistics);
+	MU_RUN_TEST(it_should_overflow_integer_arithmetic_to_doubles);
+	MU_RUN_TEST(it_should_compare_numbers_and_strings_without_coercion);
+	MU_RUN_TEST(it_should_keep_accessors_out_of_line);
+	MU_RUN_TEST(it_should_share_compiled_script_between_states);
+	MU_RUN_TEST(it_should_create_states_from_snapshot);
+	MU_RUN_TEST(it_should_create_builtin_methods_on_first_use);
+	MU_RUN_TEST(it_should_run_mapped_bytecode_image);
+	MU_RUN_TEST(it_should_reject_damaged_or_stale_bytecode);
+	MU_RUN_TEST(it_should_cache_compiled_scripts);
+	MU_RUN_TEST(it_should_lex_identifiers_and_strings_from_source);
+	MU_RUN_TEST(it_should_compile_functions_on_first_call);
+	MU_RUN_TEST(it_should_fold_constants_and_drop_dead_code);
+	MU_RUN_TEST(it_should_load_source_from_a_reader);
+	MU_RUN_TEST(it_should_compile_in_a_separate_context);
+	MU_RUN_TEST(it_should_find_keywords_and_reserved_words);
+	MU_RUN_TEST(it_should_parse_json_in_one_pass);
+	MU_RUN_TEST(it_should_stringify_to_the_host);
+	MU_RUN_TEST(it_should_stringify_deep_and_shared_values);
+	MU_RUN_TEST(it_should_clone_values_between_states);
+	MU_RUN_TEST(it_should_keep_counting_opcodes_when_profiling_starts);
+	MU_RUN_TEST(it_should_compare_objects_converted_to_small_integers);
+	MU_RUN_TEST(it_should_check_every_table_of_a_mapped_image);
+	MU_RUN_TEST(it_should_reject_bytecode_that_closes_unopened_scopes);
+	MU_RUN_TEST(it_should_leave_finally_blocks_with_break_and_continue);
+	MU_RUN_TEST(it_should_not_count_requested_samples_as_ticks);
 }
 
 int main(int argc, char **argv) {